@@ -20,3 +20,15 @@ function core.handle_async(func, callback, ...)
 	return true
 end
 
+
+local function find_path_job(snapshot, ...)
+	return snapshot:find_path(...)
+end
+
+function core.find_path_async(pos1, pos2, searchdistance, max_jump, max_drop, algorithm, callback)
+	assert(type(callback) == "function", "Invalid core.find_path_async invocation")
+	-- searches are run on the last periodic snapshot, this is cheap to get
+	local snapshot = core.get_map_snapshot(true)
+	return core.handle_async(find_path_job, callback, snapshot, pos1, pos2,
+		searchdistance, max_jump, max_drop, algorithm)
+end
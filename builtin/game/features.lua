@@ -47,6 +47,10 @@ core.features = {
 	particle_blend_clip = true,
 	remove_item_match_meta = true,
 	httpfetch_additional_methods = true,
+	voxelmanip_raw_data = true,
+	find_nodes_in_area_flat = true,
+	map_snapshots = true,
+	find_path_async = true,
 }
 
 function core.has_feature(arg)
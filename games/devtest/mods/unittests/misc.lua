@@ -341,3 +341,68 @@ local function test_ipc_poll(cb)
 	print("delta: " .. (core.get_us_time() - t0) .. "us")
 end
 unittests.register("test_ipc_poll", test_ipc_poll)
+
+local function test_voxelmanip_raw_data()
+	local stone = core.get_content_id("basenodes:stone")
+	local vm = VoxelManip()
+	local emin, emax = vm:initialize(vector.zero(), vector.zero(),
+		{name = "basenodes:stone", param1 = 3, param2 = 7})
+	local volume = VoxelArea(emin, emax):getVolume()
+
+	local s = vm:get_raw_data()
+	assert(#s == volume * 4)
+	assert(s:byte(1) + s:byte(2) * 256 == stone)
+	assert(s:byte(3) == 3 and s:byte(4) == 7)
+
+	-- Change the second node only
+	local air = core.CONTENT_AIR
+	s = s:sub(1, 4) .. string.char(air % 256, math.floor(air / 256), 15, 1) .. s:sub(9)
+	vm:set_raw_data(s)
+	local data, light, param2 = vm:get_data(), vm:get_light_data(), vm:get_param2_data()
+	assert(data[1] == stone and light[1] == 3 and param2[1] == 7)
+	assert(data[2] == air and light[2] == 15 and param2[2] == 1)
+	assert(data[3] == stone)
+	assert(vm:get_raw_data() == s)
+
+	assert(not pcall(vm.set_raw_data, vm, s:sub(5)))
+	vm:close()
+end
+unittests.register("test_voxelmanip_raw_data", test_voxelmanip_raw_data)
+
+local function test_find_nodes(_, pos)
+	local minp, maxp = pos:subtract(24), pos:add(24)
+	core.load_area(minp, maxp)
+	-- in different blocks
+	local p1, p2 = pos:offset(-20, 0, 0), pos:offset(3, 17, -5)
+	core.set_node(p1, {name = "basenodes:mossycobble"})
+	core.set_node(p2, {name = "basenodes:snowblock"})
+
+	local names = {"basenodes:mossycobble", "basenodes:snowblock"}
+	local list, counts = core.find_nodes_in_area(minp, maxp, names)
+	assert(#list == 2)
+	assert(counts["basenodes:mossycobble"] == 1 and counts["basenodes:snowblock"] == 1)
+
+	local grouped = core.find_nodes_in_area(minp, maxp, names, true)
+	assert(grouped["basenodes:mossycobble"][1] == p1)
+	assert(grouped["basenodes:snowblock"][1] == p2)
+
+	local area = VoxelArea(minp, maxp)
+	local flat = core.find_nodes_in_area(maxp, minp, names, false, true)
+	assert(#flat == 2)
+	for i, idx in ipairs(flat) do
+		assert(area:position(idx) == list[i])
+	end
+	grouped = core.find_nodes_in_area(minp, maxp, "basenodes:snowblock", true, true)
+	assert(area:position(grouped["basenodes:snowblock"][1]) == p2)
+
+	assert(core.find_node_near(pos, 24, names) == p2)
+	assert(core.find_node_near(pos, 16, "basenodes:mossycobble") == nil)
+	assert(core.find_node_near(pos, 20, "basenodes:mossycobble") == p1)
+	assert(core.find_node_near(pos, 24, "basenodes:ice") == nil)
+	assert(#core.find_nodes_in_area(minp, maxp, "basenodes:ice") == 0)
+
+	core.remove_node(p1)
+	core.remove_node(p2)
+	assert(core.find_node_near(pos, 24, names) == nil)
+end
+unittests.register("test_find_nodes", test_find_nodes, {map=true})
@@ -4,15 +4,269 @@
 
 #include "benchmark/benchmark.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <vector>
+#include <json/json.h>
+
 #define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include "catch.h"
+#include "log.h"
+
+/*
+	Allocation counting
+
+	The global allocation functions are replaced to count how often they
+	are called while a benchmark is measured. Sanitizers bring their own,
+	so nothing is counted there.
+*/
+
+#if defined(__SANITIZE_ADDRESS__)
+	#define COUNT_ALLOCATIONS 0
+#elif defined(__has_feature)
+	#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+		#define COUNT_ALLOCATIONS 0
+	#endif
+#endif
+#ifndef COUNT_ALLOCATIONS
+	#define COUNT_ALLOCATIONS 1
+#endif
+
+static std::atomic<bool> s_count_allocations{false};
+static std::atomic<u64> s_allocations{0};
+
+#if COUNT_ALLOCATIONS
+void *operator new(std::size_t size)
+{
+	if (s_count_allocations.load(std::memory_order_relaxed))
+		s_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (size == 0)
+		size = 1;
+	while (true) {
+		if (void *p = std::malloc(size))
+			return p;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	try {
+		return operator new(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+#endif
+
+/*
+	Result collection
+*/
+
+namespace {
+
+struct BenchmarkResult
+{
+	std::string test_case;
+	std::string name;
+	// Per iteration, in nanoseconds
+	double median, p95, mean;
+	u32 samples;
+	u32 iterations;
+	// Per iteration, negative if unknown
+	double allocations;
+	u64 bytes;
+};
+
+std::vector<BenchmarkResult> s_results;
+// Set by set_benchmark_bytes() for the next benchmark
+u64 s_next_bytes = 0;
+
+class BenchmarkRecorder : public Catch::EventListenerBase
+{
+public:
+	using Catch::EventListenerBase::EventListenerBase;
+
+	void testCaseStarting(const Catch::TestCaseInfo &info) override
+	{
+		m_test_case = info.name;
+	}
 
-bool run_benchmarks(const char *arg)
+	void benchmarkStarting(const Catch::BenchmarkInfo &info) override
+	{
+		m_bytes = s_next_bytes;
+		s_next_bytes = 0;
+		s_allocations = 0;
+		s_count_allocations = true;
+	}
+
+	void benchmarkEnded(const Catch::BenchmarkStats<> &stats) override
+	{
+		s_count_allocations = false;
+
+		BenchmarkResult r;
+		r.test_case = m_test_case;
+		r.name = stats.info.name;
+		r.samples = stats.samples.size();
+		r.iterations = stats.info.iterations;
+
+		std::vector<double> ns;
+		ns.reserve(stats.samples.size());
+		for (const auto &sample : stats.samples)
+			ns.push_back(std::chrono::duration<double, std::nano>(sample).count());
+		std::sort(ns.begin(), ns.end());
+		if (ns.empty())
+			ns.push_back(0);
+		r.median = ns[ns.size() / 2];
+		r.p95 = ns[std::min<size_t>(ns.size() - 1, ns.size() * 95 / 100)];
+		r.mean = std::chrono::duration<double, std::nano>(stats.mean.point).count();
+
+		const u64 total_iterations = (u64)r.samples * r.iterations;
+		if (COUNT_ALLOCATIONS && total_iterations > 0)
+			r.allocations = (double)s_allocations / total_iterations;
+		else
+			r.allocations = -1;
+		r.bytes = m_bytes;
+
+		s_results.push_back(std::move(r));
+	}
+
+	void benchmarkFailed(Catch::StringRef error) override
+	{
+		s_count_allocations = false;
+	}
+
+private:
+	std::string m_test_case;
+	u64 m_bytes = 0;
+};
+
+CATCH_REGISTER_LISTENER(BenchmarkRecorder)
+
+Json::Value results_to_json()
+{
+	Json::Value root(Json::objectValue);
+	Json::Value &list = root["benchmarks"];
+	list = Json::Value(Json::objectValue);
+	for (const BenchmarkResult &r : s_results) {
+		Json::Value &v = list[r.name];
+		v["test_case"] = r.test_case;
+		v["median_ns"] = r.median;
+		v["p95_ns"] = r.p95;
+		v["mean_ns"] = r.mean;
+		v["samples"] = r.samples;
+		v["iterations"] = r.iterations;
+		if (r.allocations >= 0)
+			v["allocations"] = r.allocations;
+		if (r.bytes > 0 && r.median > 0)
+			v["bytes_per_second"] = r.bytes * 1.0e9 / r.median;
+	}
+	return root;
+}
+
+// Returns false if a benchmark got slower by more than the threshold
+bool compare_to_baseline(const Json::Value &baseline, f32 threshold)
+{
+	const Json::Value &old_list = baseline["benchmarks"];
+	if (!old_list.isObject()) {
+		errorstream << "Benchmark baseline has no results" << std::endl;
+		return false;
+	}
+
+	bool ok = true;
+	rawstream << "Comparison to baseline (threshold " << threshold << "%):"
+		<< std::endl;
+	for (const BenchmarkResult &r : s_results) {
+		const Json::Value &old = old_list[r.name];
+		if (!old.isObject() || !old["median_ns"].isNumeric()) {
+			rawstream << "  " << r.name << ": new" << std::endl;
+			continue;
+		}
+		double old_median = old["median_ns"].asDouble();
+		double change = old_median > 0 ?
+			(r.median - old_median) / old_median * 100 : 0;
+		bool regressed = change > threshold;
+		rawstream << "  " << r.name << ": " << old_median << " ns -> "
+			<< r.median << " ns (" << (change >= 0 ? "+" : "") << change
+			<< "%)" << (regressed ? " REGRESSION" : "") << std::endl;
+		ok &= !regressed;
+	}
+	return ok;
+}
+
+}
+
+void set_benchmark_bytes(u64 bytes_per_iteration)
 {
-	const char *const argv[] = {
-		"MinetestBenchmark", arg, nullptr
-	};
-	const int argc = arg ? 2 : 1;
-	int errCount = Catch::Session().run(argc, argv);
-	return errCount == 0;
+	s_next_bytes = bytes_per_iteration;
+}
+
+bool run_benchmarks(const BenchmarkOptions &options)
+{
+	std::vector<const char *> argv = { "MinetestBenchmark" };
+	if (!options.filter.empty())
+		argv.push_back(options.filter.c_str());
+	const bool machine_readable = !options.json_output.empty() ||
+		!options.baseline.empty();
+	// The median and p95 are calculated from the samples, Catch's
+	// bootstrapping would only take time and distort the allocation count.
+	if (machine_readable)
+		argv.push_back("--benchmark-no-analysis");
+	argv.push_back(nullptr);
+
+	Json::Value baseline;
+	if (!options.baseline.empty()) {
+		std::ifstream ifs(options.baseline, std::ios::binary);
+		Json::CharReaderBuilder builder;
+		std::string errs;
+		if (!ifs.good() || !Json::parseFromStream(builder, ifs, &baseline, &errs)) {
+			errorstream << "Failed to read benchmark baseline \""
+				<< options.baseline << "\": " << errs << std::endl;
+			return false;
+		}
+	}
+
+	s_results.clear();
+	int errCount = Catch::Session().run((int)argv.size() - 1, argv.data());
+	bool ok = errCount == 0;
+
+	if (!options.json_output.empty()) {
+		std::ofstream ofs(options.json_output, std::ios::binary);
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "\t";
+		ofs << Json::writeString(builder, results_to_json()) << std::endl;
+		if (!ofs.good()) {
+			errorstream << "Failed to write benchmark results to \""
+				<< options.json_output << "\"" << std::endl;
+			ok = false;
+		}
+	}
+
+	if (!options.baseline.empty())
+		ok &= compare_to_baseline(baseline, options.threshold);
+
+	return ok;
 }
@@ -4,8 +4,27 @@
 
 #pragma once
 
+#include <string>
 #include "config.h"
+#include "irrlichttypes.h"
 
 #if BUILD_BENCHMARKS
-extern bool run_benchmarks(const char *arg = nullptr);
+struct BenchmarkOptions
+{
+	// Only run the matching test cases (Catch test spec), empty = all
+	std::string filter;
+	// Write the results as JSON to this file
+	std::string json_output;
+	// Compare the results to a file written by an earlier run
+	std::string baseline;
+	// Allowed slowdown of the median compared to the baseline, in percent
+	f32 threshold = 10.0f;
+};
+
+// Returns false if a benchmark failed or regressed
+extern bool run_benchmarks(const BenchmarkOptions &options);
+
+// Sets how many bytes one iteration of the next BENCHMARK processes,
+// so that the throughput can be reported.
+extern void set_benchmark_bytes(u64 bytes_per_iteration);
 #endif
@@ -0,0 +1,109 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "catch.h"
+#include "benchmark/benchmark_serverenv.h"
+#include "nodedef.h"
+#include "server/blockmodifier.h"
+
+namespace {
+
+class CountingABM : public ActiveBlockModifier
+{
+public:
+	CountingABM(const std::string &trigger, const std::string &neighbor, u32 chance) :
+		m_trigger_contents{trigger}, m_chance(chance)
+	{
+		if (!neighbor.empty())
+			m_required_neighbors.push_back(neighbor);
+	}
+
+	const std::vector<std::string> &getTriggerContents() const override
+		{ return m_trigger_contents; }
+	const std::vector<std::string> &getRequiredNeighbors() const override
+		{ return m_required_neighbors; }
+	const std::vector<std::string> &getWithoutNeighbors() const override
+		{ return m_without_neighbors; }
+	float getTriggerInterval() override { return 1.0f; }
+	u32 getTriggerChance() override { return m_chance; }
+	bool getSimpleCatchUp() override { return false; }
+	s16 getMinY() override { return -MAX_MAP_GENERATION_LIMIT; }
+	s16 getMaxY() override { return MAX_MAP_GENERATION_LIMIT; }
+
+	void trigger(ServerEnvironment *env, v3s16 p, MapNode n) override
+	{
+		triggered++;
+	}
+
+	u32 triggered = 0;
+
+private:
+	std::vector<std::string> m_trigger_contents;
+	std::vector<std::string> m_required_neighbors;
+	std::vector<std::string> m_without_neighbors;
+	u32 m_chance;
+};
+
+}
+
+TEST_CASE("benchmark_abm")
+{
+	BenchmarkServerEnv benv;
+	NodeDefManager *ndef = benv.server.getWritableNodeDefManager();
+	content_t c_stone, c_grass;
+	{
+		ContentFeatures f;
+		f.name = "bench:stone";
+		c_stone = ndef->set(f.name, f);
+		f.name = "bench:grass";
+		c_grass = ndef->set(f.name, f);
+	}
+
+	// 8x8 columns of stone with a grass surface and air above
+	constexpr s16 size = 8;
+	benv.fill(v3s16(0, -2, 0), v3s16(size - 1, -1, size - 1), MapNode(c_stone));
+	benv.fill(v3s16(0, 0, 0), v3s16(size - 1, 1, size - 1), MapNode(CONTENT_AIR));
+	ServerMap &map = benv.env->getServerMap();
+	std::vector<MapBlock *> blocks;
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = -2; y <= 1; y++)
+	for (s16 x = 0; x < size; x++) {
+		MapBlock *block = map.getBlockNoCreateNoEx(v3s16(x, y, z));
+		if (y == -1) {
+			for (s16 nz = 0; nz < MAP_BLOCKSIZE; nz++)
+			for (s16 nx = 0; nx < MAP_BLOCKSIZE; nx++)
+				block->setNodeNoCheck(nx, MAP_BLOCKSIZE - 1, nz, MapNode(c_grass));
+		}
+		blocks.push_back(block);
+	}
+
+	// Grass spreading and a rare ABM on the stone, like in a typical game
+	CountingABM grass_abm("bench:grass", "air", 1);
+	CountingABM stone_abm("bench:stone", "", 50);
+	std::vector<ABMWithState> abms;
+	abms.emplace_back(&grass_abm);
+	abms.emplace_back(&stone_abm);
+
+	BENCHMARK("ABMHandler::apply_8x4x8") {
+		ABMHandler handler(abms, 1.0f, benv.env.get(), false);
+		int scanned = 0, run = 0, skipped = 0;
+		for (MapBlock *block : blocks)
+			handler.apply(block, scanned, run, skipped);
+		return run;
+	};
+
+	// Only the air blocks, which can be skipped without scanning
+	std::vector<MapBlock *> air_blocks;
+	for (MapBlock *block : blocks) {
+		if (block->getPos().Y >= 0)
+			air_blocks.push_back(block);
+	}
+	BENCHMARK("ABMHandler::apply_air_8x2x8") {
+		ABMHandler handler(abms, 1.0f, benv.env.get(), false);
+		int scanned = 0, run = 0, skipped = 0;
+		for (MapBlock *block : air_blocks)
+			handler.apply(block, scanned, run, skipped);
+		return skipped;
+	};
+}
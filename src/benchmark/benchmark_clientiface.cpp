@@ -0,0 +1,83 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "catch.h"
+#include "benchmark/benchmark_serverenv.h"
+#include "nodedef.h"
+#include "remoteplayer.h"
+#include "server/clientiface.h"
+#include "server/player_sao.h"
+
+// Selects blocks for a client until everything in range has been sent
+static u32 send_all_blocks(RemoteClient &client, ServerEnvironment *env,
+	EmergeManager *emerge)
+{
+	std::vector<PrioritySortedBlockTransfer> dest;
+	u32 sent = 0;
+	// The client pauses for 2s after a completed map send, so the
+	// remaining calls return right away.
+	for (int i = 0; i < 200; i++) {
+		dest.clear();
+		client.GetNextBlocks(env, emerge, 0.001f, dest);
+		for (const auto &transfer : dest) {
+			client.SentBlock(transfer.pos);
+			client.GotBlock(transfer.pos);
+		}
+		sent += dest.size();
+	}
+	return sent;
+}
+
+TEST_CASE("benchmark_clientiface")
+{
+	BenchmarkServerEnv benv;
+	NodeDefManager *ndef = benv.server.getWritableNodeDefManager();
+	content_t c_stone;
+	{
+		ContentFeatures f;
+		f.name = "bench:stone";
+		c_stone = ndef->set(f.name, f);
+	}
+
+	// Every block in range exists, so nothing ends up in the emerge queue
+	constexpr s16 radius = 10;
+	benv.fill(v3s16(-radius, -radius, -radius), v3s16(radius, -1, radius),
+		MapNode(c_stone));
+	benv.fill(v3s16(-radius, 0, -radius), v3s16(radius, radius, radius),
+		MapNode(CONTENT_AIR));
+
+	const session_t peer_id = 2;
+	auto *player = new RemotePlayer("bench", benv.server.getItemDefManager());
+	player->setPeerId(peer_id);
+	benv.env->addPlayer(player);
+	PlayerSAO sao(benv.env.get(), player, peer_id, false);
+	player->setPlayerSAO(&sao);
+	sao.setBasePosition(v3f(8, 2, 8) * BS);
+	sao.setLookPitch(10);
+	sao.setFov(72 * core::DEGTORAD);
+	sao.setWantedRange(radius - 1);
+
+	BENCHMARK("RemoteClient::GetNextBlocks_full_send") {
+		RemoteClient client;
+		client.peer_id = peer_id;
+		return send_all_blocks(client, benv.env.get(), benv.emerge.get());
+	};
+
+	// What the server does most of the time: looking for new blocks to send
+	// to a client that has everything already.
+	RemoteClient idle_client;
+	idle_client.peer_id = peer_id;
+	send_all_blocks(idle_client, benv.env.get(), benv.emerge.get());
+	BENCHMARK("RemoteClient::GetNextBlocks_idle_pass") {
+		std::vector<PrioritySortedBlockTransfer> dest;
+		// Ends the pause after the previous pass, then makes one pass
+		// over the view range. It pauses again once it is done.
+		idle_client.GetNextBlocks(benv.env.get(), benv.emerge.get(), 2.5f, dest);
+		for (int i = 0; i < 15; i++)
+			idle_client.GetNextBlocks(benv.env.get(), benv.emerge.get(), 0.01f, dest);
+		return dest.size();
+	};
+
+	player->setPlayerSAO(nullptr);
+}
@@ -0,0 +1,112 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "benchmark/benchmark_mapgen.h"
+#include "benchmark/benchmark_serverenv.h"
+#include "catch.h"
+#include "mapgen/mapgen.h"
+#include "nodedef.h"
+#include "settings.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Mapchunks generated per iteration, divide by the time for chunks per second
+static constexpr int CHUNKS = 8;
+static constexpr int MAX_THREADS = 4;
+
+/*
+	Generates chunks like the emerge threads do, with a mutex in place of the
+	environment lock. Unlike the emerge threads, there are no Lua callbacks.
+*/
+static void generate_chunks(ServerMap &map, EmergeManager &emerge,
+	const std::vector<v3s16> &chunks, int threads, bool prepare)
+{
+	std::mutex env_lock;
+	std::atomic<size_t> next{0};
+
+	auto run = [&] (int id) {
+		Mapgen *mg = emerge.getMapgen(id);
+		size_t i;
+		while ((i = next++) < chunks.size()) {
+			BlockMakeData data;
+			BlockMakePrep prep;
+			if (prepare)
+				map.prepareBlockMake(chunks[i], &prep);
+			{
+				std::lock_guard<std::mutex> lock(env_lock);
+				if (!map.initBlockMake(chunks[i], &data, prepare ? &prep : nullptr))
+					continue;
+			}
+
+			mg->makeChunk(&data);
+
+			if (prepare)
+				data.vmanip->prepareBlitBack();
+			std::map<v3s16, MapBlock *> modified_blocks;
+			std::lock_guard<std::mutex> lock(env_lock);
+			map.finishBlockMake(&data, &modified_blocks, 0);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int id = 1; id < threads; id++)
+		workers.emplace_back(run, id);
+	run(0);
+	for (auto &t : workers)
+		t.join();
+}
+
+TEST_CASE("benchmark_emerge")
+{
+	// One mapgen per thread
+	std::string old_threads;
+	const bool had_threads = g_settings->getNoEx("num_emerge_threads", old_threads);
+	g_settings->setS16("num_emerge_threads", MAX_THREADS);
+	BenchmarkServerEnv env;
+	if (had_threads)
+		g_settings->set("num_emerge_threads", old_threads);
+	else
+		g_settings->remove("num_emerge_threads");
+
+	NodeDefManager *ndef = env.server.getWritableNodeDefManager();
+	register_mapgen_nodes(ndef);
+	ndef->setNodeRegistrationStatus(true);
+	ndef->runNodeResolveCallbacks();
+
+	// The singlenode mapgen does almost nothing, what is measured is the work
+	// around it that every mapgen needs
+	ServerMap &map = env.env->getServerMap();
+	map.settings_mgr.setMapSetting("seed", "1234");
+	map.settings_mgr.setMapSetting("mg_name", "singlenode");
+	MapgenParams *params = map.settings_mgr.makeMapgenParams();
+	env.emerge->initMapgens(params);
+
+	// Chunks with a free chunk between them, so none has to wait for another
+	const s16 csize = params->chunksize;
+	std::vector<v3s16> chunks;
+	for (int i = 0; i < CHUNKS; i++) {
+		chunks.push_back(EmergeManager::getContainingChunk(
+			v3s16(i % 4, 0, i / 4) * 2 * csize, csize));
+	}
+	std::vector<v2s16> sectors;
+	for (v3s16 chunk : chunks) {
+		for (s16 z = chunk.Z - 1; z <= chunk.Z + csize; z++)
+		for (s16 x = chunk.X - 1; x <= chunk.X + csize; x++)
+			sectors.emplace_back(x, z);
+	}
+
+	for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+	for (bool prepare : {false, true}) {
+		BENCHMARK_ADVANCED("generate_" + std::to_string(CHUNKS) + "_chunks_" +
+				std::to_string(threads) + (threads == 1 ? "_thread" : "_threads") +
+				(prepare ? "" : "_locked"))(Catch::Benchmark::Chronometer meter) {
+			// Every run generates the same chunks again, after freeing them
+			meter.measure([&] {
+				generate_chunks(map, *env.emerge, chunks, threads, prepare);
+				map.deleteSectors(sectors);
+			});
+		};
+	}
+}
@@ -69,3 +69,61 @@ TEST_CASE("benchmark_lighting")
 		});
 	};
 }
+
+// Large writes, like those of world editing mods
+TEST_CASE("benchmark_lighting_large")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	// 128x64x128 nodes
+	v3s16 bpmin(-4, -2, -4);
+	v3s16 bpmax(3, 1, 3);
+	DummyMap map(&gamedef, bpmin, bpmax);
+
+	content_t content_wall;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		content_wall = ndef->set(f.name, f);
+	}
+
+	content_t content_light;
+	{
+		ContentFeatures f;
+		f.name = "light";
+		f.param_type = CPT_LIGHT;
+		f.light_propagates = true;
+		f.light_source = 14;
+		content_light = ndef->set(f.name, f);
+	}
+
+	// Hilly terrain with lights in the air and underground
+	MMVManip vm(&map);
+	vm.initialEmerge(bpmin, bpmax, false);
+	const VoxelArea &area = vm.m_area;
+	for (s32 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s32 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+	for (s32 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+		content_t c = CONTENT_AIR;
+		if (y < (x * x + z * z) / 512 - 16 && (x + y + z) % 23 != 0)
+			c = content_wall;
+		else if (x % 9 == 0 && y % 9 == 0 && z % 9 == 0)
+			c = content_light;
+		vm.m_data[area.index(x, y, z)] = MapNode(c);
+	}
+
+	for (unsigned int threads : {1U, 0U}) {
+		voxalgo::set_bulk_light_threads(threads);
+		const std::string suffix = threads == 1 ? " (1 thread)" : " (auto threads)";
+
+		BENCHMARK_ADVANCED("voxalgo::blit_back_with_light 128x64x128" + suffix)(
+				Catch::Benchmark::Chronometer meter) {
+			std::map<v3s16, MapBlock*> modified_blocks;
+			meter.measure([&] {
+				voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
+			});
+		};
+	}
+	voxalgo::set_bulk_light_threads(0);
+}
@@ -0,0 +1,96 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "benchmark/benchmark_mapgen.h"
+#include "catch.h"
+#include "dummymap.h"
+#include "emerge.h"
+#include "map_settings_manager.h"
+#include "mapgen/mapgen.h"
+#include "nodedef.h"
+#include "util/metricsbackend.h"
+#include "unittest/mock_server.h"
+
+// Nodes that the mapgens look up, see Mapgen::createMapgen()
+static const char *mapgen_nodes[] = {
+	"mapgen_stone", "mapgen_cobble", "mapgen_mossycobble",
+	"mapgen_stair_cobble", "mapgen_desert_stone", "mapgen_stair_desert_stone",
+	"mapgen_dirt", "mapgen_dirt_with_grass", "mapgen_dirt_with_snow",
+	"mapgen_sand", "mapgen_desert_sand", "mapgen_gravel", "mapgen_snow",
+	"mapgen_snowblock", "mapgen_ice", "mapgen_tree", "mapgen_leaves",
+	"mapgen_apple", "mapgen_jungletree", "mapgen_jungleleaves",
+	"mapgen_junglegrass", "mapgen_pine_tree", "mapgen_pine_needles",
+	"mapgen_singlenode",
+};
+static const char *mapgen_liquids[] = {
+	"mapgen_water_source", "mapgen_river_water_source", "mapgen_lava_source",
+};
+
+void register_mapgen_nodes(NodeDefManager *ndef)
+{
+	for (const char *name : mapgen_nodes) {
+		ContentFeatures f;
+		f.name = name;
+		ndef->set(f.name, f);
+	}
+	for (const char *name : mapgen_liquids) {
+		ContentFeatures f;
+		f.name = name;
+		f.drawtype = NDT_LIQUID;
+		f.liquid_type = LIQUID_SOURCE;
+		f.walkable = false;
+		f.light_propagates = true;
+		f.liquid_alternative_source = name;
+		ndef->set(f.name, f);
+	}
+}
+
+TEST_CASE("benchmark_mapgen")
+{
+	MockServer server;
+	NodeDefManager *ndef = server.getWritableNodeDefManager();
+	register_mapgen_nodes(ndef);
+	// Like after loading the mods, so the mapgens resolve their nodes right away
+	ndef->setNodeRegistrationStatus(true);
+	ndef->runNodeResolveCallbacks();
+
+	for (int i = 0; i < (int)MAPGEN_INVALID; i++) {
+		const auto mgtype = (MapgenType)i;
+		const std::string name = Mapgen::getMapgenName(mgtype);
+
+		// Falls back to the global settings, which hold the mapgen defaults
+		MapSettingsManager msm("");
+		msm.setMapSetting("seed", "1234");
+		msm.setMapSetting("mg_name", name);
+		MapgenParams *params = msm.makeMapgenParams();
+
+		MetricsBackend mb;
+		EmergeManager emerge(&server, &mb);
+		emerge.initMapgens(params);
+		Mapgen *mg = emerge.getMapgen(0);
+
+		// The mapchunk around the origin, where all mapgens have terrain
+		const v3s16 bpmin = EmergeManager::getContainingChunk(v3s16(0, 0, 0),
+			params->chunksize);
+		const v3s16 bpmax = bpmin + v3s16(1, 1, 1) * (params->chunksize - 1);
+		DummyMap map(&server, bpmin - v3s16(1, 1, 1), bpmax + v3s16(1, 1, 1));
+
+		BENCHMARK_ADVANCED("makeChunk_" + name)(Catch::Benchmark::Chronometer meter) {
+			// Every run needs fresh, ungenerated data
+			std::vector<BlockMakeData> data(meter.runs());
+			for (BlockMakeData &d : data) {
+				d.seed = params->seed;
+				d.blockpos_min = bpmin;
+				d.blockpos_max = bpmax;
+				d.nodedef = server.getNodeDefManager();
+				d.vmanip = new MMVManip(&map);
+				d.vmanip->initialEmerge(bpmin - v3s16(1, 1, 1),
+					bpmax + v3s16(1, 1, 1));
+			}
+			meter.measure([&] (int run) {
+				mg->makeChunk(&data[run]);
+			});
+		};
+	}
+}
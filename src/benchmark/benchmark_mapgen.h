@@ -0,0 +1,10 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+class NodeDefManager;
+
+// Registers the nodes that the mapgens look up, like the mapgen aliases of a game
+void register_mapgen_nodes(NodeDefManager *ndef);
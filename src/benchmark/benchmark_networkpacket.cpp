@@ -0,0 +1,131 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "catch.h"
+#include "benchmark/benchmark.h"
+#include "network/networkpacket.h"
+#include "network/networkprotocol.h"
+#include "network/mtp/internal.h"
+
+// Like TOCLIENT_ACTIVE_OBJECT_MESSAGES: many small fields
+static void put_object_messages(NetworkPacket &pkt, const std::string &msg)
+{
+	for (u16 id = 1; id <= 100; id++) {
+		pkt << id;
+		pkt.putLongString(msg);
+	}
+}
+
+static u32 read_object_messages(NetworkPacket &pkt)
+{
+	u32 total = 0;
+	while (pkt.getRemainingBytes() > 0) {
+		u16 id;
+		pkt >> id;
+		total += id + pkt.readLongString().size();
+	}
+	return total;
+}
+
+// Like TOCLIENT_BLOCKDATA: one large field
+static void put_block_data(NetworkPacket &pkt, const std::string &data)
+{
+	pkt << v3s16(1, 2, 3);
+	pkt.putRawString(data);
+}
+
+// What the connection does to a packet before it goes to the socket:
+// splitting it and adding the reliable and base headers
+static size_t send_reliable(const PacketBuffer &data)
+{
+	const Address address(127, 0, 0, 1, 30000);
+	const u32 max_packet_size = 512;
+
+	std::list<PacketBuffer> originals;
+	u16 split_seqnum = 0;
+	con::makeAutoSplitPacket(data, max_packet_size - BASE_HEADER_SIZE -
+		RELIABLE_HEADER_SIZE, split_seqnum, &originals);
+
+	size_t total = 0;
+	u16 seqnum = 0;
+	for (const PacketBuffer &original : originals) {
+		con::BufferedPacketPtr p = con::makePacket(address,
+			con::makeReliablePacket(original, seqnum++), PROTOCOL_ID,
+			PEER_ID_SERVER, 2);
+		total += p->size();
+	}
+	return total;
+}
+
+TEST_CASE("benchmark_networkpacket")
+{
+	const std::string msg(40, 'x');
+	const std::string block_data(16 * 1024, 'y');
+
+	Buffer<u8> object_raw;
+	{
+		NetworkPacket pkt(TOCLIENT_ACTIVE_OBJECT_MESSAGES, 0);
+		put_object_messages(pkt, msg);
+		object_raw = pkt.oldForgePacket();
+	}
+	Buffer<u8> block_raw;
+	{
+		NetworkPacket pkt(TOCLIENT_BLOCKDATA, 0);
+		put_block_data(pkt, block_data);
+		block_raw = pkt.oldForgePacket();
+	}
+
+	set_benchmark_bytes(object_raw.getSize());
+	BENCHMARK("encode_object_messages") {
+		NetworkPacket pkt(TOCLIENT_ACTIVE_OBJECT_MESSAGES, 0);
+		put_object_messages(pkt, msg);
+		return pkt.oldForgePacket();
+	};
+
+	set_benchmark_bytes(object_raw.getSize());
+	BENCHMARK("decode_object_messages") {
+		NetworkPacket pkt;
+		pkt.putRawPacket(*object_raw, object_raw.getSize(), 1);
+		return read_object_messages(pkt);
+	};
+
+	set_benchmark_bytes(block_raw.getSize());
+	BENCHMARK("encode_blockdata") {
+		NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 6 + block_data.size());
+		put_block_data(pkt, block_data);
+		return pkt.oldForgePacket();
+	};
+
+	// The allocations per iteration are the allocations per sent block
+	set_benchmark_bytes(block_raw.getSize());
+	BENCHMARK("send_blockdata") {
+		PacketBuffer data;
+		{
+			NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 6 + block_data.size());
+			put_block_data(pkt, block_data);
+			data = pkt.forgePacket();
+		}
+		return send_reliable(data);
+	};
+
+	set_benchmark_bytes(object_raw.getSize());
+	BENCHMARK("send_object_messages") {
+		PacketBuffer data;
+		{
+			NetworkPacket pkt(TOCLIENT_ACTIVE_OBJECT_MESSAGES, 0);
+			put_object_messages(pkt, msg);
+			data = pkt.forgePacket();
+		}
+		return send_reliable(data);
+	};
+
+	set_benchmark_bytes(block_raw.getSize());
+	BENCHMARK("decode_blockdata") {
+		NetworkPacket pkt;
+		pkt.putRawPacket(*block_raw, block_raw.getSize(), 1);
+		v3s16 p;
+		pkt >> p;
+		return pkt.readRawString(pkt.getRemainingBytes());
+	};
+}
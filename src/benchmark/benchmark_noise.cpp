@@ -0,0 +1,52 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "catch.h"
+#include "noise.h"
+
+// Typical parameters of the v7 and valleys mapgens, for one mapchunk
+static const NoiseParams np_terrain(4, 70, v3f(600, 600, 600), 82341, 5, 0.6, 2.0);
+static const NoiseParams np_cave(0, 12, v3f(96, 96, 96), 52534, 4, 0.5, 2.0);
+static const NoiseParams np_eased(0, 1, v3f(384, 128, 384), 5333, 5, 0.63, 2.0,
+	NOISE_FLAG_EASED);
+
+static const char *level_name(NoiseSimdLevel level)
+{
+	switch (level) {
+	case NOISE_SIMD_SSE2:
+		return "sse2";
+	case NOISE_SIMD_AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+TEST_CASE("benchmark_noise")
+{
+	const NoiseSimdLevel prev = getNoiseSimdLevel();
+
+	for (int i = NOISE_SIMD_NONE; i <= getSupportedNoiseSimdLevel(); i++) {
+		const auto level = (NoiseSimdLevel)i;
+		const std::string name = level_name(level);
+		setNoiseSimdLevel(level);
+
+		Noise terrain(&np_terrain, 1, 80, 80);
+		BENCHMARK("noiseMap2D_80x80_" + name, i) {
+			return terrain.noiseMap2D(i * 80, 0)[0];
+		};
+
+		Noise cave(&np_cave, 1, 80, 82, 80);
+		BENCHMARK("noiseMap3D_80x82x80_" + name, i) {
+			return cave.noiseMap3D(i * 80, 0, 0)[0];
+		};
+
+		Noise eased(&np_eased, 1, 80, 82, 80);
+		BENCHMARK("noiseMap3D_eased_80x82x80_" + name, i) {
+			return eased.noiseMap3D(i * 80, 0, 0)[0];
+		};
+	}
+
+	setNoiseSimdLevel(prev);
+}
@@ -0,0 +1,58 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "catch.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "mapsnapshot.h"
+#include "nodedef.h"
+#include "pathfinder.h"
+
+TEST_CASE("benchmark_pathfinder")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t content_stone;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		content_stone = ndef->set(f.name, f);
+	}
+
+	v3s16 bpmin(-2, -1, -2), bpmax(1, 0, 1);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+
+	// Bumpy floor with some walls
+	for (s16 z = -32; z < 32; z++)
+	for (s16 x = -32; x < 32; x++) {
+		s16 height = ((x * 7 + z * 13) & 7) == 0 ? 1 : 0;
+		for (s16 y = -4; y <= height; y++)
+			map.setNode({x, y, z}, MapNode(content_stone));
+		if (x % 12 == 0 && (z & 15) < 12) {
+			for (s16 y = 1; y <= 4; y++)
+				map.setNode({x, y, z}, MapNode(content_stone));
+		}
+	}
+
+	MapSnapshotBuilder builder(nullptr);
+	for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+	for (s16 y = bpmin.Y; y <= bpmax.Y; y++)
+	for (s16 x = bpmin.X; x <= bpmax.X; x++) {
+		MapBlock *block = map.getBlockNoCreateNoEx({x, y, z});
+		builder.setBlock(block->getPos(), block->getData());
+	}
+	auto snapshot = builder.finish();
+
+	const v3s16 from(-26, 2, -20), to(26, 2, 22);
+
+	BENCHMARK("get_path_map") {
+		return get_path(&map, ndef, from, to, 8, 1, 2, PA_PLAIN_NP).size();
+	};
+
+	BENCHMARK("get_path_snapshot") {
+		return get_path(snapshot.get(), ndef, from, to, 8, 1, 2, PA_PLAIN_NP).size();
+	};
+}
@@ -0,0 +1,75 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include <fstream>
+#include "emerge.h"
+#include "filesys.h"
+#include "serverenvironment.h"
+#include "servermap.h"
+#include "util/metricsbackend.h"
+#include "unittest/mock_server.h"
+
+/*
+ * A server environment with an empty map that is kept in memory only.
+ * The map is filled by the benchmarks themselves, nothing is generated.
+ */
+class BenchmarkServerEnv
+{
+public:
+	BenchmarkServerEnv() :
+		m_world(fs::CreateTempDir()),
+		server(m_world)
+	{
+		std::ofstream ofs(m_world + DIR_DELIM "world.mt", std::ios::binary);
+		ofs << "backend = dummy\n";
+		ofs.close();
+		ofs.open(m_world + DIR_DELIM "map_meta.txt", std::ios::binary);
+		ofs << "[end_of_params]\n";
+		ofs.close();
+
+		emerge = std::make_unique<EmergeManager>(&server, &mb);
+		auto map = std::make_unique<ServerMap>(m_world, &server, emerge.get(), &mb);
+		env = std::make_unique<ServerEnvironment>(std::move(map), &server, &mb);
+	}
+
+	~BenchmarkServerEnv()
+	{
+		env->deactivateBlocksAndObjects();
+		env.reset();
+		emerge.reset();
+		fs::RecursiveDelete(m_world);
+	}
+
+	DISABLE_CLASS_COPY(BenchmarkServerEnv)
+
+	// Fills the blocks in the given area with a node, creating them if needed
+	void fill(v3s16 bpmin, v3s16 bpmax, MapNode n)
+	{
+		ServerMap &map = env->getServerMap();
+		v3s16 p;
+		for (p.Z = bpmin.Z; p.Z <= bpmax.Z; p.Z++)
+		for (p.Y = bpmin.Y; p.Y <= bpmax.Y; p.Y++)
+		for (p.X = bpmin.X; p.X <= bpmax.X; p.X++) {
+			MapBlock *block = map.emergeBlock(p, true);
+			MapNode *data = block->getData();
+			for (size_t i = 0; i < MapBlock::nodecount; i++)
+				data[i] = n;
+			block->raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
+			block->expireIsAirCache();
+			block->expireContentCache();
+			block->setGenerated(true);
+		}
+	}
+
+private:
+	std::string m_world;
+
+public:
+	MockServer server;
+	MetricsBackend mb;
+	std::unique_ptr<EmergeManager> emerge;
+	std::unique_ptr<ServerEnvironment> env;
+};
@@ -0,0 +1,60 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "catch.h"
+#include "benchmark/benchmark.h"
+#include "network/socket.h"
+#include <vector>
+
+// Packets per iteration, so the time per packet is the result divided by this
+#define PACKET_COUNT 64
+#define PACKET_SIZE 512
+
+static const Address loopback(127, 0, 0, 1, 30005);
+
+// Receives the packets that were sent, one by one
+static int receive_single(UDPSocket &socket, std::vector<u8> &buffer)
+{
+	int received = 0;
+	Address sender;
+	while (received < PACKET_COUNT &&
+			socket.Receive(sender, buffer.data(), PACKET_SIZE) >= 0)
+		received++;
+	return received;
+}
+
+TEST_CASE("benchmark_socket")
+{
+	UDPSocket socket(false);
+	socket.Bind(Address(0, 0, 0, 0, loopback.getPort()));
+	socket.setTimeoutMs(100);
+
+	std::vector<u8> buffer(PACKET_COUNT * PACKET_SIZE, 0x42);
+	std::vector<UDPSocket::OutgoingPacket> outgoing(PACKET_COUNT);
+	std::vector<UDPSocket::IncomingPacket> incoming(PACKET_COUNT);
+	for (int i = 0; i < PACKET_COUNT; i++)
+		outgoing[i] = {loopback, &buffer[i * PACKET_SIZE], PACKET_SIZE};
+
+	set_benchmark_bytes(PACKET_COUNT * PACKET_SIZE);
+	BENCHMARK("loopback_single") {
+		for (const auto &packet : outgoing)
+			socket.Send(packet.destination, packet.data, packet.size);
+		return receive_single(socket, buffer);
+	};
+
+	set_benchmark_bytes(PACKET_COUNT * PACKET_SIZE);
+	BENCHMARK("loopback_batched") {
+		socket.SendMany(outgoing.data(), outgoing.size());
+		int received = 0;
+		while (received < PACKET_COUNT) {
+			for (int i = received; i < PACKET_COUNT; i++)
+				incoming[i] = {Address(), &buffer[i * PACKET_SIZE], PACKET_SIZE};
+			int n = socket.ReceiveMany(&incoming[received], PACKET_COUNT - received);
+			if (n == 0)
+				break;
+			received += n;
+		}
+		return received;
+	};
+}
@@ -217,7 +217,8 @@ void MeshUpdateWorkerThread::doUpdate()
 
 		porting::TriggerMemoryTrim();
 
-		ScopeProfiler sp(g_profiler, "Client: Mesh making (sum)");
+		static const ProfilerId sp_id = ScopeProfiler::makeId("Client: Mesh making (sum)");
+		ScopeProfiler sp(g_profiler, sp_id);
 
 		MapBlockMesh *mesh_new = new MapBlockMesh(m_client, q->data);
 
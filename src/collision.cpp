@@ -371,7 +371,26 @@ static void add_object_boxes(Environment *env,
 	}
 }
 
-#define PROFILER_NAME(text) (dynamic_cast<ServerEnvironment*>(env) ? ("Server: " text) : ("Client: " text))
+namespace {
+// These run for every object in every step, so the names are interned once
+struct CollisionProfilerId
+{
+	CollisionProfilerId(const std::string &name) :
+		server(ScopeProfiler::makeId("Server: " + name, PRECISION_MICRO)),
+		client(ScopeProfiler::makeId("Client: " + name, PRECISION_MICRO))
+	{}
+
+	ProfilerId get(Environment *env) const
+	{
+		return dynamic_cast<ServerEnvironment*>(env) ? server : client;
+	}
+
+	const ProfilerId server, client;
+};
+
+const CollisionProfilerId move_simple_id("collisionMoveSimple()");
+const CollisionProfilerId check_intersection_id("collision_check_intersection()");
+}
 
 collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		const aabb3f &box_0,
@@ -382,7 +401,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 {
 	static bool time_notification_done = false;
 
-	ScopeProfiler sp(g_profiler, PROFILER_NAME("collisionMoveSimple()"), SPT_AVG, PRECISION_MICRO);
+	ScopeProfiler sp(g_profiler, move_simple_id.get(env), SPT_AVG, PRECISION_MICRO);
 
 	collisionMoveResult result;
 
@@ -644,7 +663,7 @@ bool collision_check_intersection(Environment *env, IGameDef *gamedef,
 		const aabb3f &box_0, const v3f &pos_f, ActiveObject *self,
 		bool collide_with_objects)
 {
-	ScopeProfiler sp(g_profiler, PROFILER_NAME("collision_check_intersection()"), SPT_AVG, PRECISION_MICRO);
+	ScopeProfiler sp(g_profiler, check_intersection_id.get(env), SPT_AVG, PRECISION_MICRO);
 
 	std::vector<NearbyCollisionInfo> cinfo;
 	{
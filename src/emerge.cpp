@@ -6,6 +6,7 @@
 
 #include "emerge_internal.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "util/container.h"
@@ -278,7 +279,6 @@ bool EmergeManager::enqueueBlockEmergeEx(
 	EmergeCompletionCallback callback,
 	void *callback_param)
 {
-	EmergeThread *thread = NULL;
 	bool entry_already_exists = false;
 
 	{
@@ -291,11 +291,12 @@ bool EmergeManager::enqueueBlockEmergeEx(
 		if (entry_already_exists)
 			return true;
 
-		thread = getOptimalThread();
-		thread->pushBlock(blockpos);
+		const BlockEmergeData &bedata = m_blocks_enqueued[blockpos];
+		m_queue.push(QueueItem{getPriority(blockpos, bedata, bedata.time_enqueued),
+			bedata.seq, blockpos});
 	}
 
-	thread->signal();
+	signalThreads();
 
 	return true;
 }
@@ -313,6 +314,54 @@ bool EmergeManager::isBlockInQueue(v3s16 pos)
 	return m_blocks_enqueued.find(pos) != m_blocks_enqueued.end();
 }
 
+static inline s32 block_distance(v3s16 a, v3s16 b)
+{
+	return std::max({std::abs(a.X - b.X), std::abs(a.Y - b.Y), std::abs(a.Z - b.Z)});
+}
+
+void EmergeManager::updateQueuePriorities(
+	const std::unordered_map<session_t, v3s16> &player_blockpos,
+	s16 cancel_distance)
+{
+	u32 cancelled = 0;
+	{
+		MutexAutoLock queuelock(m_queue_mutex);
+
+		m_player_blockpos = player_blockpos;
+
+		const u64 now = porting::getTimeMs();
+		std::vector<QueueItem> items;
+		items.reserve(m_blocks_enqueued.size());
+		for (auto it = m_blocks_enqueued.begin(); it != m_blocks_enqueued.end();) {
+			const v3s16 pos = it->first;
+			const BlockEmergeData &bedata = it->second;
+
+			// Only drop what nobody else is waiting for
+			auto it2 = player_blockpos.find(bedata.peer_requested);
+			if (it2 != player_blockpos.end() && bedata.callbacks.empty() &&
+					!(bedata.flags & BLOCK_EMERGE_FORCE_QUEUE) &&
+					block_distance(pos, it2->second) > cancel_distance) {
+				u32 &count_peer = m_peer_queue_count[bedata.peer_requested];
+				assert(count_peer != 0);
+				count_peer--;
+				it = m_blocks_enqueued.erase(it);
+				cancelled++;
+				continue;
+			}
+
+			items.push_back(QueueItem{getPriority(pos, bedata, now), bedata.seq, pos});
+			++it;
+		}
+
+		m_queue = std::priority_queue<QueueItem>(std::less<QueueItem>(), std::move(items));
+	}
+
+	for (u32 i = 0; i < cancelled; i++)
+		reportCompletedEmerge(EMERGE_CANCELLED);
+	if (cancelled > 0)
+		g_profiler->add("EmergeManager: cancelled [#]", cancelled);
+}
+
 
 //
 // Mapgen-related helper functions
@@ -388,6 +437,8 @@ bool EmergeManager::pushBlockEmergeData(
 	} else {
 		bedata.flags = flags;
 		bedata.peer_requested = peer_requested;
+		bedata.seq = m_queue_seq++;
+		bedata.time_enqueued = porting::getTimeMs();
 
 		count_peer++;
 	}
@@ -419,24 +470,79 @@ bool EmergeManager::popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata)
 }
 
 
-EmergeThread *EmergeManager::getOptimalThread()
+s32 EmergeManager::getPriority(v3s16 pos, const BlockEmergeData &bedata,
+	u64 now) const
 {
-	size_t nthreads = m_threads.size();
+	s32 d = 0;
+	if (!m_player_blockpos.empty()) {
+		d = S32_MAX;
+		for (const auto &it : m_player_blockpos)
+			d = std::min(d, block_distance(pos, it.second));
+	}
 
-	FATAL_ERROR_IF(nthreads == 0, "No emerge threads!");
+	// Every second spent waiting counts like being one block closer,
+	// so that requests far away from all players don't starve.
+	return d - (s32)((now - bedata.time_enqueued) / 1000);
+}
 
-	size_t index = 0;
-	size_t nitems_lowest = m_threads[0]->m_block_queue.size();
 
-	for (size_t i = 1; i < nthreads; i++) {
-		size_t nitems = m_threads[i]->m_block_queue.size();
-		if (nitems < nitems_lowest) {
-			index = i;
-			nitems_lowest = nitems;
+void EmergeManager::signalThreads()
+{
+	for (EmergeThread *thread : m_threads)
+		thread->signal();
+}
+
+
+bool EmergeManager::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
+{
+	// How many items we look at before giving up
+	constexpr size_t MAX_SKIPPED = 32;
+
+	MutexAutoLock queuelock(m_queue_mutex);
+
+	std::vector<QueueItem> skipped;
+	bool found = false;
+	while (!m_queue.empty() && skipped.size() < MAX_SKIPPED) {
+		QueueItem item = m_queue.top();
+		m_queue.pop();
+
+		// Cancelled or re-queued since
+		auto it = m_blocks_enqueued.find(item.pos);
+		if (it == m_blocks_enqueued.end() || it->second.seq != item.seq)
+			continue;
+
+		// Another thread is loading or generating the same mapchunk, this
+		// block is likely to be ready once it's done. Not skipping it would
+		// just make initBlockMake() fail.
+		v3s16 chunkpos = getContainingChunk(item.pos, mgparams->chunksize);
+		if (m_chunks_in_progress.count(chunkpos)) {
+			skipped.push_back(item);
+			continue;
 		}
+
+		m_chunks_in_progress.insert(chunkpos);
+		*pos = item.pos;
+		popBlockEmergeData(item.pos, bedata);
+		found = true;
+		break;
+	}
+
+	for (const QueueItem &item : skipped)
+		m_queue.push(item);
+
+	return found;
+}
+
+
+void EmergeManager::finishBlockEmerge(v3s16 pos)
+{
+	{
+		MutexAutoLock queuelock(m_queue_mutex);
+		m_chunks_in_progress.erase(getContainingChunk(pos, mgparams->chunksize));
 	}
 
-	return m_threads[index];
+	// Someone might be waiting for this chunk
+	signalThreads();
 }
 
 void EmergeManager::reportCompletedEmerge(EmergeAction action)
@@ -469,25 +575,18 @@ void EmergeThread::signal()
 }
 
 
-bool EmergeThread::pushBlock(v3s16 pos)
-{
-	m_block_queue.push(pos);
-	return true;
-}
-
-
 void EmergeThread::cancelPendingItems()
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	while (!m_block_queue.empty()) {
+	auto &queue = m_emerge->m_queue;
+	while (!queue.empty()) {
 		BlockEmergeData bedata;
-		v3s16 pos;
+		v3s16 pos = queue.top().pos;
+		queue.pop();
 
-		pos = m_block_queue.front();
-		m_block_queue.pop();
-
-		m_emerge->popBlockEmergeData(pos, &bedata);
+		if (!m_emerge->popBlockEmergeData(pos, &bedata))
+			continue;
 
 		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata.callbacks);
 	}
@@ -511,24 +610,9 @@ void EmergeThread::runCompletionCallbacks(v3s16 pos, EmergeAction action,
 }
 
 
-bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
-{
-	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
-
-	if (m_block_queue.empty())
-		return false;
-
-	*pos = m_block_queue.front();
-	m_block_queue.pop();
-
-	m_emerge->popBlockEmergeData(*pos, bedata);
-
-	return true;
-}
-
-
 EmergeAction EmergeThread::getBlockOrStartGen(const v3s16 pos, bool allow_gen,
-	 const std::string *from_db, MapBlock **block, BlockMakeData *bmdata)
+	 const std::string *from_db, MapBlock **block, BlockMakeData *bmdata,
+	 BlockMakePrep *prep)
 {
 	//TimeTaker tt("", nullptr, PRECISION_MICRO);
 	Server::EnvAutoLock envlock(m_server);
@@ -562,8 +646,13 @@ EmergeAction EmergeThread::getBlockOrStartGen(const v3s16 pos, bool allow_gen,
 	}
 
 	// 3). Attempt to start generation
-	if (allow_gen && m_map->initBlockMake(pos, bmdata))
-		return EMERGE_GENERATED;
+	if (allow_gen) {
+		// Let the caller prepare it without the lock first
+		if (prep && !prep->prepared)
+			return EMERGE_GENERATED;
+		if (m_map->initBlockMake(pos, bmdata, prep))
+			return EMERGE_GENERATED;
+	}
 
 	// All attempts failed; cancel this block emerge
 	return EMERGE_CANCELLED;
@@ -676,41 +765,57 @@ void *EmergeThread::run()
 	while (!stopRequested()) {
 		BlockEmergeData bedata;
 		BlockMakeData bmdata;
+		BlockMakePrep prep;
 		EmergeAction action;
 		MapBlock *block = nullptr;
 
 		porting::TriggerMemoryTrim();
 
-		if (!popBlockEmerge(&pos, &bedata)) {
+		if (!m_emerge->popBlockEmerge(&pos, &bedata)) {
 			m_queue_event.wait();
 			continue;
 		}
 
 		g_profiler->add(m_name + ": processed [#]", 1);
 
-		if (blockpos_over_max_limit(pos))
+		if (blockpos_over_max_limit(pos)) {
+			m_emerge->finishBlockEmerge(pos);
 			continue;
+		}
 
 		bool allow_gen = bedata.flags & BLOCK_EMERGE_ALLOW_GEN;
 		EMERGE_DBG_OUT("pos=" << pos << " allow_gen=" << allow_gen);
 
-		action = getBlockOrStartGen(pos, allow_gen, nullptr, &block, &bmdata);
+		action = getBlockOrStartGen(pos, allow_gen, nullptr, &block, &bmdata, &prep);
 
 		/* Try to load it */
 		if (action == EMERGE_FROM_DISK) {
 			auto &m_db = *m_emerge->m_db;
 			{
-				ScopeProfiler sp(g_profiler, "EmergeThread: load block - async (sum)");
+				static const ProfilerId sp_id =
+					ScopeProfiler::makeId("EmergeThread: load block - async (sum)");
+				ScopeProfiler sp(g_profiler, sp_id);
 				MutexAutoLock dblock(m_db.mutex);
 				// Note: this can throw an exception, but there isn't really
 				// a good, safe way to handle it.
 				m_db.loadBlock(pos, databuf);
 			}
 			// actually load it, then decide again
-			action = getBlockOrStartGen(pos, allow_gen, &databuf, &block, &bmdata);
+			action = getBlockOrStartGen(pos, allow_gen, &databuf, &block, &bmdata, &prep);
 			databuf.clear();
 		}
 
+		/* Prepare generating it, then decide again */
+		if (action == EMERGE_GENERATED && !bmdata.vmanip) {
+			{
+				ScopeProfiler sp(g_profiler,
+					"EmergeThread: ServerMap::prepareBlockMake", SPT_AVG);
+				m_map->prepareBlockMake(pos, &prep);
+			}
+			// the block was loaded already if it exists
+			action = getBlockOrStartGen(pos, allow_gen, &databuf, &block, &bmdata, &prep);
+		}
+
 		/* Generate it */
 		if (action == EMERGE_GENERATED) {
 			bool error = false;
@@ -735,14 +840,19 @@ void *EmergeThread::run()
 				}
 			}
 
-			if (!error)
+			if (!error) {
+				// Only copying the result into the map needs the lock
+				bmdata.vmanip->prepareBlitBack();
 				block = finishGen(pos, &bmdata, &modified_blocks);
+			}
 			if (!block || error)
 				action = EMERGE_ERRORED;
 
 			m_trans_liquid = nullptr;
 		}
 
+		m_emerge->finishBlockEmerge(pos);
+
 		runCompletionCallbacks(pos, action, bedata.callbacks);
 
 		if (block)
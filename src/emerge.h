@@ -6,6 +6,8 @@
 
 #include <map>
 #include <mutex>
+#include <queue>
+#include <unordered_map>
 #include "network/networkprotocol.h"
 #include "irr_v3d.h"
 #include "util/metricsbackend.h"
@@ -79,6 +81,10 @@ struct BlockEmergeData {
 	u16 peer_requested;
 	u16 flags;
 	EmergeCallbackList callbacks;
+	// Insertion order, also identifies the queue entry
+	u32 seq;
+	// Time of insertion (ms), used for aging
+	u64 time_enqueued;
 };
 
 class EmergeParams {
@@ -166,6 +172,7 @@ class EmergeManager {
 	void startThreads();
 	void stopThreads();
 	bool isRunning();
+	size_t getThreadCount() const { return m_threads.size(); }
 
 	bool enqueueBlockEmerge(
 		session_t peer_id,
@@ -183,7 +190,25 @@ class EmergeManager {
 	size_t getQueueSize();
 	bool isBlockInQueue(v3s16 pos);
 
+	/**
+	 * Sorts the queue by distance to the nearest player, so that what the
+	 * players are close to is emerged first.
+	 *
+	 * Blocks that were requested by one of these players but are further
+	 * than `cancel_distance` away from them are no longer wanted and dropped.
+	 *
+	 * @param player_blockpos block position of each player, by peer id
+	 */
+	void updateQueuePriorities(
+		const std::unordered_map<session_t, v3s16> &player_blockpos,
+		s16 cancel_distance);
+
 	Mapgen *getCurrentMapgen();
+	// Mapgen of the given thread, must not be used while the threads run
+	Mapgen *getMapgen(size_t thread_index) const
+	{
+		return m_mapgens.at(thread_index);
+	}
 
 	// Mapgen helpers methods
 	int getSpawnLevelAtPoint(v2s16 p);
@@ -199,9 +224,32 @@ class EmergeManager {
 	// The map database
 	MapDatabaseAccessor *m_db = nullptr;
 
+	struct QueueItem {
+		// Lower is more urgent
+		s32 priority;
+		u32 seq;
+		v3s16 pos;
+
+		// std::priority_queue returns the largest item first
+		bool operator<(const QueueItem &other) const
+		{
+			if (priority != other.priority)
+				return priority > other.priority;
+			return seq > other.seq;
+		}
+	};
+
 	std::mutex m_queue_mutex;
 	std::map<v3s16, BlockEmergeData> m_blocks_enqueued;
 	std::unordered_map<u16, u32> m_peer_queue_count;
+	// Shared by all emerge threads, so that idle threads can pick up any work.
+	// May contain outdated items, which are skipped.
+	std::priority_queue<QueueItem> m_queue;
+	u32 m_queue_seq = 0;
+	// Last known player positions
+	std::unordered_map<session_t, v3s16> m_player_blockpos;
+	// Mapchunks an emerge thread is working on right now
+	std::set<v3s16> m_chunks_in_progress;
 
 	u32 m_qlimit_total;
 	u32 m_qlimit_diskonly;
@@ -219,7 +267,14 @@ class EmergeManager {
 	SchematicManager *schemmgr;
 
 	// Requires m_queue_mutex held
-	EmergeThread *getOptimalThread();
+	s32 getPriority(v3s16 pos, const BlockEmergeData &bedata, u64 now) const;
+
+	void signalThreads();
+
+	// Returns the most urgent block that no other thread is busy with the
+	// mapchunk of. finishBlockEmerge() must be called when done with it.
+	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
+	void finishBlockEmerge(v3s16 pos);
 
 	bool pushBlockEmergeData(
 		v3s16 pos,
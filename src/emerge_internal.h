@@ -10,14 +10,13 @@
 
 #include "emerge.h"
 
-#include <queue>
-
 #include "util/thread.h"
 #include "threading/event.h"
 
 class Server;
 class ServerMap;
 class Mapgen;
+struct BlockMakePrep;
 
 class EmergeManager;
 class EmergeScripting;
@@ -33,9 +32,6 @@ class EmergeThread : public Thread {
 	void *run();
 	void signal();
 
-	// Requires queue mutex held
-	bool pushBlock(v3s16 pos);
-
 	void cancelPendingItems();
 
 	EmergeManager *getEmergeManager() { return m_emerge; }
@@ -58,12 +54,9 @@ class EmergeThread : public Thread {
 	UniqueQueue<v3s16> *m_trans_liquid; //< non-null only when generating a mapblock
 
 	Event m_queue_event;
-	std::queue<v3s16> m_block_queue;
 
 	bool initScripting();
 
-	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
-
 	/**
 	 * Try to get a block from memory and decide what to do.
 	 *
@@ -73,10 +66,14 @@ class EmergeThread : public Thread {
 	 * @param allow_gen allow invoking mapgen?
 	 * @param block output pointer for block
 	 * @param data info for mapgen
+	 * @param prep for ServerMap::initBlockMake(), optional. If it was not
+	 *             prepared yet, EMERGE_GENERATED is returned without starting
+	 *             generation (data->vmanip is null) so it can be prepared first.
 	 * @return what to do for this block
 	 */
 	EmergeAction getBlockOrStartGen(v3s16 pos, bool allow_gen,
-		const std::string *from_db,  MapBlock **block, BlockMakeData *data);
+		const std::string *from_db,  MapBlock **block, BlockMakeData *data,
+		BlockMakePrep *prep = nullptr);
 
 	MapBlock *finishGen(v3s16 pos, BlockMakeData *bmdata,
 		std::map<v3s16, MapBlock *> *modified_blocks);
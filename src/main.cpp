@@ -27,6 +27,7 @@
 #include "serialization.h" // SER_FMT_VER_HIGHEST_*
 #include "network/socket.h"
 #include "mapblock.h"
+#include "server/mappregenerator.h"
 #if USE_CURSES
 	#include "terminal_chat_console.h"
 #endif
@@ -113,6 +114,7 @@ static bool determine_subgame(GameParams *game_params);
 static bool run_dedicated_server(const GameParams &game_params, const Settings &cmd_args);
 static bool migrate_map_database(const GameParams &game_params, const Settings &cmd_args);
 static bool recompress_map_database(const GameParams &game_params, const Settings &cmd_args);
+static bool pregenerate_map(const GameParams &game_params, const Settings &cmd_args);
 
 /**********************************************************************/
 
@@ -230,10 +232,16 @@ int main(int argc, char *argv[])
 	if (cmd_args.getFlag("run-benchmarks")) {
 		porting::attachOrCreateConsole();
 #if BUILD_BENCHMARKS
+		BenchmarkOptions options;
 		if (cmd_args.exists("test-module"))
-			return run_benchmarks(cmd_args.get("test-module").c_str()) ? 0 : 1;
-		else
-			return run_benchmarks() ? 0 : 1;
+			options.filter = cmd_args.get("test-module");
+		if (cmd_args.exists("benchmark-output"))
+			options.json_output = cmd_args.get("benchmark-output");
+		if (cmd_args.exists("benchmark-baseline"))
+			options.baseline = cmd_args.get("benchmark-baseline");
+		if (cmd_args.exists("benchmark-threshold"))
+			options.threshold = cmd_args.getFloat("benchmark-threshold");
+		return run_benchmarks(options) ? 0 : 1;
 #else
 		errorstream << "Benchmark support is not enabled in this binary. "
 			<< "If you want to enable it, compile project with BUILD_BENCHMARKS=1 flag."
@@ -341,6 +349,12 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Run benchmarks and exit"))));
 	allowed_options->insert(std::make_pair("test-module", ValueSpec(VALUETYPE_STRING,
 			_("Only run the specified test module or benchmark"))));
+	allowed_options->insert(std::make_pair("benchmark-output", ValueSpec(VALUETYPE_STRING,
+			_("Write benchmark results as JSON to the specified file"))));
+	allowed_options->insert(std::make_pair("benchmark-baseline", ValueSpec(VALUETYPE_STRING,
+			_("Compare benchmark results to the specified JSON file"))));
+	allowed_options->insert(std::make_pair("benchmark-threshold", ValueSpec(VALUETYPE_STRING,
+			_("Allowed benchmark slowdown compared to the baseline in percent (default: 10)"))));
 	allowed_options->insert(std::make_pair("map-dir", ValueSpec(VALUETYPE_STRING,
 			_("Same as --world (deprecated)"))));
 	allowed_options->insert(std::make_pair("world", ValueSpec(VALUETYPE_STRING,
@@ -378,6 +392,8 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Enable ncurses interactive terminal" SERVER_ONLY))));
 	allowed_options->insert(std::make_pair("recompress", ValueSpec(VALUETYPE_FLAG,
 			_("Recompress the blocks of the given map database" SERVER_ONLY))));
+	allowed_options->insert(std::make_pair("pregenerate", ValueSpec(VALUETYPE_STRING,
+			_("Generate the map between two positions, e.g. \"(-1000,-64,-1000) (1000,128,1000)\"" SERVER_ONLY))));
 #if CHECK_CLIENT_BUILD()
 	allowed_options->insert(std::make_pair("address", ValueSpec(VALUETYPE_STRING,
 			_("Address to connect to ('' = local game)"))));
@@ -1097,6 +1113,9 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	if (cmd_args.getFlag("recompress"))
 		return recompress_map_database(game_params, cmd_args);
 
+	if (cmd_args.exists("pregenerate"))
+		return pregenerate_map(game_params, cmd_args);
+
 	// Bind address
 	std::string bind_str = g_settings->get("bind_address");
 	Address bind_addr(0, 0, 0, 0, game_params.socket_port);
@@ -1330,3 +1349,36 @@ static bool recompress_map_database(const GameParams &game_params, const Setting
 	actionstream << "Done, " << count << " blocks were recompressed." << std::endl;
 	return true;
 }
+
+static bool pregenerate_map(const GameParams &game_params, const Settings &cmd_args)
+{
+	// "(x,y,z) (x,y,z)"
+	const std::string area = cmd_args.get("pregenerate");
+	const size_t split = area.find(')');
+	std::optional<v3f> minp, maxp;
+	if (split != std::string::npos) {
+		minp = str_to_v3f(std::string_view(area).substr(0, split + 1));
+		maxp = str_to_v3f(std::string_view(area).substr(split + 1));
+	}
+	if (!minp || !maxp) {
+		errorstream << "Invalid area for --pregenerate, expected two positions "
+			"like \"(-1000,-64,-1000) (1000,128,1000)\"" << std::endl;
+		return false;
+	}
+
+	try {
+		Server server(game_params.world_path, game_params.game_spec, false,
+			Address(), true);
+		MapPregenerator pregen(&server, floatToInt(*minp, 1.0f),
+			floatToInt(*maxp, 1.0f));
+
+		volatile auto &kill = *porting::signal_handler_killstatus();
+		return pregen.run(kill);
+	} catch (const ModError &e) {
+		errorstream << "ModError: " << e.what() << std::endl;
+		return false;
+	} catch (const ServerError &e) {
+		errorstream << "ServerError: " << e.what() << std::endl;
+		return false;
+	}
+}
@@ -17,6 +17,7 @@
 #include "rollback_interface.h"
 #include "environment.h"
 #include "irrlicht_changes/printing.h"
+#include <algorithm>
 
 /*
 	Map
@@ -319,6 +320,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 
 					// Delete from memory
 					sector->deleteBlock(block);
+					onBlockRemoved(p);
 
 					if (unloaded_blocks)
 						unloaded_blocks->push_back(p);
@@ -376,6 +378,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, s32 max_loaded_blocks,
 
 			// Delete from memory
 			b.sect->deleteBlock(block);
+			onBlockRemoved(p);
 
 			if (unloaded_blocks)
 				unloaded_blocks->push_back(p);
@@ -809,6 +812,33 @@ void MMVManip::initialEmerge(v3s16 p_min, v3s16 p_max, bool load_if_inexistent)
 		m_is_dirty = false;
 }
 
+void MMVManip::preallocate(v3s16 p_min, v3s16 p_max)
+{
+	assert(m_area.hasEmptyExtent());
+
+	addArea(VoxelArea(p_min * MAP_BLOCKSIZE,
+		(p_max + 1) * MAP_BLOCKSIZE - v3s16(1, 1, 1)));
+
+	// This also takes the page faults of the new memory
+	const u32 volume = m_area.getVolume();
+	std::fill_n(m_data, volume, MapNode(CONTENT_IGNORE));
+	memset(m_flags, 0, volume);
+}
+
+void MMVManip::initialEmergeBlocks(const std::vector<MapBlock *> &blocks)
+{
+	TimeTaker timer1("initialEmerge", &emerge_time);
+
+	assert(m_map);
+
+	for (MapBlock *block : blocks) {
+		assert(m_area.contains(block->getPosRelative()));
+		block->copyTo(*this);
+	}
+
+	m_is_dirty = false;
+}
+
 std::map<v3s16, bool> MMVManip::getCoveredBlocks() const
 {
 	std::map<v3s16, bool> ret;
@@ -854,12 +884,7 @@ void MMVManip::blitBackAll(std::map<v3s16, MapBlock*> *modified_blocks,
 
 	size_t nload = 0;
 
-	// Copy all the blocks with data back to the map
-	const auto loaded_blocks = getCoveredBlocks();
-	for (auto &it : loaded_blocks) {
-		if (!it.second)
-			continue;
-		v3s16 p = it.first;
+	const auto get_block = [&] (v3s16 p) -> MapBlock * {
 		MapBlock *block = m_map->getBlockNoCreateNoEx(p);
 		if (!block) {
 			if (!blockpos_over_max_limit(p)) {
@@ -870,17 +895,53 @@ void MMVManip::blitBackAll(std::map<v3s16, MapBlock*> *modified_blocks,
 		if (!block) {
 			warningstream << "blitBackAll: Couldn't load block " << p
 				<< " to write data to map" << std::endl;
-			continue;
+			return nullptr;
 		}
 		if (!overwrite_generated && block->isGenerated())
-			continue;
+			return nullptr;
+		return block;
+	};
 
-		block->copyFrom(*this);
+	const auto finish_block = [&] (v3s16 p, MapBlock *block) {
 		block->raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_VMANIP);
 		block->expireIsAirCache();
 
 		if(modified_blocks)
 			(*modified_blocks)[p] = block;
+	};
+
+	if (!m_blit_blocks.empty()) {
+		// Copy the blocks prepared by prepareBlitBack()
+		for (auto &it : m_blit_blocks) {
+			MapBlock *block = get_block(it.pos);
+			if (!block)
+				continue;
+
+			MapNode *data = block->getData();
+			if (!it.has_ignore) {
+				memcpy(data, it.data.get(), MapBlock::nodecount * sizeof(MapNode));
+			} else {
+				for (u32 i = 0; i < MapBlock::nodecount; i++) {
+					if (it.data[i].getContent() != CONTENT_IGNORE)
+						data[i] = it.data[i];
+				}
+			}
+			block->expireContentCache();
+			finish_block(it.pos, block);
+		}
+	} else {
+		// Copy all the blocks with data back to the map
+		const auto loaded_blocks = getCoveredBlocks();
+		for (auto &it : loaded_blocks) {
+			if (!it.second)
+				continue;
+			MapBlock *block = get_block(it.first);
+			if (!block)
+				continue;
+
+			block->copyFrom(*this);
+			finish_block(it.first, block);
+		}
 	}
 
 	if (nload > 0) {
@@ -888,6 +949,36 @@ void MMVManip::blitBackAll(std::map<v3s16, MapBlock*> *modified_blocks,
 	}
 }
 
+void MMVManip::prepareBlitBack()
+{
+	m_blit_blocks.clear();
+
+	const auto loaded_blocks = getCoveredBlocks();
+	m_blit_blocks.reserve(loaded_blocks.size());
+	for (auto &it : loaded_blocks) {
+		if (!it.second)
+			continue;
+
+		BlitBlock &b = m_blit_blocks.emplace_back();
+		b.pos = it.first;
+		b.data.reset(new MapNode[MapBlock::nodecount]);
+		b.has_ignore = false;
+
+		// Same layout as MapBlock::data
+		const v3s16 pmin = it.first * MAP_BLOCKSIZE;
+		MapNode *dst = b.data.get();
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++) {
+			const MapNode *src = &m_data[m_area.index(pmin.X, pmin.Y + y, pmin.Z + z)];
+			for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+				b.has_ignore |= src[x].getContent() == CONTENT_IGNORE;
+				dst[x] = src[x];
+			}
+			dst += MAP_BLOCKSIZE;
+		}
+	}
+}
+
 MMVManip *MMVManip::clone() const
 {
 	MMVManip *ret = new MMVManip();
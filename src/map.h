@@ -5,8 +5,10 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <set>
 #include <map>
+#include <vector>
 
 #include "irrlichttypes_bloated.h"
 #include "mapblock.h"
@@ -242,6 +244,14 @@ class Map /*: public NodeContainer*/
 	// as its second. If it returns false, forEachNodeInArea returns early.
 	template<typename F>
 	void forEachNodeInArea(v3s16 minp, v3s16 maxp, F func)
+	{
+		forEachNodeInArea(minp, maxp, func, [] (MapBlock *) { return true; });
+	}
+
+	// Same, but blocks for which want_block returns false are skipped as
+	// a whole. It takes the block, or nullptr if it is not loaded.
+	template<typename F, typename B>
+	void forEachNodeInArea(v3s16 minp, v3s16 maxp, F func, B want_block)
 	{
 		v3s16 bpmin = getNodeBlockPos(minp);
 		v3s16 bpmax = getNodeBlockPos(maxp);
@@ -251,6 +261,8 @@ class Map /*: public NodeContainer*/
 			// y is iterated innermost to make use of the sector cache.
 			v3s16 bp(bx, by, bz);
 			MapBlock *block = getBlockNoCreateNoEx(bp);
+			if (!want_block(block))
+				continue;
 			v3s16 basep = bp * MAP_BLOCKSIZE;
 			s16 minx_block = rangelim(minp.X - basep.X, 0, MAP_BLOCKSIZE - 1);
 			s16 miny_block = rangelim(minp.Y - basep.Y, 0, MAP_BLOCKSIZE - 1);
@@ -293,6 +305,8 @@ class Map /*: public NodeContainer*/
 
 	// Can be implemented by child class
 	virtual void reportMetrics(u64 save_time_us, u32 saved_blocks, u32 all_blocks) {}
+	// Called when a block is removed from the map
+	virtual void onBlockRemoved(v3s16 blockpos) {}
 
 	bool determineAdditionalOcclusionCheck(v3s16 pos_camera,
 		const core::aabbox3d<s16> &block_bounds, v3s16 &to_check);
@@ -314,6 +328,21 @@ class MMVManip : public VoxelManipulator
 	void initialEmerge(v3s16 blockpos_min, v3s16 blockpos_max,
 		bool load_if_inexistent = true);
 
+	/**
+		Allocates the area of the given blocks, filled with CONTENT_IGNORE, for
+		initialEmergeBlocks(). Doesn't access the map, so this can be done
+		without holding the environment lock.
+		@note the VManip must be empty
+	*/
+	void preallocate(v3s16 blockpos_min, v3s16 blockpos_max);
+
+	/**
+		Completes initialEmerge() for an area allocated by preallocate(): only
+		the given blocks are copied from the map. All other blocks of the area
+		must exist and contain nothing but CONTENT_IGNORE, like new blocks.
+	*/
+	void initialEmergeBlocks(const std::vector<MapBlock *> &blocks);
+
 	/**
 		Uses the flags array to determine which blocks the VManip covers,
 		and for which of them we have any data.
@@ -333,6 +362,14 @@ class MMVManip : public VoxelManipulator
 	void blitBackAll(std::map<v3s16, MapBlock*> * modified_blocks,
 		bool overwrite_generated = true) const;
 
+	/**
+		Copies the blocks with data out of the VManip, so blitBackAll() only
+		has to copy them into the map. Doesn't access the map, so this can be
+		done without holding the environment lock.
+		@note the VManip must not be changed afterwards
+	*/
+	void prepareBlitBack();
+
 	/*
 		Creates a copy of this VManip including contents, the copy will not be
 		associated with a Map.
@@ -352,4 +389,15 @@ class MMVManip : public VoxelManipulator
 
 	// may be null
 	Map *m_map = nullptr;
+
+private:
+	struct BlitBlock {
+		v3s16 pos;
+		// CONTENT_IGNORE where the map is not changed
+		std::unique_ptr<MapNode[]> data;
+		bool has_ignore;
+	};
+
+	// see prepareBlitBack()
+	std::vector<BlitBlock> m_blit_blocks;
 };
@@ -225,6 +225,7 @@ void MapBlock::copyFrom(const VoxelManipulator &src)
 	// Copy from VoxelManipulator to data
 	src.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+	expireContentCache();
 }
 
 void MapBlock::actuallyUpdateIsAir()
@@ -250,6 +251,54 @@ void MapBlock::expireIsAirCache()
 	m_is_air_expired = true;
 }
 
+void MapBlock::rebuildContentCache()
+{
+	// Counting with a flat array is a lot faster than any map
+	static thread_local std::unique_ptr<u16[]> counts;
+	if (!counts)
+		counts = std::make_unique<u16[]>(CONTENT_MAX + 1);
+
+	m_contents.clear();
+	for (u32 i = 0; i < nodecount; i++) {
+		content_t c = data[i].getContent();
+		if (counts[c]++ == 0)
+			m_contents.push_back(c);
+	}
+	std::sort(m_contents.begin(), m_contents.end());
+
+	m_content_counts.resize(m_contents.size());
+	for (size_t i = 0; i < m_contents.size(); i++) {
+		m_content_counts[i] = counts[m_contents[i]];
+		counts[m_contents[i]] = 0;
+	}
+
+	m_contents_expired = false;
+}
+
+void MapBlock::updateContentCache(content_t removed, content_t added)
+{
+	auto it = std::lower_bound(m_contents.begin(), m_contents.end(), removed);
+	if (it == m_contents.end() || *it != removed) {
+		// Data was written to directly, start over
+		expireContentCache();
+		return;
+	}
+	size_t i = it - m_contents.begin();
+	if (--m_content_counts[i] == 0) {
+		m_contents.erase(it);
+		m_content_counts.erase(m_content_counts.begin() + i);
+	}
+
+	it = std::lower_bound(m_contents.begin(), m_contents.end(), added);
+	i = it - m_contents.begin();
+	if (it != m_contents.end() && *it == added) {
+		m_content_counts[i]++;
+	} else {
+		m_contents.insert(it, added);
+		m_content_counts.insert(m_content_counts.begin() + i, 1);
+	}
+}
+
 /*
 	Serialization
 */
@@ -347,9 +396,26 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 	if (!ser_ver_supported_write(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
-	std::ostringstream os_raw(std::ios_base::binary);
-	std::ostream &os = version >= 29 ? os_raw : os_compressed;
+	if (version >= 29) {
+		std::ostringstream os_raw(std::ios_base::binary);
+		serializeBody(os_raw, version, disk, compression_level);
+		// now compress the whole thing
+		compress(os_raw.str(), os_compressed, version, compression_level);
+	} else {
+		serializeBody(os_compressed, version, disk, compression_level);
+	}
+}
+
+void MapBlock::serializeUncompressed(std::ostream &os, u8 version, bool disk)
+{
+	if (!ser_ver_supported_write(version) || version < 29)
+		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
+	serializeBody(os, version, disk, -1);
+}
+
+void MapBlock::serializeBody(std::ostream &os, u8 version, bool disk, int compression_level)
+{
 	// First byte
 	u8 flags = 0;
 	if(is_underground)
@@ -413,7 +479,7 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 	if (version >= 29) {
 		m_node_metadata.serialize(os, version, disk);
 	} else {
-		// use os_raw from above to avoid allocating another stream object
+		std::ostringstream os_raw(std::ios_base::binary);
 		m_node_metadata.serialize(os_raw, version, disk);
 		// prior to 29 node data was compressed individually
 		compress(os_raw.str(), os, version, compression_level);
@@ -444,11 +510,6 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 			m_node_timers.serialize(os, version);
 		}
 	}
-
-	if (version >= 29) {
-		// now compress the whole thing
-		compress(os_raw.str(), os_compressed, version, compression_level);
-	}
 }
 
 void MapBlock::serializeNetworkSpecific(std::ostream &os)
@@ -464,6 +525,7 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()<<std::endl);
 
 	m_is_air_expired = true;
+	m_contents_expired = true;
 
 	if(version <= 21)
 	{
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include "irr_v3d.h"
 #include "mapnode.h"
@@ -80,6 +81,8 @@ class MapBlock
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
 	}
 
+	// Note: if you write to the data directly, call expireContentCache()
+	// or raiseModified() afterwards.
 	MapNode* getData()
 	{
 		return data;
@@ -99,7 +102,11 @@ class MapBlock
 			m_modified_reason |= reason;
 		}
 		if (mod == MOD_STATE_WRITE_NEEDED)
-			contents.clear();
+			m_snapshot_outdated = true;
+		// setNode() keeps the content cache up to date on its own
+		if (mod == MOD_STATE_WRITE_NEEDED && (reason & (MOD_REASON_REALLOCATE |
+				MOD_REASON_VMANIP | MOD_REASON_UNKNOWN)))
+			expireContentCache();
 	}
 
 	inline u32 getModified()
@@ -255,8 +262,7 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
-		data[z * zstride + y * ystride + x] = n;
-		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
+		setNodeNoCheck(x, y, z, n);
 	}
 
 	inline void setNode(v3s16 p, MapNode n)
@@ -280,7 +286,10 @@ class MapBlock
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode n)
 	{
-		data[z * zstride + y * ystride + x] = n;
+		MapNode &dst = data[z * zstride + y * ystride + x];
+		if (!m_contents_expired && dst.getContent() != n.getContent())
+			updateContentCache(dst.getContent(), n.getContent());
+		dst = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -299,6 +308,42 @@ class MapBlock
 	// Sets m_is_air to appropriate value.
 	void actuallyUpdateIsAir();
 
+	////
+	//// Content tracking
+	////
+
+	// Returns the sorted set of content types present in this block.
+	// Computed on demand, then kept up to date by setNode().
+	const std::vector<content_t> &getContents()
+	{
+		if (m_contents_expired)
+			rebuildContentCache();
+		return m_contents;
+	}
+
+	bool containsContent(content_t c)
+	{
+		const auto &contents = getContents();
+		return std::binary_search(contents.begin(), contents.end(), c);
+	}
+
+	inline void expireContentCache()
+	{
+		m_contents_expired = true;
+		m_snapshot_outdated = true;
+	}
+
+	// Whether the node data changed since it was last copied to a MapSnapshot
+	bool isSnapshotOutdated() const
+	{
+		return m_snapshot_outdated;
+	}
+
+	void setSnapshotOutdated(bool outdated)
+	{
+		m_snapshot_outdated = outdated;
+	}
+
 	// Call this to schedule what the previous function does to be done
 	// when the value is actually needed.
 	void expireIsAirCache();
@@ -416,11 +461,16 @@ class MapBlock
 	// Set disk to true for on-disk format, false for over-the-network format
 	// Precondition: version >= SER_FMT_VER_LOWEST_WRITE
 	void serialize(std::ostream &result, u8 version, bool disk, int compression_level);
+	// Same as serialize() but skips the final compression step, which the
+	// caller must do with compress() before the data is usable.
+	// Allows moving the expensive part to another thread.
+	// Precondition: version >= 29
+	void serializeUncompressed(std::ostream &result, u8 version, bool disk);
 	// If disk == true: In addition to doing other things, will add
 	// unknown blocks from id-name mapping to wndef
 	void deSerialize(std::istream &is, u8 version, bool disk);
 
-	void serializeNetworkSpecific(std::ostream &os);
+	static void serializeNetworkSpecific(std::ostream &os);
 	void deSerializeNetworkSpecific(std::istream &is);
 
 	bool storeActiveObject(u16 id);
@@ -437,6 +487,9 @@ class MapBlock
 		Private methods
 	*/
 
+	void serializeBody(std::ostream &os, u8 version, bool disk, int compression_level);
+	void rebuildContentCache();
+	void updateContentCache(content_t removed, content_t added);
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
 	/*
@@ -491,17 +544,15 @@ class MapBlock
 	*/
 	float m_usage_timer = 0;
 
-public:
-	//// ABM optimizations ////
-	// True if we never want to cache content types for this block
-	bool do_not_cache_contents = false;
-	// Cache of content types
-	// This is actually a set but for the small sizes we have a vector should be
-	// more efficient.
-	// Can be empty, in which case nothing was cached yet.
-	std::vector<content_t> contents;
+	// Content types present in the block, sorted. For the small sizes we have
+	// a vector is more efficient than a set.
+	std::vector<content_t> m_contents;
+	// Number of nodes of each type in m_contents (same index)
+	std::vector<u16> m_content_counts;
+	bool m_contents_expired = true;
+	// see isSnapshotOutdated()
+	bool m_snapshot_outdated = true;
 
-private:
 	// Whether day and night lighting differs
 	bool m_is_air = false;
 	bool m_is_air_expired = true;
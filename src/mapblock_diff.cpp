@@ -0,0 +1,106 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "mapblock_diff.h"
+#include <iterator>
+#include <sstream>
+#include "exceptions.h"
+#include "mapblock.h"
+#include "serialization.h"
+#include "util/serialize.h"
+
+void MapBlockDiff::setFlags(MapBlock *block)
+{
+	// See MapBlock::serializeBody()
+	flags = 0;
+	if (block->getIsUnderground())
+		flags |= 0x01;
+	if (!block->isAir())
+		flags |= 0x02;
+	if (!block->isGenerated())
+		flags |= 0x08;
+	lighting_complete = block->getLightingComplete();
+}
+
+void MapBlockDiff::serialize(std::ostream &os_compressed, u8 version,
+	int compression_level) const
+{
+	if (version < 29 || !ser_ver_supported_write(version))
+		throw VersionMismatchException("MapBlockDiff: format not supported");
+	assert(indices.size() == nodes.size());
+	assert(indices.size() <= MapBlock::nodecount);
+
+	std::ostringstream os(std::ios_base::binary);
+	writeU8(os, flags);
+	writeU16(os, lighting_complete);
+
+	writeU16(os, indices.size());
+	for (u16 i : indices)
+		writeU16(os, i);
+	if (!nodes.empty()) {
+		Buffer<u8> buf = MapNode::serializeBulk(version, nodes.data(),
+			nodes.size(), 2, 2);
+		os.write(reinterpret_cast<char *>(*buf), buf.getSize());
+	}
+
+	writeU8(os, metadata.has_value());
+	if (metadata)
+		os << *metadata;
+
+	compress(os.str(), os_compressed, version, compression_level);
+}
+
+void MapBlockDiff::deSerialize(std::istream &is_compressed, u8 version)
+{
+	if (version < 29 || !ser_ver_supported_read(version))
+		throw VersionMismatchException("MapBlockDiff: format not supported");
+
+	std::stringstream is(std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+	decompress(is_compressed, is, version);
+
+	flags = readU8(is);
+	lighting_complete = readU16(is);
+
+	u16 count = readU16(is);
+	if (count > MapBlock::nodecount)
+		throw SerializationError("MapBlockDiff: too many nodes");
+	indices.resize(count);
+	u16 last = 0;
+	for (u16 k = 0; k < count; k++) {
+		indices[k] = readU16(is);
+		if (indices[k] >= MapBlock::nodecount || (k > 0 && indices[k] <= last))
+			throw SerializationError("MapBlockDiff: invalid node index");
+		last = indices[k];
+	}
+	nodes.resize(count);
+	if (count > 0) {
+		MapNode::deSerializeBulk(is, version, nodes.data(), count, 2, 2);
+		if (!is.good())
+			throw SerializationError("MapBlockDiff: truncated node data");
+	}
+
+	metadata.reset();
+	if (readU8(is)) {
+		std::string rest(std::istreambuf_iterator<char>(is), {});
+		metadata = std::move(rest);
+	}
+}
+
+void MapBlockDiff::apply(MapBlock *block, IItemDefManager *idef) const
+{
+	block->setIsUnderground(flags & 0x01);
+	block->setGenerated(!(flags & 0x08));
+	block->setLightingComplete(lighting_complete);
+
+	MapNode *data = block->getData();
+	for (size_t k = 0; k < indices.size(); k++)
+		data[indices[k]] = nodes[k];
+	block->expireIsAirCache();
+	block->expireContentCache();
+
+	if (metadata) {
+		std::istringstream is(*metadata, std::ios_base::binary);
+		block->m_node_metadata.deSerialize(is, idef);
+	}
+}
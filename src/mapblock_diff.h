@@ -0,0 +1,47 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "irrlichttypes.h"
+#include "mapnode.h"
+
+class MapBlock;
+class IItemDefManager;
+
+/*
+	Changes between two versions of a MapBlock, so that a block which the
+	client already has can be updated without sending all of it again.
+	See TOCLIENT_BLOCKDATA_DIFF.
+
+	Only serialization version 29 and newer is supported.
+*/
+struct MapBlockDiff
+{
+	// Same meaning as in a serialized MapBlock
+	u8 flags = 0;
+	u16 lighting_complete = 0xFFFF;
+
+	// Indices of the changed nodes in ascending order, and their new value
+	std::vector<u16> indices;
+	std::vector<MapNode> nodes;
+
+	// All node metadata of the block in network format, only set if changed
+	std::optional<std::string> metadata;
+
+	// Takes the flags from the current block
+	void setFlags(MapBlock *block);
+
+	void serialize(std::ostream &os_compressed, u8 version,
+		int compression_level) const;
+	// Throws SerializationError on invalid data
+	void deSerialize(std::istream &is_compressed, u8 version);
+
+	// Applies the changes to the block
+	void apply(MapBlock *block, IItemDefManager *idef) const;
+};
@@ -39,12 +39,14 @@ DecorationManager::DecorationManager(IGameDef *gamedef) :
 void DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
 	v3s16 nmin, v3s16 nmax)
 {
+	DecoPlacementIndex index(mg, nmin, nmax);
+
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Decoration *deco = (Decoration *)m_objects[i];
 		if (!deco)
 			continue;
 
-		deco->placeDeco(mg, blockseed, nmin, nmax);
+		deco->placeDeco(mg, blockseed, nmin, nmax, index);
 		blockseed++;
 	}
 }
@@ -60,6 +62,116 @@ DecorationManager *DecorationManager::clone() const
 ///////////////////////////////////////////////////////////////////////////////
 
 
+DecoPlacementIndex::DecoPlacementIndex(Mapgen *mg, v3s16 nmin, v3s16 nmax) :
+	m_mg(mg),
+	m_nmin(nmin),
+	m_nmax(nmax)
+{
+	const u32 area = (nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1);
+
+	if (mg->biomemap) {
+		m_biomes.assign(mg->biomemap, mg->biomemap + area);
+		std::sort(m_biomes.begin(), m_biomes.end());
+		m_biomes.erase(std::unique(m_biomes.begin(), m_biomes.end()),
+			m_biomes.end());
+	}
+
+	if (mg->heightmap) {
+		auto minmax = std::minmax_element(mg->heightmap, mg->heightmap + area);
+		m_height_min = *minmax.first;
+		m_height_max = *minmax.second;
+	}
+}
+
+
+bool DecoPlacementIndex::hasAnyBiome(const std::unordered_set<biome_t> &biomes) const
+{
+	if (!m_mg->biomemap)
+		return true;
+
+	for (biome_t biome : m_biomes) {
+		if (biomes.count(biome))
+			return true;
+	}
+	return false;
+}
+
+
+bool DecoPlacementIndex::hasHeightIn(s16 ymin, s16 ymax) const
+{
+	if (!m_mg->heightmap)
+		return true;
+
+	return m_height_min <= ymax && m_height_max >= ymin;
+}
+
+
+DecoPlacementIndex::Column &DecoPlacementIndex::getColumn(v2s16 p2d)
+{
+	if (p2d.X < m_nmin.X || p2d.X > m_nmax.X ||
+			p2d.Y < m_nmin.Z || p2d.Y > m_nmax.Z) {
+		m_scratch.surfaces_valid = false;
+		m_scratch.liquid_surface_valid = false;
+		return m_scratch;
+	}
+
+	const s16 sizex = m_nmax.X - m_nmin.X + 1;
+	if (m_columns.empty())
+		m_columns.resize(sizex * (m_nmax.Z - m_nmin.Z + 1));
+	return m_columns[sizex * (p2d.Y - m_nmin.Z) + (p2d.X - m_nmin.X)];
+}
+
+
+const DecoPlacementIndex::Column &DecoPlacementIndex::getSurfaces(v2s16 p2d)
+{
+	Column &col = getColumn(p2d);
+	if (!col.surfaces_valid) {
+		col.floors.clear();
+		col.ceilings.clear();
+		m_mg->getSurfaces(p2d, m_nmin.Y, m_nmax.Y, col.floors, col.ceilings);
+		col.surfaces_valid = true;
+	}
+	return col;
+}
+
+
+s16 DecoPlacementIndex::getLiquidSurface(v2s16 p2d)
+{
+	Column &col = getColumn(p2d);
+	if (!col.liquid_surface_valid) {
+		col.liquid_surface = m_mg->findLiquidSurface(p2d, m_nmin.Y, m_nmax.Y);
+		col.liquid_surface_valid = true;
+	}
+	return col.liquid_surface;
+}
+
+
+void DecoPlacementIndex::invalidate(v2s16 p2d, s16 reach)
+{
+	if (m_columns.empty())
+		return;
+
+	const s16 sizex = m_nmax.X - m_nmin.X + 1;
+	s16 x0 = m_nmin.X, x1 = m_nmax.X, z0 = m_nmin.Z, z1 = m_nmax.Z;
+	if (reach >= 0) {
+		x0 = std::max<int>(x0, p2d.X - reach);
+		x1 = std::min<int>(x1, p2d.X + reach);
+		z0 = std::max<int>(z0, p2d.Y - reach);
+		z1 = std::min<int>(z1, p2d.Y + reach);
+	}
+
+	for (s16 z = z0; z <= z1; z++)
+	for (s16 x = x0; x <= x1; x++) {
+		Column &col = m_columns[sizex * (z - m_nmin.Z) + (x - m_nmin.X)];
+		col.surfaces_valid = false;
+		col.liquid_surface_valid = false;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
 void Decoration::resolveNodeNames()
 {
 	getIdsFromNrBacklog(&c_place_on);
@@ -124,12 +236,22 @@ bool Decoration::canPlaceDecoration(MMVManip *vm, v3s16 p)
 }
 
 
-void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+	DecoPlacementIndex &placement)
 {
 	// Skip if y ranges do not overlap
 	if (nmax.Y < y_min || y_max < nmin.Y)
 		return;
 
+	// Skip if no position could pass the biome or height checks below
+	if (!biomes.empty() && !placement.hasAnyBiome(biomes))
+		return;
+	const bool use_heightmap = !(flags & (DECO_ALL_FLOORS | DECO_ALL_CEILINGS |
+		DECO_LIQUID_SURFACE));
+	if (use_heightmap && !placement.hasHeightIn(std::max(y_min, nmin.Y),
+			std::min(y_max, nmax.Y)))
+		return;
+
 	PcgRandom ps(blockseed + 53);
 	int carea_size = nmax.X - nmin.X + 1;
 
@@ -194,42 +316,41 @@ void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 						continue;
 				}
 
-				// Get all floors and ceilings in node column
-				u16 size = (nmax.Y - nmin.Y + 1) / 2;
-				std::vector<s16> floors;
-				std::vector<s16> ceilings;
-				floors.reserve(size);
-				ceilings.reserve(size);
-
-				mg->getSurfaces(v2s16(x, z), nmin.Y, nmax.Y, floors, ceilings);
+				// Get all floors and ceilings in node column. Both are found
+				// before any decoration is placed here.
+				const auto &surfaces = placement.getSurfaces(v2s16(x, z));
 
 				if (flags & DECO_ALL_FLOORS) {
 					// Floor decorations
-					for (const s16 y : floors) {
+					for (const s16 y : surfaces.floors) {
 						if (y < y_min || y > y_max)
 							continue;
 
 						v3s16 pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, false))
+						bool placed = generate(mg->vm, &ps, pos, false);
+						placement.invalidate(v2s16(x, z), getReach());
+						if (placed)
 							mg->gennotify.addDecorationEvent(pos, index);
 					}
 				}
 
 				if (flags & DECO_ALL_CEILINGS) {
 					// Ceiling decorations
-					for (const s16 y : ceilings) {
+					for (const s16 y : surfaces.ceilings) {
 						if (y < y_min || y > y_max)
 							continue;
 
 						v3s16 pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, true))
+						bool placed = generate(mg->vm, &ps, pos, true);
+						placement.invalidate(v2s16(x, z), getReach());
+						if (placed)
 							mg->gennotify.addDecorationEvent(pos, index);
 					}
 				}
 			} else { // Heightmap decorations
 				s16 y = -MAX_MAP_GENERATION_LIMIT;
 				if (flags & DECO_LIQUID_SURFACE)
-					y = mg->findLiquidSurface(v2s16(x, z), nmin.Y, nmax.Y);
+					y = placement.getLiquidSurface(v2s16(x, z));
 				else if (mg->heightmap)
 					y = mg->heightmap[mapindex];
 				else
@@ -245,7 +366,9 @@ void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 				}
 
 				v3s16 pos(x, y, z);
-				if (generate(mg->vm, &ps, pos, false))
+				bool placed = generate(mg->vm, &ps, pos, false);
+				placement.invalidate(v2s16(x, z), getReach());
+				if (placed)
 					mg->gennotify.addDecorationEvent(pos, index);
 			}
 		}
@@ -396,6 +519,13 @@ ObjDef *DecoSchematic::clone() const
 }
 
 
+s16 DecoSchematic::getReach() const
+{
+	// Also covers centering and rotation
+	return schematic ? std::max(schematic->size.X, schematic->size.Z) : 0;
+}
+
+
 size_t DecoSchematic::generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling)
 {
 	// Schematic could have been unloaded but not the decoration
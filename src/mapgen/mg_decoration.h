@@ -6,6 +6,7 @@
 #pragma once
 
 #include <unordered_set>
+#include <vector>
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
@@ -35,6 +36,52 @@ enum DecorationType {
 
 extern const FlagDesc flagdesc_deco[];
 
+/*
+	What all decorations of a mapchunk look up, found once in
+	DecorationManager::placeAllDecos() instead of once per decoration.
+	The surfaces of a node column are found when they are first needed and
+	again after a decoration changed the column.
+*/
+class DecoPlacementIndex {
+public:
+	DecoPlacementIndex(Mapgen *mg, v3s16 nmin, v3s16 nmax);
+
+	// Whether the biome map has any of these biomes
+	bool hasAnyBiome(const std::unordered_set<biome_t> &biomes) const;
+	// Whether the heightmap has a height between ymin and ymax
+	bool hasHeightIn(s16 ymin, s16 ymax) const;
+
+	struct Column {
+		bool surfaces_valid = false;
+		bool liquid_surface_valid = false;
+		// see Mapgen::getSurfaces()
+		std::vector<s16> floors;
+		std::vector<s16> ceilings;
+		// see Mapgen::findLiquidSurface()
+		s16 liquid_surface;
+	};
+
+	// The reference is valid until the next call
+	const Column &getSurfaces(v2s16 p2d);
+	s16 getLiquidSurface(v2s16 p2d);
+
+	// Call after nodes within this horizontal distance of p2d may have
+	// changed, a negative distance means anywhere
+	void invalidate(v2s16 p2d, s16 reach);
+
+private:
+	Column &getColumn(v2s16 p2d);
+
+	Mapgen *m_mg;
+	v3s16 m_nmin, m_nmax;
+	std::vector<biome_t> m_biomes; // sorted
+	s16 m_height_min, m_height_max;
+	// for the columns between nmin and nmax, created on first use
+	std::vector<Column> m_columns;
+	// for other columns, these aren't kept
+	Column m_scratch;
+};
+
 
 class Decoration : public ObjDef, public NodeResolver {
 public:
@@ -44,9 +91,13 @@ class Decoration : public ObjDef, public NodeResolver {
 	virtual void resolveNodeNames();
 
 	bool canPlaceDecoration(MMVManip *vm, v3s16 p);
-	void placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+	void placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+		DecoPlacementIndex &placement);
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling) = 0;
+	// Horizontal distance from the position given to generate() within which
+	// nodes may be changed, negative if unknown
+	virtual s16 getReach() const { return -1; }
 
 	u32 flags = 0;
 	int mapseed = 0;
@@ -74,6 +125,7 @@ class DecoSimple : public Decoration {
 
 	virtual void resolveNodeNames();
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling);
+	virtual s16 getReach() const { return 0; }
 
 	std::vector<content_t> c_decos;
 	s16 deco_height;
@@ -91,6 +143,7 @@ class DecoSchematic : public Decoration {
 	virtual ~DecoSchematic();
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling);
+	virtual s16 getReach() const;
 
 	Rotation rotation;
 	Schematic *schematic = nullptr;
@@ -32,6 +32,7 @@ OreManager::OreManager(IGameDef *gamedef) :
 
 size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 {
+	OrePlacementIndex placement(mg, nmin, nmax);
 	size_t nplaced = 0;
 
 	for (size_t i = 0; i != m_objects.size(); i++) {
@@ -39,7 +40,7 @@ size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nma
 		if (!ore)
 			continue;
 
-		nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+		nplaced += ore->placeOre(mg, blockseed, nmin, nmax, placement);
 		blockseed++;
 	}
 
@@ -68,6 +69,115 @@ OreManager *OreManager::clone() const
 ///////////////////////////////////////////////////////////////////////////////
 
 
+OrePlacementIndex::OrePlacementIndex(Mapgen *mg, v3s16 nmin, v3s16 nmax) :
+	m_mg(mg),
+	m_nmin(nmin),
+	m_nmax(nmax)
+{
+	if (mg->biomemap) {
+		const u32 area = (nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1);
+		m_biomes.assign(mg->biomemap, mg->biomemap + area);
+		std::sort(m_biomes.begin(), m_biomes.end());
+		m_biomes.erase(std::unique(m_biomes.begin(), m_biomes.end()),
+			m_biomes.end());
+	}
+
+	// Cover the whole height of the voxel manipulator, since not all ores
+	// stay within nmin and nmax
+	const VoxelArea &varea = mg->vm->m_area;
+	m_enabled = varea.contains(VoxelArea(
+		v3s16(nmin.X, varea.MinEdge.Y, nmin.Z),
+		v3s16(nmax.X, varea.MaxEdge.Y, nmax.Z)));
+	if (m_enabled) {
+		m_ymin = varea.MinEdge.Y;
+		m_ymax = varea.MaxEdge.Y;
+		m_layers.resize((m_ymax - m_ymin) / LAYER_HEIGHT + 1);
+	}
+}
+
+
+bool OrePlacementIndex::hasAnyBiome(const std::unordered_set<biome_t> &biomes) const
+{
+	if (!m_mg->biomemap)
+		return true;
+
+	for (biome_t biome : m_biomes) {
+		if (biomes.count(biome))
+			return true;
+	}
+	return false;
+}
+
+
+OrePlacementIndex::Layer &OrePlacementIndex::getLayer(size_t i)
+{
+	Layer &layer = m_layers[i];
+	if (layer.scanned)
+		return layer;
+
+	layer.scanned = true;
+	layer.contents.assign((size_t)U16_MAX + 1, false);
+
+	const MMVManip *vm = m_mg->vm;
+	const s16 y0 = m_ymin + i * LAYER_HEIGHT;
+	const s16 y1 = std::min<int>(m_ymax, y0 + LAYER_HEIGHT - 1);
+	for (s16 z = m_nmin.Z; z <= m_nmax.Z; z++)
+	for (s16 y = y0; y <= y1; y++) {
+		u32 vi = vm->m_area.index(m_nmin.X, y, z);
+		content_t last = vm->m_data[vi].getContent();
+		layer.contents[last] = true;
+		for (s16 x = m_nmin.X; x <= m_nmax.X; x++, vi++) {
+			content_t c = vm->m_data[vi].getContent();
+			if (c != last) {
+				layer.contents[c] = true;
+				last = c;
+			}
+		}
+	}
+	return layer;
+}
+
+
+bool OrePlacementIndex::mayContain(const std::vector<content_t> &contents,
+	s16 ymin, s16 ymax)
+{
+	if (!m_enabled || ymin < m_ymin || ymax > m_ymax)
+		return true;
+
+	for (size_t i = (ymin - m_ymin) / LAYER_HEIGHT;
+			i <= (size_t)(ymax - m_ymin) / LAYER_HEIGHT; i++) {
+		const Layer &layer = getLayer(i);
+		for (content_t c : contents) {
+			if (layer.contents[c])
+				return true;
+		}
+	}
+	return false;
+}
+
+
+void OrePlacementIndex::add(content_t c, s16 ymin, s16 ymax)
+{
+	if (!m_enabled)
+		return;
+
+	ymin = std::max(ymin, m_ymin);
+	ymax = std::min(ymax, m_ymax);
+	if (ymin > ymax)
+		return;
+
+	// Layers that aren't scanned yet will find it themselves
+	for (size_t i = (ymin - m_ymin) / LAYER_HEIGHT;
+			i <= (size_t)(ymax - m_ymin) / LAYER_HEIGHT; i++) {
+		if (m_layers[i].scanned)
+			m_layers[i].contents[c] = true;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
 Ore::~Ore()
 {
 	delete noise;
@@ -81,7 +191,8 @@ void Ore::resolveNodeNames()
 }
 
 
-size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+	OrePlacementIndex &placement)
 {
 	if (nmin.Y > y_max || nmax.Y < y_min)
 		return 0;
@@ -91,9 +202,23 @@ size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 	if (clust_size >= actual_ymax - actual_ymin + 1)
 		return 0;
 
+	// Skip if there is nowhere to place the ore, which doesn't change what
+	// the other ores place as each uses its own random numbers
+	if (!biomes.empty() && !placement.hasAnyBiome(biomes))
+		return 0;
+	s16 place_ymin = actual_ymin;
+	s16 place_ymax = actual_ymax;
+	if (!staysInYRange()) {
+		place_ymin = placement.getMinY();
+		place_ymax = placement.getMaxY();
+	}
+	if (!placement.mayContain(c_wherein, place_ymin, place_ymax))
+		return 0;
+
 	nmin.Y = actual_ymin;
 	nmax.Y = actual_ymax;
 	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap);
+	placement.add(c_ore, place_ymin, place_ymax);
 
 	return 1;
 }
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <unordered_set>
+#include <vector>
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
@@ -35,6 +36,47 @@ enum OreType {
 
 extern const FlagDesc flagdesc_ore[];
 
+/*
+	Which biomes and node contents a mapchunk has, found once in
+	OreManager::placeAllOres() so that ores which cannot be placed anywhere in
+	it are skipped. Contents are collected by horizontal layers when a layer
+	is first needed.
+*/
+class OrePlacementIndex {
+public:
+	OrePlacementIndex(Mapgen *mg, v3s16 nmin, v3s16 nmax);
+
+	// Whether the biome map has any of these biomes
+	bool hasAnyBiome(const std::unordered_set<biome_t> &biomes) const;
+	// Whether any node of the chunk columns between ymin and ymax may
+	// have one of these contents
+	bool mayContain(const std::vector<content_t> &contents, s16 ymin, s16 ymax);
+	// Call after c was placed between ymin and ymax
+	void add(content_t c, s16 ymin, s16 ymax);
+
+	// Y range covered by mayContain()
+	s16 getMinY() const { return m_ymin; }
+	s16 getMaxY() const { return m_ymax; }
+
+private:
+	static constexpr s16 LAYER_HEIGHT = 16;
+
+	struct Layer {
+		bool scanned = false;
+		std::vector<bool> contents;
+	};
+
+	Layer &getLayer(size_t i);
+
+	Mapgen *m_mg;
+	v3s16 m_nmin, m_nmax;
+	std::vector<biome_t> m_biomes; // sorted
+	// false if the chunk columns aren't within the voxel manipulator
+	bool m_enabled = false;
+	s16 m_ymin = 0, m_ymax = -1;
+	std::vector<Layer> m_layers;
+};
+
 class Ore : public ObjDef, public NodeResolver {
 public:
 	const bool needs_noise;
@@ -58,7 +100,11 @@ class Ore : public ObjDef, public NodeResolver {
 
 	virtual void resolveNodeNames();
 
-	size_t placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+	size_t placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+		OrePlacementIndex &placement);
+	// Places c_ore only in place of c_wherein within the x and z of nmin and
+	// nmax, and also within their y if this is true
+	virtual bool staysInYRange() const { return true; }
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
 		v3s16 nmin, v3s16 nmax, biome_t *biomemap) = 0;
 
@@ -102,6 +148,7 @@ class OrePuff : public Ore {
 	OrePuff() : Ore(true) {}
 	virtual ~OrePuff();
 
+	bool staysInYRange() const override { return false; }
 	void generate(MMVManip *vm, int mapseed, u32 blockseed,
 			v3s16 nmin, v3s16 nmax, biome_t *biomemap) override;
 };
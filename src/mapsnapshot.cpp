@@ -0,0 +1,110 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "mapsnapshot.h"
+#include "mapblock.h"
+#include <algorithm>
+
+const MapSnapshot::BlockData *MapSnapshot::getBlock(v3s16 blockpos) const
+{
+	auto it = m_regions.find(getRegionPos(blockpos));
+	if (it == m_regions.end())
+		return nullptr;
+	return it->second->blocks[getRegionIndex(blockpos)].get();
+}
+
+std::shared_ptr<const MapSnapshot::BlockData> MapSnapshot::getSharedBlock(
+		v3s16 blockpos) const
+{
+	auto it = m_regions.find(getRegionPos(blockpos));
+	if (it == m_regions.end())
+		return nullptr;
+	return it->second->blocks[getRegionIndex(blockpos)];
+}
+
+MapNode MapSnapshot::getNode(v3s16 p, bool *is_valid_position) const
+{
+	v3s16 blockpos, offset;
+	getNodeBlockPosWithOffset(p, blockpos, offset);
+	const BlockData *block = getBlock(blockpos);
+	if (is_valid_position)
+		*is_valid_position = block != nullptr;
+	if (!block)
+		return {CONTENT_IGNORE};
+	return (*block)[offset.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+		offset.Y * MAP_BLOCKSIZE + offset.X];
+}
+
+MapSnapshotBuilder::MapSnapshotBuilder(const MapSnapshot *base) :
+	m_snapshot(std::make_unique<MapSnapshot>())
+{
+	if (base) {
+		m_snapshot->m_regions = base->m_regions;
+		m_snapshot->m_epoch = base->m_epoch;
+		m_snapshot->m_block_count = base->m_block_count;
+	}
+}
+
+MapSnapshot::Region *MapSnapshotBuilder::getRegion(v3s16 regionpos, bool create)
+{
+	auto own = m_own_regions.find(regionpos);
+	if (own != m_own_regions.end())
+		return own->second;
+
+	auto &regions = m_snapshot->m_regions;
+	auto it = regions.find(regionpos);
+	if (it == regions.end() && !create)
+		return nullptr;
+
+	// Copy on write, the base snapshot might be in use
+	auto region = it == regions.end() ? std::make_shared<MapSnapshot::Region>() :
+		std::make_shared<MapSnapshot::Region>(*it->second);
+	MapSnapshot::Region *ptr = region.get();
+	regions[regionpos] = std::move(region);
+	m_own_regions[regionpos] = ptr;
+	return ptr;
+}
+
+void MapSnapshotBuilder::setBlock(v3s16 blockpos, const MapNode *data)
+{
+	MapSnapshot::Region *region =
+		getRegion(MapSnapshot::getRegionPos(blockpos), true);
+	auto &block = region->blocks[MapSnapshot::getRegionIndex(blockpos)];
+	if (!block) {
+		region->block_count++;
+		m_snapshot->m_block_count++;
+	}
+
+	auto copy = std::make_shared<MapSnapshot::BlockData>();
+	std::copy(data, data + MapSnapshot::BLOCK_NODECOUNT, copy->begin());
+	block = std::move(copy);
+	m_changed = true;
+}
+
+void MapSnapshotBuilder::removeBlock(v3s16 blockpos)
+{
+	const v3s16 regionpos = MapSnapshot::getRegionPos(blockpos);
+	const u32 index = MapSnapshot::getRegionIndex(blockpos);
+
+	// Don't copy the region if the block isn't there
+	auto it = m_snapshot->m_regions.find(regionpos);
+	if (it == m_snapshot->m_regions.end() || !it->second->blocks[index])
+		return;
+
+	MapSnapshot::Region *region = getRegion(regionpos, false);
+	region->blocks[index].reset();
+	m_snapshot->m_block_count--;
+	if (--region->block_count == 0) {
+		m_own_regions.erase(regionpos);
+		m_snapshot->m_regions.erase(regionpos);
+	}
+	m_changed = true;
+}
+
+std::shared_ptr<const MapSnapshot> MapSnapshotBuilder::finish()
+{
+	m_own_regions.clear();
+	m_snapshot->m_epoch++;
+	return std::shared_ptr<const MapSnapshot>(m_snapshot.release());
+}
@@ -0,0 +1,136 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "constants.h"
+#include "mapnode.h"
+#include "util/numeric.h"
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+/*
+	Read-only copy of the node data of all loaded blocks of a map, as it was
+	at one point in time.
+
+	A snapshot never changes once it is created, so any thread can query it
+	without locking while the map keeps changing. ServerMap creates a new
+	snapshot every few steps, which shares the data of unchanged blocks with
+	the previous one. The memory is freed when the last user drops it.
+
+	Blocks that were not loaded read as CONTENT_IGNORE.
+*/
+class MapSnapshot
+{
+public:
+	static constexpr u32 BLOCK_NODECOUNT =
+		MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+	// Node data of a block, in the order of MapBlock::getData()
+	using BlockData = std::array<MapNode, BLOCK_NODECOUNT>;
+
+	// Number of the update that created the snapshot, increases by one with
+	// each update of the map
+	u64 getEpoch() const { return m_epoch; }
+
+	size_t getBlockCount() const { return m_block_count; }
+
+	// @return nullptr if the block was not loaded
+	const BlockData *getBlock(v3s16 blockpos) const;
+	// Same, for keeping the data after the snapshot is gone. The data of a
+	// block is replaced instead of modified when the block changes.
+	std::shared_ptr<const BlockData> getSharedBlock(v3s16 blockpos) const;
+
+	MapNode getNode(v3s16 p, bool *is_valid_position = nullptr) const;
+
+	// Same as Map::forEachNodeInArea()
+	template<typename F>
+	void forEachNodeInArea(v3s16 minp, v3s16 maxp, F func) const
+	{
+		v3s16 bpmin = getContainerPos(minp, MAP_BLOCKSIZE);
+		v3s16 bpmax = getContainerPos(maxp, MAP_BLOCKSIZE);
+		for (s16 bz = bpmin.Z; bz <= bpmax.Z; bz++)
+		for (s16 by = bpmin.Y; by <= bpmax.Y; by++)
+		for (s16 bx = bpmin.X; bx <= bpmax.X; bx++) {
+			v3s16 bp(bx, by, bz);
+			const BlockData *block = getBlock(bp);
+			v3s16 basep = bp * MAP_BLOCKSIZE;
+			s16 minx_block = rangelim(minp.X - basep.X, 0, MAP_BLOCKSIZE - 1);
+			s16 miny_block = rangelim(minp.Y - basep.Y, 0, MAP_BLOCKSIZE - 1);
+			s16 minz_block = rangelim(minp.Z - basep.Z, 0, MAP_BLOCKSIZE - 1);
+			s16 maxx_block = rangelim(maxp.X - basep.X, 0, MAP_BLOCKSIZE - 1);
+			s16 maxy_block = rangelim(maxp.Y - basep.Y, 0, MAP_BLOCKSIZE - 1);
+			s16 maxz_block = rangelim(maxp.Z - basep.Z, 0, MAP_BLOCKSIZE - 1);
+			for (s16 z_block = minz_block; z_block <= maxz_block; z_block++)
+			for (s16 y_block = miny_block; y_block <= maxy_block; y_block++)
+			for (s16 x_block = minx_block; x_block <= maxx_block; x_block++) {
+				v3s16 p = basep + v3s16(x_block, y_block, z_block);
+				MapNode n = block ? (*block)[z_block * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+						y_block * MAP_BLOCKSIZE + x_block] : MapNode(CONTENT_IGNORE);
+				if (!func(p, n))
+					return;
+			}
+		}
+	}
+
+private:
+	friend class MapSnapshotBuilder;
+
+	// Blocks are grouped, so that an update only copies the groups that changed
+	static constexpr s16 REGION_SHIFT = 2;
+	static constexpr u32 REGION_BLOCKCOUNT = 1 << (3 * REGION_SHIFT);
+
+	struct Region {
+		std::shared_ptr<const BlockData> blocks[REGION_BLOCKCOUNT];
+		u32 block_count = 0;
+	};
+
+	static v3s16 getRegionPos(v3s16 blockpos)
+	{
+		return v3s16(blockpos.X >> REGION_SHIFT, blockpos.Y >> REGION_SHIFT,
+			blockpos.Z >> REGION_SHIFT);
+	}
+
+	static u32 getRegionIndex(v3s16 blockpos)
+	{
+		constexpr s16 mask = (1 << REGION_SHIFT) - 1;
+		return (blockpos.Z & mask) << (2 * REGION_SHIFT) |
+			(blockpos.Y & mask) << REGION_SHIFT | (blockpos.X & mask);
+	}
+
+	std::unordered_map<v3s16, std::shared_ptr<const Region>> m_regions;
+	u64 m_epoch = 0;
+	size_t m_block_count = 0;
+};
+
+/*
+	Creates a snapshot from the previous one and the blocks that changed.
+*/
+class MapSnapshotBuilder
+{
+public:
+	// @param base previous snapshot, nullptr to start with an empty one
+	MapSnapshotBuilder(const MapSnapshot *base);
+
+	// Copies the node data of a block (MapBlock::nodecount nodes)
+	void setBlock(v3s16 blockpos, const MapNode *data);
+	void removeBlock(v3s16 blockpos);
+
+	// Whether the snapshot differs from the base
+	bool changed() const { return m_changed; }
+
+	std::shared_ptr<const MapSnapshot> finish();
+
+private:
+	// Region that can be modified, copied from the base if needed
+	MapSnapshot::Region *getRegion(v3s16 regionpos, bool create);
+
+	std::unique_ptr<MapSnapshot> m_snapshot;
+	// Regions that were copied, these aren't shared yet
+	std::unordered_map<v3s16, MapSnapshot::Region *> m_own_regions;
+	bool m_changed = false;
+};
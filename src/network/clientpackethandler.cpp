@@ -14,6 +14,7 @@
 #include "log.h"
 #include "servermap.h"
 #include "mapsector.h"
+#include "mapblock_diff.h"
 #include "client/minimap.h"
 #include "modchannels.h"
 #include "nodedef.h"
@@ -320,6 +321,35 @@ void Client::handleCommand_BlockData(NetworkPacket* pkt)
 	addUpdateMeshTaskWithEdge(p, true);
 }
 
+void Client::handleCommand_BlockDataDiff(NetworkPacket* pkt)
+{
+	// Ignore too small packet
+	if (pkt->getSize() < 6)
+		return;
+
+	v3s16 p;
+	*pkt >> p;
+
+	// The block was deleted meanwhile, the server will send it again
+	// once it handled TOSERVER_DELETEDBLOCKS
+	MapBlock *block = m_env.getMap().getBlockNoCreateNoEx(p);
+	if (!block)
+		return;
+
+	std::string datastring(pkt->getRemainingString(), pkt->getRemainingBytes());
+	std::istringstream istr(datastring, std::ios_base::binary);
+
+	MapBlockDiff diff;
+	diff.deSerialize(istr, m_server_ser_ver);
+	diff.apply(block, m_itemdef);
+
+	if (m_localdb) {
+		ServerMap::saveBlock(block, m_localdb);
+	}
+
+	addUpdateMeshTaskWithEdge(p, true);
+}
+
 void Client::handleCommand_Inventory(NetworkPacket* pkt)
 {
 	if (pkt->getSize() < 1)
@@ -7,11 +7,12 @@
 namespace con
 {
 
-IConnection *createMTP(float timeout, bool ipv6, PeerHandler *handler)
+IConnection *createMTP(float timeout, bool ipv6, PeerHandler *handler,
+		u32 workers)
 {
 	// safe minimum across internet networks for ipv4 and ipv6
 	constexpr u32 MAX_PACKET_SIZE = 512;
-	return new con::Connection(MAX_PACKET_SIZE, timeout, ipv6, handler);
+	return new con::Connection(MAX_PACKET_SIZE, timeout, ipv6, handler, workers);
 }
 
 }
@@ -62,39 +62,35 @@ void BufferedPacket::setSenderPeerId(session_t id)
 	writeU16(&data[4], id);
 }
 
-BufferedPacketPtr makePacket(const Address &address, const SharedBuffer<u8> &data,
+BufferedPacketPtr makePacket(const Address &address, PacketBuffer data,
 		u32 protocol_id, session_t sender_peer_id, u8 channel)
 {
-	u32 packet_size = data.getSize() + BASE_HEADER_SIZE;
+	u8 *header = data.prepend(BASE_HEADER_SIZE);
+	writeU32(&header[0], protocol_id);
+	writeU16(&header[4], sender_peer_id);
+	writeU8(&header[6], channel);
 
-	auto p = std::make_shared<BufferedPacket>(packet_size);
+	auto p = std::make_shared<BufferedPacket>(std::move(data));
 	p->address = address;
-
-	writeU32(&p->data[0], protocol_id);
-	writeU16(&p->data[4], sender_peer_id);
-	writeU8(&p->data[6], channel);
-
-	memcpy(&p->data[BASE_HEADER_SIZE], *data, data.getSize());
-
 	return p;
 }
 
-SharedBuffer<u8> makeOriginalPacket(const SharedBuffer<u8> &data)
+BufferedPacketPtr makePacket(const Address &address, const SharedBuffer<u8> &data,
+		u32 protocol_id, session_t sender_peer_id, u8 channel)
 {
-	u32 header_size = 1;
-	u32 packet_size = data.getSize() + header_size;
-	SharedBuffer<u8> b(packet_size);
+	return makePacket(address, PacketBuffer(*data, data.getSize()),
+		protocol_id, sender_peer_id, channel);
+}
 
-	writeU8(&(b[0]), PACKET_TYPE_ORIGINAL);
-	if (data.getSize() > 0) {
-		memcpy(&(b[header_size]), *data, data.getSize());
-	}
-	return b;
+static PacketBuffer makeOriginalPacket(PacketBuffer data)
+{
+	writeU8(data.prepend(1), PACKET_TYPE_ORIGINAL);
+	return data;
 }
 
 // Split data in chunks and add TYPE_SPLIT headers to them
-void makeSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max, u16 seqnum,
-		std::list<SharedBuffer<u8>> *chunks)
+static void makeSplitPacket(const PacketBuffer &data, u32 chunksize_max, u16 seqnum,
+		std::list<PacketBuffer> *chunks)
 {
 	// Chunk packets, containing the TYPE_SPLIT header
 	const u32 chunk_header_size = 7;
@@ -103,13 +99,14 @@ void makeSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max, u16 seqnum
 	u16 chunk_num = 0;
 	do {
 		end = start + maximum_data_size - 1;
-		if (end > data.getSize() - 1)
-			end = data.getSize() - 1;
+		if (end > data.size() - 1)
+			end = data.size() - 1;
 
 		u32 payload_size = end - start + 1;
 		u32 packet_size = chunk_header_size + payload_size;
 
-		SharedBuffer<u8> chunk(packet_size);
+		// leave room for the reliable and base headers
+		PacketBuffer chunk(packet_size, BASE_HEADER_SIZE + RELIABLE_HEADER_SIZE);
 
 		writeU8(&chunk[0], PACKET_TYPE_SPLIT);
 		writeU16(&chunk[1], seqnum);
@@ -123,7 +120,7 @@ void makeSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max, u16 seqnum
 		sanity_check(chunk_num < 0xFFFF); // overflow
 		chunk_num++;
 	}
-	while (end != data.getSize() - 1);
+	while (end != data.size() - 1);
 
 	for (auto &chunk : *chunks) {
 		// Write chunk_count
@@ -131,12 +128,12 @@ void makeSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max, u16 seqnum
 	}
 }
 
-void makeAutoSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max,
-		u16 &split_seqnum, std::list<SharedBuffer<u8>> *list)
+void makeAutoSplitPacket(const PacketBuffer &data, u32 chunksize_max,
+		u16 &split_seqnum, std::list<PacketBuffer> *list)
 {
 	u32 original_header_size = 1;
 
-	if (data.getSize() + original_header_size > chunksize_max) {
+	if (data.size() + original_header_size > chunksize_max) {
 		makeSplitPacket(data, chunksize_max, split_seqnum, list);
 		split_seqnum++;
 		return;
@@ -145,18 +142,12 @@ void makeAutoSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max,
 	list->push_back(makeOriginalPacket(data));
 }
 
-SharedBuffer<u8> makeReliablePacket(const SharedBuffer<u8> &data, u16 seqnum)
+PacketBuffer makeReliablePacket(PacketBuffer data, u16 seqnum)
 {
-	u32 header_size = 3;
-	u32 packet_size = data.getSize() + header_size;
-	SharedBuffer<u8> b(packet_size);
-
-	writeU8(&b[0], PACKET_TYPE_RELIABLE);
-	writeU16(&b[1], seqnum);
-
-	memcpy(&b[header_size], *data, data.getSize());
-
-	return b;
+	u8 *header = data.prepend(RELIABLE_HEADER_SIZE);
+	writeU8(&header[0], PACKET_TYPE_RELIABLE);
+	writeU16(&header[1], seqnum);
+	return data;
 }
 
 /*
@@ -599,7 +590,7 @@ ConnectionCommandPtr ConnectionCommand::send(session_t peer_id, u8 channelnum,
 	c->peer_id = peer_id;
 	c->channelnum = channelnum;
 	c->reliable = reliable;
-	c->data = pkt->oldForgePacket();
+	c->data = pkt->forgePacket();
 	return c;
 }
 
@@ -609,7 +600,7 @@ ConnectionCommandPtr ConnectionCommand::ack(session_t peer_id, u8 channelnum, co
 	c->peer_id = peer_id;
 	c->channelnum = channelnum;
 	c->reliable = false;
-	data.copyTo(c->data);
+	c->data = PacketBuffer(*data, data.getSize());
 	return c;
 }
 
@@ -620,7 +611,7 @@ ConnectionCommandPtr ConnectionCommand::createPeer(session_t peer_id, const Buff
 	c->channelnum = 0;
 	c->reliable = true;
 	c->raw = true;
-	data.copyTo(c->data);
+	c->data = PacketBuffer(*data, data.getSize());
 	return c;
 }
 
@@ -1026,7 +1017,7 @@ void UDPPeer::reportRTT(float rtt)
 	}
 }
 
-bool UDPPeer::Ping(float dtime,SharedBuffer<u8>& data)
+bool UDPPeer::Ping(float dtime, PacketBuffer &data)
 {
 	m_ping_timer += dtime;
 	if (!isHalfOpen() && m_ping_timer >= PING_TIMEOUT)
@@ -1053,13 +1044,13 @@ void UDPPeer::PutReliableSendCommand(ConnectionCommandPtr &c,
 			(chan.queued_reliables.size() + 1 < chan.getWindowSize() / 2)) {
 		LOG(dout_con<<m_connection->getDesc()
 				<<" processing reliable command for peer id: " << c->peer_id
-				<<" data size: " << c->data.getSize() << std::endl);
+				<<" data size: " << c->data.size() << std::endl);
 		if (processReliableSendCommand(c, max_packet_size))
 			return;
 	} else {
 		LOG(dout_con<<m_connection->getDesc()
 				<<" Queueing reliable command for peer id: " << c->peer_id
-				<<" data size: " << c->data.getSize() <<std::endl);
+				<<" data size: " << c->data.size() <<std::endl);
 
 		if (chan.queued_commands.size() + 1 >= chan.getWindowSize() / 2) {
 			LOG(derr_con << m_connection->getDesc()
@@ -1085,7 +1076,7 @@ bool UDPPeer::processReliableSendCommand(
 							- BASE_HEADER_SIZE
 							- RELIABLE_HEADER_SIZE;
 
-	std::list<SharedBuffer<u8>> originals;
+	std::list<PacketBuffer> originals;
 
 	if (c.raw) {
 		originals.emplace_back(c.data);
@@ -1102,7 +1093,7 @@ bool UDPPeer::processReliableSendCommand(
 	std::queue<BufferedPacketPtr> toadd;
 	u16 initial_sequence_number = 0;
 
-	for (SharedBuffer<u8> &original : originals) {
+	for (PacketBuffer &original : originals) {
 		u16 seqnum = chan.getOutgoingSequenceNumber(have_sequence_number);
 
 		/* oops, we don't have enough sequence numbers to send this packet */
@@ -1115,7 +1106,7 @@ bool UDPPeer::processReliableSendCommand(
 			have_initial_sequence_number = true;
 		}
 
-		SharedBuffer<u8> reliable = makeReliablePacket(original, seqnum);
+		PacketBuffer reliable = makeReliablePacket(original, seqnum);
 
 		// Add base headers and make a packet
 		BufferedPacketPtr p = con::makePacket(address, reliable,
@@ -1162,7 +1153,7 @@ bool UDPPeer::processReliableSendCommand(
 
 	LOG(dout_con<<m_connection->getDesc()
 			<< " Windowsize exceeded on reliable sending "
-			<< c.data.getSize() << " bytes"
+			<< c.data.size() << " bytes"
 			<< std::endl << "\t\tinitial_sequence_number: "
 			<< initial_sequence_number
 			<< std::endl << "\t\tgot at most            : "
@@ -1195,7 +1186,7 @@ void UDPPeer::RunCommandQueues(
 				} else {
 					LOG(dout_con << m_connection->getDesc()
 							<< " Failed to queue packets for peer_id: " << c->peer_id
-							<< ", delaying sending of " << c->data.getSize()
+							<< ", delaying sending of " << c->data.size()
 							<< " bytes" << std::endl);
 				}
 			}
@@ -1287,11 +1278,10 @@ ConnectionEventPtr ConnectionEvent::bindFailed()
 */
 
 Connection::Connection(u32 max_packet_size, float timeout,
-		bool ipv6, PeerHandler *peerhandler) :
+		bool ipv6, PeerHandler *peerhandler, u32 workers) :
 	m_udpSocket(ipv6),
 	m_protocol_id(PROTOCOL_ID),
-	m_sendThread(new ConnectionSendThread(max_packet_size, timeout)),
-	m_receiveThread(new ConnectionReceiveThread()),
+	m_shard_count(MYMAX(workers, 1)),
 	m_bc_peerhandler(peerhandler)
 
 {
@@ -1299,11 +1289,20 @@ Connection::Connection(u32 max_packet_size, float timeout,
 	 * from the connection timeout */
 	m_udpSocket.setTimeoutMs(500);
 
-	m_sendThread->setParent(this);
-	m_receiveThread->setParent(this);
+	/* The receive thread of the first shard reads the socket and passes the
+	 * packets of other peers on to their shard */
+	for (u32 shard = 0; shard < m_shard_count; shard++) {
+		m_sendThreads.emplace_back(new ConnectionSendThread(max_packet_size,
+			timeout, shard));
+		m_receiveThreads.emplace_back(new ConnectionReceiveThread(shard));
+		m_sendThreads.back()->setParent(this);
+		m_receiveThreads.back()->setParent(this);
+	}
 
-	m_sendThread->start();
-	m_receiveThread->start();
+	for (u32 shard = 0; shard < m_shard_count; shard++) {
+		m_sendThreads[shard]->start();
+		m_receiveThreads[shard]->start();
+	}
 }
 
 
@@ -1311,12 +1310,16 @@ Connection::~Connection()
 {
 	m_shutting_down = true;
 	// request threads to stop
-	m_sendThread->stop();
-	m_receiveThread->stop();
+	for (u32 shard = 0; shard < m_shard_count; shard++) {
+		m_sendThreads[shard]->stop();
+		m_receiveThreads[shard]->stop();
+	}
 
 	// wait for threads to finish
-	m_sendThread->wait();
-	m_receiveThread->wait();
+	for (u32 shard = 0; shard < m_shard_count; shard++) {
+		m_sendThreads[shard]->wait();
+		m_receiveThreads[shard]->wait();
+	}
 
 	// Delete peers
 	for (auto &peer : m_peers) {
@@ -1332,9 +1335,28 @@ void Connection::putEvent(ConnectionEventPtr e)
 	m_event_queue.push_back(e);
 }
 
-void Connection::TriggerSend()
+void Connection::TriggerSend(session_t peer_id)
+{
+	m_sendThreads[getShard(peer_id)]->Trigger();
+}
+
+void Connection::forwardPacket(std::unique_ptr<ForwardedPacket> packet)
+{
+	m_receiveThreads[getShard(packet->peer_id)]->putPacket(std::move(packet));
+}
+
+std::vector<session_t> Connection::getPeerIDs(u32 shard)
 {
-	m_sendThread->Trigger();
+	MutexAutoLock peerlock(m_peers_mutex);
+	if (m_shard_count == 1)
+		return m_peer_ids;
+
+	std::vector<session_t> peer_ids;
+	for (session_t peer_id : m_peer_ids) {
+		if (getShard(peer_id) == shard)
+			peer_ids.push_back(peer_id);
+	}
+	return peer_ids;
 }
 
 PeerHelper Connection::getPeerNoEx(session_t peer_id)
@@ -1368,12 +1390,14 @@ session_t Connection::lookupPeer(const Address& sender)
 	return PEER_ID_INEXISTENT;
 }
 
-u32 Connection::getActiveCount()
+u32 Connection::getActiveCount(u32 shard)
 {
 	MutexAutoLock peerlock(m_peers_mutex);
 	u32 count = 0;
 	for (auto &it : m_peers) {
 		Peer *peer = it.second;
+		if (getShard(peer->id) != shard)
+			continue;
 		if (peer->isPendingDeletion())
 			continue;
 		if (peer->isHalfOpen())
@@ -1418,9 +1442,25 @@ ConnectionEventPtr Connection::waitEvent(u32 timeout_ms)
 
 void Connection::putCommand(ConnectionCommandPtr c)
 {
-	if (!m_shutting_down) {
-		m_command_queue.push_back(c);
-		m_sendThread->Trigger();
+	if (m_shutting_down)
+		return;
+
+	switch (c->type) {
+	case CONNCMD_SERVE:
+	case CONNCMD_CONNECT:
+		// The socket is shared, any thread can set it up
+		m_sendThreads[0]->putCommand(c);
+		break;
+	case CONNCMD_DISCONNECT:
+	case CONNCMD_PEER_ID_SET:
+	case CONNCMD_SEND_TO_ALL:
+		// Concern all peers, so every shard handles its part
+		for (auto &thread : m_sendThreads)
+			thread->putCommand(c);
+		break;
+	default:
+		m_sendThreads[getShard(c->peer_id)]->putCommand(c);
+		break;
 	}
 }
 
@@ -1662,7 +1702,6 @@ void Connection::sendAck(session_t peer_id, u8 channelnum, u16 seqnum)
 	writeU16(&ack[2], seqnum);
 
 	putCommand(ConnectionCommand::ack(peer_id, channelnum, ack));
-	m_sendThread->Trigger();
 }
 
 UDPPeer* Connection::createServerPeer(const Address &address)
@@ -12,6 +12,7 @@
 #include "util/numeric.h"
 #include "porting.h"
 #include "network/networkprotocol.h"
+#include "network/packetbuffer.h"
 #include <atomic>
 #include <iostream>
 #include <vector>
@@ -137,7 +138,7 @@ class Peer : public IPeer {
 			FATAL_ERROR("unimplemented in abstract class");
 		}
 
-		virtual bool Ping(float dtime, SharedBuffer<u8>& data) { return false; };
+		virtual bool Ping(float dtime, PacketBuffer &data) { return false; };
 
 		virtual float getStat(rtt_stat_type type) const {
 			switch (type) {
@@ -219,6 +220,7 @@ class Peer : public IPeer {
 };
 
 class UDPPeer;
+struct ForwardedPacket;
 
 class Connection final : public IConnection
 {
@@ -226,8 +228,9 @@ class Connection final : public IConnection
 	friend class ConnectionSendThread;
 	friend class ConnectionReceiveThread;
 
+	// Peers are spread over `workers` pairs of send and receive threads
 	Connection(u32 max_packet_size, float timeout, bool ipv6,
-			PeerHandler *peerhandler);
+			PeerHandler *peerhandler, u32 workers = 1);
 	~Connection();
 
 	/* Interface */
@@ -263,21 +266,23 @@ class Connection final : public IConnection
 
 	void sendAck(session_t peer_id, u8 channelnum, u16 seqnum);
 
-	std::vector<session_t> getPeerIDs()
-	{
-		MutexAutoLock peerlock(m_peers_mutex);
-		return m_peer_ids;
-	}
+	// Index of the worker threads that handle the peer
+	u32 getShard(session_t peer_id) const { return peer_id % m_shard_count; }
+	u32 getShardCount() const { return m_shard_count; }
 
-	u32 getActiveCount();
+	// IDs of the peers handled by one pair of worker threads
+	std::vector<session_t> getPeerIDs(u32 shard);
+
+	u32 getActiveCount(u32 shard);
 
 	UDPSocket m_udpSocket;
-	// Command queue: user -> SendThread
-	MutexedQueue<ConnectionCommandPtr> m_command_queue;
 
 	void putEvent(ConnectionEventPtr e);
 
-	void TriggerSend();
+	void TriggerSend(session_t peer_id);
+
+	// Hands a received packet to the receive thread of the peer's shard
+	void forwardPacket(std::unique_ptr<ForwardedPacket> packet);
 
 	bool ConnectedToServer()
 	{
@@ -294,8 +299,9 @@ class Connection final : public IConnection
 	std::vector<session_t> m_peer_ids;
 	std::mutex m_peers_mutex;
 
-	std::unique_ptr<ConnectionSendThread> m_sendThread;
-	std::unique_ptr<ConnectionReceiveThread> m_receiveThread;
+	const u32 m_shard_count;
+	std::vector<std::unique_ptr<ConnectionSendThread>> m_sendThreads;
+	std::vector<std::unique_ptr<ConnectionReceiveThread>> m_receiveThreads;
 
 	mutable std::mutex m_info_mutex;
 
@@ -188,13 +188,13 @@ class IncomingDataCorruption : public BaseException
 /*
 	Struct for all kinds of packets. Includes following data:
 		BASE_HEADER
-		u8[] packet data (usually copied from SharedBuffer<u8>)
+		u8[] packet data
 */
 struct BufferedPacket {
-	BufferedPacket(u32 a_size)
+	BufferedPacket(PacketBuffer &&a_data) :
+		m_data(std::move(a_data))
 	{
-		m_data.resize(a_size);
-		data = &m_data[0];
+		data = m_data.data();
 	}
 
 	DISABLE_CLASS_COPY(BufferedPacket)
@@ -212,21 +212,24 @@ struct BufferedPacket {
 	unsigned int resend_count = 0;
 
 private:
-	std::vector<u8> m_data; // Data of the packet, including headers
+	PacketBuffer m_data; // Data of the packet, including headers
 };
 
 
-// This adds the base headers to the data and makes a packet out of it
+// This adds the base headers to the data and makes a packet out of it.
+// The headers are put in front of the data without copying it, if possible.
+BufferedPacketPtr makePacket(const Address &address, PacketBuffer data,
+		u32 protocol_id, session_t sender_peer_id, u8 channel);
 BufferedPacketPtr makePacket(const Address &address, const SharedBuffer<u8> &data,
 		u32 protocol_id, session_t sender_peer_id, u8 channel);
 
 // Depending on size, make a TYPE_ORIGINAL or TYPE_SPLIT packet
 // Increments split_seqnum if a split packet is made
-void makeAutoSplitPacket(const SharedBuffer<u8> &data, u32 chunksize_max,
-		u16 &split_seqnum, std::list<SharedBuffer<u8>> *list);
+void makeAutoSplitPacket(const PacketBuffer &data, u32 chunksize_max,
+		u16 &split_seqnum, std::list<PacketBuffer> *list);
 
 // Add the TYPE_RELIABLE header to the data
-SharedBuffer<u8> makeReliablePacket(const SharedBuffer<u8> &data, u16 seqnum);
+PacketBuffer makeReliablePacket(PacketBuffer data, u16 seqnum);
 
 struct IncomingSplitPacket
 {
@@ -334,7 +337,7 @@ struct ConnectionCommand
 	Address address;
 	session_t peer_id = PEER_ID_INEXISTENT;
 	u8 channelnum = 0;
-	Buffer<u8> data;
+	PacketBuffer data;
 	bool reliable = false;
 	bool raw = false;
 
@@ -521,7 +524,7 @@ class UDPPeer final : public Peer
 	void setResendTimeout(float timeout)
 		{ MutexAutoLock lock(m_exclusive_access_mutex); resend_timeout = timeout; }
 
-	bool Ping(float dtime, SharedBuffer<u8>& data) override;
+	bool Ping(float dtime, PacketBuffer &data) override;
 
 	Channel channels[CHANNEL_COUNT];
 	bool m_pending_disconnect = false;
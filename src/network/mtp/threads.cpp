@@ -46,8 +46,9 @@ static inline u8 readChannel(const u8 *packetdata)
 #define MPPI_SETTING "max_packets_per_iteration"
 
 ConnectionSendThread::ConnectionSendThread(unsigned int max_packet_size,
-	float timeout) :
+	float timeout, u32 shard) :
 	Thread("ConnectionSend"),
+	m_shard(shard),
 	m_max_packet_size(max_packet_size),
 	m_timeout(timeout),
 	m_max_data_packets_per_iteration(g_settings->getU16(MPPI_SETTING))
@@ -95,7 +96,7 @@ void *ConnectionSendThread::run()
 
 		m_iteration_packets_avaialble = m_max_data_packets_per_iteration;
 		const auto &calculate_quota = [&] () -> u32 {
-			u32 numpeers = m_connection->getActiveCount();
+			u32 numpeers = m_connection->getActiveCount(m_shard);
 			if (numpeers > 0)
 				return MYMAX(1, m_iteration_packets_avaialble / numpeers);
 			return m_iteration_packets_avaialble;
@@ -110,19 +111,22 @@ void *ConnectionSendThread::run()
 		}
 
 		/* translate commands to packets */
-		auto c = m_connection->m_command_queue.pop_frontNoEx(0);
+		auto c = m_command_queue.pop_frontNoEx(0);
 		while (c && c->type != CONNCMD_NONE) {
 			if (c->reliable)
 				processReliableCommand(c);
 			else
 				processNonReliableCommand(c);
 
-			c = m_connection->m_command_queue.pop_frontNoEx(0);
+			c = m_command_queue.pop_frontNoEx(0);
 		}
 
 		/* send queued packets */
 		sendPackets(dtime, calculate_quota());
 
+		/* hand everything to the socket at once */
+		flushSends();
+
 		END_DEBUG_EXCEPTION_HANDLER
 	}
 
@@ -135,9 +139,15 @@ void ConnectionSendThread::Trigger()
 	m_send_sleep_semaphore.post();
 }
 
+void ConnectionSendThread::putCommand(const ConnectionCommandPtr &c)
+{
+	m_command_queue.push_back(c);
+	Trigger();
+}
+
 bool ConnectionSendThread::packetsQueued()
 {
-	std::vector<session_t> peerIds = m_connection->getPeerIDs();
+	std::vector<session_t> peerIds = m_connection->getPeerIDs(m_shard);
 
 	if (!m_outgoing_queue.empty() && !peerIds.empty())
 		return true;
@@ -165,7 +175,7 @@ bool ConnectionSendThread::packetsQueued()
 void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 {
 	std::vector<session_t> timeouted_peers;
-	std::vector<session_t> peerIds = m_connection->getPeerIDs();
+	std::vector<session_t> peerIds = m_connection->getPeerIDs(m_shard);
 
 	for (const session_t peerId : peerIds) {
 		PeerHelper peer = m_connection->getPeerNoEx(peerId);
@@ -183,7 +193,7 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 		PROFILE(ScopeProfiler
 		peerprofiler(g_profiler, peerIdentifier.str(), SPT_AVG));
 
-		SharedBuffer<u8> data(2); // data for sending ping, required here because of goto
+		PacketBuffer data(2); // data for sending ping, required here because of goto
 
 		/*
 			Check peer timeout
@@ -239,7 +249,7 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 				m_iteration_packets_avaialble = 0;
 
 			for (const auto &k : timed_outs)
-				resendReliable(channel, k.get(), resend_timeout);
+				resendReliable(channel, k, resend_timeout);
 
 			auto ws_old = channel.getWindowSize();
 			channel.UpdateTimers(dtime);
@@ -269,9 +279,10 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 	}
 }
 
-void ConnectionSendThread::resendReliable(Channel &channel, const BufferedPacket *k, float resend_timeout)
+void ConnectionSendThread::resendReliable(Channel &channel,
+	const ConstSharedPtr<BufferedPacket> &k, float resend_timeout)
 {
-	assert(k);
+	assert(k.get());
 	u8 channelnum = readChannel(k->data);
 	u16 seqnum = k->getSeqnum();
 
@@ -296,19 +307,32 @@ void ConnectionSendThread::resendReliable(Channel &channel, const BufferedPacket
 	// lost or really takes more time to transmit
 }
 
-void ConnectionSendThread::rawSend(const BufferedPacket *p)
+void ConnectionSendThread::rawSend(const ConstSharedPtr<BufferedPacket> &p)
 {
-	assert(p);
-	try {
-		m_connection->m_udpSocket.Send(p->address, p->data, p->size());
-		//LOG(dout_con << m_connection->getDesc()
-		//	<< " rawSend: " << p->size()
-		//	<< " bytes sent" << std::endl);
-	} catch (SendFailedException &e) {
+	assert(p.get());
+	// Keep the packet alive until it is sent, it might be acked meanwhile
+	m_send_batch.push_back(p);
+	if (m_send_batch.size() >= UDPSocket::BATCH_SIZE)
+		flushSends();
+}
+
+void ConnectionSendThread::flushSends()
+{
+	if (m_send_batch.empty())
+		return;
+
+	m_send_batch_packets.clear();
+	for (const auto &p : m_send_batch)
+		m_send_batch_packets.push_back({p->address, p->data, (int)p->size()});
+
+	int sent = m_connection->m_udpSocket.SendMany(m_send_batch_packets.data(),
+		m_send_batch_packets.size());
+	if (sent < (int)m_send_batch_packets.size()) {
 		LOG(derr_con << m_connection->getDesc()
-			<< "SendFailedException: " << e.what() << " to "
-			<< p->address.serializeString() << std::endl);
+			<< "Failed to send " << (m_send_batch_packets.size() - sent)
+			<< " of " << m_send_batch_packets.size() << " packets" << std::endl);
 	}
+	m_send_batch.clear();
 }
 
 void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *channel)
@@ -328,11 +352,11 @@ void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *c
 	}
 
 	// Send the packet
-	rawSend(p.get());
+	rawSend(p);
 }
 
 bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
-	const SharedBuffer<u8> &data, bool reliable)
+	const PacketBuffer &data, bool reliable)
 {
 	PeerHelper peer = m_connection->getPeerNoEx(peer_id);
 	if (!peer) {
@@ -350,7 +374,7 @@ bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
 		if (!have_seqnum)
 			return false;
 
-		SharedBuffer<u8> reliable = makeReliablePacket(data, seqnum);
+		PacketBuffer reliable = makeReliablePacket(data, seqnum);
 
 		// Add base headers and make a packet
 		BufferedPacketPtr p = con::makePacket(peer->getAddress(), reliable,
@@ -381,7 +405,7 @@ bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
 		channelnum);
 
 	// Send the packet
-	rawSend(p.get());
+	rawSend(p);
 	return true;
 }
 
@@ -428,7 +452,7 @@ void ConnectionSendThread::processReliableCommand(ConnectionCommandPtr &c)
 			auto list = channel.outgoing_reliables_sent.getResend(0, 1);
 
 			if (!list.empty())
-				resendReliable(channel, list.front().get(), -1);
+				resendReliable(channel, list.front(), -1);
 
 			return;
 		}
@@ -549,13 +573,13 @@ void ConnectionSendThread::disconnect()
 	LOG(dout_con << m_connection->getDesc() << " disconnecting" << std::endl);
 
 	// Create and send DISCO packet
-	SharedBuffer<u8> data(2);
+	PacketBuffer data(2);
 	writeU8(&data[0], PACKET_TYPE_CONTROL);
 	writeU8(&data[1], CONTROLTYPE_DISCO);
 
 
 	// Send to all
-	std::vector<session_t> peerids = m_connection->getPeerIDs();
+	std::vector<session_t> peerids = m_connection->getPeerIDs(m_shard);
 
 	for (session_t peerid : peerids) {
 		sendAsPacket(peerid, 0, data, false);
@@ -567,7 +591,7 @@ void ConnectionSendThread::disconnect_peer(session_t peer_id)
 	LOG(dout_con << m_connection->getDesc() << " disconnecting peer" << std::endl);
 
 	// Create and send DISCO packet
-	SharedBuffer<u8> data(2);
+	PacketBuffer data(2);
 	writeU8(&data[0], PACKET_TYPE_CONTROL);
 	writeU8(&data[1], CONTROLTYPE_DISCO);
 	sendAsPacket(peer_id, 0, data, false);
@@ -586,7 +610,7 @@ void ConnectionSendThread::disconnect_peer(session_t peer_id)
 
 void ConnectionSendThread::fix_peer_id(session_t own_peer_id)
 {
-	auto peer_ids = m_connection->getPeerIDs();
+	auto peer_ids = m_connection->getPeerIDs(m_shard);
 	for (const session_t peer_id : peer_ids) {
 		PeerHelper peer = m_connection->getPeerNoEx(peer_id);
 		if (!peer)
@@ -605,7 +629,7 @@ void ConnectionSendThread::fix_peer_id(session_t own_peer_id)
 }
 
 void ConnectionSendThread::send(session_t peer_id, u8 channelnum,
-	const SharedBuffer<u8> &data)
+	const PacketBuffer &data)
 {
 	assert(channelnum < CHANNEL_COUNT); // Pre-condition
 
@@ -614,24 +638,24 @@ void ConnectionSendThread::send(session_t peer_id, u8 channelnum,
 		LOG(dout_con << m_connection->getDesc() << " peer: peer_id=" << peer_id
 			<< ">>>NOT<<< found on sending packet"
 			<< ", channel " << (channelnum % 0xFF)
-			<< ", size: " << data.getSize() << std::endl);
+			<< ", size: " << data.size() << std::endl);
 		return;
 	}
 
 	LOG(dout_con << m_connection->getDesc() << " sending to peer_id=" << peer_id
 		<< ", channel " << (channelnum % 0xFF)
-		<< ", size: " << data.getSize() << std::endl);
+		<< ", size: " << data.size() << std::endl);
 
 	u16 split_sequence_number = peer->getNextSplitSequenceNumber(channelnum);
 
 	u32 chunksize_max = m_max_packet_size - BASE_HEADER_SIZE;
-	std::list<SharedBuffer<u8>> originals;
+	std::list<PacketBuffer> originals;
 
 	makeAutoSplitPacket(data, chunksize_max, split_sequence_number, &originals);
 
 	peer->setNextSplitSequenceNumber(channelnum, split_sequence_number);
 
-	for (const SharedBuffer<u8> &original : originals) {
+	for (const PacketBuffer &original : originals) {
 		sendAsPacket(peer_id, channelnum, original);
 	}
 }
@@ -645,9 +669,9 @@ void ConnectionSendThread::sendReliable(ConnectionCommandPtr &c)
 	peer->PutReliableSendCommand(c, m_max_packet_size);
 }
 
-void ConnectionSendThread::sendToAll(u8 channelnum, const SharedBuffer<u8> &data)
+void ConnectionSendThread::sendToAll(u8 channelnum, const PacketBuffer &data)
 {
-	std::vector<session_t> peerids = m_connection->getPeerIDs();
+	std::vector<session_t> peerids = m_connection->getPeerIDs(m_shard);
 
 	for (session_t peerid : peerids) {
 		send(peerid, channelnum, data);
@@ -656,7 +680,7 @@ void ConnectionSendThread::sendToAll(u8 channelnum, const SharedBuffer<u8> &data
 
 void ConnectionSendThread::sendToAllReliable(ConnectionCommandPtr &c)
 {
-	std::vector<session_t> peerids = m_connection->getPeerIDs();
+	std::vector<session_t> peerids = m_connection->getPeerIDs(m_shard);
 
 	for (session_t peerid : peerids) {
 		PeerHelper peer = m_connection->getPeerNoEx(peerid);
@@ -670,7 +694,7 @@ void ConnectionSendThread::sendToAllReliable(ConnectionCommandPtr &c)
 
 void ConnectionSendThread::sendPackets(float dtime, u32 peer_packet_quota)
 {
-	std::vector<session_t> peerIds = m_connection->getPeerIDs();
+	std::vector<session_t> peerIds = m_connection->getPeerIDs(m_shard);
 	std::vector<session_t> pendingDisconnect;
 	std::map<session_t, bool> pending_unreliable;
 
@@ -781,7 +805,7 @@ void ConnectionSendThread::sendPackets(float dtime, u32 peer_packet_quota)
 				<< " Outgoing queue: peer_id=" << packet.peer_id
 				<< ">>>NOT<<< found on sending packet"
 				<< ", channel " << (packet.channelnum % 0xFF)
-				<< ", size: " << packet.data.getSize() << std::endl);
+				<< ", size: " << packet.data.size() << std::endl);
 			continue;
 		}
 
@@ -818,14 +842,15 @@ void ConnectionSendThread::sendPackets(float dtime, u32 peer_packet_quota)
 }
 
 void ConnectionSendThread::sendAsPacket(session_t peer_id, u8 channelnum,
-	const SharedBuffer<u8> &data, bool ack)
+	const PacketBuffer &data, bool ack)
 {
 	OutgoingPacket packet(peer_id, channelnum, data, false, ack);
 	m_outgoing_queue.push(packet);
 }
 
-ConnectionReceiveThread::ConnectionReceiveThread() :
-	Thread("ConnectionReceive")
+ConnectionReceiveThread::ConnectionReceiveThread(u32 shard) :
+	Thread("ConnectionReceive"),
+	m_shard(shard)
 {
 }
 
@@ -844,7 +869,8 @@ void *ConnectionReceiveThread::run()
 	// theoretical reliable upper boundary of a udp packet for all IPv6 enabled
 	// infrastructure
 	const unsigned int packet_maxsize = 1500;
-	SharedBuffer<u8> packetdata(packet_maxsize);
+	std::vector<u8> packetdata(packet_maxsize * UDPSocket::BATCH_SIZE);
+	std::vector<UDPSocket::IncomingPacket> packets(UDPSocket::BATCH_SIZE);
 
 	bool packet_queued = true;
 
@@ -866,14 +892,22 @@ void *ConnectionReceiveThread::run()
 #endif
 
 		/* receive packets */
-		receive(packetdata, packet_queued);
+		if (m_shard == 0) {
+			for (size_t i = 0; i < packets.size(); i++) {
+				packets[i].data = &packetdata[i * packet_maxsize];
+				packets[i].size = packet_maxsize;
+			}
+			receive(packets, packet_queued);
+		} else {
+			receiveForwarded(packet_queued);
+		}
 
 #ifdef DEBUG_CONNECTION_KBPS
 		debug_print_timer += dtime;
 		if (debug_print_timer > 20.0) {
 			debug_print_timer -= 20.0;
 
-			std::vector<session_t> peerids = m_connection->getPeerIDs();
+			std::vector<session_t> peerids = m_connection->getPeerIDs(m_shard);
 
 			for (auto id : peerids)
 			{
@@ -926,35 +960,72 @@ void *ConnectionReceiveThread::run()
 }
 
 // Receive packets from the network and buffers and create ConnectionEvents
-void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
+void ConnectionReceiveThread::receive(std::vector<UDPSocket::IncomingPacket> &packets,
 		bool &packet_queued)
 {
+	processBuffers(packet_queued);
+
+	// Wait for incoming data and take everything that is there
+	int count = m_connection->m_udpSocket.ReceiveMany(packets.data(),
+		packets.size());
+
+	for (int i = 0; i < count; i++) {
+		if (i > 0)
+			processBuffers(packet_queued);
+		receivePacket(packets[i].sender, (u8 *)packets[i].data,
+			packets[i].size, packet_queued);
+	}
+}
+
+void ConnectionReceiveThread::receiveForwarded(bool &packet_queued)
+{
+	processBuffers(packet_queued);
+
+	// Same wait as for the socket
+	auto packet = m_forwarded.pop_frontNoEx(500);
+	while (packet) {
+		processPeerPacket(*packet, packet_queued);
+		packet = m_forwarded.pop_frontNoEx(0);
+		if (packet)
+			processBuffers(packet_queued);
+	}
+}
+
+void ConnectionReceiveThread::putPacket(std::unique_ptr<ForwardedPacket> packet)
+{
+	m_forwarded.push_back(std::move(packet));
+}
+
+void ConnectionReceiveThread::processBuffers(bool &packet_queued)
+{
+	// See if there any buffered packets we can process now
+	if (!packet_queued)
+		return;
+
 	try {
-		// First, see if there any buffered packets we can process now
-		if (packet_queued) {
-			session_t peer_id;
-			SharedBuffer<u8> resultdata;
-			while (true) {
-				try {
-					if (!getFromBuffers(peer_id, resultdata))
-						break;
-
-					m_connection->putEvent(ConnectionEvent::dataReceived(peer_id, resultdata));
-				}
-				catch (ProcessedSilentlyException &e) {
-					/* try reading again */
-				}
+		session_t peer_id;
+		SharedBuffer<u8> resultdata;
+		while (true) {
+			try {
+				if (!getFromBuffers(peer_id, resultdata))
+					break;
+
+				m_connection->putEvent(ConnectionEvent::dataReceived(peer_id, resultdata));
+			}
+			catch (ProcessedSilentlyException &e) {
+				/* try reading again */
 			}
-			packet_queued = false;
 		}
+		packet_queued = false;
+	}
+	catch (InvalidIncomingDataException &e) {
+	}
+}
 
-		// Call Receive() to wait for incoming data
-		Address sender;
-		s32 received_size = m_connection->m_udpSocket.Receive(sender,
-			*packetdata, packetdata.getSize());
-		if (received_size < 0)
-			return;
-
+void ConnectionReceiveThread::receivePacket(const Address &sender,
+		const u8 *packetdata, s32 received_size, bool &packet_queued)
+{
+	try {
 		if ((received_size < BASE_HEADER_SIZE) ||
 				(readU32(&packetdata[0]) != m_connection->GetProtocolID())) {
 			LOG(derr_con << m_connection->getDesc()
@@ -966,8 +1037,8 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 			return;
 		}
 
-		session_t peer_id = readPeerId(*packetdata);
-		u8 channelnum = readChannel(*packetdata);
+		session_t peer_id = readPeerId(packetdata);
+		u8 channelnum = readChannel(packetdata);
 
 		if (channelnum >= CHANNEL_COUNT) {
 			LOG(derr_con << m_connection->getDesc()
@@ -1007,6 +1078,32 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 			}
 		}
 
+		// Make a new SharedBuffer from the data without the base headers
+		SharedBuffer<u8> strippeddata(received_size - BASE_HEADER_SIZE);
+		memcpy(*strippeddata, &packetdata[BASE_HEADER_SIZE],
+			strippeddata.getSize());
+
+		if (m_connection->getShard(peer_id) != m_shard) {
+			m_connection->forwardPacket(std::unique_ptr<ForwardedPacket>(
+				new ForwardedPacket{sender, peer_id, knew_peer_id, channelnum,
+					(u32)received_size, strippeddata}));
+			return;
+		}
+
+		processPeerPacket({sender, peer_id, knew_peer_id, channelnum,
+			(u32)received_size, strippeddata}, packet_queued);
+	}
+	catch (InvalidIncomingDataException &e) {
+	}
+}
+
+void ConnectionReceiveThread::processPeerPacket(const ForwardedPacket &packet,
+		bool &packet_queued)
+{
+	const session_t peer_id = packet.peer_id;
+	const u8 channelnum = packet.channelnum;
+
+	try {
 		PeerHelper peer = m_connection->getPeerNoEx(peer_id);
 		if (!peer) {
 			LOG(dout_con << m_connection->getDesc()
@@ -1017,14 +1114,14 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 
 		// Validate peer address
 
-		if (sender != peer->getAddress()) {
+		if (packet.sender != peer->getAddress()) {
 			LOG(derr_con << m_connection->getDesc()
 				<< " Peer " << peer_id << " sending from different address."
 				" Ignoring." << std::endl);
 			return;
 		}
 
-		if (knew_peer_id) {
+		if (packet.knew_peer_id) {
 			peer->SetFullyOpen();
 			// Setup phase has a fixed timeout
 			peer->ResetTimeout();
@@ -1046,19 +1143,13 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 		}
 		Channel *channel = &udpPeer->channels[channelnum];
 
-		channel->UpdateBytesReceived(received_size);
+		channel->UpdateBytesReceived(packet.received_size);
 
 		// Throw the received packet to channel->processPacket()
-
-		// Make a new SharedBuffer from the data without the base headers
-		SharedBuffer<u8> strippeddata(received_size - BASE_HEADER_SIZE);
-		memcpy(*strippeddata, &packetdata[BASE_HEADER_SIZE],
-			strippeddata.getSize());
-
 		try {
 			// Process it (the result is some data with no headers made by us)
 			SharedBuffer<u8> resultdata = processPacket
-				(channel, strippeddata, peer_id, channelnum, false);
+				(channel, packet.data, peer_id, channelnum, false);
 
 			LOG(dout_con << m_connection->getDesc()
 				<< " ProcessPacket from peer_id: " << peer_id
@@ -1083,7 +1174,7 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 
 bool ConnectionReceiveThread::getFromBuffers(session_t &peer_id, SharedBuffer<u8> &dst)
 {
-	std::vector<session_t> peerids = m_connection->getPeerIDs();
+	std::vector<session_t> peerids = m_connection->getPeerIDs(m_shard);
 
 	for (session_t peerid : peerids) {
 		PeerHelper peer = m_connection->getPeerNoEx(peerid);
@@ -1225,7 +1316,7 @@ SharedBuffer<u8> ConnectionReceiveThread::handlePacketType_Control(Channel *chan
 			// put bytes for max bandwidth calculation
 			channel->UpdateBytesSent(p->size(), 1);
 			if (channel->outgoing_reliables_sent.size() == 0)
-				m_connection->TriggerSend();
+				m_connection->TriggerSend(peer->id);
 		} catch (NotFoundException &e) {
 			LOG(derr_con << m_connection->getDesc()
 				<< "WARNING: ACKed packet not in outgoing queue"
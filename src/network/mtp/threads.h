@@ -22,11 +22,11 @@ struct OutgoingPacket
 {
 	session_t peer_id;
 	u8 channelnum;
-	SharedBuffer<u8> data;
+	PacketBuffer data;
 	bool reliable;
 	bool ack;
 
-	OutgoingPacket(session_t peer_id_, u8 channelnum_, const SharedBuffer<u8> &data_,
+	OutgoingPacket(session_t peer_id_, u8 channelnum_, const PacketBuffer &data_,
 			bool reliable_,bool ack_=false):
 		peer_id(peer_id_),
 		channelnum(channelnum_),
@@ -37,18 +37,34 @@ struct OutgoingPacket
 	}
 };
 
+// Received packet that is passed from the thread reading the socket to the
+// receive thread of the peer's shard
+struct ForwardedPacket
+{
+	Address sender;
+	session_t peer_id;
+	bool knew_peer_id;
+	u8 channelnum;
+	// Size as received, including the base header
+	u32 received_size;
+	// Data without the base header
+	SharedBuffer<u8> data;
+};
+
 class ConnectionSendThread : public Thread
 {
 
 public:
 	friend class UDPPeer;
 
-	ConnectionSendThread(unsigned int max_packet_size, float timeout);
+	ConnectionSendThread(unsigned int max_packet_size, float timeout, u32 shard);
 
 	void *run();
 
 	void Trigger();
 
+	void putCommand(const ConnectionCommandPtr &c);
+
 	void setParent(Connection *parent)
 	{
 		assert(parent != NULL); // Pre-condition
@@ -59,10 +75,14 @@ class ConnectionSendThread : public Thread
 
 private:
 	void runTimeouts(float dtime, u32 peer_packet_quota);
-	void resendReliable(Channel &channel, const BufferedPacket *k, float resend_timeout);
-	void rawSend(const BufferedPacket *p);
+	void resendReliable(Channel &channel,
+			const ConstSharedPtr<BufferedPacket> &k, float resend_timeout);
+	// Queues the packet for sending, see flushSends()
+	void rawSend(const ConstSharedPtr<BufferedPacket> &p);
+	// Sends the packets queued by rawSend() with as few system calls as possible
+	void flushSends();
 	bool rawSendAsPacket(session_t peer_id, u8 channelnum,
-			const SharedBuffer<u8> &data, bool reliable);
+			const PacketBuffer &data, bool reliable);
 
 	void processReliableCommand(ConnectionCommandPtr &c);
 	void processNonReliableCommand(ConnectionCommandPtr &c);
@@ -71,14 +91,14 @@ class ConnectionSendThread : public Thread
 	void disconnect();
 	void disconnect_peer(session_t peer_id);
 	void fix_peer_id(session_t own_peer_id);
-	void send(session_t peer_id, u8 channelnum, const SharedBuffer<u8> &data);
+	void send(session_t peer_id, u8 channelnum, const PacketBuffer &data);
 	void sendReliable(ConnectionCommandPtr &c);
-	void sendToAll(u8 channelnum, const SharedBuffer<u8> &data);
+	void sendToAll(u8 channelnum, const PacketBuffer &data);
 	void sendToAllReliable(ConnectionCommandPtr &c);
 
 	void sendPackets(float dtime, u32 peer_packet_quota);
 
-	void sendAsPacket(session_t peer_id, u8 channelnum, const SharedBuffer<u8> &data,
+	void sendAsPacket(session_t peer_id, u8 channelnum, const PacketBuffer &data,
 			bool ack = false);
 
 	void sendAsPacketReliable(BufferedPacketPtr &p, Channel *channel);
@@ -86,9 +106,15 @@ class ConnectionSendThread : public Thread
 	bool packetsQueued();
 
 	Connection *m_connection = nullptr;
+	// Only the peers of this shard are handled
+	const u32 m_shard;
 	unsigned int m_max_packet_size;
 	float m_timeout;
+	// Command queue: user -> SendThread
+	MutexedQueue<ConnectionCommandPtr> m_command_queue;
 	std::queue<OutgoingPacket> m_outgoing_queue;
+	std::vector<ConstSharedPtr<BufferedPacket>> m_send_batch;
+	std::vector<UDPSocket::OutgoingPacket> m_send_batch_packets;
 	Semaphore m_send_sleep_semaphore;
 
 	unsigned int m_iteration_packets_avaialble;
@@ -99,10 +125,13 @@ class ConnectionSendThread : public Thread
 class ConnectionReceiveThread : public Thread
 {
 public:
-	ConnectionReceiveThread();
+	ConnectionReceiveThread(u32 shard);
 
 	void *run();
 
+	// Queues a packet of a peer of this shard, see Connection::forwardPacket()
+	void putPacket(std::unique_ptr<ForwardedPacket> packet);
+
 	void setParent(Connection *parent)
 	{
 		assert(parent); // Pre-condition
@@ -110,7 +139,17 @@ class ConnectionReceiveThread : public Thread
 	}
 
 private:
-	void receive(SharedBuffer<u8> &packetdata, bool &packet_queued);
+	void receive(std::vector<UDPSocket::IncomingPacket> &packets,
+			bool &packet_queued);
+	// Creates events for buffered packets that are ready now
+	void processBuffers(bool &packet_queued);
+	// Waits for packets forwarded by the first shard and handles them
+	void receiveForwarded(bool &packet_queued);
+	// Handles a packet as received from the socket
+	void receivePacket(const Address &sender, const u8 *packetdata,
+			s32 received_size, bool &packet_queued);
+	// Handles a packet of a peer of this shard
+	void processPeerPacket(const ForwardedPacket &packet, bool &packet_queued);
 
 	// Returns next data from a buffer if possible
 	// If found, returns true; if not, false.
@@ -170,6 +209,10 @@ class ConnectionReceiveThread : public Thread
 	static const PacketTypeHandler packetTypeRouter[PACKET_TYPE_MAX];
 
 	Connection *m_connection = nullptr;
+	// Only the peers of this shard are handled. The first shard also reads
+	// the socket and forwards the packets of the other shards.
+	const u32 m_shard;
+	MutexedQueue<std::unique_ptr<ForwardedPacket>> m_forwarded;
 
 	RateLimitHelper m_new_peer_ratelimit;
 };
@@ -509,6 +509,19 @@ NetworkPacket& NetworkPacket::operator<<(video::SColor src)
 	return *this;
 }
 
+PacketBuffer NetworkPacket::forgePacket()
+{
+	// this is the dummy packet used to first contact the server
+	if (m_command == 0) {
+		assert(m_datasize == 0);
+		return PacketBuffer();
+	}
+
+	PacketBuffer buf(m_data);
+	writeU16(buf.prepend(2), m_command);
+	return buf;
+}
+
 Buffer<u8> NetworkPacket::oldForgePacket()
 {
 	// this is the dummy packet used to first contact the server
@@ -7,6 +7,7 @@
 #include "util/pointer.h" // Buffer<T>
 #include "irrlichttypes_bloated.h"
 #include "networkprotocol.h"
+#include "packetbuffer.h"
 #include <SColor.h>
 #include <string>
 #include <string_view>
@@ -122,19 +123,26 @@ class NetworkPacket
 	// ^ this comment has been here for 7 years
 	Buffer<u8> oldForgePacket();
 
+	// Returns the command and data as sent over the network.
+	// The memory is shared with the packet unless it has been sent before.
+	PacketBuffer forgePacket();
+
 private:
 	void checkReadOffset(u32 from_offset, u32 field_size) const;
 
 	// resize data buffer for writing
+	// and copy it if it is still used by a packet being sent
 	inline void checkDataSize(u32 field_size)
 	{
 		if (m_read_offset + field_size > m_datasize) {
 			m_datasize = m_read_offset + field_size;
 			m_data.resize(m_datasize);
+		} else if (!m_data.unique()) {
+			m_data.makeUnique();
 		}
 	}
 
-	std::vector<u8> m_data;
+	PacketBuffer m_data;
 	u32 m_datasize = 0;
 	u32 m_read_offset = 0; // read and write offset
 	u16 m_command = 0;
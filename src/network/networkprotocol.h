@@ -79,6 +79,25 @@ enum ToClientCommand : u16
 		v3s16 position
 	*/
 
+	TOCLIENT_BLOCKDATA_DIFF = 0x23,
+	/*
+		Updates a block that the client already has, to be handled like
+		TOCLIENT_BLOCKDATA. The changes are relative to the last version of
+		the block that was sent, including single node changes.
+		v3s16 position
+		compressed:
+			u8 flags (like in a serialized MapBlock)
+			u16 lighting_complete
+			u16 count
+			u16[count] node indices (ascending)
+			u16[count] param0
+			u8[count] param1
+			u8[count] param2
+			u8 has_metadata
+			if has_metadata:
+				serialized node metadata of the whole block
+	*/
+
 	TOCLIENT_INVENTORY = 0x27,
 	/*
 		serialized inventory
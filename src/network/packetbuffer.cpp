@@ -0,0 +1,215 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "packetbuffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// Buffers of up to 64 KiB are pooled, by powers of two starting at 64 bytes
+#define POOL_MIN_SHIFT 6
+#define POOL_MAX_SHIFT 16
+// Memory kept per size class
+#define POOL_BYTES_PER_CLASS (1024 * 1024)
+
+static std::atomic<u64> g_allocation_count{0};
+
+class PacketBufferPool
+{
+public:
+	using Storage = PacketBuffer::Storage;
+
+	static PacketBufferPool &get()
+	{
+		// never destroyed, buffers might still be dropped on exit
+		static PacketBufferPool *pool = new PacketBufferPool();
+		return *pool;
+	}
+
+	Storage *acquire(u32 capacity)
+	{
+		const int cls = sizeClass(capacity);
+		if (cls >= 0) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto &list = m_free[cls];
+			if (!list.empty()) {
+				Storage *s = list.back();
+				list.pop_back();
+				s->refcount.store(1, std::memory_order_relaxed);
+				return s;
+			}
+			capacity = 1U << (cls + POOL_MIN_SHIFT);
+		}
+
+		g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+		Storage *s = new Storage();
+		s->refcount.store(1, std::memory_order_relaxed);
+		s->capacity = capacity;
+		s->bytes = new u8[capacity];
+		return s;
+	}
+
+	void release(Storage *s)
+	{
+		const int cls = sizeClass(s->capacity);
+		if (cls >= 0 && s->capacity == 1U << (cls + POOL_MIN_SHIFT)) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto &list = m_free[cls];
+			if (list.size() < (POOL_BYTES_PER_CLASS >> (cls + POOL_MIN_SHIFT)) + 4) {
+				list.push_back(s);
+				return;
+			}
+		}
+		delete[] s->bytes;
+		delete s;
+	}
+
+private:
+	// @return index of the smallest pooled size that fits, -1 if too large
+	static int sizeClass(u32 capacity)
+	{
+		int shift = POOL_MIN_SHIFT;
+		while ((1U << shift) < capacity) {
+			if (++shift > POOL_MAX_SHIFT)
+				return -1;
+		}
+		return shift - POOL_MIN_SHIFT;
+	}
+
+	std::mutex m_mutex;
+	std::vector<Storage *> m_free[POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1];
+};
+
+PacketBuffer::PacketBuffer(u32 size, u32 headroom)
+{
+	m_storage = PacketBufferPool::get().acquire(headroom + size);
+	m_storage->front.store(headroom, std::memory_order_relaxed);
+	m_begin = headroom;
+	m_size = size;
+}
+
+PacketBuffer::PacketBuffer(const u8 *data, u32 size, u32 headroom) :
+	PacketBuffer(size, headroom)
+{
+	if (size > 0)
+		memcpy(this->data(), data, size);
+}
+
+PacketBuffer::PacketBuffer(const PacketBuffer &other) :
+	m_storage(other.m_storage),
+	m_begin(other.m_begin),
+	m_size(other.m_size)
+{
+	if (m_storage)
+		m_storage->refcount.fetch_add(1, std::memory_order_relaxed);
+}
+
+PacketBuffer::PacketBuffer(PacketBuffer &&other) noexcept :
+	m_storage(other.m_storage),
+	m_begin(other.m_begin),
+	m_size(other.m_size)
+{
+	other.m_storage = nullptr;
+	other.m_begin = other.m_size = 0;
+}
+
+PacketBuffer &PacketBuffer::operator=(const PacketBuffer &other)
+{
+	if (this != &other) {
+		PacketBuffer copy(other);
+		*this = std::move(copy);
+	}
+	return *this;
+}
+
+PacketBuffer &PacketBuffer::operator=(PacketBuffer &&other) noexcept
+{
+	if (this != &other) {
+		drop();
+		m_storage = other.m_storage;
+		m_begin = other.m_begin;
+		m_size = other.m_size;
+		other.m_storage = nullptr;
+		other.m_begin = other.m_size = 0;
+	}
+	return *this;
+}
+
+void PacketBuffer::drop()
+{
+	if (m_storage && m_storage->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		PacketBufferPool::get().release(m_storage);
+	m_storage = nullptr;
+}
+
+void PacketBuffer::makeUnique()
+{
+	if (!m_storage)
+		return;
+	if (unique()) {
+		// nobody else can be using the space in front anymore
+		m_storage->front.store(m_begin, std::memory_order_relaxed);
+		return;
+	}
+	*this = PacketBuffer(data(), m_size);
+}
+
+void PacketBuffer::reserve(u32 capacity)
+{
+	makeUnique();
+	if (m_storage && m_begin + capacity <= m_storage->capacity)
+		return;
+
+	// grow exponentially, so that appending is cheap
+	u32 new_capacity = capacity;
+	if (m_storage)
+		new_capacity = std::max(capacity, (m_storage->capacity - m_begin) * 2);
+	PacketBuffer copy(new_capacity, m_storage ? m_begin : HEADROOM);
+	if (m_size > 0)
+		memcpy(copy.data(), data(), m_size);
+	copy.m_size = m_size;
+	*this = std::move(copy);
+}
+
+void PacketBuffer::resize(u32 size)
+{
+	reserve(size);
+	m_size = size;
+}
+
+void PacketBuffer::clear()
+{
+	if (unique()) {
+		m_size = 0;
+		makeUnique();
+	} else {
+		drop();
+		m_begin = m_size = 0;
+	}
+}
+
+u8 *PacketBuffer::prepend(u32 count)
+{
+	u32 expected = m_begin;
+	if (!m_storage || m_begin < count ||
+			!m_storage->front.compare_exchange_strong(expected, m_begin - count,
+				std::memory_order_relaxed)) {
+		*this = PacketBuffer(data(), m_size, std::max(count, HEADROOM));
+		expected = m_begin;
+		bool ok = m_storage->front.compare_exchange_strong(expected,
+			m_begin - count, std::memory_order_relaxed);
+		assert(ok);
+		(void)ok;
+	}
+	m_begin -= count;
+	m_size += count;
+	return data();
+}
+
+u64 PacketBuffer::getAllocationCount()
+{
+	return g_allocation_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,84 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include <atomic>
+
+/*
+	Reference-counted buffer for outgoing network packets.
+
+	Space is kept in front of the data, so that the connection can put its
+	headers there instead of copying the packet for each header it adds.
+	Only one packet may use that space: the first reference that calls
+	prepend() gets it, the others have to copy the data. If the references
+	are not to be written to, they can be shared between threads.
+
+	The memory is recycled through a pool.
+*/
+class PacketBuffer
+{
+public:
+	// Space in front of new buffers, enough for all headers of a packet that
+	// is not split: command, original, reliable and base header
+	static constexpr u32 HEADROOM = 16;
+
+	PacketBuffer() = default;
+	// Uninitialized data of the given size
+	explicit PacketBuffer(u32 size, u32 headroom = HEADROOM);
+	// Copies the data
+	PacketBuffer(const u8 *data, u32 size, u32 headroom = HEADROOM);
+
+	PacketBuffer(const PacketBuffer &other);
+	PacketBuffer(PacketBuffer &&other) noexcept;
+	PacketBuffer &operator=(const PacketBuffer &other);
+	PacketBuffer &operator=(PacketBuffer &&other) noexcept;
+	~PacketBuffer() { drop(); }
+
+	u8 *data() const { return m_storage ? m_storage->bytes + m_begin : nullptr; }
+	u32 size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	u8 &operator[](u32 i) const { return data()[i]; }
+
+	// Whether there are no other references to the data
+	bool unique() const
+	{
+		return !m_storage || m_storage->refcount.load(std::memory_order_acquire) == 1;
+	}
+
+	// Copies the data if there are other references, so it can be modified
+	void makeUnique();
+
+	// These copy the data first if there are other references
+	void reserve(u32 capacity);
+	void resize(u32 size);
+	void clear();
+
+	// Extends the data by `count` bytes at the front, for writing a header.
+	// The data is copied if the space in front is missing or already taken.
+	// @return pointer to the new front
+	u8 *prepend(u32 count);
+
+	// Number of times memory was allocated for buffers, for benchmarks
+	static u64 getAllocationCount();
+
+private:
+	struct Storage {
+		std::atomic<u32> refcount;
+		// Lowest offset used by any reference, everything in front is free
+		std::atomic<u32> front;
+		u32 capacity;
+		u8 *bytes;
+	};
+
+	void drop();
+
+	Storage *m_storage = nullptr;
+	u32 m_begin = 0;
+	u32 m_size = 0;
+
+	friend class PacketBufferPool;
+};
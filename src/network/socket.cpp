@@ -35,6 +35,13 @@ typedef int socklen_t;
 #define SOCKET_ERR_STR(e) strerror(e)
 #endif
 
+#ifdef __linux__
+// sendmmsg() and recvmmsg()
+#define HAVE_MMSG 1
+#else
+#define HAVE_MMSG 0
+#endif
+
 static bool g_sockets_initialized = false;
 
 // Initialize sockets
@@ -62,6 +69,35 @@ void sockets_cleanup()
 	UDPSocket
 */
 
+static socklen_t to_sockaddr(const Address &addr, sockaddr_storage &storage)
+{
+	memset(&storage, 0, sizeof(storage));
+	if (addr.getFamily() == AF_INET6) {
+		auto *address = reinterpret_cast<sockaddr_in6 *>(&storage);
+		address->sin6_family = AF_INET6;
+		address->sin6_addr = addr.getAddress6();
+		address->sin6_port = htons(addr.getPort());
+		return sizeof(sockaddr_in6);
+	}
+	auto *address = reinterpret_cast<sockaddr_in *>(&storage);
+	address->sin_family = AF_INET;
+	address->sin_addr = addr.getAddress();
+	address->sin_port = htons(addr.getPort());
+	return sizeof(sockaddr_in);
+}
+
+static Address from_sockaddr(const sockaddr_storage &storage)
+{
+	if (storage.ss_family == AF_INET6) {
+		const auto *address = reinterpret_cast<const sockaddr_in6 *>(&storage);
+		const auto *bytes = reinterpret_cast<const IPv6AddressBytes *>
+			(address->sin6_addr.s6_addr);
+		return Address(bytes, ntohs(address->sin6_port));
+	}
+	const auto *address = reinterpret_cast<const sockaddr_in *>(&storage);
+	return Address(ntohl(address->sin_addr.s_addr), ntohs(address->sin_port));
+}
+
 UDPSocket::UDPSocket(bool ipv6)
 {
 	init(ipv6, false);
@@ -96,6 +132,7 @@ bool UDPSocket::init(bool ipv6, bool noExceptions)
 	}
 
 	setTimeoutMs(0);
+	m_batching = HAVE_MMSG && !INTERNET_SIMULATOR;
 
 	return true;
 }
@@ -182,24 +219,10 @@ void UDPSocket::Send(const Address &destination, const void *data, int size)
 	if (destination.getFamily() != m_addr_family)
 		throw SendFailedException("Address family mismatch");
 
-	int sent;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address = {};
-		address.sin6_family = AF_INET6;
-		address.sin6_addr = destination.getAddress6();
-		address.sin6_port = htons(destination.getPort());
-
-		sent = sendto(m_handle, (const char *)data, size, 0,
-				(struct sockaddr *)&address, sizeof(struct sockaddr_in6));
-	} else {
-		struct sockaddr_in address = {};
-		address.sin_family = AF_INET;
-		address.sin_addr = destination.getAddress();
-		address.sin_port = htons(destination.getPort());
-
-		sent = sendto(m_handle, (const char *)data, size, 0,
-				(struct sockaddr *)&address, sizeof(struct sockaddr_in));
-	}
+	sockaddr_storage address;
+	socklen_t address_len = to_sockaddr(destination, address);
+	int sent = sendto(m_handle, (const char *)data, size, 0,
+			(const sockaddr *)&address, address_len);
 
 	if (sent != size)
 		throw SendFailedException("Failed to send packet");
@@ -212,42 +235,134 @@ int UDPSocket::Receive(Address &sender, void *data, int size)
 	if (!WaitData(m_timeout_ms))
 		return -1;
 
-	size = MYMAX(size, 0);
+	return receiveNow(sender, data, size);
+}
 
-	int received;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address;
-		memset(&address, 0, sizeof(address));
-		socklen_t address_len = sizeof(address);
+int UDPSocket::receiveNow(Address &sender, void *data, int size)
+{
+	size = MYMAX(size, 0);
 
-		received = recvfrom(m_handle, (char *)data, size, 0,
-				(struct sockaddr *)&address, &address_len);
+	sockaddr_storage address;
+	memset(&address, 0, sizeof(address));
+	socklen_t address_len = sizeof(address);
 
-		if (received < 0)
-			return -1;
+	int received = recvfrom(m_handle, (char *)data, size, 0,
+			(sockaddr *)&address, &address_len);
+	if (received < 0)
+		return -1;
 
-		u16 address_port = ntohs(address.sin6_port);
-		const auto *bytes = reinterpret_cast<IPv6AddressBytes*>
-			(address.sin6_addr.s6_addr);
-		sender = Address(bytes, address_port);
-	} else {
-		struct sockaddr_in address;
-		memset(&address, 0, sizeof(address));
+	sender = from_sockaddr(address);
+	return received;
+}
 
-		socklen_t address_len = sizeof(address);
+int UDPSocket::SendMany(const OutgoingPacket *packets, int count)
+{
+	int sent = 0;
+	int i = 0;
+
+#if HAVE_MMSG
+	mmsghdr msgs[BATCH_SIZE];
+	iovec iovs[BATCH_SIZE];
+	sockaddr_storage addresses[BATCH_SIZE];
+
+	while (m_batching && i < count) {
+		// Fill the headers of the next batch, skipping invalid packets
+		const int first = i;
+		int n = 0;
+		for (; i < count && n < BATCH_SIZE; i++) {
+			const OutgoingPacket &packet = packets[i];
+			if (packet.destination.getFamily() != m_addr_family)
+				continue;
+
+			iovs[n].iov_base = const_cast<void *>(packet.data);
+			iovs[n].iov_len = packet.size;
+			memset(&msgs[n], 0, sizeof(mmsghdr));
+			msgs[n].msg_hdr.msg_name = &addresses[n];
+			msgs[n].msg_hdr.msg_namelen =
+				to_sockaddr(packet.destination, addresses[n]);
+			msgs[n].msg_hdr.msg_iov = &iovs[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			n++;
+		}
 
-		received = recvfrom(m_handle, (char *)data, size, 0,
-				(struct sockaddr *)&address, &address_len);
+		int done = 0;
+		while (done < n) {
+			int ret = sendmmsg(m_handle, &msgs[done], n - done, 0);
+			if (ret > 0) {
+				for (int k = done; k < done + ret; k++)
+					sent += msgs[k].msg_len == iovs[k].iov_len;
+				done += ret;
+			} else if (errno == ENOSYS) {
+				// Not supported by the kernel, nothing was sent yet
+				m_batching = false;
+				i = first;
+				break;
+			} else if (errno != EINTR) {
+				// The first packet failed, continue after it
+				done++;
+			}
+		}
+	}
+#endif
 
-		if (received < 0)
-			return -1;
+	for (; i < count; i++) {
+		try {
+			Send(packets[i].destination, packets[i].data, packets[i].size);
+			sent++;
+		} catch (SendFailedException &e) {
+		}
+	}
+	return sent;
+}
 
-		u32 address_ip = ntohl(address.sin_addr.s_addr);
-		u16 address_port = ntohs(address.sin_port);
+int UDPSocket::ReceiveMany(IncomingPacket *packets, int count)
+{
+	assert(m_timeout_ms >= 0);
+	if (count <= 0 || !WaitData(m_timeout_ms))
+		return 0;
+
+#if HAVE_MMSG
+	if (m_batching) {
+		count = MYMIN(count, BATCH_SIZE);
+		mmsghdr msgs[BATCH_SIZE];
+		iovec iovs[BATCH_SIZE];
+		sockaddr_storage addresses[BATCH_SIZE];
+
+		for (int i = 0; i < count; i++) {
+			iovs[i].iov_base = packets[i].data;
+			iovs[i].iov_len = MYMAX(packets[i].size, 0);
+			memset(&msgs[i], 0, sizeof(mmsghdr));
+			msgs[i].msg_hdr.msg_name = &addresses[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
 
-		sender = Address(address_ip, address_port);
+		int received = recvmmsg(m_handle, msgs, count, MSG_DONTWAIT, nullptr);
+		if (received >= 0) {
+			for (int i = 0; i < received; i++) {
+				packets[i].sender = from_sockaddr(addresses[i]);
+				packets[i].size = msgs[i].msg_len;
+			}
+			return received;
+		}
+		if (errno != ENOSYS)
+			return 0;
+		m_batching = false;
 	}
+#endif
 
+	// Only the first packet is waited for
+	int received = 0;
+	for (; received < count; received++) {
+		if (received > 0 && !WaitData(0))
+			break;
+		IncomingPacket &packet = packets[received];
+		int size = receiveNow(packet.sender, packet.data, packet.size);
+		if (size < 0)
+			break;
+		packet.size = size;
+	}
 	return received;
 }
 
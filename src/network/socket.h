@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <ostream>
 #include <cstring>
 #include "address.h"
@@ -16,6 +17,23 @@ void sockets_cleanup();
 class UDPSocket
 {
 public:
+	// Packet for SendMany()
+	struct OutgoingPacket {
+		Address destination;
+		const void *data;
+		int size;
+	};
+
+	// Packet for ReceiveMany(), size is set to the received size
+	struct IncomingPacket {
+		Address sender;
+		void *data;
+		int size;
+	};
+
+	// Largest number of packets that are passed to the OS at once
+	static constexpr int BATCH_SIZE = 64;
+
 	UDPSocket() = default;
 	UDPSocket(bool ipv6); // calls init()
 	~UDPSocket();
@@ -26,6 +44,16 @@ class UDPSocket
 	void Send(const Address &destination, const void *data, int size);
 	// Returns -1 if there is no data
 	int Receive(Address &sender, void *data, int size);
+
+	// Sends several packets with as few system calls as possible.
+	// Packets that fail to send are skipped.
+	// Returns the number of packets that were sent
+	int SendMany(const OutgoingPacket *packets, int count);
+	// Waits for data like Receive(), then receives as many packets as are
+	// available, up to count.
+	// Returns the number of packets received
+	int ReceiveMany(IncomingPacket *packets, int count);
+
 	void setTimeoutMs(int timeout_ms);
 	// Returns true if there is data, false if timeout occurred
 	bool WaitData(int timeout_ms);
@@ -34,7 +62,12 @@ class UDPSocket
 	int GetHandle() const { return m_handle; };
 
 private:
+	// Receives a packet without waiting, returns -1 if there is none
+	int receiveNow(Address &sender, void *data, int size);
+
 	int m_handle = -1;
 	int m_timeout_ms = -1;
 	unsigned short m_addr_family = 0;
+	// Whether sendmmsg()/recvmmsg() can be used
+	std::atomic<bool> m_batching{false};
 };
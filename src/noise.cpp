@@ -27,11 +27,24 @@
 #include "noise.h"
 #include <iostream>
 #include <cstring> // memset
+#include <vector>
 #include "debug.h"
 #include "util/numeric.h"
 #include "util/string.h"
 #include "exceptions.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define NOISE_HAVE_SSE2
+	#include <emmintrin.h>
+	// AVX2 code is compiled in separate functions and only used if the
+	// CPU supports it
+	#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		#define NOISE_HAVE_AVX2
+		#include <immintrin.h>
+		#define NOISE_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
 #define NOISE_MAGIC_X    1619
 #define NOISE_MAGIC_Y    31337
 #define NOISE_MAGIC_Z    52591
@@ -168,23 +181,404 @@ void PcgRandom::setState(const u64 state[2])
 
 ///////////////////////////////////////////////////////////////////////////////
 
-float noise2d(int x, int y, s32 seed)
+// Hash of the lattice coordinates, unsigned to get defined overflow
+static inline u32 lattice_hash(u32 x, u32 y, u32 z, u32 seed)
 {
-	unsigned int n = (NOISE_MAGIC_X * x + NOISE_MAGIC_Y * y
-			+ NOISE_MAGIC_SEED * seed) & 0x7fffffff;
+	return NOISE_MAGIC_X * x + NOISE_MAGIC_Y * y + NOISE_MAGIC_Z * z
+			+ NOISE_MAGIC_SEED * seed;
+}
+
+
+static inline float lattice_value(u32 n)
+{
+	n &= 0x7fffffff;
 	n = (n >> 13) ^ n;
 	n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
 	return 1.f - (float)(int)n / 0x40000000;
 }
 
 
+float noise2d(int x, int y, s32 seed)
+{
+	return lattice_value(lattice_hash(x, y, 0, seed));
+}
+
+
 float noise3d(int x, int y, int z, s32 seed)
 {
-	unsigned int n = (NOISE_MAGIC_X * x + NOISE_MAGIC_Y * y + NOISE_MAGIC_Z * z
-			+ NOISE_MAGIC_SEED * seed) & 0x7fffffff;
-	n = (n >> 13) ^ n;
-	n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
-	return 1.f - (float)(int)n / 0x40000000;
+	return lattice_value(lattice_hash(x, y, z, seed));
+}
+
+///////////////////////// [ Bulk noise kernels ] /////////////////////////////
+
+/*
+	The inner loops of Noise::noiseMap2D/3D, in one version per instruction
+	set. They do the very same floating point operations in the same order,
+	so the results are bit-identical no matter which version is used.
+*/
+struct NoiseKernels {
+	// out[i] = lattice_value(base + NOISE_MAGIC_X * (x0 + i))
+	void (*lattice_row)(float *out, u32 n, s32 x0, u32 base);
+	// out[i] = a + (b - a) * t[i]
+	void (*lerp_const)(float *out, const float *t, float a, float b, u32 n);
+	// out[i] = a[i] + (b[i] - a[i]) * t
+	void (*lerp_rows)(float *out, const float *a, const float *b, float t, u32 n);
+	// lerp_rows() on two pairs of rows, then between the results with t2
+	void (*lerp_rows2)(float *out, const float *a0, const float *b0,
+		const float *a1, const float *b1, float t, float t2, u32 n);
+	// result[i] += g * v[i] (or fabs(v[i]))
+	void (*accumulate)(float *result, const float *v, float g, u32 n, bool absvalue);
+	// result[i] += gmap[i] * v[i] (or fabs(v[i])), gmap[i] *= pmap[i]
+	void (*accumulate_map)(float *result, float *gmap, const float *v,
+		const float *pmap, u32 n, bool absvalue);
+};
+
+static void lattice_row_scalar(float *out, u32 n, s32 x0, u32 base)
+{
+	u32 h = base + NOISE_MAGIC_X * (u32)x0;
+	for (u32 i = 0; i != n; i++, h += NOISE_MAGIC_X)
+		out[i] = lattice_value(h);
+}
+
+static void lerp_const_scalar(float *out, const float *t, float a, float b, u32 n)
+{
+	const float d = b - a;
+	for (u32 i = 0; i != n; i++)
+		out[i] = a + d * t[i];
+}
+
+static void lerp_rows_scalar(float *out, const float *a, const float *b, float t, u32 n)
+{
+	for (u32 i = 0; i != n; i++)
+		out[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+static void lerp_rows2_scalar(float *out, const float *a0, const float *b0,
+	const float *a1, const float *b1, float t, float t2, u32 n)
+{
+	for (u32 i = 0; i != n; i++) {
+		float u = a0[i] + (b0[i] - a0[i]) * t;
+		float v = a1[i] + (b1[i] - a1[i]) * t;
+		out[i] = u + (v - u) * t2;
+	}
+}
+
+static void accumulate_scalar(float *result, const float *v, float g, u32 n,
+	bool absvalue)
+{
+	if (absvalue) {
+		for (u32 i = 0; i != n; i++)
+			result[i] += g * std::fabs(v[i]);
+	} else {
+		for (u32 i = 0; i != n; i++)
+			result[i] += g * v[i];
+	}
+}
+
+static void accumulate_map_scalar(float *result, float *gmap, const float *v,
+	const float *pmap, u32 n, bool absvalue)
+{
+	if (absvalue) {
+		for (u32 i = 0; i != n; i++) {
+			result[i] += gmap[i] * std::fabs(v[i]);
+			gmap[i] *= pmap[i];
+		}
+	} else {
+		for (u32 i = 0; i != n; i++) {
+			result[i] += gmap[i] * v[i];
+			gmap[i] *= pmap[i];
+		}
+	}
+}
+
+static const NoiseKernels noise_kernels_scalar = {
+	lattice_row_scalar,
+	lerp_const_scalar,
+	lerp_rows_scalar,
+	lerp_rows2_scalar,
+	accumulate_scalar,
+	accumulate_map_scalar,
+};
+
+#ifdef NOISE_HAVE_SSE2
+
+// SSE2 has no 32-bit multiplication that keeps the low half
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static void lattice_row_sse2(float *out, u32 n, s32 x0, u32 base)
+{
+	const u32 h0 = base + NOISE_MAGIC_X * (u32)x0;
+	const __m128i mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i c1 = _mm_set1_epi32(60493);
+	const __m128i c2 = _mm_set1_epi32(19990303);
+	const __m128i c3 = _mm_set1_epi32(1376312589);
+	// 1 / 0x40000000, multiplying by it is exact
+	const __m128 scale = _mm_set1_ps(1.f / 0x40000000);
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128i step = _mm_set1_epi32(4 * NOISE_MAGIC_X);
+	__m128i h = _mm_setr_epi32((int)h0, (int)(h0 + NOISE_MAGIC_X),
+		(int)(h0 + 2 * NOISE_MAGIC_X), (int)(h0 + 3 * NOISE_MAGIC_X));
+
+	u32 i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_and_si128(h, mask);
+		v = _mm_xor_si128(_mm_srli_epi32(v, 13), v);
+		__m128i w = mullo_epi32_sse2(mullo_epi32_sse2(v, v), c1);
+		w = mullo_epi32_sse2(v, _mm_add_epi32(w, c2));
+		v = _mm_and_si128(_mm_add_epi32(w, c3), mask);
+		__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(v), scale);
+		_mm_storeu_ps(out + i, _mm_sub_ps(one, f));
+		h = _mm_add_epi32(h, step);
+	}
+	lattice_row_scalar(out + i, n - i, x0 + (s32)i, base);
+}
+
+static void lerp_const_sse2(float *out, const float *t, float a, float b, u32 n)
+{
+	const __m128 va = _mm_set1_ps(a);
+	const __m128 vd = _mm_set1_ps(b - a);
+	u32 i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(vd, _mm_loadu_ps(t + i))));
+	lerp_const_scalar(out + i, t + i, a, b, n - i);
+}
+
+static void lerp_rows_sse2(float *out, const float *a, const float *b, float t, u32 n)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	u32 i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		_mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vt)));
+	}
+	lerp_rows_scalar(out + i, a + i, b + i, t, n - i);
+}
+
+static void lerp_rows2_sse2(float *out, const float *a0, const float *b0,
+	const float *a1, const float *b1, float t, float t2, u32 n)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	const __m128 vt2 = _mm_set1_ps(t2);
+	u32 i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 va0 = _mm_loadu_ps(a0 + i);
+		__m128 va1 = _mm_loadu_ps(a1 + i);
+		__m128 u = _mm_add_ps(va0, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b0 + i), va0), vt));
+		__m128 v = _mm_add_ps(va1, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b1 + i), va1), vt));
+		_mm_storeu_ps(out + i, _mm_add_ps(u, _mm_mul_ps(_mm_sub_ps(v, u), vt2)));
+	}
+	lerp_rows2_scalar(out + i, a0 + i, b0 + i, a1 + i, b1 + i, t, t2, n - i);
+}
+
+static void accumulate_sse2(float *result, const float *v, float g, u32 n,
+	bool absvalue)
+{
+	const __m128 vg = _mm_set1_ps(g);
+	// clearing the sign bit is what fabs() does
+	const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(absvalue ? 0x7fffffff : -1));
+	u32 i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_and_ps(_mm_loadu_ps(v + i), absmask);
+		_mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(result + i), _mm_mul_ps(vg, x)));
+	}
+	accumulate_scalar(result + i, v + i, g, n - i, absvalue);
+}
+
+static void accumulate_map_sse2(float *result, float *gmap, const float *v,
+	const float *pmap, u32 n, bool absvalue)
+{
+	const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(absvalue ? 0x7fffffff : -1));
+	u32 i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 g = _mm_loadu_ps(gmap + i);
+		__m128 x = _mm_and_ps(_mm_loadu_ps(v + i), absmask);
+		_mm_storeu_ps(result + i, _mm_add_ps(_mm_loadu_ps(result + i), _mm_mul_ps(g, x)));
+		_mm_storeu_ps(gmap + i, _mm_mul_ps(g, _mm_loadu_ps(pmap + i)));
+	}
+	accumulate_map_scalar(result + i, gmap + i, v + i, pmap + i, n - i, absvalue);
+}
+
+static const NoiseKernels noise_kernels_sse2 = {
+	lattice_row_sse2,
+	lerp_const_sse2,
+	lerp_rows_sse2,
+	lerp_rows2_sse2,
+	accumulate_sse2,
+	accumulate_map_sse2,
+};
+
+#endif
+
+#ifdef NOISE_HAVE_AVX2
+
+NOISE_TARGET_AVX2
+static void lattice_row_avx2(float *out, u32 n, s32 x0, u32 base)
+{
+	const u32 h0 = base + NOISE_MAGIC_X * (u32)x0;
+	const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i c1 = _mm256_set1_epi32(60493);
+	const __m256i c2 = _mm256_set1_epi32(19990303);
+	const __m256i c3 = _mm256_set1_epi32(1376312589);
+	const __m256 scale = _mm256_set1_ps(1.f / 0x40000000);
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256i step = _mm256_set1_epi32(8 * NOISE_MAGIC_X);
+	__m256i h = _mm256_add_epi32(_mm256_set1_epi32((int)h0),
+		_mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(NOISE_MAGIC_X)));
+
+	u32 i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_and_si256(h, mask);
+		v = _mm256_xor_si256(_mm256_srli_epi32(v, 13), v);
+		__m256i w = _mm256_mullo_epi32(_mm256_mullo_epi32(v, v), c1);
+		w = _mm256_mullo_epi32(v, _mm256_add_epi32(w, c2));
+		v = _mm256_and_si256(_mm256_add_epi32(w, c3), mask);
+		__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale);
+		_mm256_storeu_ps(out + i, _mm256_sub_ps(one, f));
+		h = _mm256_add_epi32(h, step);
+	}
+	lattice_row_scalar(out + i, n - i, x0 + (s32)i, base);
+}
+
+NOISE_TARGET_AVX2
+static void lerp_const_avx2(float *out, const float *t, float a, float b, u32 n)
+{
+	const __m256 va = _mm256_set1_ps(a);
+	const __m256 vd = _mm256_set1_ps(b - a);
+	u32 i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_add_ps(va, _mm256_mul_ps(vd, _mm256_loadu_ps(t + i))));
+	lerp_const_scalar(out + i, t + i, a, b, n - i);
+}
+
+NOISE_TARGET_AVX2
+static void lerp_rows_avx2(float *out, const float *a, const float *b, float t, u32 n)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	u32 i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+		_mm256_storeu_ps(out + i, _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), vt)));
+	}
+	lerp_rows_scalar(out + i, a + i, b + i, t, n - i);
+}
+
+NOISE_TARGET_AVX2
+static void lerp_rows2_avx2(float *out, const float *a0, const float *b0,
+	const float *a1, const float *b1, float t, float t2, u32 n)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	const __m256 vt2 = _mm256_set1_ps(t2);
+	u32 i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 va0 = _mm256_loadu_ps(a0 + i);
+		__m256 va1 = _mm256_loadu_ps(a1 + i);
+		__m256 u = _mm256_add_ps(va0, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b0 + i), va0), vt));
+		__m256 v = _mm256_add_ps(va1, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b1 + i), va1), vt));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(u, _mm256_mul_ps(_mm256_sub_ps(v, u), vt2)));
+	}
+	lerp_rows2_scalar(out + i, a0 + i, b0 + i, a1 + i, b1 + i, t, t2, n - i);
+}
+
+NOISE_TARGET_AVX2
+static void accumulate_avx2(float *result, const float *v, float g, u32 n,
+	bool absvalue)
+{
+	const __m256 vg = _mm256_set1_ps(g);
+	const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(absvalue ? 0x7fffffff : -1));
+	u32 i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_and_ps(_mm256_loadu_ps(v + i), absmask);
+		_mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(result + i), _mm256_mul_ps(vg, x)));
+	}
+	accumulate_scalar(result + i, v + i, g, n - i, absvalue);
+}
+
+NOISE_TARGET_AVX2
+static void accumulate_map_avx2(float *result, float *gmap, const float *v,
+	const float *pmap, u32 n, bool absvalue)
+{
+	const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(absvalue ? 0x7fffffff : -1));
+	u32 i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 g = _mm256_loadu_ps(gmap + i);
+		__m256 x = _mm256_and_ps(_mm256_loadu_ps(v + i), absmask);
+		_mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(result + i), _mm256_mul_ps(g, x)));
+		_mm256_storeu_ps(gmap + i, _mm256_mul_ps(g, _mm256_loadu_ps(pmap + i)));
+	}
+	accumulate_map_scalar(result + i, gmap + i, v + i, pmap + i, n - i, absvalue);
+}
+
+static const NoiseKernels noise_kernels_avx2 = {
+	lattice_row_avx2,
+	lerp_const_avx2,
+	lerp_rows_avx2,
+	lerp_rows2_avx2,
+	accumulate_avx2,
+	accumulate_map_avx2,
+};
+
+#endif
+
+NoiseSimdLevel getSupportedNoiseSimdLevel()
+{
+#if defined(NOISE_HAVE_AVX2)
+	static const bool have_avx2 = [] {
+		// might be called before the CPU info is initialized
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	}();
+	if (have_avx2)
+		return NOISE_SIMD_AVX2;
+#endif
+#if defined(NOISE_HAVE_SSE2)
+	return NOISE_SIMD_SSE2;
+#else
+	return NOISE_SIMD_NONE;
+#endif
+}
+
+static const NoiseKernels *get_noise_kernels(NoiseSimdLevel level)
+{
+	switch (level) {
+#ifdef NOISE_HAVE_AVX2
+	case NOISE_SIMD_AVX2:
+		return &noise_kernels_avx2;
+#endif
+#ifdef NOISE_HAVE_SSE2
+	case NOISE_SIMD_SSE2:
+		return &noise_kernels_sse2;
+#endif
+	default:
+		return &noise_kernels_scalar;
+	}
+}
+
+static NoiseSimdLevel &noise_simd_level()
+{
+	static NoiseSimdLevel level = getSupportedNoiseSimdLevel();
+	return level;
+}
+
+NoiseSimdLevel getNoiseSimdLevel()
+{
+	return noise_simd_level();
+}
+
+bool setNoiseSimdLevel(NoiseSimdLevel level)
+{
+	if (level > getSupportedNoiseSimdLevel())
+		return false;
+	noise_simd_level() = level;
+	return true;
 }
 
 
@@ -479,76 +873,86 @@ void Noise::resizeNoiseBuf(bool is3d)
 
 
 /*
- * NB:  This algorithm is not optimal in terms of space complexity.  The entire
- * integer lattice of noise points could be done as 2 lines instead, and for 3D,
- * 2 lines + 2 planes.
- * However, this would require the noise calls to be interposed with the
- * interpolation loops, which may trash the icache, leading to lower overall
- * performance.
- * Another optimization that could save half as many noise calls is to carry over
- * values from the previous noise lattice as midpoints in the new lattice for the
- * next octave.
+ * Fractional positions and lattice cells along one axis. They are the same
+ * for every row (or column), so they are only computed once. The position
+ * is accumulated step by step like this on purpose, to get the same results
+ * as with the original per-point algorithm.
  */
-#define idx(x, y) ((y) * nlx + (x))
+static void calc_axis(std::vector<float> &frac, std::vector<u32> &cell,
+	float u, float step, u32 count, bool eased)
+{
+	frac.resize(count);
+	cell.resize(count);
+	u32 noise_i = 0;
+	for (u32 i = 0; i != count; i++) {
+		frac[i] = eased ? easeCurve(u) : u;
+		cell[i] = noise_i;
+		u += step;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noise_i++;
+		}
+	}
+}
+
+/*
+ * Interpolates a row of lattice points along X.
+ * Interpolating in the other directions is done on the results, which are
+ * shared by all rows between the same lattice points.
+ */
+static void lerp_lattice_row(const NoiseKernels &kern, float *out,
+	const float *lattice, const std::vector<float> &xs, const std::vector<u32> &nx)
+{
+	const u32 count = xs.size();
+	u32 i = 0;
+	while (i != count) {
+		const u32 cell = nx[i];
+		u32 end = i + 1;
+		while (end != count && nx[end] == cell)
+			end++;
+		kern.lerp_const(out + i, &xs[i], lattice[cell], lattice[cell + 1], end - i);
+		i = end;
+	}
+}
+
 void Noise::valueMap2D(
 		float x, float y,
 		float step_x, float step_y,
 		s32 seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	thread_local std::vector<float> xs, ys, lines;
+	thread_local std::vector<u32> nx, ny;
+
+	const NoiseKernels &kern = *get_noise_kernels(getNoiseSimdLevel());
 	u32 nlx, nly;
 	s32 x0, y0;
 
 	bool eased = np.flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED);
 	x0 = std::floor(x);
 	y0 = std::floor(y);
-	u = x - (float)x0;
-	v = y - (float)y0;
-	orig_u = u;
+	float u = x - (float)x0;
+	float v = y - (float)y0;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
-	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+	for (u32 j = 0; j != nly; j++)
+		kern.lattice_row(&noise_buf[j * nlx], nlx, x0,
+			lattice_hash(0, y0 + j, 0, seed));
 
 	//calculate interpolations
-	index  = 0;
-	noisey = 0;
-	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			value_buf[index++] =
-				biLinearInterpolation(v00, v10, v01, v11, u, v, eased);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
-		}
+	calc_axis(xs, nx, u, step_x, sx, eased);
+	calc_axis(ys, ny, v, step_y, sy, eased);
 
-		v += step_y;
-		if (v >= 1.0) {
-			v -= 1.0;
-			noisey++;
-		}
+	lines.resize(nly * sx);
+	for (u32 j = 0; j != nly; j++)
+		lerp_lattice_row(kern, &lines[j * sx], &noise_buf[j * nlx], xs, nx);
+
+	for (u32 j = 0; j != sy; j++) {
+		const float *line = &lines[ny[j] * sx];
+		kern.lerp_rows(&value_buf[j * sx], line, line + sx, ys[j], sx);
 	}
 }
-#undef idx
 
 
 #define idx(x, y, z) ((z) * nly * nlx + (y) * nlx + (x))
@@ -557,10 +961,10 @@ void Noise::valueMap3D(
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	thread_local std::vector<float> xs, ys, planes;
+	thread_local std::vector<u32> nx, ny;
+
+	const NoiseKernels &kern = *get_noise_kernels(getNoiseSimdLevel());
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
 
@@ -569,68 +973,51 @@ void Noise::valueMap3D(
 	x0 = std::floor(x);
 	y0 = std::floor(y);
 	z0 = std::floor(z);
-	u = x - (float)x0;
-	v = y - (float)y0;
-	w = z - (float)z0;
-	orig_u = u;
-	orig_v = v;
+	float u = x - (float)x0;
+	float v = y - (float)y0;
+	float w = z - (float)z0;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
-	for (k = 0; k != nlz; k++)
-		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+	for (u32 k = 0; k != nlz; k++)
+		for (u32 j = 0; j != nly; j++)
+			kern.lattice_row(&noise_buf[idx(0, j, k)], nlx, x0,
+				lattice_hash(0, y0 + j, z0 + k, seed));
 
 	//calculate interpolations
-	index  = 0;
-	noisey = 0;
-	noisez = 0;
-	for (k = 0; k != sz; k++) {
-		v = orig_v;
-		noisey = 0;
-		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				value_buf[index++] = triLinearInterpolation(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w,
-					eased);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
-
-			v += step_y;
-			if (v >= 1.0) {
-				v -= 1.0;
-				noisey++;
-			}
+	calc_axis(xs, nx, u, step_x, sx, eased);
+	calc_axis(ys, ny, v, step_y, sy, eased);
+
+	// Lattice rows interpolated along X for two consecutive Z layers
+	const u32 plane_size = nly * sx;
+	planes.resize(2 * plane_size);
+	float *plane0 = &planes[0];
+	float *plane1 = &planes[plane_size];
+	auto calc_plane = [&] (float *plane, u32 noisez) {
+		for (u32 j = 0; j != nly; j++)
+			lerp_lattice_row(kern, &plane[j * sx], &noise_buf[idx(0, j, noisez)], xs, nx);
+	};
+	calc_plane(plane0, 0);
+	calc_plane(plane1, 1);
+
+	u32 index = 0;
+	u32 noisez = 0, plane_z = 0;
+	for (u32 k = 0; k != sz; k++) {
+		if (plane_z != noisez) {
+			std::swap(plane0, plane1);
+			plane_z = noisez;
+			calc_plane(plane1, noisez + 1);
+		}
+		const float zt = eased ? easeCurve(w) : w;
+
+		for (u32 j = 0; j != sy; j++) {
+			const float *line0 = &plane0[ny[j] * sx];
+			const float *line1 = &plane1[ny[j] * sx];
+			kern.lerp_rows2(&value_buf[index], line0, line0 + sx,
+				line1, line1 + sx, ys[j], zt, sx);
+			index += sx;
 		}
 
 		w += step_z;
@@ -721,27 +1108,10 @@ float *Noise::noiseMap3D(float x, float y, float z, float *persistence_map)
 void Noise::updateResults(float g, float *gmap,
 	const float *persistence_map, size_t bufsize)
 {
-	// This looks very ugly, but it is 50-70% faster than having
-	// conditional statements inside the loop
-	if (np.flags & NOISE_FLAG_ABSVALUE) {
-		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
-				result[i] += gmap[i] * std::fabs(value_buf[i]);
-				gmap[i] *= persistence_map[i];
-			}
-		} else {
-			for (size_t i = 0; i != bufsize; i++)
-				result[i] += g * std::fabs(value_buf[i]);
-		}
-	} else {
-		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
-				result[i] += gmap[i] * value_buf[i];
-				gmap[i] *= persistence_map[i];
-			}
-		} else {
-			for (size_t i = 0; i != bufsize; i++)
-				result[i] += g * value_buf[i];
-		}
-	}
+	const NoiseKernels &kern = *get_noise_kernels(getNoiseSimdLevel());
+	const bool absvalue = np.flags & NOISE_FLAG_ABSVALUE;
+	if (persistence_map)
+		kern.accumulate_map(result, gmap, value_buf, persistence_map, bufsize, absvalue);
+	else
+		kern.accumulate(result, value_buf, g, bufsize, absvalue);
 }
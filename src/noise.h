@@ -201,6 +201,23 @@ class Noise {
 
 };
 
+/*
+	The bulk noise functions of Noise use SIMD instructions if the CPU
+	supports them. The results are exactly the same in any case.
+*/
+enum NoiseSimdLevel {
+	NOISE_SIMD_NONE,
+	NOISE_SIMD_SSE2,
+	NOISE_SIMD_AVX2,
+};
+
+// Best level supported by this CPU
+NoiseSimdLevel getSupportedNoiseSimdLevel();
+NoiseSimdLevel getNoiseSimdLevel();
+// Only meant for testing and benchmarking, not thread-safe.
+// Returns false if the level is not supported.
+bool setNoiseSimdLevel(NoiseSimdLevel level);
+
 float NoiseFractal2D(const NoiseParams *np, float x, float y, s32 seed);
 float NoiseFractal3D(const NoiseParams *np, float x, float y, float z, s32 seed);
 
@@ -9,6 +9,8 @@
 
 #include "pathfinder.h"
 #include "map.h"
+#include "mapblock.h"
+#include "mapsnapshot.h"
 #include "nodedef.h"
 #include "irrlicht_changes/printing.h"
 
@@ -25,7 +27,11 @@
 	#include <sys/time.h>
 #endif
 
-#include <queue>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 /******************************************************************************/
 /* Typedefs and macros                                                        */
@@ -47,6 +53,15 @@
 
 #define PATHFINDER_MAX_WAYPOINTS 700
 
+/* grid pages have a size of 8x8x8 nodes */
+#define PATHFINDER_PAGE_SHIFT 3
+#define PATHFINDER_PAGE_SIZE (1 << PATHFINDER_PAGE_SHIFT)
+#define PATHFINDER_PAGE_NODES (PATHFINDER_PAGE_SIZE * PATHFINDER_PAGE_SIZE * PATHFINDER_PAGE_SIZE)
+/* number of unused grid pages kept per thread */
+#define PATHFINDER_MAX_POOLED_PAGES 64
+/* number of blocks in the node type cache of snapshot searches */
+#define PATHFINDER_MAX_CACHED_BLOCKS 8192
+
 /******************************************************************************/
 /* Class definitions                                                          */
 /******************************************************************************/
@@ -59,12 +74,6 @@ class PathCost {
 	/** default constructor */
 	PathCost() = default;
 
-	/** copy constructor */
-	PathCost(const PathCost &b);
-
-	/** assignment operator */
-	PathCost &operator= (const PathCost &b);
-
 	bool valid = false;              /**< movement is possible         */
 	int  value = 0;                  /**< cost of movement             */
 	int  y_change = 0;               /**< change of y position of movement */
@@ -80,15 +89,6 @@ class PathGridnode {
 	/** default constructor */
 	PathGridnode() = default;
 
-	/** copy constructor */
-	PathGridnode(const PathGridnode &b);
-
-	/**
-	 * assignment operator
-	 * @param b node to copy
-	 */
-	PathGridnode &operator= (const PathGridnode &b);
-
 	/**
 	 * read cost in a specific direction
 	 * @param dir direction of cost to fetch
@@ -124,8 +124,88 @@ class PathGridnode {
 	                                        */
 };
 
+/** how the pathfinder sees a node */
+enum PathNodeType : u8 {
+	PNT_OPEN,                      /**< not walkable, can be moved through */
+	PNT_WALKABLE,                  /**< walkable, can be stood on          */
+	PNT_IGNORE                     /**< not loaded                         */
+};
+
+/** Abstract class to read the map data */
+class PathNodeSource {
+public:
+	virtual PathNodeType getType(v3s16 pos)=0;
+	virtual ~PathNodeSource() = default;
+};
+
+/** reads the map, the map must not change during the search */
+class MapPathNodeSource : public PathNodeSource {
+public:
+	MapPathNodeSource(Map *map, const NodeDefManager *ndef) :
+		m_map(map), m_ndef(ndef) {}
+	virtual ~MapPathNodeSource() = default;
+
+	virtual PathNodeType getType(v3s16 pos);
+
+private:
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+	v3s16 m_blockpos{S16_MAX, S16_MAX, S16_MAX}; /**< last block read */
+	MapBlock *m_block = nullptr;
+};
+
+/** node types of a block */
+typedef std::array<u8, MapBlock::nodecount> PathBlockTypes;
+
+/**
+ * Node types of snapshot blocks, shared by all searches on snapshots.
+ * Snapshot block data is never modified, changes of the map replace it.
+ * So an entry is valid as long as it was made from the block data that the
+ * snapshot has now.
+ */
+class PathBlockCache {
+public:
+	static PathBlockCache &get()
+	{
+		// never destroyed, searches might still run on exit
+		static PathBlockCache *cache = new PathBlockCache();
+		return *cache;
+	}
+
+	std::shared_ptr<const PathBlockTypes> getTypes(v3s16 blockpos,
+			const std::shared_ptr<const MapSnapshot::BlockData> &block,
+			const NodeDefManager *ndef);
+
+private:
+	struct Entry {
+		/** block data the types were made from */
+		std::weak_ptr<const MapSnapshot::BlockData> block;
+		std::shared_ptr<const PathBlockTypes> types;
+	};
+
+	std::mutex m_mutex;
+	std::unordered_map<v3s16, Entry> m_entries;
+};
+
+/** reads a map snapshot, can be used from any thread */
+class SnapshotPathNodeSource : public PathNodeSource {
+public:
+	SnapshotPathNodeSource(const MapSnapshot *snapshot, const NodeDefManager *ndef) :
+		m_snapshot(snapshot), m_ndef(ndef) {}
+	virtual ~SnapshotPathNodeSource() = default;
+
+	virtual PathNodeType getType(v3s16 pos);
+
+private:
+	const MapSnapshot *m_snapshot;
+	const NodeDefManager *m_ndef;
+	v3s16 m_blockpos{S16_MAX, S16_MAX, S16_MAX}; /**< last block read */
+	const PathBlockTypes *m_types = nullptr;      /**< nullptr if not loaded */
+	/** types of the blocks read so far */
+	std::unordered_map<v3s16, std::shared_ptr<const PathBlockTypes>> m_blocks;
+};
+
 class Pathfinder;
-class PathfinderCompareHeuristic;
 
 /** Abstract class to manage the map data */
 class GridNodeContainer {
@@ -139,27 +219,31 @@ class GridNodeContainer {
 	void initNode(v3s16 ipos, PathGridnode *p_node);
 };
 
-class ArrayGridNodeContainer : public GridNodeContainer {
-public:
-	virtual ~ArrayGridNodeContainer() = default;
-
-	ArrayGridNodeContainer(Pathfinder *pathf, v3s16 dimensions);
-	virtual PathGridnode &access(v3s16 p);
-
-private:
-	int m_x_stride;
-	int m_y_stride;
-	std::vector<PathGridnode> m_nodes_array;
+/** part of the search area, pooled per thread */
+struct PathGridPage {
+	PathGridnode nodes[PATHFINDER_PAGE_NODES];
+	bool initialized[PATHFINDER_PAGE_NODES];
 };
 
-class MapGridNodeContainer : public GridNodeContainer {
+/**
+ * Stores the grid nodes in pages of 8x8x8 that are only allocated and
+ * initialized where the search goes. The pages are reused by later searches.
+ */
+class PagedGridNodeContainer : public GridNodeContainer {
 public:
-	virtual ~MapGridNodeContainer() = default;
+	virtual ~PagedGridNodeContainer();
 
-	MapGridNodeContainer(Pathfinder *pathf);
+	PagedGridNodeContainer(Pathfinder *pathf, v3s16 dimensions);
 	virtual PathGridnode &access(v3s16 p);
+
 private:
-	std::map<v3s16, PathGridnode> m_nodes;
+	/** offset of the index positions, neighbours of the border are accessed too */
+	static constexpr s16 BORDER = 1;
+
+	v3s16 m_page_dims;
+	std::vector<PathGridPage *> m_pages;
+	/** nodes outside of the pages */
+	std::unordered_map<v3s16, PathGridnode> m_outside;
 };
 
 /** class doing pathfinding */
@@ -167,7 +251,7 @@ class Pathfinder {
 
 public:
 	Pathfinder() = delete;
-	Pathfinder(Map *map, const NodeDefManager *ndef) : m_map(map), m_ndef(ndef) {}
+	Pathfinder(PathNodeSource *source) : m_source(source) {}
 
 	~Pathfinder();
 
@@ -309,11 +393,8 @@ class Pathfinder {
 	friend class GridNodeContainer;
 	GridNodeContainer *m_nodes_container = nullptr;
 
-	Map *m_map = nullptr;
-
-	const NodeDefManager *m_ndef = nullptr;
-
-	friend class PathfinderCompareHeuristic;
+	/** where the map data is read from */
+	PathNodeSource *m_source = nullptr;
 
 #ifdef PATHFINDER_DEBUG
 
@@ -364,29 +445,18 @@ class Pathfinder {
 #endif
 };
 
-/** Helper class for the open list priority queue in the A* pathfinder
- *  to sort the pathfinder nodes by cost.
+/** Entry of the open list in the A* pathfinder. The estimated cost is
+ *  copied so the binary heap can be sorted without grid lookups.
  */
-class PathfinderCompareHeuristic
-{
-	private:
-		Pathfinder *myPathfinder;
-	public:
-		PathfinderCompareHeuristic(Pathfinder *pf)
-		{
-			myPathfinder = pf;
-		}
-		bool operator() (v3s16 pos1, v3s16 pos2) {
-			v3s16 ipos1 = myPathfinder->getIndexPos(pos1);
-			v3s16 ipos2 = myPathfinder->getIndexPos(pos2);
-			PathGridnode &g_pos1 = myPathfinder->getIndexElement(ipos1);
-			PathGridnode &g_pos2 = myPathfinder->getIndexElement(ipos2);
-			if (!g_pos1.valid)
-				return false;
-			if (!g_pos2.valid)
-				return false;
-			return g_pos1.estimated_cost > g_pos2.estimated_cost;
-		}
+struct PathOpenListEntry {
+	int   estimated_cost;
+	v3s16 pos;
+
+	/** lowest cost at the top of the heap */
+	bool operator< (const PathOpenListEntry &b) const
+	{
+		return estimated_cost > b.estimated_cost;
+	}
 };
 
 /******************************************************************************/
@@ -401,66 +471,102 @@ std::vector<v3s16> get_path(Map* map, const NodeDefManager *ndef,
 		unsigned int max_drop,
 		PathAlgorithm algo)
 {
-	return Pathfinder(map, ndef).getPath(source, destination,
+	MapPathNodeSource node_source(map, ndef);
+	return Pathfinder(&node_source).getPath(source, destination,
 				searchdistance, max_jump, max_drop, algo);
 }
 
 /******************************************************************************/
-PathCost::PathCost(const PathCost &b)
+std::vector<v3s16> get_path(const MapSnapshot *snapshot, const NodeDefManager *ndef,
+		v3s16 source,
+		v3s16 destination,
+		unsigned int searchdistance,
+		unsigned int max_jump,
+		unsigned int max_drop,
+		PathAlgorithm algo)
 {
-	valid     = b.valid;
-	y_change  = b.y_change;
-	value     = b.value;
-	updated   = b.updated;
+	SnapshotPathNodeSource node_source(snapshot, ndef);
+	return Pathfinder(&node_source).getPath(source, destination,
+				searchdistance, max_jump, max_drop, algo);
 }
 
 /******************************************************************************/
-PathCost &PathCost::operator= (const PathCost &b)
+static PathNodeType get_node_type(MapNode n, const NodeDefManager *ndef)
 {
-	valid     = b.valid;
-	y_change  = b.y_change;
-	value     = b.value;
-	updated   = b.updated;
+	if (n.getContent() == CONTENT_IGNORE)
+		return PNT_IGNORE;
+	return ndef->get(n).walkable ? PNT_WALKABLE : PNT_OPEN;
+}
 
-	return *this;
+/******************************************************************************/
+PathNodeType MapPathNodeSource::getType(v3s16 pos)
+{
+	v3s16 blockpos = getNodeBlockPos(pos);
+	if (blockpos != m_blockpos) {
+		m_blockpos = blockpos;
+		m_block = m_map->getBlockNoCreateNoEx(blockpos);
+	}
+	if (!m_block)
+		return PNT_IGNORE;
+	return get_node_type(m_block->getNodeNoCheck(pos - blockpos * MAP_BLOCKSIZE),
+			m_ndef);
 }
 
 /******************************************************************************/
-PathGridnode::PathGridnode(const PathGridnode &b)
-:	valid(b.valid),
-	target(b.target),
-	source(b.source),
-	totalcost(b.totalcost),
-	sourcedir(b.sourcedir),
-	pos(b.pos),
-	is_element(b.is_element),
-	type(b.type)
+std::shared_ptr<const PathBlockTypes> PathBlockCache::getTypes(v3s16 blockpos,
+		const std::shared_ptr<const MapSnapshot::BlockData> &block,
+		const NodeDefManager *ndef)
 {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_entries.find(blockpos);
+		// compare the owners, as the address of the data could be reused
+		if (it != m_entries.end() && !it->second.block.owner_before(block) &&
+				!block.owner_before(it->second.block))
+			return it->second.types;
+	}
 
-	directions[DIR_XP] = b.directions[DIR_XP];
-	directions[DIR_XM] = b.directions[DIR_XM];
-	directions[DIR_ZP] = b.directions[DIR_ZP];
-	directions[DIR_ZM] = b.directions[DIR_ZM];
+	auto types = std::make_shared<PathBlockTypes>();
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		(*types)[i] = get_node_type((*block)[i], ndef);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_entries.size() >= PATHFINDER_MAX_CACHED_BLOCKS) {
+		// drop the entries of replaced blocks, or everything if not enough
+		for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+			if (it->second.block.expired())
+				it = m_entries.erase(it);
+			else
+				++it;
+		}
+		if (m_entries.size() >= PATHFINDER_MAX_CACHED_BLOCKS)
+			m_entries.clear();
+	}
+	m_entries[blockpos] = Entry{block, types};
+	return types;
 }
 
 /******************************************************************************/
-PathGridnode &PathGridnode::operator= (const PathGridnode &b)
+PathNodeType SnapshotPathNodeSource::getType(v3s16 pos)
 {
-	valid      = b.valid;
-	target     = b.target;
-	source     = b.source;
-	is_element = b.is_element;
-	totalcost  = b.totalcost;
-	sourcedir  = b.sourcedir;
-	pos        = b.pos;
-	type       = b.type;
-
-	directions[DIR_XP] = b.directions[DIR_XP];
-	directions[DIR_XM] = b.directions[DIR_XM];
-	directions[DIR_ZP] = b.directions[DIR_ZP];
-	directions[DIR_ZM] = b.directions[DIR_ZM];
-
-	return *this;
+	v3s16 blockpos = getNodeBlockPos(pos);
+	if (blockpos != m_blockpos) {
+		m_blockpos = blockpos;
+		auto it = m_blocks.find(blockpos);
+		if (it == m_blocks.end()) {
+			std::shared_ptr<const PathBlockTypes> types;
+			auto block = m_snapshot->getSharedBlock(blockpos);
+			if (block)
+				types = PathBlockCache::get().getTypes(blockpos, block, m_ndef);
+			it = m_blocks.emplace(blockpos, std::move(types)).first;
+		}
+		m_types = it->second.get();
+	}
+	if (!m_types)
+		return PNT_IGNORE;
+	v3s16 rel = pos - blockpos * MAP_BLOCKSIZE;
+	return (PathNodeType)(*m_types)[rel.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+			rel.Y * MAP_BLOCKSIZE + rel.X];
 }
 
 /******************************************************************************/
@@ -501,20 +607,19 @@ void PathGridnode::setCost(v3s16 dir, const PathCost &cost)
 
 void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 {
-	const NodeDefManager *ndef = m_pathf->m_ndef;
 	PathGridnode &elem = *p_node;
 
 	v3s16 realpos = m_pathf->getRealPos(ipos);
 
-	MapNode current = m_pathf->m_map->getNode(realpos);
-	MapNode below   = m_pathf->m_map->getNode(realpos + v3s16(0, -1, 0));
+	PathNodeType current = m_pathf->m_source->getType(realpos);
+	PathNodeType below   = m_pathf->m_source->getType(realpos + v3s16(0, -1, 0));
 
 
-	if ((current.param0 == CONTENT_IGNORE) ||
-			(below.param0 == CONTENT_IGNORE)) {
+	if ((current == PNT_IGNORE) ||
+			(below == PNT_IGNORE)) {
 		DEBUG_OUT("Pathfinder: " << realpos <<
 			" current or below is invalid element" << std::endl);
-		if (current.param0 == CONTENT_IGNORE) {
+		if (current == PNT_IGNORE) {
 			elem.type = 'i';
 			DEBUG_OUT(ipos << ": " << 'i' << std::endl);
 		}
@@ -522,10 +627,10 @@ void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 	}
 
 	//don't add anything if it isn't an air node
-	if (ndef->get(current).walkable || !ndef->get(below).walkable) {
+	if (current == PNT_WALKABLE || below != PNT_WALKABLE) {
 			DEBUG_OUT("Pathfinder: " << realpos
 				<< " not on surface" << std::endl);
-			if (ndef->get(current).walkable) {
+			if (current == PNT_WALKABLE) {
 				elem.type = 's';
 				DEBUG_OUT(ipos << ": " << 's' << std::endl);
 			} else {
@@ -548,42 +653,68 @@ void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 	}
 }
 
-ArrayGridNodeContainer::ArrayGridNodeContainer(Pathfinder *pathf, v3s16 dimensions) :
-	m_x_stride(dimensions.Y * dimensions.Z),
-	m_y_stride(dimensions.Z)
+/** unused grid pages of this thread */
+static thread_local std::vector<std::unique_ptr<PathGridPage>> g_free_pages;
+
+PagedGridNodeContainer::PagedGridNodeContainer(Pathfinder *pathf, v3s16 dimensions)
 {
 	m_pathf = pathf;
 
-	m_nodes_array.resize(dimensions.X * dimensions.Y * dimensions.Z);
-	INFO_TARGET << "Pathfinder ArrayGridNodeContainer constructor." << std::endl;
-	for (int x = 0; x < dimensions.X; x++) {
-		for (int y = 0; y < dimensions.Y; y++) {
-			for (int z= 0; z < dimensions.Z; z++) {
-				v3s16 ipos(x, y, z);
-				initNode(ipos, &access(ipos));
-			}
-		}
-	}
+	// the index range is [-BORDER, dimensions + BORDER]
+	m_page_dims.X = ((dimensions.X + 2 * BORDER) >> PATHFINDER_PAGE_SHIFT) + 1;
+	m_page_dims.Y = ((dimensions.Y + 2 * BORDER) >> PATHFINDER_PAGE_SHIFT) + 1;
+	m_page_dims.Z = ((dimensions.Z + 2 * BORDER) >> PATHFINDER_PAGE_SHIFT) + 1;
+	m_pages.resize((size_t)m_page_dims.X * m_page_dims.Y * m_page_dims.Z, nullptr);
 }
 
-PathGridnode &ArrayGridNodeContainer::access(v3s16 p)
+PagedGridNodeContainer::~PagedGridNodeContainer()
 {
-	return m_nodes_array[p.X * m_x_stride + p.Y * m_y_stride + p.Z];
+	for (PathGridPage *page : m_pages) {
+		if (!page)
+			continue;
+		if (g_free_pages.size() < PATHFINDER_MAX_POOLED_PAGES)
+			g_free_pages.emplace_back(page);
+		else
+			delete page;
+	}
 }
 
-MapGridNodeContainer::MapGridNodeContainer(Pathfinder *pathf)
+PathGridnode &PagedGridNodeContainer::access(v3s16 p)
 {
-	m_pathf = pathf;
-}
+	v3s16 q = p + v3s16(BORDER, BORDER, BORDER);
+	v3s16 pagepos(q.X >> PATHFINDER_PAGE_SHIFT, q.Y >> PATHFINDER_PAGE_SHIFT,
+			q.Z >> PATHFINDER_PAGE_SHIFT);
+	if (q.X < 0 || q.Y < 0 || q.Z < 0 || pagepos.X >= m_page_dims.X ||
+			pagepos.Y >= m_page_dims.Y || pagepos.Z >= m_page_dims.Z) {
+		auto it = m_outside.find(p);
+		if (it != m_outside.end())
+			return it->second;
+		PathGridnode &n = m_outside[p];
+		initNode(p, &n);
+		return n;
+	}
 
-PathGridnode &MapGridNodeContainer::access(v3s16 p)
-{
-	auto it = m_nodes.find(p);
-	if (it != m_nodes.end()) {
-		return it->second;
+	PathGridPage *&page = m_pages[(pagepos.Z * m_page_dims.Y + pagepos.Y) *
+			m_page_dims.X + pagepos.X];
+	if (!page) {
+		if (!g_free_pages.empty()) {
+			page = g_free_pages.back().release();
+			g_free_pages.pop_back();
+		} else {
+			page = new PathGridPage();
+		}
+		std::fill(std::begin(page->initialized), std::end(page->initialized), false);
+	}
+
+	constexpr s16 mask = PATHFINDER_PAGE_SIZE - 1;
+	u32 i = ((q.Z & mask) << (2 * PATHFINDER_PAGE_SHIFT)) |
+			((q.Y & mask) << PATHFINDER_PAGE_SHIFT) | (q.X & mask);
+	PathGridnode &n = page->nodes[i];
+	if (!page->initialized[i]) {
+		n = PathGridnode();
+		initNode(p, &n);
+		page->initialized[i] = true;
 	}
-	PathGridnode &n = m_nodes[p];
-	initNode(p, &n);
 	return n;
 }
 
@@ -640,11 +771,7 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	m_max_index_z = diff.Z;
 
 	delete m_nodes_container;
-	if (diff.getLength() > 5) {
-		m_nodes_container = new MapGridNodeContainer(this);
-	} else {
-		m_nodes_container = new ArrayGridNodeContainer(this, diff);
-	}
+	m_nodes_container = new PagedGridNodeContainer(this, diff);
 #ifdef PATHFINDER_DEBUG
 	printType();
 	printCost();
@@ -652,14 +779,12 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 #endif
 
 	//fail if source or destination is walkable
-	MapNode node_at_pos = m_map->getNode(destination);
-	if (m_ndef->get(node_at_pos).walkable) {
+	if (m_source->getType(destination) == PNT_WALKABLE) {
 		VERBOSE_TARGET << "Destination is walkable. " <<
 				"Pos: " << destination << std::endl;
 		return retval;
 	}
-	node_at_pos = m_map->getNode(source);
-	if (m_ndef->get(node_at_pos).walkable) {
+	if (m_source->getType(source) == PNT_WALKABLE) {
 		VERBOSE_TARGET << "Source is walkable. " <<
 				"Pos: " << source << std::endl;
 		return retval;
@@ -825,28 +950,28 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		return retval;
 	}
 
-	MapNode node_at_pos2 = m_map->getNode(pos2);
+	PathNodeType type_at_pos2 = m_source->getType(pos2);
 
 	//did we get information about node?
-	if (node_at_pos2.param0 == CONTENT_IGNORE ) {
+	if (type_at_pos2 == PNT_IGNORE) {
 			VERBOSE_TARGET << "Pathfinder: (1) area at pos: "
 					<< pos2 << " not loaded";
 			return retval;
 	}
 
-	if (!m_ndef->get(node_at_pos2).walkable) {
-		MapNode node_below_pos2 =
-			m_map->getNode(pos2 + v3s16(0, -1, 0));
+	if (type_at_pos2 != PNT_WALKABLE) {
+		PathNodeType type_below_pos2 =
+			m_source->getType(pos2 + v3s16(0, -1, 0));
 
 		//did we get information about node?
-		if (node_below_pos2.param0 == CONTENT_IGNORE ) {
+		if (type_below_pos2 == PNT_IGNORE) {
 				VERBOSE_TARGET << "Pathfinder: (2) area at pos: "
 					<< (pos2 + v3s16(0, -1, 0)) << " not loaded";
 				return retval;
 		}
 
 		//test if the same-height neighbor is suitable
-		if (m_ndef->get(node_below_pos2).walkable) {
+		if (type_below_pos2 == PNT_WALKABLE) {
 			//SUCCESS!
 			retval.valid = true;
 			retval.value = 1;
@@ -857,19 +982,17 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		else {
 			//test if we can fall a couple of nodes (m_maxdrop)
 			v3s16 testpos = pos2 + v3s16(0, -1, 0);
-			MapNode node_at_pos = m_map->getNode(testpos);
+			PathNodeType type_at_pos = m_source->getType(testpos);
 
-			while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-					(!m_ndef->get(node_at_pos).walkable) &&
+			while ((type_at_pos == PNT_OPEN) &&
 					(testpos.Y > m_limits.MinEdge.Y)) {
 				testpos += v3s16(0, -1, 0);
-				node_at_pos = m_map->getNode(testpos);
+				type_at_pos = m_source->getType(testpos);
 			}
 
 			//did we find surface?
 			if ((testpos.Y >= m_limits.MinEdge.Y) &&
-					(node_at_pos.param0 != CONTENT_IGNORE) &&
-					(m_ndef->get(node_at_pos).walkable)) {
+					(type_at_pos == PNT_WALKABLE)) {
 				if ((pos2.Y - testpos.Y - 1) <= m_maxdrop) {
 					//SUCCESS!
 					retval.valid = true;
@@ -895,34 +1018,31 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 
 		v3s16 targetpos = pos2; // position for jump target
 		v3s16 jumppos = pos; // position for checking if jumping space is free
-		MapNode node_target = m_map->getNode(targetpos);
-		MapNode node_jump = m_map->getNode(jumppos);
+		PathNodeType type_target = m_source->getType(targetpos);
+		PathNodeType type_jump = m_source->getType(jumppos);
 		bool headbanger = false; // true if anything blocks jumppath
 
-		while ((node_target.param0 != CONTENT_IGNORE) &&
-				(m_ndef->get(node_target).walkable) &&
+		while ((type_target == PNT_WALKABLE) &&
 				(targetpos.Y < m_limits.MaxEdge.Y)) {
 			//if the jump would hit any solid node, discard
-			if ((node_jump.param0 == CONTENT_IGNORE) ||
-					(m_ndef->get(node_jump).walkable)) {
+			if (type_jump != PNT_OPEN) {
 					headbanger = true;
 				break;
 			}
 			targetpos += v3s16(0, 1, 0);
 			jumppos   += v3s16(0, 1, 0);
-			node_target = m_map->getNode(targetpos);
-			node_jump   = m_map->getNode(jumppos);
+			type_target = m_source->getType(targetpos);
+			type_jump   = m_source->getType(jumppos);
 
 		}
 		//check headbanger one last time
-		if ((node_jump.param0 == CONTENT_IGNORE) ||
-			(m_ndef->get(node_jump).walkable)) {
+		if (type_jump != PNT_OPEN) {
 			headbanger = true;
 		}
 
 		//did we find surface without banging our head?
 		if ((!headbanger) && (targetpos.Y <= m_limits.MaxEdge.Y) &&
-				(!m_ndef->get(node_target).walkable)) {
+				(type_target != PNT_WALKABLE)) {
 
 			if (targetpos.Y - pos2.Y <= m_maxjump) {
 				//SUCCESS!
@@ -1095,17 +1215,14 @@ bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
 	// A* search algorithm.
 
 	// The open list contains the pathfinder nodes that still need to be
-	// checked. The priority queue sorts the pathfinder nodes by
-	// estimated cost, with lowest cost on the top.
-	std::priority_queue<v3s16, std::vector<v3s16>, PathfinderCompareHeuristic>
-			openList(PathfinderCompareHeuristic(this));
+	// checked. It is a binary heap sorted by estimated cost, with lowest
+	// cost on the top. Its memory is reused by later searches.
+	static thread_local std::vector<PathOpenListEntry> openList;
+	openList.clear();
 
 	v3s16 source = getRealPos(isource);
 	v3s16 destination = getRealPos(idestination);
 
-	// initial position
-	openList.push(source);
-
 	// the 4 cardinal directions
 	const static v3s16 directions[4] = {
 		v3s16(1,0, 0),
@@ -1123,11 +1240,15 @@ bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
 	int cur_manhattan = getXZManhattanDist(destination);
 	s_pos.estimated_cost = cur_manhattan;
 
+	// initial position
+	openList.push_back({s_pos.estimated_cost, source});
+
 	while (!openList.empty()) {
 		// Pick node with lowest total cost estimate.
 		// The "cheapest" node is always on top.
-		current_pos = openList.top();
-		openList.pop();
+		std::pop_heap(openList.begin(), openList.end());
+		current_pos = openList.back().pos;
+		openList.pop_back();
 		v3s16 ipos = getIndexPos(current_pos);
 
 		// check if node is inside searchdistance and valid
@@ -1178,7 +1299,8 @@ bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
 				n_pos.totalcost = current_totalcost + cost.value;
 				n_pos.estimated_cost = current_totalcost + cost.value + cur_manhattan;
 				n_pos.is_open = true;
-				openList.push(neighbor);
+				openList.push_back({n_pos.estimated_cost, neighbor});
+				std::push_heap(openList.begin(), openList.end());
 			}
 		}
 	}
@@ -1222,20 +1344,18 @@ v3s16 Pathfinder::walkDownwards(v3s16 pos, unsigned int max_down) {
 	if (max_down == 0)
 		return pos;
 	v3s16 testpos = v3s16(pos);
-	MapNode node_at_pos = m_map->getNode(testpos);
+	PathNodeType type_at_pos = m_source->getType(testpos);
 	unsigned int down = 0;
-	while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-			(!m_ndef->get(node_at_pos).walkable) &&
+	while ((type_at_pos == PNT_OPEN) &&
 			(testpos.Y > m_limits.MinEdge.Y) &&
 			(down <= max_down)) {
 		testpos += v3s16(0, -1, 0);
 		down++;
-		node_at_pos = m_map->getNode(testpos);
+		type_at_pos = m_source->getType(testpos);
 	}
 	//did we find surface?
 	if ((testpos.Y >= m_limits.MinEdge.Y) &&
-			(node_at_pos.param0 != CONTENT_IGNORE) &&
-			(m_ndef->get(node_at_pos).walkable)) {
+			(type_at_pos == PNT_WALKABLE)) {
 		if (down == 0) {
 			pos = testpos;
 		} else if ((down - 1) <= max_down) {
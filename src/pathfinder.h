@@ -16,6 +16,7 @@
 
 class NodeDefManager;
 class Map;
+class MapSnapshot;
 
 /******************************************************************************/
 /* Typedefs and macros                                                        */
@@ -47,3 +48,12 @@ std::vector<v3s16> get_path(Map *map, const NodeDefManager *ndef,
 		unsigned int max_jump,
 		unsigned int max_drop,
 		PathAlgorithm algo);
+
+/** same on a map snapshot, this can be called from any thread */
+std::vector<v3s16> get_path(const MapSnapshot *snapshot, const NodeDefManager *ndef,
+		v3s16 source,
+		v3s16 destination,
+		unsigned int searchdistance,
+		unsigned int max_jump,
+		unsigned int max_drop,
+		PathAlgorithm algo);
@@ -4,16 +4,181 @@
 
 #include "profiler.h"
 #include "porting.h"
+#include "log.h"
+#include <thread>
 
 static Profiler main_profiler;
 Profiler *g_profiler = &main_profiler;
 
+/*
+	Name registry, shared by all profilers
+*/
+
+namespace {
+
+// Slots are allocated in chunks, so that the owning thread can add more
+// while other threads read them.
+constexpr u32 SLOT_CHUNK_SIZE = 64;
+constexpr u32 MAX_SLOT_CHUNKS = 256;
+constexpr u32 MAX_PROFILER_IDS = SLOT_CHUNK_SIZE * MAX_SLOT_CHUNKS;
+
+struct NameRegistry
+{
+	std::mutex mutex;
+	std::unordered_map<std::string, ProfilerId> ids;
+	std::vector<std::string> names;
+};
+
+NameRegistry &get_registry()
+{
+	// Not a global, as profilers may be used during static initialization
+	static NameRegistry registry;
+	return registry;
+}
+
+ProfilerId register_name(const std::string &name)
+{
+	NameRegistry &registry = get_registry();
+	MutexAutoLock lock(registry.mutex);
+	auto it = registry.ids.find(name);
+	if (it != registry.ids.end())
+		return it->second;
+
+	if (registry.names.size() == MAX_PROFILER_IDS - 1) {
+		// Everything else ends up in the last ID
+		registry.names.emplace_back("(too many profiler names)");
+		warningstream << "Profiler: too many names, last one was \""
+			<< name << "\"" << std::endl;
+	}
+	if (registry.names.size() == MAX_PROFILER_IDS)
+		return MAX_PROFILER_IDS - 1;
+
+	ProfilerId id = registry.names.size();
+	registry.names.push_back(name);
+	registry.ids.emplace(name, id);
+	return id;
+}
+
+std::atomic<u64> s_next_serial{1};
+
+}
+
+ProfilerId Profiler::getId(const std::string &name)
+{
+	// Saves taking the registry lock for names that were seen before
+	thread_local std::unordered_map<std::string, ProfilerId> cache;
+	auto it = cache.find(name);
+	if (it != cache.end())
+		return it->second;
+
+	ProfilerId id = register_name(name);
+	cache.emplace(name, id);
+	return id;
+}
+
+std::string Profiler::getName(ProfilerId id)
+{
+	NameRegistry &registry = get_registry();
+	MutexAutoLock lock(registry.mutex);
+	return id < registry.names.size() ? registry.names[id] : "";
+}
+
+/*
+	Per-thread data
+
+	Each slot is only written by the thread it belongs to, so no atomic
+	read-modify-write operations are needed. Readers may see a slot halfway
+	through an update, which is fine for profiling purposes.
+*/
+
+struct Profiler::Slot
+{
+	std::atomic<float> value{0};
+	// Count of averaged values, negative values mark add() and max()
+	std::atomic<int> avgcount{0};
+	// Epoch in which the value was started
+	std::atomic<u32> start{0};
+	// Epoch of the last write, 0 = never written
+	std::atomic<u32> last{0};
+};
+
+struct Profiler::ThreadData
+{
+	std::thread::id thread;
+	std::atomic<Slot *> chunks[MAX_SLOT_CHUNKS] = {};
+
+	ThreadData(std::thread::id thread) : thread(thread) {}
+
+	~ThreadData()
+	{
+		for (auto &chunk : chunks)
+			delete[] chunk.load();
+	}
+
+	DISABLE_CLASS_COPY(ThreadData)
+
+	Slot &getSlot(ProfilerId id)
+	{
+		auto &chunk = chunks[id / SLOT_CHUNK_SIZE];
+		Slot *slots = chunk.load(std::memory_order_relaxed);
+		if (!slots) {
+			slots = new Slot[SLOT_CHUNK_SIZE];
+			chunk.store(slots, std::memory_order_release);
+		}
+		return slots[id % SLOT_CHUNK_SIZE];
+	}
+};
+
+Profiler::ThreadData *Profiler::getThreadData()
+{
+	// The last few profilers used by this thread
+	struct CacheEntry {
+		u64 serial = 0;
+		ThreadData *data = nullptr;
+	};
+	thread_local CacheEntry cache[4];
+	thread_local u32 next_entry = 0;
+
+	for (const CacheEntry &entry : cache) {
+		if (entry.serial == m_serial)
+			return entry.data;
+	}
+
+	ThreadData *data = nullptr;
+	{
+		const auto thread = std::this_thread::get_id();
+		MutexAutoLock lock(m_mutex);
+		for (auto &it : m_threads) {
+			if (it->thread == thread) {
+				data = it.get();
+				break;
+			}
+		}
+		if (!data) {
+			m_threads.push_back(std::make_unique<ThreadData>(thread));
+			data = m_threads.back().get();
+		}
+	}
+	cache[next_entry] = CacheEntry{m_serial, data};
+	next_entry = (next_entry + 1) % ARRLEN(cache);
+	return data;
+}
+
+/*
+	ScopeProfiler
+*/
+
 ScopeProfiler::ScopeProfiler(Profiler *profiler, const std::string &name,
 		ScopeProfilerType type, TimePrecision prec) :
+	ScopeProfiler(profiler, makeId(name, prec), type, prec)
+{
+}
+
+ScopeProfiler::ScopeProfiler(Profiler *profiler, ProfilerId id,
+		ScopeProfilerType type, TimePrecision prec) :
 	m_profiler(profiler),
-	m_name(name), m_type(type), m_precision(prec)
+	m_id(id), m_type(type), m_precision(prec)
 {
-	m_name.append(" [").append(TimePrecision_units[prec]).append("]");
 	m_time1 = porting::getTime(prec);
 }
 
@@ -26,87 +191,183 @@ ScopeProfiler::~ScopeProfiler()
 
 	switch (m_type) {
 	case SPT_ADD:
-		m_profiler->add(m_name, duration);
+		m_profiler->add(m_id, duration);
 		break;
 	case SPT_AVG:
-		m_profiler->avg(m_name, duration);
+		m_profiler->avg(m_id, duration);
 		break;
 	case SPT_GRAPH_ADD:
-		m_profiler->graphAdd(m_name, duration);
+		m_profiler->graphAdd(Profiler::getName(m_id), duration);
 		break;
 	case SPT_MAX:
-		m_profiler->max(m_name, duration);
+		m_profiler->max(m_id, duration);
 		break;
 	}
 }
 
-Profiler::Profiler()
+ProfilerId ScopeProfiler::makeId(const std::string &name, TimePrecision prec)
+{
+	std::string full_name;
+	full_name.reserve(name.size() + 5);
+	full_name.append(name).append(" [").append(TimePrecision_units[prec]).append("]");
+	return Profiler::getId(full_name);
+}
+
+/*
+	Profiler
+*/
+
+Profiler::Profiler() :
+	m_serial(s_next_serial++)
 {
 	m_start_time = porting::getTimeMs();
 }
 
-void Profiler::add(const std::string &name, float value)
+Profiler::~Profiler() = default;
+
+bool Profiler::beginWrite(ProfilerId id, Slot *&slot)
 {
-	MutexAutoLock lock(m_mutex);
+	slot = &getThreadData()->getSlot(id);
+	const u32 start = slot->start.load(std::memory_order_relaxed);
+	if (start != 0 && start >= m_clear_epoch.load(std::memory_order_relaxed))
+		return false;
+	slot->start.store(m_epoch.load(std::memory_order_relaxed),
+		std::memory_order_relaxed);
+	return true;
+}
 
-	auto it = m_data.find(name);
-	if (it == m_data.end()) {
+void Profiler::add(ProfilerId id, float value)
+{
+	Slot *slot;
+	if (beginWrite(id, slot)) {
+		slot->value.store(value, std::memory_order_relaxed);
 		// mark with special value for checking
-		m_data.emplace(name, DataPair{value, -SPT_ADD});
+		slot->avgcount.store(-SPT_ADD, std::memory_order_relaxed);
 	} else {
-		assert(it->second.avgcount == -SPT_ADD);
-		it->second.value += value;
+		assert(slot->avgcount.load(std::memory_order_relaxed) == -SPT_ADD);
+		slot->value.store(slot->value.load(std::memory_order_relaxed) + value,
+			std::memory_order_relaxed);
 	}
+	slot->last.store(m_epoch.load(std::memory_order_relaxed),
+		std::memory_order_release);
 }
 
-void Profiler::max(const std::string &name, float value)
+void Profiler::max(ProfilerId id, float value)
 {
-	MutexAutoLock lock(m_mutex);
-
-	auto it = m_data.find(name);
-	if (it == m_data.end()) {
+	Slot *slot;
+	if (beginWrite(id, slot)) {
+		slot->value.store(value, std::memory_order_relaxed);
 		// mark with special value for checking
-		m_data.emplace(name, DataPair{value, -SPT_MAX});
+		slot->avgcount.store(-SPT_MAX, std::memory_order_relaxed);
 	} else {
-		assert(it->second.avgcount == -SPT_MAX);
-		it->second.value = std::max(value, it->second.value);
+		assert(slot->avgcount.load(std::memory_order_relaxed) == -SPT_MAX);
+		if (value > slot->value.load(std::memory_order_relaxed))
+			slot->value.store(value, std::memory_order_relaxed);
 	}
+	slot->last.store(m_epoch.load(std::memory_order_relaxed),
+		std::memory_order_release);
 }
 
-void Profiler::avg(const std::string &name, float value)
+void Profiler::avg(ProfilerId id, float value)
 {
-	MutexAutoLock lock(m_mutex);
-
-	auto it = m_data.find(name);
-	if (it == m_data.end()) {
-		m_data.emplace(name, DataPair{value, 1});
+	Slot *slot;
+	if (beginWrite(id, slot)) {
+		slot->value.store(value, std::memory_order_relaxed);
+		slot->avgcount.store(1, std::memory_order_relaxed);
 	} else {
-		assert(it->second.avgcount >= 0);
-		it->second.value += value;
-		it->second.avgcount++;
+		assert(slot->avgcount.load(std::memory_order_relaxed) >= 0);
+		slot->value.store(slot->value.load(std::memory_order_relaxed) + value,
+			std::memory_order_relaxed);
+		slot->avgcount.store(slot->avgcount.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
 	}
+	slot->last.store(m_epoch.load(std::memory_order_relaxed),
+		std::memory_order_release);
 }
 
 void Profiler::clear()
 {
 	MutexAutoLock lock(m_mutex);
-	for (auto &it : m_data)
-		it.second.reset();
+	// The slots start over on their next write
+	m_clear_epoch = ++m_epoch;
 	m_start_time = porting::getTimeMs();
 }
 
-float Profiler::getValue(const std::string &name) const
+void Profiler::remove(const std::string &name)
 {
-	auto it = m_data.find(name);
-	if (it == m_data.end())
+	ProfilerId id = getId(name);
+	MutexAutoLock lock(m_mutex);
+	m_removed[id] = m_epoch++;
+}
+
+void Profiler::collect(std::map<std::string, DataPair> &data)
+{
+	std::map<ProfilerId, DataPair> values;
+	{
+		MutexAutoLock lock(m_mutex);
+		const u32 clear_epoch = m_clear_epoch;
+		for (auto &thread : m_threads)
+		for (u32 c = 0; c < MAX_SLOT_CHUNKS; c++) {
+			const Slot *slots = thread->chunks[c].load(std::memory_order_acquire);
+			if (!slots)
+				continue;
+			for (u32 i = 0; i < SLOT_CHUNK_SIZE; i++) {
+				const Slot &slot = slots[i];
+				const u32 last = slot.last.load(std::memory_order_acquire);
+				if (last == 0)
+					continue;
+				const ProfilerId id = c * SLOT_CHUNK_SIZE + i;
+				auto removed = m_removed.find(id);
+				if (removed != m_removed.end() && last <= removed->second)
+					continue;
+
+				int avgcount = slot.avgcount.load(std::memory_order_relaxed);
+				float value = slot.value.load(std::memory_order_relaxed);
+				if (slot.start.load(std::memory_order_relaxed) < clear_epoch) {
+					// Cleared, but still listed
+					value = 0;
+					avgcount = std::min(avgcount, 0);
+				}
+
+				auto it = values.find(id);
+				if (it == values.end()) {
+					values.emplace(id, DataPair{value, avgcount});
+					continue;
+				}
+				DataPair &pair = it->second;
+				if (avgcount == -SPT_MAX) {
+					pair.value = std::max(pair.value, value);
+				} else {
+					pair.value += value;
+					if (avgcount >= 0)
+						pair.avgcount = std::max(pair.avgcount, 0) + avgcount;
+				}
+			}
+		}
+	}
+
+	NameRegistry &registry = get_registry();
+	MutexAutoLock lock(registry.mutex);
+	for (const auto &it : values)
+		data[registry.names[it.first]] = it.second;
+}
+
+float Profiler::getValue(const std::string &name)
+{
+	std::map<std::string, DataPair> data;
+	collect(data);
+	auto it = data.find(name);
+	if (it == data.end())
 		return 0;
 	return it->second.getValue();
 }
 
-int Profiler::getAvgCount(const std::string &name) const
+int Profiler::getAvgCount(const std::string &name)
 {
-	auto it = m_data.find(name);
-	if (it == m_data.end())
+	std::map<std::string, DataPair> data;
+	collect(data);
+	auto it = data.find(name);
+	if (it == data.end())
 		return 1;
 	int denominator = it->second.avgcount;
 	return denominator >= 1 ? denominator : 1;
@@ -119,13 +380,28 @@ u64 Profiler::getElapsedMs() const
 
 int Profiler::print(std::ostream &o, u32 page, u32 pagecount)
 {
-	GraphValues values;
-	getPage(values, page, pagecount);
+	std::map<std::string, DataPair> data;
+	collect(data);
+
+	u32 minindex, maxindex;
+	paging(data.size(), page, pagecount, minindex, maxindex);
 	char buffer[128];
+	int count = 0;
 
-	for (const auto &i : values) {
+	for (const auto &i : data) {
+		if (maxindex == 0)
+			break;
+		maxindex--;
+
+		if (minindex != 0) {
+			minindex--;
+			continue;
+		}
+		count++;
+
+		const float value = i.second.getValue();
 		o << "  " << i.first << " ";
-		if (i.second == 0) {
+		if (value == 0) {
 			o << std::endl;
 			continue;
 		}
@@ -139,20 +415,21 @@ int Profiler::print(std::ostream &o, u32 page, u32 pagecount)
 		}
 
 		porting::mt_snprintf(buffer, sizeof(buffer), "% 5ix % 7g",
-				getAvgCount(i.first), floor(i.second * 1000.0) / 1000.0);
+				std::max(i.second.avgcount, 1), floor(value * 1000.0) / 1000.0);
 		o << buffer << std::endl;
 	}
-	return values.size();
+	return count;
 }
 
 void Profiler::getPage(GraphValues &o, u32 page, u32 pagecount)
 {
-	MutexAutoLock lock(m_mutex);
+	std::map<std::string, DataPair> data;
+	collect(data);
 
 	u32 minindex, maxindex;
-	paging(m_data.size(), page, pagecount, minindex, maxindex);
+	paging(data.size(), page, pagecount, minindex, maxindex);
 
-	for (const auto &i : m_data) {
+	for (const auto &i : data) {
 		if (maxindex == 0)
 			break;
 		maxindex--;
@@ -5,12 +5,17 @@
 #pragma once
 
 #include "irrlichttypes.h"
+#include <atomic>
 #include <cassert>
-#include <string>
 #include <map>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "threading/mutex_auto_lock.h"
+#include "util/basic_macros.h"
 #include "util/timetaker.h"
 #include "util/numeric.h"      // paging()
 
@@ -20,20 +25,38 @@ extern Profiler *g_profiler;
 
 /*
 	Time profiler
+
+	Names are interned into IDs that are valid for all profilers. The samples
+	are accumulated per thread without locking and only added up when the
+	values are read.
 */
 
+typedef u32 ProfilerId;
+
 class Profiler
 {
 public:
 	Profiler();
+	~Profiler();
+
+	DISABLE_CLASS_COPY(Profiler)
 
-	void add(const std::string &name, float value);
-	void avg(const std::string &name, float value);
-	void max(const std::string &name, float value);
+	// Returns the ID of a name, registering it if needed. Hot paths should
+	// keep the ID (e.g. in a static) instead of looking it up every time.
+	static ProfilerId getId(const std::string &name);
+	static std::string getName(ProfilerId id);
+
+	void add(ProfilerId id, float value);
+	void avg(ProfilerId id, float value);
+	void max(ProfilerId id, float value);
+
+	void add(const std::string &name, float value) { add(getId(name), value); }
+	void avg(const std::string &name, float value) { avg(getId(name), value); }
+	void max(const std::string &name, float value) { max(getId(name), value); }
 	void clear();
 
-	float getValue(const std::string &name) const;
-	int getAvgCount(const std::string &name) const;
+	float getValue(const std::string &name);
+	int getAvgCount(const std::string &name);
 	u64 getElapsedMs() const;
 
 	typedef std::map<std::string, float> GraphValues;
@@ -64,30 +87,40 @@ class Profiler
 		std::swap(result, m_graphvalues);
 	}
 
-	void remove(const std::string& name)
-	{
-		MutexAutoLock lock(m_mutex);
-		m_data.erase(name);
-	}
+	// Hides the value until it is written again
+	void remove(const std::string &name);
 
 private:
 	struct DataPair {
 		float value = 0;
 		int avgcount = 0;
 
-		inline void reset() {
-			value = 0;
-			// negative values are used for type checking, so leave them alone
-			if (avgcount >= 1)
-				avgcount = 0;
-		}
 		inline float getValue() const {
 			return avgcount >= 1 ? (value / avgcount) : value;
 		}
 	};
 
+	struct Slot;
+	struct ThreadData;
+
+	// Returns the slot of the calling thread, which then may be written to.
+	// Starts the slot over if it was cleared meanwhile and returns true then.
+	bool beginWrite(ProfilerId id, Slot *&slot);
+	ThreadData *getThreadData();
+	// Adds up the values of all threads
+	void collect(std::map<std::string, DataPair> &data);
+
+	// Identifies this instance in the thread-local caches, never reused
+	const u64 m_serial;
+	// Incremented by clear() and remove()
+	std::atomic<u32> m_epoch{1};
+	// m_epoch at the last clear()
+	std::atomic<u32> m_clear_epoch{1};
+
 	std::mutex m_mutex;
-	std::map<std::string, DataPair> m_data;
+	// Protected by m_mutex
+	std::vector<std::unique_ptr<ThreadData>> m_threads;
+	std::unordered_map<ProfilerId, u32> m_removed;
 	std::map<std::string, float> m_graphvalues;
 	u64 m_start_time;
 };
@@ -108,11 +141,19 @@ class ScopeProfiler
 	ScopeProfiler(Profiler *profiler, const std::string &name,
 			ScopeProfilerType type = SPT_ADD,
 			TimePrecision precision = PRECISION_MILLI);
+	// The ID must come from makeId() with the same precision
+	ScopeProfiler(Profiler *profiler, ProfilerId id,
+			ScopeProfilerType type = SPT_ADD,
+			TimePrecision precision = PRECISION_MILLI);
 	~ScopeProfiler();
 
+	// Interns the name with the unit appended
+	static ProfilerId makeId(const std::string &name,
+			TimePrecision precision = PRECISION_MILLI);
+
 private:
 	Profiler *m_profiler = nullptr;
-	std::string m_name;
+	ProfilerId m_id;
 	u64 m_time1;
 	ScopeProfilerType m_type;
 	TimePrecision m_precision;
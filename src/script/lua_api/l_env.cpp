@@ -12,10 +12,13 @@
 #include "lua_api/l_object.h"
 #include "common/c_converter.h"
 #include "common/c_content.h"
+#include "common/c_packer.h"
 #include "scripting_server.h"
 #include "environment.h"
 #include "mapblock.h"
+#include "mapsnapshot.h"
 #include "server.h"
+#include "servermap.h"
 #include "nodedef.h"
 #include "daynightratio.h"
 #include "util/pointedthing.h"
@@ -28,6 +31,7 @@
 #include "server/player_sao.h"
 #include "util/string.h"
 #include "translation.h"
+#include "voxelalgorithms.h"
 #if CHECK_CLIENT_BUILD()
 #include "client/client.h"
 #endif
@@ -788,6 +792,28 @@ int ModApiEnv::l_get_gametime(lua_State *L)
 	return 1;
 }
 
+NodeFilter::NodeFilter(std::vector<content_t> &&ids) :
+	m_ids(std::move(ids))
+{
+	if (m_ids.empty())
+		return;
+	m_lookup.resize(*std::max_element(m_ids.begin(), m_ids.end()) + 1, 0);
+	// keep the first occurrence like std::find would
+	for (u32 i = m_ids.size(); i-- > 0; )
+		m_lookup[m_ids[i]] = i + 1;
+}
+
+bool NodeFilter::matchesBlock(MapBlock *block) const
+{
+	if (!block)
+		return contains(CONTENT_IGNORE);
+	for (content_t c : block->getContents()) {
+		if (contains(c))
+			return true;
+	}
+	return false;
+}
+
 void ModApiEnvBase::collectNodeIds(lua_State *L, int idx, const NodeDefManager *ndef,
 	std::vector<content_t> &filter)
 {
@@ -807,14 +833,17 @@ void ModApiEnvBase::collectNodeIds(lua_State *L, int idx, const NodeDefManager *
 
 template <typename F>
 int ModApiEnvBase::findNodeNear(lua_State *L, v3s16 pos, int radius,
-		const std::vector<content_t> &filter, int start_radius, F &&getNode)
+		const NodeFilter &filter, int start_radius, F &&getNode)
 {
+	if (filter.empty())
+		return 0;
+
+	MapNode n;
 	for (int d = start_radius; d <= radius; d++) {
 		const std::vector<v3s16> &list = FacePositionCache::getFacePositions(d);
 		for (const v3s16 &i : list) {
 			v3s16 p = pos + i;
-			content_t c = getNode(p).getContent();
-			if (CONTAINS(filter, c)) {
+			if (getNode(p, n) && filter.contains(n.getContent())) {
 				push_v3s16(L, p);
 				return 1;
 			}
@@ -834,8 +863,9 @@ int ModApiEnv::l_find_node_near(lua_State *L)
 
 	v3s16 pos = read_v3s16(L, 1);
 	int radius = luaL_checkinteger(L, 2);
-	std::vector<content_t> filter;
-	collectNodeIds(L, 3, ndef, filter);
+	std::vector<content_t> ids;
+	collectNodeIds(L, 3, ndef, ids);
+	NodeFilter filter(std::move(ids));
 
 	int start_radius = (lua_isboolean(L, 4) && readParam<bool>(L, 4)) ? 0 : 1;
 
@@ -845,8 +875,61 @@ int ModApiEnv::l_find_node_near(lua_State *L)
 		radius = client->CSMClampRadius(pos, radius);
 #endif
 
-	auto getNode = [&map] (v3s16 p) -> MapNode {
-		return map.getNode(p);
+	// Remember for each block whether it can match at all, so that
+	// the nodes of the others are skipped without accessing them.
+	struct BlockState {
+		MapBlock *block = nullptr;
+		bool matches = false;
+	};
+	std::unordered_map<v3s16, BlockState> blocks;
+	auto getBlockState = [&] (v3s16 bp) -> const BlockState & {
+		auto [it, inserted] = blocks.try_emplace(bp);
+		if (inserted) {
+			it->second.block = map.getBlockNoCreateNoEx(bp);
+			it->second.matches = filter.matchesBlock(it->second.block);
+		}
+		return it->second;
+	};
+
+	// For larger searches, check first whether there can be a result at all.
+	// Blocks outside of the map limits are never loaded, so this is only
+	// possible if "ignore" is not searched for.
+	if (radius >= MAP_BLOCKSIZE && !filter.contains(CONTENT_IGNORE)) {
+		const s32 limit = MAX_MAP_GENERATION_LIMIT;
+		auto to_block = [&] (s32 c) -> s16 {
+			return getContainerPos((s16)core::clamp(c, -limit, limit), MAP_BLOCKSIZE);
+		};
+		v3s16 bpmin(to_block(pos.X - radius), to_block(pos.Y - radius),
+			to_block(pos.Z - radius));
+		v3s16 bpmax(to_block(pos.X + radius), to_block(pos.Y + radius),
+			to_block(pos.Z + radius));
+		if (VoxelArea(bpmin, bpmax).getVolume() <= 4096) {
+			bool any = false;
+			v3s16 bp;
+			for (bp.Z = bpmin.Z; bp.Z <= bpmax.Z && !any; bp.Z++)
+			for (bp.X = bpmin.X; bp.X <= bpmax.X && !any; bp.X++)
+			for (bp.Y = bpmin.Y; bp.Y <= bpmax.Y && !any; bp.Y++)
+				any = getBlockState(bp).matches;
+			if (!any)
+				return 0;
+		}
+	}
+
+	// Consecutive positions are mostly in the same block
+	v3s16 last_bp;
+	const BlockState *last = nullptr;
+	auto getNode = [&] (v3s16 p, MapNode &n) -> bool {
+		v3s16 bp, rel;
+		getNodeBlockPosWithOffset(p, bp, rel);
+		if (!last || bp != last_bp) {
+			last = &getBlockState(bp);
+			last_bp = bp;
+		}
+		if (!last->matches)
+			return false;
+		n = last->block ? last->block->getNodeNoCheck(rel) :
+			MapNode(CONTENT_IGNORE);
+		return true;
 	};
 	return findNodeNear(L, pos, radius, filter, start_radius, getNode);
 }
@@ -867,27 +950,33 @@ void ModApiEnvBase::checkArea(v3s16 &minp, v3s16 &maxp)
 
 template <typename F>
 int ModApiEnvBase::findNodesInArea(lua_State *L, const NodeDefManager *ndef,
-		const std::vector<content_t> &filter, bool grouped, F &&iterate)
-{
+		const NodeFilter &filter, bool grouped, const VoxelArea *flat_area,
+		F &&iterate)
+{
+	auto pushPos = [&] (v3s16 p) {
+		if (flat_area)
+			lua_pushinteger(L, flat_area->index(p) + 1);
+		else
+			push_v3s16(L, p);
+	};
+
+	const std::vector<content_t> &ids = filter.getIds();
 	if (grouped) {
 		// create the table we will be returning
-		lua_createtable(L, 0, filter.size());
+		lua_createtable(L, 0, ids.size());
 		int base = lua_gettop(L);
 
 		// create one table for each filter
 		std::vector<u32> idx;
-		idx.resize(filter.size());
-		for (u32 i = 0; i < filter.size(); i++)
+		idx.resize(ids.size());
+		for (u32 i = 0; i < ids.size(); i++)
 			lua_newtable(L);
 
 		iterate([&](v3s16 p, MapNode n) -> bool {
-			content_t c = n.getContent();
-
-			auto it = std::find(filter.begin(), filter.end(), c);
-			if (it != filter.end()) {
-				// Calculate index of the table and append the position
-				u32 filt_index = it - filter.begin();
-				push_v3s16(L, p);
+			s32 filt_index = filter.find(n.getContent());
+			if (filt_index >= 0) {
+				// Append the position to the table of the filter
+				pushPos(p);
 				lua_rawseti(L, base + 1 + filt_index, ++idx[filt_index]);
 			}
 
@@ -895,14 +984,14 @@ int ModApiEnvBase::findNodesInArea(lua_State *L, const NodeDefManager *ndef,
 		});
 
 		// last filter table is at top of stack
-		u32 i = filter.size();
+		u32 i = ids.size();
 		while (i --> 0) {
 			if (idx[i] == 0) {
 				// No such node found -> drop the empty table
 				lua_pop(L, 1);
 			} else {
 				// This node was found -> put table into the return table
-				lua_setfield(L, base, ndef->get(filter[i]).name.c_str());
+				lua_setfield(L, base, ndef->get(ids[i]).name.c_str());
 			}
 		}
 
@@ -910,35 +999,32 @@ int ModApiEnvBase::findNodesInArea(lua_State *L, const NodeDefManager *ndef,
 		return 1;
 	} else {
 		std::vector<u32> individual_count;
-		individual_count.resize(filter.size());
+		individual_count.resize(ids.size());
 
 		lua_newtable(L);
 		u32 i = 0;
 		iterate([&](v3s16 p, MapNode n) -> bool {
-			content_t c = n.getContent();
-
-			auto it = std::find(filter.begin(), filter.end(), c);
-			if (it != filter.end()) {
-				push_v3s16(L, p);
+			s32 filt_index = filter.find(n.getContent());
+			if (filt_index >= 0) {
+				pushPos(p);
 				lua_rawseti(L, -2, ++i);
 
-				u32 filt_index = it - filter.begin();
 				individual_count[filt_index]++;
 			}
 
 			return true;
 		});
 
-		lua_createtable(L, 0, filter.size());
-		for (u32 i = 0; i < filter.size(); i++) {
+		lua_createtable(L, 0, ids.size());
+		for (u32 i = 0; i < ids.size(); i++) {
 			lua_pushinteger(L, individual_count[i]);
-			lua_setfield(L, -2, ndef->get(filter[i]).name.c_str());
+			lua_setfield(L, -2, ndef->get(ids[i]).name.c_str());
 		}
 		return 2;
 	}
 }
 
-// find_nodes_in_area(minp, maxp, nodenames, [grouped])
+// find_nodes_in_area(minp, maxp, nodenames, [grouped], [flat])
 int ModApiEnv::l_find_nodes_in_area(lua_State *L)
 {
 	GET_PLAIN_ENV_PTR;
@@ -946,6 +1032,7 @@ int ModApiEnv::l_find_nodes_in_area(lua_State *L)
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
 	sortBoxVerticies(minp, maxp);
+	const VoxelArea area(minp, maxp);
 
 	const NodeDefManager *ndef = env->getGameDef()->ndef();
 	Map &map = env->getMap();
@@ -959,20 +1046,25 @@ int ModApiEnv::l_find_nodes_in_area(lua_State *L)
 
 	checkArea(minp, maxp);
 
-	std::vector<content_t> filter;
-	collectNodeIds(L, 3, ndef, filter);
+	std::vector<content_t> ids;
+	collectNodeIds(L, 3, ndef, ids);
+	NodeFilter filter(std::move(ids));
 
 	bool grouped = lua_isboolean(L, 4) && readParam<bool>(L, 4);
+	bool flat = lua_isboolean(L, 5) && readParam<bool>(L, 5);
 
 	auto iterate = [&] (auto &&callback) {
-		map.forEachNodeInArea(minp, maxp, callback);
+		map.forEachNodeInArea(minp, maxp, callback, [&] (MapBlock *block) {
+			return filter.matchesBlock(block);
+		});
 	};
-	return findNodesInArea(L, ndef, filter, grouped, iterate);
+	return findNodesInArea(L, ndef, filter, grouped, flat ? &area : nullptr,
+		iterate);
 }
 
 template <typename F>
 int ModApiEnvBase::findNodesInAreaUnderAir(lua_State *L, v3s16 minp, v3s16 maxp,
-	const std::vector<content_t> &filter, F &&getNode)
+	const NodeFilter &filter, F &&getNode)
 {
 	lua_newtable(L);
 	u32 i = 0;
@@ -985,7 +1077,7 @@ int ModApiEnvBase::findNodesInAreaUnderAir(lua_State *L, v3s16 minp, v3s16 maxp,
 			v3s16 psurf(p.X, p.Y + 1, p.Z);
 			content_t csurf = getNode(psurf).getContent();
 			if (c != CONTENT_AIR && csurf == CONTENT_AIR &&
-					CONTAINS(filter, c)) {
+					filter.contains(c)) {
 				push_v3s16(L, p);
 				lua_rawseti(L, -2, ++i);
 			}
@@ -1021,8 +1113,9 @@ int ModApiEnv::l_find_nodes_in_area_under_air(lua_State *L)
 
 	checkArea(minp, maxp);
 
-	std::vector<content_t> filter;
-	collectNodeIds(L, 3, ndef, filter);
+	std::vector<content_t> ids;
+	collectNodeIds(L, 3, ndef, ids);
+	NodeFilter filter(std::move(ids));
 
 	auto getNode = [&map] (v3s16 p) -> MapNode {
 		return map.getNode(p);
@@ -1256,20 +1349,11 @@ int ModApiEnv::l_delete_area(lua_State *L)
 	return 1;
 }
 
-// find_path(pos1, pos2, searchdistance,
-//     max_jump, max_drop, algorithm) -> table containing path
-int ModApiEnv::l_find_path(lua_State *L)
+static PathAlgorithm read_path_algorithm(lua_State *L, int index)
 {
-	GET_ENV_PTR;
-
-	v3s16 pos1                  = read_v3s16(L, 1);
-	v3s16 pos2                  = read_v3s16(L, 2);
-	unsigned int searchdistance = luaL_checkint(L, 3);
-	unsigned int max_jump       = luaL_checkint(L, 4);
-	unsigned int max_drop       = luaL_checkint(L, 5);
-	PathAlgorithm algo          = PA_PLAIN_NP;
-	if (!lua_isnoneornil(L, 6)) {
-		std::string algorithm = luaL_checkstring(L,6);
+	PathAlgorithm algo = PA_PLAIN_NP;
+	if (!lua_isnoneornil(L, index)) {
+		std::string algorithm = luaL_checkstring(L, index);
 
 		if (algorithm == "A*")
 			algo = PA_PLAIN;
@@ -1277,10 +1361,11 @@ int ModApiEnv::l_find_path(lua_State *L)
 		if (algorithm == "Dijkstra")
 			algo = PA_DIJKSTRA;
 	}
+	return algo;
+}
 
-	std::vector<v3s16> path = get_path(&env->getServerMap(), env->getGameDef()->ndef(), pos1, pos2,
-		searchdistance, max_jump, max_drop, algo);
-
+static int push_path(lua_State *L, const std::vector<v3s16> &path)
+{
 	if (!path.empty()) {
 		lua_createtable(L, path.size(), 0);
 		int top = lua_gettop(L);
@@ -1297,6 +1382,25 @@ int ModApiEnv::l_find_path(lua_State *L)
 	return 0;
 }
 
+// find_path(pos1, pos2, searchdistance,
+//     max_jump, max_drop, algorithm) -> table containing path
+int ModApiEnv::l_find_path(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 pos1                  = read_v3s16(L, 1);
+	v3s16 pos2                  = read_v3s16(L, 2);
+	unsigned int searchdistance = luaL_checkint(L, 3);
+	unsigned int max_jump       = luaL_checkint(L, 4);
+	unsigned int max_drop       = luaL_checkint(L, 5);
+	PathAlgorithm algo          = read_path_algorithm(L, 6);
+
+	std::vector<v3s16> path = get_path(&env->getServerMap(), env->getGameDef()->ndef(), pos1, pos2,
+		searchdistance, max_jump, max_drop, algo);
+
+	return push_path(L, path);
+}
+
 // spawn_tree(pos, treedef)
 int ModApiEnv::l_spawn_tree(lua_State *L)
 {
@@ -1383,6 +1487,31 @@ int ModApiEnv::l_get_translated_string(lua_State * L)
 	return 1;
 }
 
+// get_map_snapshot([allow_old])
+int ModApiEnv::l_get_map_snapshot(lua_State *L)
+{
+	Server *server = getServer(L);
+	if (getScriptApiBase(L)->getType() != ScriptingType::Async) {
+		GET_ENV_PTR;
+		// The main thread gets the current state of the map, unless it
+		// is fine with the last periodic update
+		ServerMap &map = env->getServerMap();
+		bool allow_old = readParam<bool>(L, 1, false);
+		// also marks snapshots as used
+		bool have_snapshot = map.getSnapshot() != nullptr;
+		if (!allow_old || !have_snapshot)
+			map.updateSnapshot();
+	}
+
+	auto snapshot = server->getEnv().getServerMap().getSnapshot();
+	if (!snapshot) {
+		lua_pushnil(L);
+		return 1;
+	}
+	LuaMapSnapshot::create(L, std::move(snapshot));
+	return 1;
+}
+
 void ModApiEnv::Initialize(lua_State *L, int top)
 {
 	API_FCT(set_node);
@@ -1435,6 +1564,7 @@ void ModApiEnv::Initialize(lua_State *L, int top)
 	API_FCT(forceload_free_block);
 	API_FCT(compare_block_status);
 	API_FCT(get_translated_string);
+	API_FCT(get_map_snapshot);
 }
 
 void ModApiEnv::InitializeClient(lua_State *L, int top)
@@ -1451,6 +1581,11 @@ void ModApiEnv::InitializeClient(lua_State *L, int top)
 	API_FCT(raycast);
 }
 
+void ModApiEnv::InitializeAsync(lua_State *L, int top)
+{
+	API_FCT(get_map_snapshot);
+}
+
 #define GET_VM_PTR               \
 	MMVManip *vm = getVManip(L); \
 	if (!vm)                     \
@@ -1530,17 +1665,19 @@ int ModApiEnvVM::l_find_node_near(lua_State *L)
 
 	v3s16 pos = read_v3s16(L, 1);
 	int radius = luaL_checkinteger(L, 2);
-	std::vector<content_t> filter;
-	collectNodeIds(L, 3, ndef, filter);
+	std::vector<content_t> ids;
+	collectNodeIds(L, 3, ndef, ids);
+	NodeFilter filter(std::move(ids));
 	int start_radius = (lua_isboolean(L, 4) && readParam<bool>(L, 4)) ? 0 : 1;
 
-	auto getNode = [&vm] (v3s16 p) -> MapNode {
-		return vm->getNodeNoExNoEmerge(p);
+	auto getNode = [&vm] (v3s16 p, MapNode &n) -> bool {
+		n = vm->getNodeNoExNoEmerge(p);
+		return true;
 	};
 	return findNodeNear(L, pos, radius, filter, start_radius, getNode);
 }
 
-// find_nodes_in_area(minp, maxp, nodenames, [grouped])
+// find_nodes_in_area(minp, maxp, nodenames, [grouped], [flat])
 int ModApiEnvVM::l_find_nodes_in_area(lua_State *L)
 {
 	GET_VM_PTR;
@@ -1550,6 +1687,7 @@ int ModApiEnvVM::l_find_nodes_in_area(lua_State *L)
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
 	sortBoxVerticies(minp, maxp);
+	const VoxelArea area(minp, maxp);
 
 	checkArea(minp, maxp);
 	// avoid the loop going out-of-bounds
@@ -1559,10 +1697,12 @@ int ModApiEnvVM::l_find_nodes_in_area(lua_State *L)
 		maxp = cropped.MaxEdge;
 	}
 
-	std::vector<content_t> filter;
-	collectNodeIds(L, 3, ndef, filter);
+	std::vector<content_t> ids;
+	collectNodeIds(L, 3, ndef, ids);
+	NodeFilter filter(std::move(ids));
 
 	bool grouped = lua_isboolean(L, 4) && readParam<bool>(L, 4);
+	bool flat = lua_isboolean(L, 5) && readParam<bool>(L, 5);
 
 	auto iterate = [&] (auto callback) {
 		for (s16 z = minp.Z; z <= maxp.Z; z++)
@@ -1577,7 +1717,8 @@ int ModApiEnvVM::l_find_nodes_in_area(lua_State *L)
 			}
 		}
 	};
-	return findNodesInArea(L, ndef, filter, grouped, iterate);
+	return findNodesInArea(L, ndef, filter, grouped, flat ? &area : nullptr,
+		iterate);
 }
 
 // find_nodes_in_area_under_air(minp, maxp, nodenames)
@@ -1592,8 +1733,9 @@ int ModApiEnvVM::l_find_nodes_in_area_under_air(lua_State *L)
 	sortBoxVerticies(minp, maxp);
 	checkArea(minp, maxp);
 
-	std::vector<content_t> filter;
-	collectNodeIds(L, 3, ndef, filter);
+	std::vector<content_t> ids;
+	collectNodeIds(L, 3, ndef, ids);
+	NodeFilter filter(std::move(ids));
 
 	auto getNode = [&vm] (v3s16 p) -> MapNode {
 		return vm->getNodeNoExNoEmerge(p);
@@ -1646,3 +1788,164 @@ void ModApiEnvVM::InitializeEmerge(lua_State *L, int top)
 }
 
 #undef GET_VM_PTR
+
+/*
+	LuaMapSnapshot
+*/
+
+int LuaMapSnapshot::gc_object(lua_State *L)
+{
+	LuaMapSnapshot *o = *(LuaMapSnapshot **)(lua_touserdata(L, 1));
+	delete o;
+	return 0;
+}
+
+// get_node(self, pos)
+int LuaMapSnapshot::l_get_node(lua_State *L)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, 1);
+
+	v3s16 pos = read_v3s16(L, 2);
+	pushnode(L, o->m_snapshot->getNode(pos));
+	return 1;
+}
+
+// get_node_or_nil(self, pos)
+int LuaMapSnapshot::l_get_node_or_nil(lua_State *L)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, 1);
+
+	v3s16 pos = read_v3s16(L, 2);
+	bool pos_ok;
+	MapNode n = o->m_snapshot->getNode(pos, &pos_ok);
+	if (pos_ok)
+		pushnode(L, n);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+// find_nodes_in_area(self, minp, maxp, nodenames, [grouped], [flat])
+int LuaMapSnapshot::l_find_nodes_in_area(lua_State *L)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, 1);
+	const MapSnapshot &snapshot = *o->m_snapshot;
+
+	v3s16 minp = read_v3s16(L, 2);
+	v3s16 maxp = read_v3s16(L, 3);
+	sortBoxVerticies(minp, maxp);
+	const VoxelArea area(minp, maxp);
+
+	const NodeDefManager *ndef = getGameDef(L)->ndef();
+
+	checkArea(minp, maxp);
+
+	std::vector<content_t> ids;
+	collectNodeIds(L, 4, ndef, ids);
+	NodeFilter filter(std::move(ids));
+
+	bool grouped = lua_isboolean(L, 5) && readParam<bool>(L, 5);
+	bool flat = lua_isboolean(L, 6) && readParam<bool>(L, 6);
+
+	auto iterate = [&] (auto &&callback) {
+		snapshot.forEachNodeInArea(minp, maxp, callback);
+	};
+	return findNodesInArea(L, ndef, filter, grouped, flat ? &area : nullptr,
+		iterate);
+}
+
+// line_of_sight(self, pos1, pos2)
+int LuaMapSnapshot::l_line_of_sight(lua_State *L)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, 1);
+	const MapSnapshot &snapshot = *o->m_snapshot;
+
+	v3f pos1 = checkFloatPos(L, 2);
+	v3f pos2 = checkFloatPos(L, 3);
+
+	// Same as Environment::line_of_sight()
+	voxalgo::VoxelLineIterator iterator(pos1 / BS, (pos2 - pos1) / BS);
+	do {
+		MapNode n = snapshot.getNode(iterator.m_current_node_pos);
+		if (n.param0 != CONTENT_AIR) {
+			lua_pushboolean(L, false);
+			push_v3s16(L, iterator.m_current_node_pos);
+			return 2;
+		}
+		iterator.next();
+	} while (iterator.m_current_index <= iterator.m_last_index);
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+// find_path(self, pos1, pos2, searchdistance, max_jump, max_drop, [algorithm])
+int LuaMapSnapshot::l_find_path(lua_State *L)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, 1);
+
+	v3s16 pos1                  = read_v3s16(L, 2);
+	v3s16 pos2                  = read_v3s16(L, 3);
+	unsigned int searchdistance = luaL_checkint(L, 4);
+	unsigned int max_jump       = luaL_checkint(L, 5);
+	unsigned int max_drop       = luaL_checkint(L, 6);
+	PathAlgorithm algo          = read_path_algorithm(L, 7);
+
+	std::vector<v3s16> path = get_path(o->m_snapshot.get(), getGameDef(L)->ndef(),
+		pos1, pos2, searchdistance, max_jump, max_drop, algo);
+
+	return push_path(L, path);
+}
+
+// get_epoch(self)
+int LuaMapSnapshot::l_get_epoch(lua_State *L)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, 1);
+	lua_pushnumber(L, o->m_snapshot->getEpoch());
+	return 1;
+}
+
+void LuaMapSnapshot::create(lua_State *L, std::shared_ptr<const MapSnapshot> snapshot)
+{
+	LuaMapSnapshot *o = new LuaMapSnapshot(std::move(snapshot));
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, className);
+	lua_setmetatable(L, -2);
+}
+
+void *LuaMapSnapshot::packIn(lua_State *L, int idx)
+{
+	LuaMapSnapshot *o = checkObject<LuaMapSnapshot>(L, idx);
+	// The snapshot is immutable, so it is shared instead of copied
+	return new std::shared_ptr<const MapSnapshot>(o->m_snapshot);
+}
+
+void LuaMapSnapshot::packOut(lua_State *L, void *ptr)
+{
+	auto *snapshot = reinterpret_cast<std::shared_ptr<const MapSnapshot> *>(ptr);
+	if (L)
+		create(L, std::move(*snapshot));
+	delete snapshot;
+}
+
+void LuaMapSnapshot::Register(lua_State *L)
+{
+	static const luaL_Reg metamethods[] = {
+		{"__gc", gc_object},
+		{0, 0}
+	};
+	registerClass<LuaMapSnapshot>(L, methods, metamethods);
+
+	script_register_packer(L, className, packIn, packOut);
+}
+
+const char LuaMapSnapshot::className[] = "MapSnapshot";
+const luaL_Reg LuaMapSnapshot::methods[] = {
+	luamethod(LuaMapSnapshot, get_node),
+	luamethod(LuaMapSnapshot, get_node_or_nil),
+	luamethod(LuaMapSnapshot, find_nodes_in_area),
+	luamethod(LuaMapSnapshot, line_of_sight),
+	luamethod(LuaMapSnapshot, find_path),
+	luamethod(LuaMapSnapshot, get_epoch),
+	{0,0}
+};
@@ -6,8 +6,37 @@
 
 #include "lua_api/l_base.h"
 #include "raycast.h"
+#include <memory>
 
 class ServerScripting;
+class MapBlock;
+class MapSnapshot;
+
+// Node names of the find_node* functions, with a lookup table for matching
+class NodeFilter {
+public:
+	NodeFilter(std::vector<content_t> &&ids);
+
+	// Content ids in the order given, may contain duplicates
+	const std::vector<content_t> &getIds() const { return m_ids; }
+	bool empty() const { return m_ids.empty(); }
+
+	// @return index of the first occurrence in getIds(), or -1
+	s32 find(content_t c) const
+	{
+		return c < m_lookup.size() ? (s32)m_lookup[c] - 1 : -1;
+	}
+
+	bool contains(content_t c) const { return find(c) >= 0; }
+
+	// Whether the block (nullptr if not loaded) can contain any matching nodes
+	bool matchesBlock(MapBlock *block) const;
+
+private:
+	std::vector<content_t> m_ids;
+	// index in m_ids + 1, 0 if not contained
+	std::vector<u32> m_lookup;
+};
 
 // base class containing helpers
 class ModApiEnvBase : public ModApiBase {
@@ -18,22 +47,25 @@ class ModApiEnvBase : public ModApiBase {
 
 	static void checkArea(v3s16 &minp, v3s16 &maxp);
 
-	// F must be (v3s16 pos) -> MapNode
+	// F must be (v3s16 pos, MapNode &n) -> bool
+	// returning false if the position cannot match and is skipped
 	template <typename F>
 	static int findNodeNear(lua_State *L, v3s16 pos, int radius,
-		const std::vector<content_t> &filter, int start_radius, F &&getNode);
+		const NodeFilter &filter, int start_radius, F &&getNode);
 
 	// F must be (G callback) -> void
 	// with G being (v3s16 p, MapNode n) -> bool
 	// and behave like Map::forEachNodeInArea
+	// If flat_area is set, indices into it are returned instead of positions.
 	template <typename F>
 	static int findNodesInArea(lua_State *L,  const NodeDefManager *ndef,
-		const std::vector<content_t> &filter, bool grouped, F &&iterate);
+		const NodeFilter &filter, bool grouped, const VoxelArea *flat_area,
+		F &&iterate);
 
 	// F must be (v3s16 pos) -> MapNode
 	template <typename F>
 	static int findNodesInAreaUnderAir(lua_State *L, v3s16 minp, v3s16 maxp,
-		const std::vector<content_t> &filter, F &&getNode);
+		const NodeFilter &filter, F &&getNode);
 
 	static const EnumString es_ClearObjectsMode[];
 	static const EnumString es_BlockStatusType[];
@@ -225,9 +257,13 @@ class ModApiEnv : public ModApiEnvBase {
 	// get_translated_string(lang_code, string)
 	static int l_get_translated_string(lua_State * L);
 
+	// get_map_snapshot([allow_old])
+	static int l_get_map_snapshot(lua_State *L);
+
 public:
 	static void Initialize(lua_State *L, int top);
 	static void InitializeClient(lua_State *L, int top);
+	static void InitializeAsync(lua_State *L, int top);
 };
 
 /*
@@ -255,7 +291,7 @@ class ModApiEnvVM : public ModApiEnvBase {
 	// find_node_near(pos, radius, nodenames, [search_center])
 	static int l_find_node_near(lua_State *L);
 
-	// find_nodes_in_area(minp, maxp, nodenames, [grouped])
+	// find_nodes_in_area(minp, maxp, nodenames, [grouped], [flat])
 	static int l_find_nodes_in_area(lua_State *L);
 
 	// find_surface_nodes_in_area(minp, maxp, nodenames)
@@ -308,6 +344,53 @@ class LuaRaycast : public ModApiBase
 	static const char className[];
 };
 
+//! Lua wrapper for MapSnapshot objects
+class LuaMapSnapshot : public ModApiEnvBase
+{
+private:
+	static const luaL_Reg methods[];
+	std::shared_ptr<const MapSnapshot> m_snapshot;
+
+	// garbage collector
+	static int gc_object(lua_State *L);
+
+	// get_node(pos)
+	static int l_get_node(lua_State *L);
+
+	// get_node_or_nil(pos)
+	static int l_get_node_or_nil(lua_State *L);
+
+	// find_nodes_in_area(minp, maxp, nodenames, [grouped], [flat])
+	static int l_find_nodes_in_area(lua_State *L);
+
+	// line_of_sight(pos1, pos2)
+	static int l_line_of_sight(lua_State *L);
+
+	// find_path(pos1, pos2, searchdistance, max_jump, max_drop, [algorithm])
+	static int l_find_path(lua_State *L);
+
+	// get_epoch()
+	static int l_get_epoch(lua_State *L);
+
+public:
+	LuaMapSnapshot(std::shared_ptr<const MapSnapshot> snapshot) :
+		m_snapshot(std::move(snapshot))
+	{}
+
+	const std::shared_ptr<const MapSnapshot> &getSnapshot() const { return m_snapshot; }
+
+	//! Creates a LuaMapSnapshot and leaves it on top of the stack.
+	static void create(lua_State *L, std::shared_ptr<const MapSnapshot> snapshot);
+
+	static void *packIn(lua_State *L, int idx);
+	static void packOut(lua_State *L, void *ptr);
+
+	//! Registers MapSnapshot as a Lua userdata type.
+	static void Register(lua_State *L);
+
+	static const char className[];
+};
+
 struct ScriptCallbackState {
 	ServerScripting *script;
 	int callback_ref;
@@ -13,8 +13,12 @@
 #include "map.h"
 #include "mapblock.h"
 #include "server.h"
+#include "util/serialize.h"
 #include "voxelalgorithms.h"
 
+// The raw data is the node array itself where possible
+static_assert(sizeof(MapNode) == 4);
+
 // garbage collector
 int LuaVoxelManip::gc_object(lua_State *L)
 {
@@ -346,6 +350,80 @@ int LuaVoxelManip::l_set_param2_data(lua_State *L)
 	return 0;
 }
 
+// get_raw_data(self)
+int LuaVoxelManip::l_get_raw_data(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManip *o = checkObject<LuaVoxelManip>(L, 1);
+	MMVManip *vm = o->vm;
+	const u32 volume = vm->m_area.getVolume();
+
+	// Little endian content id, param1, param2
+	std::string data(volume * 4, '\0');
+	u8 *p = reinterpret_cast<u8 *>(&data[0]);
+#if BYTE_ORDER == LITTLE_ENDIAN
+	if (volume > 0)
+		memcpy(p, vm->m_data, volume * 4);
+#else
+	for (u32 i = 0; i != volume; i++) {
+		const MapNode &n = vm->m_data[i];
+		p[i * 4] = n.param0 & 0xFF;
+		p[i * 4 + 1] = n.param0 >> 8;
+		p[i * 4 + 2] = n.param1;
+		p[i * 4 + 3] = n.param2;
+	}
+#endif
+
+	// Do not push unintialized data to Lua, same values as get_data() etc.
+	for (u32 i = 0; i != volume; i++) {
+		if (vm->m_flags[i] & VOXELFLAG_NO_DATA) {
+			p[i * 4] = CONTENT_IGNORE & 0xFF;
+			p[i * 4 + 1] = CONTENT_IGNORE >> 8;
+			p[i * 4 + 2] = 0;
+			p[i * 4 + 3] = 0;
+		}
+	}
+
+	lua_pushlstring(L, data.c_str(), data.size());
+	return 1;
+}
+
+// set_raw_data(self, data)
+int LuaVoxelManip::l_set_raw_data(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManip *o = checkObject<LuaVoxelManip>(L, 1);
+	MMVManip *vm = o->vm;
+	const u32 volume = vm->m_area.getVolume();
+
+	size_t len;
+	const char *s = luaL_checklstring(L, 2, &len);
+	if (len != (size_t)volume * 4)
+		throw LuaError("VoxelManip:set_raw_data: expected " +
+			std::to_string((size_t)volume * 4) + " bytes, got " +
+			std::to_string(len));
+
+	const u8 *p = reinterpret_cast<const u8 *>(s);
+#if BYTE_ORDER == LITTLE_ENDIAN
+	if (volume > 0)
+		memcpy(vm->m_data, p, len);
+#else
+	for (u32 i = 0; i != volume; i++) {
+		MapNode &n = vm->m_data[i];
+		n.param0 = p[i * 4] | (p[i * 4 + 1] << 8);
+		n.param1 = p[i * 4 + 2];
+		n.param2 = p[i * 4 + 3];
+	}
+#endif
+
+	// See l_set_data()
+	vm->clearFlags(vm->m_area, VOXELFLAG_NO_DATA);
+
+	return 0;
+}
+
 int LuaVoxelManip::l_update_map(lua_State *L)
 {
 	return 0;
@@ -497,6 +575,8 @@ const luaL_Reg LuaVoxelManip::methods[] = {
 	luamethod(LuaVoxelManip, set_light_data),
 	luamethod(LuaVoxelManip, get_param2_data),
 	luamethod(LuaVoxelManip, set_param2_data),
+	luamethod(LuaVoxelManip, get_raw_data),
+	luamethod(LuaVoxelManip, set_raw_data),
 	luamethod(LuaVoxelManip, was_modified),
 	luamethod(LuaVoxelManip, get_emerged_area),
 	luamethod(LuaVoxelManip, close),
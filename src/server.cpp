@@ -21,6 +21,7 @@
 #include "version.h"
 #include "filesys.h"
 #include "mapblock.h"
+#include "mapblock_diff.h"
 #include "server/serveractiveobject.h"
 #include "serialization.h" // SER_FMT_VER_INVALID
 #include "settings.h"
@@ -53,6 +54,8 @@
 #include "remoteplayer.h"
 #include "server/player_sao.h"
 #include "server/serverinventorymgr.h"
+#include "server/sentblockhistory.h"
+#include "server/serializedblockcache.h"
 #include "translation.h"
 #include "database/database-sqlite3.h"
 #if USE_POSTGRESQL
@@ -269,7 +272,8 @@ Server::Server(
 	m_simple_singleplayer_mode(simple_singleplayer_mode),
 	m_dedicated(dedicated),
 	m_async_fatal_error(""),
-	m_con(con::createMTP(CONNECTION_TIMEOUT, m_bind_addr.isIPv6(), this)),
+	m_con(con::createMTP(CONNECTION_TIMEOUT, m_bind_addr.isIPv6(), this,
+		g_settings->getU16("num_network_workers"))),
 	m_itemdef(createItemDefManager()),
 	m_nodedef(createNodeDefManager()),
 	m_craftdef(createCraftDefManager()),
@@ -329,6 +333,24 @@ Server::Server(
 
 	m_lag_gauge->set(g_settings->getFloat("dedicated_server_step"));
 
+	m_block_cache = std::make_unique<SerializedBlockCache>(
+		(size_t)g_settings->getU32("block_send_cache_size") * 1024 * 1024,
+		rangelim(g_settings->getS16("map_compression_level_net"), -1, 9));
+	m_block_cache->setSendCallback([this] (v3s16 pos,
+			const std::vector<session_t> &peers,
+			const SerializedBlockCache::Data &data, bool outdated) {
+		for (session_t peer_id : peers) {
+			SendBlockData(peer_id, pos, *data);
+			// The client needs the current version too
+			if (outdated)
+				m_blocks_to_resend.push_back({peer_id, pos});
+		}
+	});
+
+	m_sent_block_history = std::make_unique<SentBlockHistory>(
+		(size_t)g_settings->getU32("block_send_diff_history_size") * 1024 * 1024,
+		SER_FMT_VER_HIGHEST_WRITE);
+
 	m_path_mod_data = porting::path_user + DIR_DELIM "mod_data";
 	if (!fs::CreateDir(m_path_mod_data))
 		throw ServerError("Failed to create mod data dir");
@@ -348,6 +370,8 @@ Server::~Server()
 		delete m_thread;
 	}
 
+	m_block_cache.reset();
+
 	// Stop all emerge activity and finish off mapgen callbacks. Do this before
 	// shutdown callbacks since there may be state that is finalized in a
 	// callback.
@@ -723,6 +747,16 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 	*/
 	m_env->getServerMap().step();
 
+	/*
+		Update the map snapshot used by other threads
+	*/
+	if (m_map_snapshot_interval.step(dtime,
+			g_settings->getFloat("map_snapshot_interval"))) {
+		EnvAutoLock lock(this);
+		ScopeProfiler sp(g_profiler, "Server: update map snapshot");
+		m_env->getServerMap().updateSnapshot();
+	}
+
 	/*
 		Listen to the admin chat, if available
 	*/
@@ -859,79 +893,54 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		EnvAutoLock envlock(this);
 		ScopeProfiler sp(g_profiler, "Server: send SAO messages");
 
-		// Key = object id
-		// Value = data sent by object
-		std::unordered_map<u16, std::vector<ActiveObjectMessage>*> buffered_messages;
+		// Get active object messages from environment and serialize them
+		m_env->takeActiveObjectMessages(m_aom_queue);
+		m_aom_batch.build(m_aom_queue);
+		m_aom_queue.clear();
 
-		// Get active object messages from environment
-		ActiveObjectMessage aom(0);
-		u32 count_reliable = 0, count_unreliable = 0;
-		for(;;) {
-			if (!m_env->getActiveObjectMessage(&aom))
-				break;
-			if (aom.reliable)
-				count_reliable++;
-			else
-				count_unreliable++;
+		m_aom_buffer_counter[0]->increment(m_aom_batch.getMessageCounts()[0]);
+		m_aom_buffer_counter[1]->increment(m_aom_batch.getMessageCounts()[1]);
 
-			std::vector<ActiveObjectMessage>* message_list = nullptr;
-			auto n = buffered_messages.find(aom.id);
-			if (n == buffered_messages.end()) {
-				message_list = new std::vector<ActiveObjectMessage>;
-				buffered_messages[aom.id] = message_list;
-			} else {
-				message_list = n->second;
-			}
-			message_list->push_back(std::move(aom));
-		}
+		// If object does not exist, skip it
+		auto &objects = m_aom_batch.getObjects();
+		for (auto &obj : objects)
+			obj.sao = m_env->getActiveObject(obj.id);
 
-		m_aom_buffer_counter[0]->increment(count_reliable);
-		m_aom_buffer_counter[1]->increment(count_unreliable);
-
-		{
+		if (!objects.empty()) {
 			ClientInterface::AutoLock clientlock(m_clients);
 			const RemoteClientMap &clients = m_clients.getClientList();
 			// Route data to every client
-			std::string reliable_data, unreliable_data;
+			std::string &reliable_data = m_aom_data[0];
+			std::string &unreliable_data = m_aom_data[1];
 			for (const auto &client_it : clients) {
 				reliable_data.clear();
 				unreliable_data.clear();
 				RemoteClient *client = client_it.second;
+				const std::set<u16> &known = client->m_known_objects;
+				if (known.empty())
+					continue;
 				PlayerSAO *player = getPlayerSAO(client->peer_id);
-				// Go through all objects in message buffer
-				for (const auto &buffered_message : buffered_messages) {
-					// If object does not exist or is not known by client, skip it
-					u16 id = buffered_message.first;
-					ServerActiveObject *sao = m_env->getActiveObject(id);
-					if (!sao || client->m_known_objects.find(id) == client->m_known_objects.end())
+
+				for (const auto &obj : objects) {
+					// Skip objects not known by client
+					if (!obj.sao || known.find(obj.id) == known.end())
 						continue;
 
-					// Get message list of object
-					std::vector<ActiveObjectMessage>* list = buffered_message.second;
-					// Go through every message
-					for (const ActiveObjectMessage &aom : *list) {
+					bool skip_position = false;
+					if (obj.has_position) {
 						// Send position updates to players who do not see the attachment
-						if (aom.datastring[0] == AO_CMD_UPDATE_POSITION) {
-							if (sao->getId() == player->getId())
-								continue;
-
-							// Do not send position updates for attached players
-							// as long the parent is known to the client
-							ServerActiveObject *parent = sao->getParent();
-							if (parent && client->m_known_objects.find(parent->getId()) !=
-									client->m_known_objects.end())
-								continue;
-						}
-
-						// Add full new data to appropriate buffer
-						std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
-						char idbuf[2];
-						writeU16((u8*) idbuf, aom.id);
-						// u16 id
-						// std::string data
-						buffer.append(idbuf, sizeof(idbuf));
-						buffer.append(serializeString16(aom.datastring));
+						if (player && obj.id == player->getId())
+							skip_position = true;
+
+						// Do not send position updates for attached players
+						// as long the parent is known to the client
+						ServerActiveObject *parent = obj.sao->getParent();
+						if (parent && known.find(parent->getId()) != known.end())
+							skip_position = true;
 					}
+
+					m_aom_batch.append(obj, skip_position, reliable_data,
+						unreliable_data);
 				}
 				/*
 					reliable_data and unreliable_data are now ready.
@@ -946,11 +955,6 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 				}
 			}
 		}
-
-		// Clear buffered_messages
-		for (auto &buffered_message : buffered_messages) {
-			delete buffered_message.second;
-		}
 	}
 
 	/*
@@ -1027,7 +1031,7 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 			*/
 			for (const u16 far_player : far_players) {
 				if (RemoteClient *client = getClient(far_player))
-					client->SetBlocksNotSent(event->modified_blocks, event->low_priority);
+					client->SetBlocksChanged(event->modified_blocks, event->low_priority);
 			}
 
 			delete event;
@@ -1281,7 +1285,8 @@ void Server::ProcessData(NetworkPacket *pkt)
 	// Environment is locked first.
 	EnvAutoLock envlock(this);
 
-	ScopeProfiler sp(g_profiler, "Server: Process network packet (sum)");
+	static const ProfilerId sp_id = ScopeProfiler::makeId("Server: Process network packet (sum)");
+	ScopeProfiler sp(g_profiler, sp_id);
 	u32 peer_id = pkt->getPeerId();
 
 	try {
@@ -1342,6 +1347,12 @@ void Server::setTimeOfDay(u32 time)
 
 void Server::onMapEditEvent(const MapEditEvent &event)
 {
+	// Serialized copies are outdated in any case
+	if (m_block_cache)
+		m_block_cache->invalidate(event.modified_blocks);
+	if (m_sent_block_history)
+		m_sent_block_history->invalidate(event.modified_blocks);
+
 	if (m_ignore_map_edit_events_area.contains(event.getArea()))
 		return;
 
@@ -2329,30 +2340,26 @@ void Server::fadeSound(s32 handle, float step, float gain)
 void Server::sendRemoveNode(v3s16 p, std::unordered_set<u16> *far_players,
 		float far_d_nodes)
 {
-	v3f p_f = intToFloat(p, BS);
-	v3s16 block_pos = getNodeBlockPos(p);
-
 	NetworkPacket pkt(TOCLIENT_REMOVENODE, 6);
 	pkt << p;
 
-	sendNodeChangePkt(pkt, block_pos, p_f, far_d_nodes, far_players);
+	sendNodeChangePkt(pkt, p, far_d_nodes, far_players);
 }
 
 void Server::sendAddNode(v3s16 p, MapNode n, std::unordered_set<u16> *far_players,
 		float far_d_nodes, bool remove_metadata)
 {
-	v3f p_f = intToFloat(p, BS);
-	v3s16 block_pos = getNodeBlockPos(p);
-
 	NetworkPacket pkt(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
 	pkt << p << n.param0 << n.param1 << n.param2
 			<< (u8) (remove_metadata ? 0 : 1);
-	sendNodeChangePkt(pkt, block_pos, p_f, far_d_nodes, far_players);
+	sendNodeChangePkt(pkt, p, far_d_nodes, far_players);
 }
 
-void Server::sendNodeChangePkt(NetworkPacket &pkt, v3s16 block_pos,
-		v3f p, float far_d_nodes, std::unordered_set<u16> *far_players)
+void Server::sendNodeChangePkt(NetworkPacket &pkt, v3s16 p,
+		float far_d_nodes, std::unordered_set<u16> *far_players)
 {
+	v3f p_f = intToFloat(p, BS);
+	v3s16 block_pos = getNodeBlockPos(p);
 	float maxd = far_d_nodes * BS;
 	std::vector<session_t> clients = m_clients.getClientIDs();
 	ClientInterface::AutoLock clientlock(m_clients);
@@ -2367,15 +2374,16 @@ void Server::sendNodeChangePkt(NetworkPacket &pkt, v3s16 block_pos,
 
 		// If player is far away, only set modified blocks not sent
 		if (!client->isBlockSent(block_pos) || (sao &&
-				sao->getBasePosition().getDistanceFrom(p) > maxd)) {
+				sao->getBasePosition().getDistanceFrom(p_f) > maxd)) {
 			if (far_players)
 				far_players->emplace(client_id);
 			else
-				client->SetBlockNotSent(block_pos);
+				client->SetBlockChanged(block_pos);
 			continue;
 		}
 
 		Send(client_id, &pkt);
+		client->SentNodeChange(p);
 	}
 }
 
@@ -2406,12 +2414,13 @@ void Server::sendMetadataChanged(const std::unordered_set<v3s16> &positions, flo
 			v3s16 block_pos = getNodeBlockPos(pos);
 			if (!client->isBlockSent(block_pos) ||
 					player_pos.getDistanceFrom(pos) > far_d_nodes) {
-				client->SetBlockNotSent(block_pos);
+				client->SetBlockChanged(block_pos);
 				continue;
 			}
 
 			// Add the change to send list
 			meta_updates_list.set(pos, meta);
+			client->SentMetadataChange(pos);
 		}
 		if (meta_updates_list.size() == 0)
 			continue;
@@ -2432,34 +2441,66 @@ void Server::sendMetadataChanged(const std::unordered_set<v3s16> &positions, flo
 }
 
 void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache)
+		u16 net_proto_version)
 {
 	thread_local const int net_compression_level = rangelim(g_settings->getS16("map_compression_level_net"), -1, 9);
-	std::string s, *sptr = nullptr;
-
-	if (cache) {
-		auto it = cache->find({block->getPos(), ver});
-		if (it != cache->end())
-			sptr = &it->second;
-	}
 
-	// Serialize the block in the right format
-	if (!sptr) {
+	auto data = m_block_cache->get(block->getPos(), ver);
+	if (!data) {
+		// Serialize the block in the right format
 		std::ostringstream os(std::ios_base::binary);
 		block->serialize(os, ver, false, net_compression_level);
 		block->serializeNetworkSpecific(os);
-		s = os.str();
-		sptr = &s;
+		data = std::make_shared<std::string>(os.str());
+
+		m_block_cache->put(block->getPos(), ver, data);
 	}
 
-	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + sptr->size(), peer_id);
-	pkt << block->getPos();
-	pkt.putRawString(*sptr);
+	SendBlockData(peer_id, block->getPos(), *data);
+}
+
+void Server::SendBlockData(session_t peer_id, v3s16 blockpos, const std::string &data)
+{
+	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + data.size(), peer_id);
+	pkt << blockpos;
+	pkt.putRawString(data);
 	Send(&pkt);
+}
+
+bool Server::SendBlockDiff(RemoteClient *client, MapBlock *block)
+{
+	thread_local const int net_compression_level = rangelim(g_settings->getS16("map_compression_level_net"), -1, 9);
+
+	const u8 ver = client->serialization_version;
+	const RemoteClient::BlockVersion *known = client->getBlockVersion(block->getPos());
+	if (!known)
+		return false;
+	// The diff must not arrive before the full block it is based on
+	if (m_block_cache->isPending(block->getPos(), ver))
+		return false;
+
+	MapBlockDiff diff;
+	if (!m_sent_block_history->makeDiff(block, known->version,
+			known->changed_nodes, known->metadata_changed, diff))
+		return false;
+	// Not worth it if most of the block changed
+	if (diff.indices.size() > MapBlock::nodecount / 4)
+		return false;
 
-	// Store away in cache
-	if (cache && sptr == &s)
-		(*cache)[{block->getPos(), ver}] = std::move(s);
+	std::ostringstream os(std::ios_base::binary);
+	diff.serialize(os, ver, net_compression_level);
+	std::string data = os.str();
+
+	auto full = m_block_cache->get(block->getPos(), ver);
+	if (full && full->size() <= data.size())
+		return false;
+
+	NetworkPacket pkt(TOCLIENT_BLOCKDATA_DIFF, 2 + 2 + 2 + data.size(),
+		client->peer_id);
+	pkt << block->getPos();
+	pkt.putRawString(data);
+	Send(&pkt);
+	return true;
 }
 
 void Server::SendBlocks(float dtime)
@@ -2468,7 +2509,7 @@ void Server::SendBlocks(float dtime)
 
 	std::vector<PrioritySortedBlockTransfer> queue;
 
-	u32 total_sending = 0, unique_clients = 0;
+	u32 total_sending = 0;
 
 	{
 		ScopeProfiler sp2(g_profiler, "Server::SendBlocks(): Collect list");
@@ -2483,12 +2524,27 @@ void Server::SendBlocks(float dtime)
 				continue;
 
 			total_sending += client->getSendingCount();
-			const auto old_count = queue.size();
 			client->GetNextBlocks(m_env, m_emerge.get(), dtime, queue);
-			unique_clients += queue.size() > old_count ? 1 : 0;
 		}
 	}
 
+	// Have the emerge threads work on what the players are closest to and
+	// forget about what they left behind
+	if (m_emerge_priority_interval.step(dtime, 0.5f)) {
+		std::unordered_map<session_t, v3s16> player_blockpos;
+		for (RemotePlayer *player : m_env->getPlayers()) {
+			PlayerSAO *sao = player->getPlayerSAO();
+			if (!sao)
+				continue;
+			player_blockpos[player->getPeerId()] =
+				getNodeBlockPos(floatToInt(sao->getBasePosition(), BS));
+		}
+		// One block of leeway for the movement prediction in GetNextBlocks()
+		s16 cancel_distance = std::max(g_settings->getS16("max_block_send_distance"),
+			g_settings->getS16("max_block_generate_distance")) + 1;
+		m_emerge->updateQueuePriorities(player_blockpos, cancel_distance);
+	}
+
 	// Sort.
 	// Lowest priority number comes first.
 	// Lowest is most important.
@@ -2496,6 +2552,12 @@ void Server::SendBlocks(float dtime)
 
 	ClientInterface::AutoLock clientlock(m_clients);
 
+	while (!m_blocks_to_resend.empty()) {
+		auto [peer_id, pos] = m_blocks_to_resend.pop_frontNoEx(0);
+		if (RemoteClient *client = m_clients.lockedGetClientNoEx(peer_id, CS_Active))
+			client->SetBlockNotSent(pos);
+	}
+
 	// Maximal total count calculation
 	// The per-client block sends is halved with the maximal online users
 	u32 max_blocks_to_send = (m_env->getPlayerCount() + g_settings->getU32("max_users")) *
@@ -2504,13 +2566,9 @@ void Server::SendBlocks(float dtime)
 	ScopeProfiler sp(g_profiler, "Server::SendBlocks(): Send to clients");
 	Map &map = m_env->getMap();
 
-	SerializedBlockCache cache, *cache_ptr = nullptr;
-	if (unique_clients > 1) {
-		// caching is pointless with a single client
-		cache_ptr = &cache;
-	}
-
-	for (const PrioritySortedBlockTransfer &block_to_send : queue) {
+	size_t i = 0;
+	for (; i < queue.size(); i++) {
+		const PrioritySortedBlockTransfer &block_to_send = queue[i];
 		if (total_sending >= max_blocks_to_send)
 			break;
 
@@ -2523,12 +2581,44 @@ void Server::SendBlocks(float dtime)
 		if (!client)
 			continue;
 
-		SendBlockNoLock(block_to_send.peer_id, block, client->serialization_version,
-				client->net_proto_version, cache_ptr);
+		const u8 ver = client->serialization_version;
+
+		// If the client has an older version of the block, it might be
+		// enough to send what changed
+		u32 version = 0;
+		bool sent = false;
+		if (m_sent_block_history->enabled() &&
+				client->net_proto_version >= 49 &&
+				ver == SER_FMT_VER_HIGHEST_WRITE) {
+			version = m_sent_block_history->remember(block);
+			sent = SendBlockDiff(client, block);
+		}
 
-		client->SentBlock(block_to_send.pos);
+		// Only snapshot the block here if possible, compression happens on
+		// the worker threads which then also send it.
+		if (sent) {
+			// nothing else to do
+		} else if (auto data = m_block_cache->get(block_to_send.pos, ver)) {
+			SendBlockData(block_to_send.peer_id, block_to_send.pos, *data);
+		} else if (!m_block_cache->compressAndSend(block, ver, block_to_send.peer_id)) {
+			SendBlockNoLock(block_to_send.peer_id, block, ver,
+					client->net_proto_version);
+		}
+
+		client->SentBlock(block_to_send.pos, version);
 		total_sending++;
 	}
+
+	// The rest is likely to be picked again next step, so have the
+	// workers compress these in the meantime.
+	for (; i < queue.size(); i++) {
+		const PrioritySortedBlockTransfer &block_to_send = queue[i];
+		MapBlock *block = map.getBlockNoCreateNoEx(block_to_send.pos);
+		RemoteClient *client = m_clients.lockedGetClientNoEx(block_to_send.peer_id,
+				CS_Active);
+		if (block && client)
+			m_block_cache->precompress(block, client->serialization_version);
+	}
 }
 
 bool Server::SendBlock(session_t peer_id, const v3s16 &blockpos)
@@ -2543,6 +2633,8 @@ bool Server::SendBlock(session_t peer_id, const v3s16 &blockpos)
 		return false;
 	SendBlockNoLock(peer_id, block, client->serialization_version,
 			client->net_proto_version);
+	// Diffs must not be based on what the client had before
+	client->forgetBlockVersion(blockpos);
 
 	return true;
 }
@@ -19,6 +19,7 @@
 #include "util/metricsbackend.h"
 #include "serverenvironment.h"
 #include "server/clientiface.h"
+#include "server/activeobjectmessagebatch.h"
 #include "threading/ordered_mutex.h"
 #include "chatmessage.h"
 #include "sound.h"
@@ -64,6 +65,8 @@ struct Lighting;
 class ServerThread;
 class ServerModManager;
 class ServerInventoryManager;
+class SerializedBlockCache;
+class SentBlockHistory;
 struct PackedValue;
 struct ParticleParameters;
 struct ParticleSpawnerParameters;
@@ -478,6 +481,7 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 private:
 	friend class EmergeThread;
+	friend class MapPregenerator;
 	friend class RemoteClient;
 
 	// unittest classes
@@ -506,15 +510,6 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		std::unordered_set<session_t> waiting_players;
 	};
 
-	// The standard library does not implement std::hash for pairs so we have this:
-	struct SBCHash {
-		size_t operator() (const std::pair<v3s16, u16> &p) const {
-			return std::hash<v3s16>()(p.first) ^ p.second;
-		}
-	};
-
-	typedef std::unordered_map<std::pair<v3s16, u16>, std::string, SBCHash> SerializedBlockCache;
-
 	void init();
 
 	void SendMovement(session_t peer_id);
@@ -565,16 +560,21 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void sendAddNode(v3s16 p, MapNode n,
 			std::unordered_set<u16> *far_players = nullptr,
 			float far_d_nodes = 100, bool remove_metadata = true);
-	void sendNodeChangePkt(NetworkPacket &pkt, v3s16 block_pos,
-			v3f p, float far_d_nodes, std::unordered_set<u16> *far_players);
+	void sendNodeChangePkt(NetworkPacket &pkt, v3s16 p,
+			float far_d_nodes, std::unordered_set<u16> *far_players);
 
 	void sendMetadataChanged(const std::unordered_set<v3s16> &positions,
 			float far_d_nodes = 100);
 
 	// Environment and Connection must be locked when called
-	// `cache` may only be very short lived! (invalidation not handeled)
 	void SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache = nullptr);
+		u16 net_proto_version);
+	// Sends an already serialized block, can be called from any thread
+	void SendBlockData(session_t peer_id, v3s16 blockpos, const std::string &data);
+	// Sends what changed since the version of the block the client has.
+	// Environment and Connection must be locked when called
+	// @return false if the full block has to be sent instead
+	bool SendBlockDiff(RemoteClient *client, MapBlock *block);
 
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
@@ -674,6 +674,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	float m_savemap_timer = 0.0f;
 	IntervalLimiter m_map_timer_and_unload_interval;
 	IntervalLimiter m_max_lag_decrease;
+	IntervalLimiter m_emerge_priority_interval;
+	IntervalLimiter m_map_snapshot_interval;
 
 	// Environment
 	ServerEnvironment *m_env = nullptr;
@@ -681,6 +683,13 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// server connection
 	std::shared_ptr<con::IConnection> m_con;
 
+	// Blocks serialized for sending, shared between clients and steps
+	std::unique_ptr<SerializedBlockCache> m_block_cache;
+	// Blocks that changed while a worker was compressing them
+	MutexedQueue<std::pair<session_t, v3s16>> m_blocks_to_resend;
+	// Versions of the blocks that clients have, to send changes as diffs
+	std::unique_ptr<SentBlockHistory> m_sent_block_history;
+
 	// Ban checking
 	BanManager *m_banmanager = nullptr;
 
@@ -746,6 +755,14 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		This is behind m_env_mutex
 	*/
 	std::queue<MapEditEvent*> m_unsent_map_edit_queue;
+
+	/*
+		Active object messages of the current step and the data sent
+		to a client, kept to reuse the storage. Behind m_env_mutex.
+	*/
+	std::vector<ActiveObjectMessage> m_aom_queue;
+	ActiveObjectMessageBatch m_aom_batch;
+	std::string m_aom_data[2]; // [0] = rel, [1] = unrel
 	/*
 		If a non-empty area, map edit events contained within are left
 		unsent. Done at map generation time to speed up editing of the
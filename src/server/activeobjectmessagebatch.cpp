@@ -0,0 +1,74 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "activeobjectmessagebatch.h"
+#include <algorithm>
+#include "exceptions.h"
+#include "util/serialize.h"
+
+void ActiveObjectMessageBatch::build(std::vector<ActiveObjectMessage> &messages)
+{
+	clear();
+
+	// Group by object, keeping the order of the messages of each object
+	m_order.reserve(messages.size());
+	for (u32 i = 0; i < messages.size(); i++)
+		m_order.emplace_back(messages[i].id, i);
+	std::sort(m_order.begin(), m_order.end());
+
+	for (auto [id, i] : m_order) {
+		const ActiveObjectMessage &aom = messages[i];
+		if (aom.datastring.size() > STRING_MAX_LEN)
+			throw SerializationError("String too long for serializeString16");
+		const bool position = !aom.datastring.empty() &&
+			aom.datastring[0] == AO_CMD_UPDATE_POSITION;
+		m_counts[aom.reliable ? 0 : 1]++;
+
+		if (m_objects.empty() || m_objects.back().id != id)
+			m_objects.push_back({id, nullptr, false, (u32)m_slices.size(), 0});
+		Object &obj = m_objects.back();
+		obj.has_position |= position;
+
+		// u16 id
+		// std::string data
+		const u32 offset = m_data.size();
+		char buf[4];
+		writeU16((u8 *)buf, id);
+		writeU16((u8 *)buf + 2, aom.datastring.size());
+		m_data.append(buf, sizeof(buf));
+		m_data.append(aom.datastring);
+		const u32 length = m_data.size() - offset;
+
+		if (obj.slice_count > 0) {
+			Slice &last = m_slices.back();
+			if (last.reliable == aom.reliable && last.position == position) {
+				last.length += length;
+				continue;
+			}
+		}
+		m_slices.push_back({offset, length, aom.reliable, position});
+		obj.slice_count++;
+	}
+}
+
+void ActiveObjectMessageBatch::clear()
+{
+	m_order.clear();
+	m_data.clear();
+	m_slices.clear();
+	m_objects.clear();
+	m_counts[0] = m_counts[1] = 0;
+}
+
+void ActiveObjectMessageBatch::append(const Object &obj, bool skip_position,
+	std::string &reliable, std::string &unreliable) const
+{
+	for (u32 i = obj.first_slice; i < obj.first_slice + obj.slice_count; i++) {
+		const Slice &slice = m_slices[i];
+		if (skip_position && slice.position)
+			continue;
+		std::string &dest = slice.reliable ? reliable : unreliable;
+		dest.append(m_data, slice.offset, slice.length);
+	}
+}
@@ -0,0 +1,71 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "activeobject.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+class ServerActiveObject;
+
+/*
+	The active object messages of one server step, grouped by object.
+
+	Every message is serialized only once in the format of
+	TOCLIENT_ACTIVE_OBJECT_MESSAGES. The data for each client is then put
+	together from slices of that buffer.
+
+	The storage is kept between steps, so that sending the messages does
+	not allocate once the buffers have grown large enough.
+*/
+class ActiveObjectMessageBatch
+{
+public:
+	struct Object {
+		u16 id;
+		// Not used by the batch, for the server to fill in
+		ServerActiveObject *sao;
+		// whether there are AO_CMD_UPDATE_POSITION messages
+		bool has_position;
+		u32 first_slice;
+		u32 slice_count;
+	};
+
+	/// Replaces the contents by the given messages.
+	/// The messages are left in a valid but unspecified state.
+	void build(std::vector<ActiveObjectMessage> &messages);
+
+	void clear();
+
+	/// Objects in ascending order of their id
+	std::vector<Object> &getObjects() { return m_objects; }
+
+	/// Appends the messages of the object to the buffer of their kind,
+	/// in the order they were emitted.
+	/// @param skip_position leave out the AO_CMD_UPDATE_POSITION messages
+	void append(const Object &obj, bool skip_position,
+		std::string &reliable, std::string &unreliable) const;
+
+	/// @return number of messages per kind, [0] = reliable, [1] = unreliable
+	const u32 *getMessageCounts() const { return m_counts; }
+
+private:
+	// Consecutive messages of the same object and kind
+	struct Slice {
+		u32 offset;
+		u32 length;
+		bool reliable;
+		bool position;
+	};
+
+	// (object id, message index) in sorted order
+	std::vector<std::pair<u16, u32>> m_order;
+	std::string m_data;
+	std::vector<Slice> m_slices;
+	std::vector<Object> m_objects;
+	u32 m_counts[2] = {0, 0};
+};
@@ -9,6 +9,9 @@
 #include "mapblock.h"
 #include "nodedef.h"
 #include "gamedef.h"
+#include "noise.h"
+#include "debug.h"
+#include "threading/thread.h"
 
 /*
 	ABMs
@@ -34,8 +37,6 @@ struct ActiveABM
 	s16 min_y, max_y;
 };
 
-#define CONTENT_TYPE_CACHE_MAX 64
-
 ABMHandler::ABMHandler(std::vector<ABMWithState> &abms,
 	float dtime_s, ServerEnvironment *env,
 	bool use_timers):
@@ -130,67 +131,87 @@ u32 ABMHandler::countObjects(MapBlock *block, ServerMap *map, u32 &wider)
 	return active_object_count;
 }
 
-void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_cached)
+bool ABMHandler::prepare(MapBlock *block, ABMBlockJob &job)
 {
 	if (m_aabms.empty())
-		return;
+		return false;
 
-	// Check the content type cache first
-	// to see whether there are any ABMs
-	// to be run at all for this block.
-	if (!block->contents.empty()) {
-		assert(!block->do_not_cache_contents); // invariant
-		blocks_cached++;
-		bool run_abms = false;
-		for (content_t c : block->contents) {
-			if (c < m_aabms.size() && m_aabms[c]) {
-				run_abms = true;
-				break;
-			}
+	// Check the content types present in the block first to see whether
+	// there are any ABMs to be run at all, and for which Y range.
+	const v3s16 pos_relative = block->getPosRelative();
+	s32 min_y = MAP_BLOCKSIZE, max_y = -1;
+	for (content_t c : block->getContents()) {
+		if (c >= m_aabms.size() || !m_aabms[c])
+			continue;
+		for (const ActiveABM &aabm : *m_aabms[c]) {
+			min_y = std::min<s32>(min_y, aabm.min_y - pos_relative.Y);
+			max_y = std::max<s32>(max_y, aabm.max_y - pos_relative.Y);
 		}
-		if (!run_abms)
-			return;
 	}
-	blocks_scanned++;
-
+	min_y = std::max<s32>(min_y, 0);
+	max_y = std::min<s32>(max_y, MAP_BLOCKSIZE - 1);
+	if (min_y > max_y)
+		return false;
+
+	job.blockpos = block->getPos();
+	job.min_y = min_y;
+	job.max_y = max_y;
+	job.seed = (u64)myrand() << 32 | myrand();
+	job.triggers.clear();
+
+	// Looking up blocks is not thread-safe, so do it here
 	ServerMap *map = &m_env->getServerMap();
+	u32 i = 0;
+	v3s16 d;
+	for (d.Z = -1; d.Z <= 1; d.Z++)
+	for (d.Y = -1; d.Y <= 1; d.Y++)
+	for (d.X = -1; d.X <= 1; d.X++)
+		job.blocks[i++] = d == v3s16() ? block :
+			map->getBlockNoCreateNoEx(job.blockpos + d);
+	return true;
+}
 
-	u32 active_object_count_wider;
-	u32 active_object_count = countObjects(block, map, active_object_count_wider);
-	m_env->m_added_objects = 0;
-
-	bool want_contents_cached = block->contents.empty() && !block->do_not_cache_contents;
+void ABMHandler::selectTriggers(ABMBlockJob &job) const
+{
+	MapBlock *block = job.blocks[13];
+	PcgRandom rand(job.seed);
+
+	// Neighbors outside of the block
+	auto get_content = [&job] (v3s16 p) -> content_t {
+		v3s16 bp(0, 0, 0);
+		for (int i = 0; i < 3; i++) {
+			if (p[i] < 0) {
+				bp[i] = -1;
+				p[i] += MAP_BLOCKSIZE;
+			} else if (p[i] >= MAP_BLOCKSIZE) {
+				bp[i] = 1;
+				p[i] -= MAP_BLOCKSIZE;
+			}
+		}
+		MapBlock *b = job.blocks[(bp.Z + 1) * 9 + (bp.Y + 1) * 3 + (bp.X + 1)];
+		if (!b)
+			return CONTENT_IGNORE;
+		return b->getNodeNoCheck(p).getContent();
+	};
 
+	const v3s16 pos_relative = block->getPosRelative();
 	v3s16 p0;
 	for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
-	for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
+	for(p0.Y=job.min_y; p0.Y<=job.max_y; p0.Y++)
 	for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
 	{
-		MapNode n = block->getNodeNoCheck(p0);
+		const MapNode n = block->getNodeNoCheck(p0);
 		content_t c = n.getContent();
 
-		// Cache content types as we go
-		if (want_contents_cached && !CONTAINS(block->contents, c)) {
-			if (block->contents.size() >= CONTENT_TYPE_CACHE_MAX) {
-				// Too many different nodes... don't try to cache
-				want_contents_cached = false;
-				block->do_not_cache_contents = true;
-				decltype(block->contents) empty;
-				std::swap(block->contents, empty);
-			} else {
-				block->contents.push_back(c);
-			}
-		}
-
 		if (c >= m_aabms.size() || !m_aabms[c])
 			continue;
 
-		v3s16 p = p0 + block->getPosRelative();
-		for (ActiveABM &aabm : *m_aabms[c]) {
+		v3s16 p = p0 + pos_relative;
+		for (const ActiveABM &aabm : *m_aabms[c]) {
 			if (p.Y < aabm.min_y || p.Y > aabm.max_y)
 				continue;
 
-			if (myrand() % aabm.chance != 0)
+			if (rand.next() % aabm.chance != 0)
 				continue;
 
 			// Check neighbors
@@ -212,9 +233,7 @@ void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int
 						const MapNode &n = block->getNodeNoCheck(p1);
 						c = n.getContent();
 					} else {
-						// otherwise consult the map
-						MapNode n = map->getNode(p1 + block->getPosRelative());
-						c = n.getContent();
+						c = get_content(p1);
 					}
 					if (check_required_neighbors && !have_required) {
 						if (CONTAINS(aabm.required_neighbors, c)) {
@@ -237,26 +256,172 @@ void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int
 
 neighbor_found:
 
-			abms_run++;
-			// Call all the trigger variations
-			aabm.abm->trigger(m_env, p, n);
-			aabm.abm->trigger(m_env, p, n,
-				active_object_count, active_object_count_wider);
+			job.triggers.push_back(ABMTrigger{aabm.abm, p0, n});
+		}
+	}
+}
 
-			if (block->isOrphan())
-				return;
+void ABMHandler::dispatch(ABMBlockJob &job, int &abms_run)
+{
+	if (job.triggers.empty())
+		return;
+
+	// Previous callbacks may have unloaded the block
+	ServerMap *map = &m_env->getServerMap();
+	MapBlock *block = map->getBlockNoCreateNoEx(job.blockpos);
+	if (!block)
+		return;
+
+	u32 active_object_count_wider;
+	u32 active_object_count = countObjects(block, map, active_object_count_wider);
+	m_env->m_added_objects = 0;
+
+	const v3s16 pos_relative = block->getPosRelative();
+	for (const ABMTrigger &trigger : job.triggers) {
+		// Skip if the node was changed meanwhile
+		MapNode n = block->getNodeNoCheck(trigger.p);
+		if (n.getContent() != trigger.n.getContent())
+			continue;
+
+		abms_run++;
+		// Call all the trigger variations
+		v3s16 p = trigger.p + pos_relative;
+		trigger.abm->trigger(m_env, p, n);
+		trigger.abm->trigger(m_env, p, n,
+			active_object_count, active_object_count_wider);
+
+		if (block->isOrphan())
+			return;
+
+		// Count surrounding objects again if the abms added any
+		if (m_env->m_added_objects > 0) {
+			active_object_count = countObjects(block, map, active_object_count_wider);
+			m_env->m_added_objects = 0;
+		}
+	}
+}
+
+void ABMHandler::apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_skipped)
+{
+	ABMBlockJob job;
+	if (!prepare(block, job)) {
+		blocks_skipped++;
+		return;
+	}
+	blocks_scanned++;
+
+	selectTriggers(job);
+	dispatch(job, abms_run);
+}
+
+/*
+	ABMWorkerPool
+*/
 
-			// Count surrounding objects again if the abms added any
-			if (m_env->m_added_objects > 0) {
-				active_object_count = countObjects(block, map, active_object_count_wider);
-				m_env->m_added_objects = 0;
+class ABMWorkerThread : public Thread
+{
+public:
+	ABMWorkerThread(ABMWorkerPool *pool, int id) :
+		Thread("ABMWorker" + std::to_string(id)),
+		m_pool(pool)
+	{}
+
+protected:
+	void *run() override
+	{
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		u32 generation = 0;
+		while (true) {
+			const ABMHandler *handler;
+			std::vector<ABMBlockJob> *jobs;
+			{
+				std::unique_lock<std::mutex> lock(m_pool->m_mutex);
+				m_pool->m_work_cv.wait(lock, [&] {
+					return m_pool->m_stop || m_pool->m_generation != generation;
+				});
+				if (m_pool->m_stop)
+					break;
+				generation = m_pool->m_generation;
+				handler = m_pool->m_handler;
+				jobs = m_pool->m_jobs;
+				// Work is already done
+				if (!jobs)
+					continue;
+				m_pool->m_busy++;
 			}
 
-			// Update and check node after possible modification
-			n = block->getNodeNoCheck(p0);
-			if (n.getContent() != c)
-				break;
+			m_pool->work(handler, jobs);
+
+			{
+				std::unique_lock<std::mutex> lock(m_pool->m_mutex);
+				m_pool->m_busy--;
+			}
+			m_pool->m_done_cv.notify_all();
 		}
+
+		END_DEBUG_EXCEPTION_HANDLER
+
+		return nullptr;
+	}
+
+private:
+	ABMWorkerPool *m_pool;
+};
+
+ABMWorkerPool::ABMWorkerPool(unsigned int num_threads)
+{
+	for (unsigned int i = 0; i < num_threads; i++) {
+		m_workers.emplace_back(std::make_unique<ABMWorkerThread>(this, i));
+		m_workers.back()->start();
+	}
+}
+
+ABMWorkerPool::~ABMWorkerPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_work_cv.notify_all();
+	for (auto &worker : m_workers)
+		worker->wait();
+}
+
+void ABMWorkerPool::selectTriggers(const ABMHandler &handler,
+	std::vector<ABMBlockJob> &jobs)
+{
+	if (m_workers.empty() || jobs.size() < 2) {
+		for (ABMBlockJob &job : jobs)
+			handler.selectTriggers(job);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_handler = &handler;
+		m_jobs = &jobs;
+		m_next_job = 0;
+		m_generation++;
+	}
+	m_work_cv.notify_all();
+
+	work(&handler, &jobs);
+
+	// All jobs are taken now, wait for the workers to finish theirs
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done_cv.wait(lock, [&] { return m_busy == 0; });
+	m_handler = nullptr;
+	m_jobs = nullptr;
+}
+
+void ABMWorkerPool::work(const ABMHandler *handler, std::vector<ABMBlockJob> *jobs)
+{
+	while (true) {
+		size_t i = m_next_job++;
+		if (i >= jobs->size())
+			break;
+		handler->selectTriggers((*jobs)[i]);
 	}
 }
 
@@ -7,6 +7,10 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -62,6 +66,38 @@ struct ABMWithState
 
 struct ActiveABM; // hidden
 
+struct ABMTrigger
+{
+	ActiveBlockModifier *abm;
+	// relative to the block
+	v3s16 p;
+	MapNode n;
+};
+
+// State of one block during an ABM pass
+struct ABMBlockJob
+{
+	v3s16 blockpos;
+	// The block and its neighbors (may be nullptr),
+	// index = (z + 1) * 9 + (y + 1) * 3 + (x + 1)
+	MapBlock *blocks[27];
+	// Y range that needs to be scanned
+	s16 min_y, max_y;
+	// Seed for the trigger chance
+	u64 seed;
+	// Output, in scan order
+	std::vector<ABMTrigger> triggers;
+};
+
+/*
+	Running ABMs on a block happens in three steps:
+	1. prepare() collects what is needed to look at the block (server thread)
+	2. selectTriggers() finds the nodes that pass the chance and neighbor
+	   checks. It only reads from the map and can run on any thread, as long
+	   as the map isn't modified meanwhile (i.e. the server thread holds the
+	   env lock and waits).
+	3. dispatch() calls the Lua callbacks (server thread)
+*/
 class ABMHandler
 {
 	ServerEnvironment *m_env;
@@ -80,7 +116,51 @@ class ABMHandler
 	// may be an estimate if any neighbors are unloaded.
 	static u32 countObjects(MapBlock *block, ServerMap * map, u32 &wider);
 
-	void apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_cached);
+	// @return false if no ABM can run in this block
+	bool prepare(MapBlock *block, ABMBlockJob &job);
+	void selectTriggers(ABMBlockJob &job) const;
+	void dispatch(ABMBlockJob &job, int &abms_run);
+
+	// All of the above in one go
+	void apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_skipped);
+};
+
+class ABMWorkerThread;
+
+// Runs ABMHandler::selectTriggers() on multiple threads
+class ABMWorkerPool
+{
+public:
+	// @param num_threads number of extra threads, 0 runs everything on
+	//                    the calling thread
+	ABMWorkerPool(unsigned int num_threads);
+	~ABMWorkerPool();
+
+	DISABLE_CLASS_COPY(ABMWorkerPool)
+
+	// Returns once all jobs are done. The calling thread helps out.
+	void selectTriggers(const ABMHandler &handler, std::vector<ABMBlockJob> &jobs);
+
+private:
+	friend class ABMWorkerThread;
+
+	// Processes jobs until none are left
+	void work(const ABMHandler *handler, std::vector<ABMBlockJob> *jobs);
+
+	std::mutex m_mutex;
+	std::condition_variable m_work_cv;
+	std::condition_variable m_done_cv;
+	// Incremented for each call of selectTriggers()
+	u32 m_generation = 0;
+	// Current work, only valid while selectTriggers() runs
+	const ABMHandler *m_handler = nullptr;
+	std::vector<ABMBlockJob> *m_jobs = nullptr;
+	std::atomic<size_t> m_next_job{0};
+	// Workers currently inside work()
+	u32 m_busy = 0;
+	bool m_stop = false;
+
+	std::vector<std::unique_ptr<ABMWorkerThread>> m_workers;
 };
 
 /*
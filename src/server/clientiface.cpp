@@ -52,6 +52,67 @@ const char *ClientInterface::state2Name(ClientState state)
 	return statenames[state];
 }
 
+/*
+	BlockSendCube
+*/
+
+// Limits the memory used per client, further blocks are looked up in the sets
+constexpr s16 MAX_SEND_CUBE_RADIUS = 32;
+
+BlockSendCube::BlockSendCube(s16 radius) :
+	m_radius(rangelim(radius, 0, MAX_SEND_CUBE_RADIUS)),
+	m_width(2 * m_radius + 1),
+	m_flags(m_width * m_width * m_width, 0),
+	m_shell_done(m_radius + 1, 0)
+{
+}
+
+void BlockSendCube::setCenter(v3s16 center)
+{
+	m_center = center;
+	std::fill(m_flags.begin(), m_flags.end(), 0);
+	std::fill(m_shell_done.begin(), m_shell_done.end(), 0);
+}
+
+void BlockSendCube::set(v3s16 p, u8 flag)
+{
+	s32 i = index(p);
+	if (i < 0)
+		return;
+	if (m_flags[i] == 0)
+		m_shell_done[distance(p)]++;
+	m_flags[i] |= flag;
+}
+
+void BlockSendCube::unset(v3s16 p, u8 flag)
+{
+	s32 i = index(p);
+	if (i < 0 || !(m_flags[i] & flag))
+		return;
+	m_flags[i] &= ~flag;
+	if (m_flags[i] == 0)
+		m_shell_done[distance(p)]--;
+}
+
+void BlockSendCube::unsetAll(u8 flag)
+{
+	v3s16 p;
+	size_t i = 0;
+	for (p.Z = -m_radius; p.Z <= m_radius; p.Z++)
+	for (p.Y = -m_radius; p.Y <= m_radius; p.Y++)
+	for (p.X = -m_radius; p.X <= m_radius; p.X++, i++) {
+		if (!(m_flags[i] & flag))
+			continue;
+		m_flags[i] &= ~flag;
+		if (m_flags[i] == 0)
+			m_shell_done[std::max({std::abs(p.X), std::abs(p.Y), std::abs(p.Z)})]--;
+	}
+}
+
+/*
+	RemoteClient
+*/
+
 RemoteClient::RemoteClient() :
 	serialization_version(SER_FMT_VER_INVALID),
 	m_pending_serialization_version(SER_FMT_VER_INVALID),
@@ -62,7 +123,8 @@ RemoteClient::RemoteClient() :
 	m_block_optimize_distance(g_settings->getS16("block_send_optimize_distance")),
 	m_block_cull_optimize_distance(g_settings->getS16("block_cull_optimize_distance")),
 	m_max_gen_distance(g_settings->getS16("max_block_generate_distance")),
-	m_occ_cull(g_settings->getBool("server_side_occlusion_culling"))
+	m_occ_cull(g_settings->getBool("server_side_occlusion_culling")),
+	m_send_cube(m_max_send_distance)
 {
 }
 
@@ -92,8 +154,10 @@ void RemoteClient::GetNextBlocks (
 	// Increment timers
 	m_nothing_to_send_pause_timer -= dtime;
 	m_map_send_completion_timer += dtime;
+	m_full_pass_timer += dtime;
 
-	if (m_map_send_completion_timer > g_settings->getFloat("server_unload_unused_data_timeout") * 0.8f) {
+	const float unload_timeout = g_settings->getFloat("server_unload_unused_data_timeout");
+	if (m_map_send_completion_timer > unload_timeout * 0.8f) {
 		infostream << "Server: Player " << m_name << ", peer_id=" << peer_id
 				<< ": full map send is taking too long ("
 				<< m_map_send_completion_timer
@@ -101,6 +165,8 @@ void RemoteClient::GetNextBlocks (
 				<< std::endl;
 		m_map_send_completion_timer = 0.0f;
 		m_nearest_unsent_d = 0;
+		m_full_pass = true;
+		m_occlusion_valid = false;
 	}
 
 	if (m_nothing_to_send_pause_timer >= 0)
@@ -187,6 +253,7 @@ void RemoteClient::GetNextBlocks (
 		m_nearest_unsent_d = 0;
 		m_last_center = center;
 		m_map_send_completion_timer = 0.0f;
+		updateSendCube(center);
 	}
 	// reset the unsent distance if the view angle has changed more that 10% of the fov
 	// (this matches isBlockInSight which allows for an extra 10%)
@@ -239,8 +306,25 @@ void RemoteClient::GetNextBlocks (
 
 	const v3s16 cam_pos_nodes = floatToInt(camera_pos, BS);
 
+	// The occlusion flags stay valid while the camera and the map don't change
+	if (!m_occlusion_valid || cam_pos_nodes != m_last_cam_pos_nodes) {
+		m_send_cube.unsetAll(BlockSendCube::OCCLUDED);
+		m_last_cam_pos_nodes = cam_pos_nodes;
+		m_occlusion_valid = true;
+	}
+
+	// Blocks that are done only need to be looked at in a full pass
+	const bool skip_done = !m_full_pass;
+
 	s16 d;
 	for (d = d_start; d <= d_max; d++) {
+		if (skip_done && m_send_cube.isShellDone(d)) {
+			// Skipping is cheap, so it doesn't count towards the limit
+			if (d_max < full_d_max)
+				d_max++;
+			continue;
+		}
+
 		/*
 			Get the border/face dot coordinates of a "d-radiused"
 			box
@@ -250,6 +334,11 @@ void RemoteClient::GetNextBlocks (
 		for (auto li = list.begin(); li != list.end(); ++li) {
 			v3s16 p = *li + center;
 
+			const bool in_cube = m_send_cube.contains(p);
+			const u8 flags = m_send_cube.get(p);
+			if (skip_done && flags != 0)
+				continue;
+
 			/*
 				Send throttling
 				- Don't allow too many simultaneous transfers
@@ -306,15 +395,17 @@ void RemoteClient::GetNextBlocks (
 				goto queue_full_break;
 			}
 
-			// Don't send blocks that are currently being transferred
-			if (m_blocks_sending.find(p) != m_blocks_sending.end())
-				continue;
-
 			/*
-				Don't send already sent blocks
+				Don't send blocks that are currently being transferred
+				or were sent already
 			*/
-			if (m_blocks_sent.find(p) != m_blocks_sent.end())
+			if (in_cube) {
+				if (flags & BlockSendCube::SENT)
+					continue;
+			} else if (m_blocks_sending.find(p) != m_blocks_sending.end() ||
+					m_blocks_sent.find(p) != m_blocks_sent.end()) {
 				continue;
+			}
 
 			if (block) {
 				/*
@@ -339,7 +430,8 @@ void RemoteClient::GetNextBlocks (
 				/*
 					Check occlusion cache first.
 				 */
-				if (m_blocks_occ.find(p) != m_blocks_occ.end())
+				if (in_cube ? (flags & BlockSendCube::OCCLUDED) :
+						m_blocks_occ.find(p) != m_blocks_occ.end())
 					continue;
 
 				/*
@@ -347,7 +439,10 @@ void RemoteClient::GetNextBlocks (
 				 */
 				if (m_occ_cull &&
 						env->getMap().isBlockOccluded(p * MAP_BLOCKSIZE, cam_pos_nodes, d >= d_cull_opt)) {
-					m_blocks_occ.insert(p);
+					if (in_cube)
+						m_send_cube.set(p, BlockSendCube::OCCLUDED);
+					else
+						m_blocks_occ.insert(p);
 					continue;
 				}
 			}
@@ -389,6 +484,13 @@ void RemoteClient::GetNextBlocks (
 				<< ": full map send completed after " << m_map_send_completion_timer
 				<< "s, restarting" << std::endl;
 			m_map_send_completion_timer = 0.0f;
+
+			// Keep the usage timers of the blocks in sight from running out
+			if (m_full_pass)
+				m_full_pass_timer = 0.0f;
+			m_full_pass = m_full_pass_timer > unload_timeout * 0.25f;
+			if (m_full_pass)
+				m_occlusion_valid = false;
 		} else {
 			if (nearest_sent_d != -1)
 				new_nearest_unsent_d = nearest_sent_d;
@@ -400,6 +502,7 @@ void RemoteClient::GetNextBlocks (
 	if (new_nearest_unsent_d != -1 && m_nearest_unsent_d != new_nearest_unsent_d) {
 		m_nearest_unsent_d = new_nearest_unsent_d;
 		// if the distance has changed, clear the occlusion cache
+		// (the flags in m_send_cube are kept, see above)
 		m_blocks_occ.clear();
 	}
 }
@@ -409,26 +512,77 @@ void RemoteClient::GotBlock(v3s16 p)
 	if (m_blocks_sending.erase(p) > 0) {
 		// only add to sent blocks if it actually was sending
 		// (it might have been modified since)
+		// The flag in m_send_cube stays set.
 		m_blocks_sent.insert(p);
 	} else {
 		m_excess_gotblocks++;
 	}
 }
 
-void RemoteClient::SentBlock(v3s16 p)
+void RemoteClient::SentBlock(v3s16 p, u32 version)
 {
 	if (!m_blocks_sending.insert(p).second)
 		infostream<<"RemoteClient::SentBlock(): Sent block"
 				" already in m_blocks_sending"<<std::endl;
+	m_send_cube.set(p, BlockSendCube::SENT);
+
+	if (version != 0)
+		m_block_versions[p] = BlockVersion{version, {}, false};
+	else
+		m_block_versions.erase(p);
 }
 
 void RemoteClient::SetBlockNotSent(v3s16 p, bool low_priority)
+{
+	// The client might not have the block anymore, or has a different
+	// version of it (e.g. from a client-side prediction)
+	m_block_versions.erase(p);
+	markBlockNotSent(p, low_priority);
+}
+
+void RemoteClient::SetBlockChanged(v3s16 p, bool low_priority)
+{
+	markBlockNotSent(p, low_priority);
+}
+
+void RemoteClient::SentNodeChange(v3s16 p)
+{
+	v3s16 blockpos = getNodeBlockPos(p);
+	auto it = m_block_versions.find(blockpos);
+	if (it == m_block_versions.end())
+		return;
+
+	// At some point the full block is cheaper
+	if (it->second.changed_nodes.size() >= 256) {
+		m_block_versions.erase(it);
+		return;
+	}
+	v3s16 rel = p - blockpos * MAP_BLOCKSIZE;
+	it->second.changed_nodes.push_back(rel.Z * MapBlock::zstride +
+		rel.Y * MapBlock::ystride + rel.X);
+	// The node's metadata may have been removed
+	it->second.metadata_changed = true;
+}
+
+void RemoteClient::SentMetadataChange(v3s16 p)
+{
+	auto it = m_block_versions.find(getNodeBlockPos(p));
+	if (it != m_block_versions.end())
+		it->second.metadata_changed = true;
+}
+
+void RemoteClient::markBlockNotSent(v3s16 p, bool low_priority)
 {
 	m_nothing_to_send_pause_timer = 0;
 
+	// The change may have uncovered other blocks
+	if (m_send_cube.contains(p))
+		m_occlusion_valid = false;
+
 	// remove the block from sending and sent sets,
 	// and reset the scan loop if found
 	if (m_blocks_sending.erase(p) + m_blocks_sent.erase(p) > 0) {
+		m_send_cube.unset(p, BlockSendCube::SENT);
 		// If this is a low priority event, do not reset m_nearest_unsent_d.
 		// Instead, the send loop will get to the block in the next full loop iteration.
 		if (!low_priority) {
@@ -446,6 +600,17 @@ void RemoteClient::SetBlockNotSent(v3s16 p, bool low_priority)
 	}
 }
 
+void RemoteClient::updateSendCube(v3s16 center)
+{
+	m_send_cube.setCenter(center);
+	for (v3s16 p : m_blocks_sending)
+		m_send_cube.set(p, BlockSendCube::SENT);
+	for (v3s16 p : m_blocks_sent)
+		m_send_cube.set(p, BlockSendCube::SENT);
+	// Occlusion is checked again from the new position
+	m_occlusion_valid = false;
+}
+
 void RemoteClient::SetBlocksNotSent(const std::vector<v3s16> &blocks, bool low_priority)
 {
 	for (v3s16 p : blocks) {
@@ -453,6 +618,12 @@ void RemoteClient::SetBlocksNotSent(const std::vector<v3s16> &blocks, bool low_p
 	}
 }
 
+void RemoteClient::SetBlocksChanged(const std::vector<v3s16> &blocks, bool low_priority)
+{
+	for (v3s16 p : blocks)
+		SetBlockChanged(p, low_priority);
+}
+
 void RemoteClient::notifyEvent(ClientStateEvent event)
 {
 	std::ostringstream myerror;
@@ -673,7 +844,7 @@ void ClientInterface::markBlocksNotSent(const std::vector<v3s16> &positions, boo
 	RecursiveMutexAutoLock clientslock(m_clients_mutex);
 	for (const auto &client : m_clients) {
 		if (client.second->getState() >= CS_Active)
-			client.second->SetBlocksNotSent(positions, low_priority);
+			client.second->SetBlocksChanged(positions, low_priority);
 	}
 }
 
@@ -12,6 +12,7 @@
 #include "threading/mutex_auto_lock.h"
 #include "clientdynamicinfo.h"
 
+#include <algorithm>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -209,6 +210,75 @@ struct PrioritySortedBlockTransfer
 	session_t peer_id;
 };
 
+/*
+	Flags for the blocks around a center position, used by
+	RemoteClient::GetNextBlocks() to skip blocks it already knows about
+	without looking them up in its sets. A count of flagged positions is
+	kept for every distance shell, so that finished shells can be skipped
+	as a whole. Positions outside of the cube have no flags.
+*/
+class BlockSendCube
+{
+public:
+	enum : u8 {
+		// Sent, or being sent
+		SENT = 1,
+		OCCLUDED = 2,
+	};
+
+	BlockSendCube(s16 radius);
+
+	// Clears all flags
+	void setCenter(v3s16 center);
+
+	bool contains(v3s16 p) const { return index(p) >= 0; }
+
+	u8 get(v3s16 p) const
+	{
+		s32 i = index(p);
+		return i >= 0 ? m_flags[i] : 0;
+	}
+
+	void set(v3s16 p, u8 flag);
+	void unset(v3s16 p, u8 flag);
+	void unsetAll(u8 flag);
+
+	// Whether all positions at this distance from the center have a flag
+	bool isShellDone(s16 d) const
+	{
+		return d <= m_radius && m_shell_done[d] == shellSize(d);
+	}
+
+private:
+	s32 index(v3s16 p) const
+	{
+		p -= m_center;
+		if (std::abs(p.X) > m_radius || std::abs(p.Y) > m_radius ||
+				std::abs(p.Z) > m_radius)
+			return -1;
+		return ((p.Z + m_radius) * m_width + p.Y + m_radius) * m_width +
+			p.X + m_radius;
+	}
+
+	s16 distance(v3s16 p) const
+	{
+		p -= m_center;
+		return std::max({std::abs(p.X), std::abs(p.Y), std::abs(p.Z)});
+	}
+
+	static u32 shellSize(s16 d)
+	{
+		return d == 0 ? 1 : 24 * d * d + 2;
+	}
+
+	const s16 m_radius;
+	const s32 m_width;
+	v3s16 m_center;
+	std::vector<u8> m_flags;
+	// Number of positions with flags, per distance
+	std::vector<u32> m_shell_done;
+};
+
 class RemoteClient
 {
 public:
@@ -249,11 +319,40 @@ class RemoteClient
 
 	void GotBlock(v3s16 p);
 
-	void SentBlock(v3s16 p);
+	// @param version see SentBlockHistory, 0 if unknown
+	void SentBlock(v3s16 p, u32 version = 0);
 
 	void SetBlockNotSent(v3s16 p, bool low_priority = false);
 	void SetBlocksNotSent(const std::vector<v3s16> &blocks, bool low_priority = false);
 
+	// Like SetBlockNotSent(), but for blocks that changed on the server only.
+	// The client still has the version that was sent, so it may be updated
+	// with a diff.
+	void SetBlockChanged(v3s16 p, bool low_priority = false);
+	void SetBlocksChanged(const std::vector<v3s16> &blocks, bool low_priority = false);
+
+	// A single node change (TOCLIENT_ADDNODE, TOCLIENT_REMOVENODE) or
+	// metadata change (TOCLIENT_NODEMETA_CHANGED) was sent at node position p.
+	void SentNodeChange(v3s16 p);
+	void SentMetadataChange(v3s16 p);
+
+	struct BlockVersion {
+		u32 version;
+		// Nodes that might differ from the version, see SentNodeChange()
+		std::vector<u16> changed_nodes;
+		bool metadata_changed = false;
+	};
+
+	// @return the version of the block the client has, or nullptr if unknown
+	const BlockVersion *getBlockVersion(v3s16 p) const
+	{
+		auto it = m_block_versions.find(p);
+		return it != m_block_versions.end() ? &it->second : nullptr;
+	}
+
+	// The client got the block in some other way, see Server::SendBlock()
+	void forgetBlockVersion(v3s16 p) { m_block_versions.erase(p); }
+
 	/**
 	 * tell client about this block being modified right now.
 	 * this information is required to requeue the block in case it's "on wire"
@@ -357,13 +456,25 @@ class RemoteClient
 	*/
 	std::unordered_set<v3s16> m_blocks_sent;
 
+	/*
+		Versions of the blocks in m_blocks_sending and m_blocks_sent,
+		if known. They stay when a block changes on the server.
+	*/
+	std::unordered_map<v3s16, BlockVersion> m_block_versions;
+
+	void markBlockNotSent(v3s16 p, bool low_priority);
+
 	/*
 		Cache of blocks that have been occlusion culled at the current distance.
 		As GetNextBlocks traverses the same distance multiple times, this saves
 		significant CPU time.
+		Only used for blocks outside of m_send_cube.
 	 */
 	std::unordered_set<v3s16> m_blocks_occ;
 
+	// Moves m_send_cube and sets its flags from the sets above
+	void updateSendCube(v3s16 center);
+
 	s16 m_nearest_unsent_d = 0;
 	v3s16 m_last_center;
 	v3f m_last_camera_dir;
@@ -376,6 +487,24 @@ class RemoteClient
 	const s16 m_max_gen_distance;
 	const bool m_occ_cull;
 
+	// Mirrors the sets above for the blocks within the send distance
+	BlockSendCube m_send_cube;
+	/*
+		Passes over the view range that don't touch the blocks that are
+		done (sent or occluded) are cheaper, but they don't reset the usage
+		timers of those blocks either. So every now and then, a full pass
+		is made.
+	*/
+	bool m_full_pass = true;
+	float m_full_pass_timer = 0.0f;
+	/*
+		Unlike m_blocks_occ, the occlusion flags of m_send_cube are kept
+		until the camera moves, the map around changes or a full pass
+		starts.
+	*/
+	bool m_occlusion_valid = false;
+	v3s16 m_last_cam_pos_nodes;
+
 	/*
 		Set of media files the client has already requested
 		We won't send the same file twice to avoid bandwidth consumption attacks.
@@ -0,0 +1,325 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "mappregenerator.h"
+#include "filesys.h"
+#include "irrlicht_changes/printing.h"
+#include "log.h"
+#include "mapblock.h"
+#include "porting.h"
+#include "server.h"
+#include "serverenvironment.h"
+#include "servermap.h"
+#include "settings.h"
+#include "threading/thread.h"
+#include "util/numeric.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+MapPregenerator::MapPregenerator(Server *server, v3s16 minp, v3s16 maxp) :
+	m_server(server),
+	m_minp(componentwise_min(minp, maxp)),
+	m_maxp(componentwise_max(minp, maxp)),
+	m_progress_path(server->getWorldPath() + DIR_DELIM "pregenerate.txt")
+{
+}
+
+MapPregenerator::~MapPregenerator()
+{
+	// The emerge threads must not call back into a deleted object
+	if (EmergeManager *emerge = m_server->getEmergeManager())
+		emerge->stopThreads();
+}
+
+size_t MapPregenerator::getChunkIndex(v3s16 chunkpos) const
+{
+	v3s16 p = (chunkpos - m_chunk_first) / m_chunksize;
+	// Columns are generated together, the overgenerated borders are still
+	// loaded when the chunk above or below is generated.
+	return ((size_t)p.Z * m_chunk_count.X + p.X) * m_chunk_count.Y + p.Y;
+}
+
+v3s16 MapPregenerator::getChunkPos(size_t index) const
+{
+	v3s16 p;
+	p.Y = index % m_chunk_count.Y;
+	index /= m_chunk_count.Y;
+	p.X = index % m_chunk_count.X;
+	p.Z = index / m_chunk_count.X;
+	return m_chunk_first + p * m_chunksize;
+}
+
+void MapPregenerator::emergeCallback(v3s16 blockpos, EmergeAction action,
+	void *param)
+{
+	auto *self = reinterpret_cast<MapPregenerator *>(param);
+	{
+		std::lock_guard<std::mutex> lock(self->m_mutex);
+		self->m_finished.emplace_back(self->getChunkIndex(blockpos), action);
+	}
+	self->m_cv.notify_one();
+}
+
+bool MapPregenerator::run(volatile std::sig_atomic_t &kill)
+{
+	// Use all cores unless configured otherwise
+	if (!g_settings->existsLocal("num_emerge_threads") ||
+			g_settings->getS16("num_emerge_threads") <= 0) {
+		g_settings->setS16("num_emerge_threads",
+			std::max(Thread::getNumberOfProcessors(), 1U));
+	}
+
+	m_server->init();
+
+	EmergeManager *emerge = m_server->getEmergeManager();
+	ServerMap &map = m_server->getEnv().getServerMap();
+
+	m_chunksize = map.getMapgenParams()->chunksize;
+	m_chunk_first = EmergeManager::getContainingChunk(
+		getNodeBlockPos(m_minp), m_chunksize);
+	v3s16 chunk_last = EmergeManager::getContainingChunk(
+		getNodeBlockPos(m_maxp), m_chunksize);
+	m_chunk_count = (chunk_last - m_chunk_first) / m_chunksize + v3s16(1, 1, 1);
+	m_chunks.assign((size_t)m_chunk_count.X * m_chunk_count.Y * m_chunk_count.Z,
+		CHUNK_PENDING);
+
+	loadProgress();
+	m_next = m_first_done = m_done;
+	m_window = emerge->getThreadCount() * 2;
+
+	actionstream << "Pregenerating " << m_chunks.size() << " mapchunks from "
+		<< m_minp << " to " << m_maxp << " using " << emerge->getThreadCount()
+		<< " threads";
+	if (m_done > 0)
+		actionstream << ", continuing after " << m_done << " chunks";
+	actionstream << std::endl;
+
+	const float save_interval = g_settings->getFloat("server_map_save_interval");
+	IntervalLimiter save_interval_limiter, liquid_interval_limiter,
+		print_interval_limiter;
+	bool failed = false;
+
+	emerge->startThreads();
+	m_start_time = porting::getTimeMs();
+	u64 last_time = m_start_time;
+
+	while (!kill && m_done < m_chunks.size()) {
+		// Errors in the emerge threads, e.g. from Lua, are fatal
+		std::string async_err = m_server->m_async_fatal_error.get();
+		if (!async_err.empty()) {
+			std::cerr << std::endl;
+			errorstream << "Pregeneration failed: " << async_err << std::endl;
+			failed = true;
+			break;
+		}
+
+		enqueueChunks();
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait_for(lock, std::chrono::milliseconds(100),
+				[this] { return !m_finished.empty(); });
+		}
+		processFinished(false);
+
+		const u64 now = porting::getTimeMs();
+		const float dtime = (now - last_time) / 1000.0f;
+		last_time = now;
+
+		// Let liquids flow like they would on a running server
+		if (liquid_interval_limiter.step(dtime, m_server->m_liquid_transform_every)) {
+			Server::EnvAutoLock lock(m_server);
+			std::map<v3s16, MapBlock *> modified_blocks;
+			map.transformLiquids(modified_blocks, &m_server->getEnv());
+		}
+
+		if (save_interval_limiter.step(dtime, save_interval))
+			checkpoint();
+
+		if (print_interval_limiter.step(dtime, 1.0f))
+			printProgress(false);
+	}
+
+	// Cancels what is still queued
+	emerge->stopThreads();
+	processFinished(true);
+
+	checkpoint();
+	printProgress(true);
+
+	const bool complete = m_done == m_chunks.size();
+	if (complete)
+		fs::DeleteSingleFileOrEmptyDirectory(m_progress_path);
+	else if (!failed)
+		actionstream << "Pregeneration stopped, run again to continue" << std::endl;
+
+	return complete && !failed;
+}
+
+void MapPregenerator::enqueueChunks()
+{
+	EmergeManager *emerge = m_server->getEmergeManager();
+	while (m_queued.size() < m_window && m_next < m_chunks.size()) {
+		const size_t index = m_next++;
+		if (m_chunks[index] != CHUNK_PENDING)
+			continue;
+
+		if (!emerge->enqueueBlockEmergeEx(getChunkPos(index), PEER_ID_INEXISTENT,
+				BLOCK_EMERGE_ALLOW_GEN | BLOCK_EMERGE_FORCE_QUEUE,
+				emergeCallback, this)) {
+			errorstream << "MapPregenerator: failed to enqueue chunk at "
+				<< getChunkPos(index) << std::endl;
+			continue;
+		}
+		m_chunks[index] = CHUNK_QUEUED;
+		m_queued.push_back(index);
+	}
+}
+
+void MapPregenerator::processFinished(bool stopping)
+{
+	std::vector<std::pair<size_t, EmergeAction>> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		finished.swap(m_finished);
+	}
+
+	for (auto [index, action] : finished) {
+		auto it = std::find(m_queued.begin(), m_queued.end(), index);
+		if (it == m_queued.end())
+			continue;
+		m_queued.erase(it);
+
+		// Only chunks outside of the mapgen limits are cancelled, unless the
+		// emerge threads are stopping. Errors are fatal and retried next time.
+		if (action == EMERGE_ERRORED || (action == EMERGE_CANCELLED && stopping)) {
+			m_chunks[index] = CHUNK_PENDING;
+			continue;
+		}
+
+		m_chunks[index] = CHUNK_DONE;
+		m_count[action]++;
+	}
+
+	while (m_done < m_chunks.size() && m_chunks[m_done] == CHUNK_DONE)
+		m_done++;
+}
+
+void MapPregenerator::checkpoint()
+{
+	ServerMap &map = m_server->getEnv().getServerMap();
+	size_t done;
+	{
+		Server::EnvAutoLock lock(m_server);
+
+		// The blocks of queued chunks may be in use by a mapgen
+		std::vector<MapBlock *> grabbed;
+		for (size_t index : m_queued) {
+			const v3s16 bpmin = getChunkPos(index) - v3s16(1, 1, 1);
+			const v3s16 bpmax = bpmin + v3s16(1, 1, 1) * (m_chunksize + 1);
+			for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+			for (s16 y = bpmin.Y; y <= bpmax.Y; y++)
+			for (s16 x = bpmin.X; x <= bpmax.X; x++) {
+				MapBlock *block = map.getBlockNoCreateNoEx(v3s16(x, y, z));
+				if (block) {
+					block->refGrab();
+					grabbed.push_back(block);
+				}
+			}
+		}
+
+		map.save(MOD_STATE_WRITE_NEEDED);
+		map.unloadUnreferencedBlocks();
+		for (MapBlock *block : grabbed)
+			block->refDrop();
+		map.step();
+
+		// There are no clients to send the changes to
+		auto &queue = m_server->m_unsent_map_edit_queue;
+		while (!queue.empty()) {
+			delete queue.front();
+			queue.pop();
+		}
+
+		// All blocks of these chunks were in the map or saved before
+		done = m_done;
+	}
+
+	map.flushSaveQueue();
+	saveProgress(done);
+}
+
+void MapPregenerator::printProgress(bool final)
+{
+	const size_t processed = m_done - m_first_done;
+	const float elapsed = (porting::getTimeMs() - m_start_time) / 1000.0f;
+	const float rate = elapsed > 0 ? processed / elapsed : 0;
+
+	std::cerr << " Pregenerated " << m_done << "/" << m_chunks.size()
+		<< " chunks, " << std::fixed << std::setprecision(1)
+		<< (100.0f * m_done / m_chunks.size()) << "% completed, "
+		<< rate << " chunks/s";
+	if (!final && rate > 0)
+		std::cerr << ", " << (u32)((m_chunks.size() - m_done) / rate) << "s left";
+	std::cerr << "  \r" << std::flush;
+
+	if (!final)
+		return;
+	std::cerr << std::endl;
+	actionstream << "Pregeneration: " << m_count[EMERGE_GENERATED]
+		<< " chunks generated, "
+		<< m_count[EMERGE_FROM_DISK] + m_count[EMERGE_FROM_MEMORY]
+		<< " already existed, " << m_count[EMERGE_CANCELLED]
+		<< " outside of the map limits, in " << std::round(elapsed) << "s ("
+		<< std::round(rate * 10.0f) / 10.0f << " chunks/s)" << std::endl;
+}
+
+static std::string describe_chunks(v3s16 first, v3s16 count, s16 chunksize)
+{
+	std::ostringstream os;
+	os << first << " " << count << " " << chunksize;
+	return os.str();
+}
+
+void MapPregenerator::loadProgress()
+{
+	if (!fs::PathExists(m_progress_path))
+		return;
+
+	Settings progress;
+	std::string chunks;
+	u64 done;
+	if (!progress.readConfigFile(m_progress_path.c_str()) ||
+			!progress.getNoEx("chunks", chunks) ||
+			!progress.getU64NoEx("done", done)) {
+		warningstream << "MapPregenerator: ignoring invalid "
+			<< m_progress_path << std::endl;
+		return;
+	}
+
+	// The order of the chunks only matches for the same chunk area
+	if (chunks != describe_chunks(m_chunk_first, m_chunk_count, m_chunksize)) {
+		infostream << "MapPregenerator: " << m_progress_path
+			<< " is for a different area, starting over" << std::endl;
+		return;
+	}
+
+	m_done = std::min<size_t>(done, m_chunks.size());
+	std::fill(m_chunks.begin(), m_chunks.begin() + m_done, CHUNK_DONE);
+}
+
+void MapPregenerator::saveProgress(size_t done)
+{
+	Settings progress;
+	progress.set("chunks", describe_chunks(m_chunk_first, m_chunk_count,
+		m_chunksize));
+	progress.setU64("done", done);
+	if (!progress.updateConfigFile(m_progress_path.c_str()))
+		errorstream << "MapPregenerator: failed to write " << m_progress_path
+			<< std::endl;
+}
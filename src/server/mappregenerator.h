@@ -0,0 +1,94 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "emerge.h"
+#include "util/basic_macros.h"
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Server;
+
+/*
+	Generates all mapchunks of an area without running the server.
+
+	The server is initialized (mods are loaded) but neither the network nor
+	the server thread are started. Chunks are handed to the emerge threads,
+	a few more at a time than there are threads, in a fixed order. Finished
+	blocks are saved and unloaded regularly, so memory use stays bounded.
+
+	The number of chunks that are finished in order is written to
+	"pregenerate.txt" in the world directory together with the area, so an
+	interrupted run continues where it stopped. Chunks that already exist
+	are loaded instead of generated again in any case.
+*/
+class MapPregenerator
+{
+public:
+	/// @param minp, maxp corners of the area in nodes
+	MapPregenerator(Server *server, v3s16 minp, v3s16 maxp);
+	~MapPregenerator();
+
+	DISABLE_CLASS_COPY(MapPregenerator)
+
+	/// Initializes the server and generates the area.
+	/// @param kill set to stop early, progress is saved
+	/// @return true if all chunks were generated or already existed
+	bool run(volatile std::sig_atomic_t &kill);
+
+private:
+	enum ChunkState : u8 {
+		CHUNK_PENDING,
+		CHUNK_QUEUED,
+		CHUNK_DONE,
+	};
+
+	size_t getChunkIndex(v3s16 chunkpos) const;
+	v3s16 getChunkPos(size_t index) const;
+
+	static void emergeCallback(v3s16 blockpos, EmergeAction action, void *param);
+
+	void enqueueChunks();
+	void processFinished(bool stopping);
+	// Saves and unloads the map, then writes the progress
+	void checkpoint();
+	void printProgress(bool final);
+
+	void loadProgress();
+	void saveProgress(size_t done);
+
+	Server *m_server;
+	const v3s16 m_minp, m_maxp;
+	const std::string m_progress_path;
+
+	s16 m_chunksize = 0;
+	// Block position of the first chunk and the number of chunks per axis
+	v3s16 m_chunk_first;
+	v3s16 m_chunk_count;
+
+	std::vector<ChunkState> m_chunks;
+	std::vector<size_t> m_queued;
+	// Chunks before this index are all done
+	size_t m_done = 0;
+	// Next chunk to enqueue
+	size_t m_next = 0;
+	size_t m_window = 0;
+
+	u64 m_start_time = 0;
+	// Value of m_done when this run started
+	size_t m_first_done = 0;
+	// Finished chunks by EmergeAction
+	u32 m_count[ARRLEN(emergeActionStrs)] = {};
+
+	// Written by the emerge threads
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::vector<std::pair<size_t, EmergeAction>> m_finished;
+};
@@ -0,0 +1,156 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "sentblockhistory.h"
+#include "mapblock.h"
+#include "mapblock_diff.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+// Clients that are further behind get the full block again
+#define MAX_VERSIONS_PER_BLOCK 4
+
+size_t SentBlockHistory::Version::getSize() const
+{
+	return MapBlock::nodecount * sizeof(MapNode) + metadata.size() +
+		sizeof(Version);
+}
+
+SentBlockHistory::SentBlockHistory(size_t limit, u8 ser_ver) :
+	m_limit(limit),
+	m_ser_ver(ser_ver)
+{
+}
+
+u32 SentBlockHistory::remember(MapBlock *block)
+{
+	if (!enabled())
+		return 0;
+
+	const v3s16 pos = block->getPos();
+	auto [it, inserted] = m_blocks.try_emplace(pos);
+	History &history = it->second;
+	if (inserted) {
+		m_lru.push_front(pos);
+		history.lru_it = m_lru.begin();
+	} else {
+		m_lru.splice(m_lru.begin(), m_lru, history.lru_it);
+	}
+
+	if (history.up_to_date && !history.versions.empty())
+		return history.versions.back().id;
+
+	std::ostringstream os(std::ios_base::binary);
+	block->m_node_metadata.serialize(os, m_ser_ver, false);
+	std::string metadata = os.str();
+	const MapNode *data = block->getData();
+
+	// The block might not have changed in a way that matters to clients
+	if (!history.versions.empty()) {
+		const Version &latest = history.versions.back();
+		if (latest.metadata == metadata && std::memcmp(latest.nodes.get(), data,
+				MapBlock::nodecount * sizeof(MapNode)) == 0) {
+			history.up_to_date = true;
+			return latest.id;
+		}
+	}
+
+	Version version;
+	version.id = m_next_id++;
+	if (m_next_id == 0)
+		m_next_id = 1;
+	version.nodes = std::make_unique<MapNode[]>(MapBlock::nodecount);
+	std::copy(data, data + MapBlock::nodecount, version.nodes.get());
+	version.metadata = std::move(metadata);
+
+	const u32 id = version.id;
+	m_size += version.getSize();
+	history.versions.push_back(std::move(version));
+	if (history.versions.size() > MAX_VERSIONS_PER_BLOCK) {
+		m_size -= history.versions.front().getSize();
+		history.versions.pop_front();
+	}
+	history.up_to_date = true;
+
+	evict();
+	return id;
+}
+
+bool SentBlockHistory::makeDiff(MapBlock *block, u32 from_version,
+	const std::vector<u16> &extra_nodes, bool with_metadata,
+	MapBlockDiff &diff)
+{
+	auto it = m_blocks.find(block->getPos());
+	if (it == m_blocks.end())
+		return false;
+	const History &history = it->second;
+	if (!history.up_to_date || history.versions.empty())
+		return false;
+
+	const Version *from = findVersion(history, from_version);
+	if (!from)
+		return false;
+	const Version &to = history.versions.back();
+
+	diff.setFlags(block);
+	diff.indices.clear();
+	diff.nodes.clear();
+
+	std::vector<u16> extra(extra_nodes);
+	std::sort(extra.begin(), extra.end());
+	auto extra_it = extra.begin();
+	for (u16 i = 0; i < MapBlock::nodecount; i++) {
+		bool is_extra = false;
+		while (extra_it != extra.end() && *extra_it <= i)
+			is_extra |= *(extra_it++) == i;
+		if (is_extra || from->nodes[i] != to.nodes[i]) {
+			diff.indices.push_back(i);
+			diff.nodes.push_back(to.nodes[i]);
+		}
+	}
+
+	if (with_metadata || from->metadata != to.metadata)
+		diff.metadata = to.metadata;
+	else
+		diff.metadata.reset();
+	return true;
+}
+
+void SentBlockHistory::invalidate(const std::vector<v3s16> &positions)
+{
+	for (v3s16 pos : positions) {
+		auto it = m_blocks.find(pos);
+		if (it != m_blocks.end())
+			it->second.up_to_date = false;
+	}
+}
+
+void SentBlockHistory::clear()
+{
+	m_blocks.clear();
+	m_lru.clear();
+	m_size = 0;
+}
+
+const SentBlockHistory::Version *SentBlockHistory::findVersion(
+	const History &history, u32 id) const
+{
+	for (const Version &version : history.versions) {
+		if (version.id == id)
+			return &version;
+	}
+	return nullptr;
+}
+
+void SentBlockHistory::evict()
+{
+	while (m_size > m_limit && !m_lru.empty()) {
+		auto it = m_blocks.find(m_lru.back());
+		for (const Version &version : it->second.versions)
+			m_size -= version.getSize();
+		m_blocks.erase(it);
+		m_lru.pop_back();
+	}
+}
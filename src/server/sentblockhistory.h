@@ -0,0 +1,97 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "util/basic_macros.h"
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MapBlock;
+struct MapBlockDiff;
+struct MapNode;
+
+/*
+	Keeps the last few versions of blocks as they were sent to clients.
+
+	When a block that a client already has changes, the server can compare
+	it to the version the client got and send only the difference (see
+	MapBlockDiff). Versions are identified by a number that is unique for
+	the lifetime of the server.
+
+	Versions are evicted in LRU order of their block once the memory limit
+	is reached. Like SerializedBlockCache, blocks must be invalidated
+	whenever they change (see Server::onMapEditEvent).
+
+	Only used by the server thread, not thread-safe.
+*/
+class SentBlockHistory
+{
+public:
+	/// @param limit memory limit in bytes, 0 disables the history
+	/// @param ser_ver serialization version of the metadata that is kept
+	SentBlockHistory(size_t limit, u8 ser_ver);
+
+	DISABLE_CLASS_COPY(SentBlockHistory)
+
+	bool enabled() const { return m_limit > 0; }
+
+	/// Stores the current state of the block, unless it is the same as the
+	/// latest known version.
+	/// @return version of the current state, 0 if disabled
+	u32 remember(MapBlock *block);
+
+	/// Creates the diff from an older version to the current state, which
+	/// must have been remembered.
+	/// @param extra_nodes indices of nodes that are included even if they
+	///        did not change between the versions
+	/// @param with_metadata include the metadata even if it did not change
+	/// @return false if the older version is no longer known
+	bool makeDiff(MapBlock *block, u32 from_version,
+		const std::vector<u16> &extra_nodes, bool with_metadata,
+		MapBlockDiff &diff);
+
+	/// Tells that the blocks might have changed since they were remembered
+	void invalidate(const std::vector<v3s16> &positions);
+
+	void clear();
+
+	size_t getSize() const { return m_size; }
+
+private:
+	struct Version {
+		u32 id;
+		std::unique_ptr<MapNode[]> nodes;
+		std::string metadata;
+
+		size_t getSize() const;
+	};
+
+	struct History {
+		std::list<v3s16>::iterator lru_it;
+		// oldest first
+		std::deque<Version> versions;
+		// whether the latest version is known to be the current state
+		bool up_to_date = false;
+	};
+
+	const Version *findVersion(const History &history, u32 id) const;
+
+	void evict();
+
+	const size_t m_limit;
+	const u8 m_ser_ver;
+
+	u32 m_next_id = 1;
+	std::unordered_map<v3s16, History> m_blocks;
+	// most recently used first
+	std::list<v3s16> m_lru;
+	size_t m_size = 0;
+};
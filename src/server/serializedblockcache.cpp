@@ -0,0 +1,247 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "serializedblockcache.h"
+#include "mapblock.h"
+#include "serialization.h"
+#include "threading/thread.h"
+#include "util/numeric.h"
+#include "log.h"
+#include "debug.h"
+#include <sstream>
+
+// Limits the memory held by snapshots that wait for compression
+#define MAX_PENDING_JOBS 512
+
+class BlockCompressThread : public Thread
+{
+public:
+	BlockCompressThread(SerializedBlockCache *cache, int id) :
+		Thread("BlockCompress" + std::to_string(id)),
+		m_cache(cache)
+	{}
+
+protected:
+	void *run() override
+	{
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		while (!stopRequested()) {
+			SerializedBlockCache::Job job = m_cache->m_jobs.pop_frontNoEx(1000);
+			if (job.raw.empty())
+				continue;
+
+			std::ostringstream os(std::ios_base::binary);
+			compress(job.raw, os, job.key.ver, m_cache->m_compression_level);
+			MapBlock::serializeNetworkSpecific(os);
+
+			m_cache->finishJob(job.key, std::make_shared<std::string>(os.str()));
+		}
+
+		END_DEBUG_EXCEPTION_HANDLER
+
+		return nullptr;
+	}
+
+private:
+	SerializedBlockCache *m_cache;
+};
+
+SerializedBlockCache::SerializedBlockCache(size_t limit, int compression_level) :
+	m_limit(limit),
+	m_compression_level(compression_level)
+{
+	// Leave some room for the server and emerge threads
+	unsigned int nthreads = Thread::getNumberOfProcessors() / 2;
+	nthreads = rangelim(nthreads, 1, 4);
+	for (unsigned int i = 0; i < nthreads; i++) {
+		m_workers.emplace_back(std::make_unique<BlockCompressThread>(this, i));
+		m_workers.back()->start();
+	}
+}
+
+SerializedBlockCache::~SerializedBlockCache()
+{
+	for (auto &worker : m_workers)
+		worker->stop();
+	for (auto &worker : m_workers)
+		worker->wait();
+}
+
+SerializedBlockCache::Data SerializedBlockCache::get(v3s16 pos, u8 ver)
+{
+	MutexAutoLock lock(m_mutex);
+	auto it = m_entries.find({pos, ver});
+	if (it == m_entries.end())
+		return nullptr;
+
+	// Mark as most recently used
+	m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+	return it->second.data;
+}
+
+void SerializedBlockCache::put(v3s16 pos, u8 ver, Data data)
+{
+	if (!enabled() || !data)
+		return;
+
+	MutexAutoLock lock(m_mutex);
+	putLocked({pos, ver}, std::move(data));
+}
+
+void SerializedBlockCache::putLocked(const Key &key, Data data)
+{
+	auto it = m_entries.find(key);
+	if (it != m_entries.end()) {
+		m_size -= it->second.data->size();
+		m_lru.erase(it->second.lru_it);
+		m_entries.erase(it);
+	}
+
+	m_lru.push_front(key);
+	m_size += data->size();
+	m_entries[key] = Entry{m_lru.begin(), std::move(data)};
+
+	evict();
+}
+
+void SerializedBlockCache::invalidate(v3s16 pos)
+{
+	MutexAutoLock lock(m_mutex);
+	for (u8 ver = SER_FMT_VER_LOWEST_WRITE; ver <= SER_FMT_VER_HIGHEST_WRITE; ver++) {
+		const Key key{pos, ver};
+		auto it = m_entries.find(key);
+		if (it != m_entries.end()) {
+			m_size -= it->second.data->size();
+			m_lru.erase(it->second.lru_it);
+			m_entries.erase(it);
+		}
+		auto it2 = m_in_progress.find(key);
+		if (it2 != m_in_progress.end())
+			it2->second.valid = false;
+	}
+}
+
+void SerializedBlockCache::invalidate(const std::vector<v3s16> &positions)
+{
+	for (v3s16 pos : positions)
+		invalidate(pos);
+}
+
+void SerializedBlockCache::clear()
+{
+	MutexAutoLock lock(m_mutex);
+	m_entries.clear();
+	m_lru.clear();
+	m_size = 0;
+	for (auto &it : m_in_progress)
+		it.second.valid = false;
+}
+
+void SerializedBlockCache::precompress(MapBlock *block, u8 ver)
+{
+	queueJob(block, ver, nullptr);
+}
+
+bool SerializedBlockCache::compressAndSend(MapBlock *block, u8 ver, session_t peer_id)
+{
+	if (!m_send_callback)
+		return false;
+	return queueJob(block, ver, &peer_id);
+}
+
+bool SerializedBlockCache::queueJob(MapBlock *block, u8 ver, const session_t *peer_id)
+{
+	// Only the new format can be compressed separately
+	if (ver < 29)
+		return false;
+	// Pointless if the result can't be kept
+	if (!peer_id && !enabled())
+		return false;
+
+	const Key key{block->getPos(), ver};
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_in_progress.find(key);
+		if (it != m_in_progress.end()) {
+			// Piggyback on the existing job
+			if (peer_id)
+				it->second.peers.push_back(*peer_id);
+			return true;
+		}
+		if (m_in_progress.size() >= MAX_PENDING_JOBS)
+			return false;
+		if (!peer_id && m_entries.count(key))
+			return true;
+
+		Pending &p = m_in_progress[key];
+		if (peer_id)
+			p.peers.push_back(*peer_id);
+	}
+
+	std::ostringstream os(std::ios_base::binary);
+	block->serializeUncompressed(os, ver, false);
+	m_jobs.push_back(Job{key, os.str()});
+	return true;
+}
+
+bool SerializedBlockCache::isPending(v3s16 pos, u8 ver)
+{
+	MutexAutoLock lock(m_mutex);
+	return m_in_progress.count({pos, ver}) > 0;
+}
+
+size_t SerializedBlockCache::getSize()
+{
+	MutexAutoLock lock(m_mutex);
+	return m_size;
+}
+
+void SerializedBlockCache::finishJob(const Key &key, Data data)
+{
+	std::vector<session_t> peers;
+	bool valid;
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_in_progress.find(key);
+		if (it == m_in_progress.end())
+			return;
+		peers.swap(it->second.peers);
+		valid = it->second.valid;
+		// Don't cache if the block changed while we were working on it
+		if (valid)
+			putLocked(key, data);
+		if (peers.empty()) {
+			m_in_progress.erase(it);
+			return;
+		}
+	}
+
+	// The job stays in progress until the data has been sent, so that
+	// nothing that builds on it can overtake it (see isPending()).
+	while (true) {
+		m_send_callback(key.pos, peers, data, !valid);
+
+		MutexAutoLock lock(m_mutex);
+		auto it = m_in_progress.find(key);
+		// Peers might have been added meanwhile
+		peers.clear();
+		peers.swap(it->second.peers);
+		valid = it->second.valid;
+		if (peers.empty()) {
+			m_in_progress.erase(it);
+			return;
+		}
+	}
+}
+
+void SerializedBlockCache::evict()
+{
+	while (m_size > m_limit && !m_lru.empty()) {
+		auto it = m_entries.find(m_lru.back());
+		m_size -= it->second.data->size();
+		m_entries.erase(it);
+		m_lru.pop_back();
+	}
+}
@@ -0,0 +1,144 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "util/basic_macros.h"
+#include "util/container.h"
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MapBlock;
+class BlockCompressThread;
+typedef u16 session_t;
+
+/*
+	Long-lived cache of blocks serialized for network transfer.
+
+	Entries are keyed by block position and serialization version and are
+	evicted in LRU order once the memory limit is reached. They must be
+	invalidated whenever the block changes (see Server::onMapEditEvent).
+
+	Blocks can also be compressed in the background by a pool of worker
+	threads, so the server thread only has to take a snapshot. The workers
+	then hand the result to the send callback, which builds the packets.
+
+	All methods are thread-safe.
+*/
+class SerializedBlockCache
+{
+public:
+	typedef std::shared_ptr<const std::string> Data;
+
+	/// Called from the worker threads once a block is ready for sending.
+	/// `outdated` is true if the block changed after the snapshot was taken.
+	typedef std::function<void(v3s16 pos, const std::vector<session_t> &peers,
+		const Data &data, bool outdated)> SendCallback;
+
+	/// @param limit memory limit in bytes, 0 disables caching
+	/// @param compression_level zstd level for background compression
+	SerializedBlockCache(size_t limit, int compression_level);
+	~SerializedBlockCache();
+
+	DISABLE_CLASS_COPY(SerializedBlockCache)
+
+	bool enabled() const { return m_limit > 0; }
+
+	/// @return cached data or nullptr
+	Data get(v3s16 pos, u8 ver);
+
+	void put(v3s16 pos, u8 ver, Data data);
+
+	/// Drops all versions of a block, including pending background work
+	void invalidate(v3s16 pos);
+	void invalidate(const std::vector<v3s16> &positions);
+
+	void clear();
+
+	/// Snapshots the block and compresses it in the background.
+	/// Does nothing if the block is already cached or queued.
+	/// @note block must be locked (envlock) by the caller
+	void precompress(MapBlock *block, u8 ver);
+
+	/// Like precompress(), but also passes the result to the send callback.
+	/// @return false if this is not possible, the caller has to send the
+	///         block on its own then
+	bool compressAndSend(MapBlock *block, u8 ver, session_t peer_id);
+
+	void setSendCallback(SendCallback cb) { m_send_callback = std::move(cb); }
+
+	/// @return true if the block is being compressed, or the result is
+	///         being sent
+	bool isPending(v3s16 pos, u8 ver);
+
+	size_t getSize();
+
+private:
+	friend class BlockCompressThread;
+
+	struct Key {
+		v3s16 pos;
+		u8 ver;
+
+		bool operator==(const Key &other) const
+		{
+			return pos == other.pos && ver == other.ver;
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key &k) const
+		{
+			return std::hash<v3s16>()(k.pos) ^ k.ver;
+		}
+	};
+
+	struct Entry {
+		std::list<Key>::iterator lru_it;
+		Data data;
+	};
+
+	struct Job {
+		Key key;
+		std::string raw;
+	};
+
+	struct Pending {
+		// false if invalidated meanwhile
+		bool valid = true;
+		// who to send the result to
+		std::vector<session_t> peers;
+	};
+
+	bool queueJob(MapBlock *block, u8 ver, const session_t *peer_id);
+
+	// Called by the workers once a job is done
+	void finishJob(const Key &key, Data data);
+
+	void putLocked(const Key &key, Data data);
+
+	void evict();
+
+	const size_t m_limit;
+	const int m_compression_level;
+
+	std::mutex m_mutex;
+	std::unordered_map<Key, Entry, KeyHash> m_entries;
+	// most recently used first
+	std::list<Key> m_lru;
+	size_t m_size = 0;
+	// Keys with work in progress
+	std::unordered_map<Key, Pending, KeyHash> m_in_progress;
+	SendCallback m_send_callback;
+
+	MutexedQueue<Job> m_jobs;
+	std::vector<std::unique_ptr<BlockCompressThread>> m_workers;
+};
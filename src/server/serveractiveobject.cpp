@@ -62,10 +62,10 @@ std::string ServerActiveObject::generateUpdateInfantCommand(u16 infant_id, u16 p
 	return os.str();
 }
 
-void ServerActiveObject::dumpAOMessagesToQueue(std::queue<ActiveObjectMessage> &queue)
+void ServerActiveObject::dumpAOMessagesToQueue(std::vector<ActiveObjectMessage> &queue)
 {
 	while (!m_messages_out.empty()) {
-		queue.push(std::move(m_messages_out.front()));
+		queue.push_back(std::move(m_messages_out.front()));
 		m_messages_out.pop();
 	}
 }
@@ -189,7 +189,7 @@ class ServerActiveObject : public ActiveObject
 
 	std::string generateUpdateInfantCommand(u16 infant_id, u16 protocol_version);
 
-	void dumpAOMessagesToQueue(std::queue<ActiveObjectMessage> &queue);
+	void dumpAOMessagesToQueue(std::vector<ActiveObjectMessage> &queue);
 
 	/*
 		Number of players which know about this object. Object won't be
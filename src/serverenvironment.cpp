@@ -24,6 +24,7 @@
 #include "util/basic_macros.h"
 #include "util/pointedthing.h"
 #include "threading/mutex_auto_lock.h"
+#include "threading/thread.h"
 #include "filesys.h"
 #include "gameparams.h"
 #include "database/database-dummy.h"
@@ -190,6 +191,14 @@ ServerEnvironment::ServerEnvironment(std::unique_ptr<ServerMap> map,
 	m_cache_nodetimer_interval = rangelim(g_settings->getFloat("nodetimer_interval"), 0.1f, 1);
 	m_cache_abm_time_budget = g_settings->getFloat("abm_time_budget");
 
+	// If automatic, leave some room for the emerge and network threads
+	s16 abm_threads = g_settings->getS16("abm_threads");
+	if (abm_threads <= 0)
+		abm_threads = Thread::getNumberOfProcessors() - 2;
+	// The server thread does its share of the work too
+	abm_threads = MYMAX(abm_threads, 1) - 1;
+	m_abm_workers = std::make_unique<ABMWorkerPool>(abm_threads);
+
 	m_step_time_counter = mb->addCounter(
 		"minetest_env_step_time", "Time spent in environment step (in microseconds)");
 
@@ -1018,7 +1027,7 @@ void ServerEnvironment::step(float dtime)
 
 		int blocks_scanned = 0;
 		int abms_run = 0;
-		int blocks_cached = 0;
+		int blocks_skipped = 0;
 
 		std::vector<v3s16> output(m_active_blocks.m_abm_list.size());
 
@@ -1027,33 +1036,52 @@ void ServerEnvironment::step(float dtime)
 		std::copy(m_active_blocks.m_abm_list.begin(), m_active_blocks.m_abm_list.end(), output.begin());
 		std::shuffle(output.begin(), output.end(), MyRandGenerator());
 
-		int i = 0;
-		// determine the time budget for ABMs
-		u32 max_time_ms = m_cache_abm_interval * 1000 * m_cache_abm_time_budget;
+		// Find out where ABMs are to be run. This is done by multiple threads,
+		// which only read from the map while we hold the env lock.
+		std::vector<ABMBlockJob> jobs;
+		jobs.reserve(output.size());
 		for (const v3s16 &p : output) {
 			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
 			if (!block)
 				continue;
 
-			i++;
-
 			// Set current time as timestamp
 			block->setTimestampNoChangedFlag(m_game_time);
 
+			jobs.emplace_back();
+			if (!abmhandler.prepare(block, jobs.back())) {
+				jobs.pop_back();
+				blocks_skipped++;
+			}
+		}
+		blocks_scanned = jobs.size();
+
+		{
+			ScopeProfiler sp2(g_profiler, "SEnv: ABM trigger selection avg", SPT_AVG);
+			m_abm_workers->selectTriggers(abmhandler, jobs);
+		}
+
+		// Now run the callbacks, in a deterministic order
+		size_t i = 0;
+		// determine the time budget for ABMs
+		u32 max_time_ms = m_cache_abm_interval * 1000 * m_cache_abm_time_budget;
+		for (ABMBlockJob &job : jobs) {
+			i++;
+
 			/* Handle ActiveBlockModifiers */
-			abmhandler.apply(block, blocks_scanned, abms_run, blocks_cached);
+			abmhandler.dispatch(job, abms_run);
 
 			u32 time_ms = timer.getTimerTime();
 
 			if (time_ms > max_time_ms) {
 				warningstream << "active block modifiers took "
 					  << time_ms << "ms (processed " << i << " of "
-					  << output.size() << " active blocks)" << std::endl;
+					  << jobs.size() << " active blocks)" << std::endl;
 				break;
 			}
 		}
 		g_profiler->avg("ServerEnv: active blocks", m_active_blocks.m_abm_list.size());
-		g_profiler->avg("ServerEnv: active blocks cached", blocks_cached);
+		g_profiler->avg("ServerEnv: active blocks skipped for ABMs", blocks_skipped);
 		g_profiler->avg("ServerEnv: active blocks scanned for ABMs", blocks_scanned);
 		g_profiler->avg("ServerEnv: ABMs run", abms_run);
 
@@ -1319,14 +1347,10 @@ void ServerEnvironment::setStaticForActiveObjectsInBlock(
 	}
 }
 
-bool ServerEnvironment::getActiveObjectMessage(ActiveObjectMessage *dest)
+void ServerEnvironment::takeActiveObjectMessages(std::vector<ActiveObjectMessage> &dest)
 {
-	if (m_active_object_messages.empty())
-		return false;
-
-	*dest = std::move(m_active_object_messages.front());
-	m_active_object_messages.pop();
-	return true;
+	dest.clear();
+	dest.swap(m_active_object_messages);
 }
 
 void ServerEnvironment::getSelectedActiveObjects(
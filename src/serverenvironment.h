@@ -182,10 +182,11 @@ class ServerEnvironment final : public Environment
 		std::vector<std::pair<bool /* gone? */, u16>> &removed_objects);
 
 	/*
-		Get the next message emitted by some active object.
-		Returns false if no messages are available, true otherwise.
+		Takes all messages emitted by active objects, in the order they were
+		emitted. The vector is swapped with the internal one, so it should
+		be cleared and passed again to reuse its storage.
 	*/
-	bool getActiveObjectMessage(ActiveObjectMessage *dest);
+	void takeActiveObjectMessages(std::vector<ActiveObjectMessage> &dest);
 
 	virtual void getSelectedActiveObjects(
 		const core::line3d<f32> &shootline_on_map,
@@ -358,7 +359,7 @@ class ServerEnvironment final : public Environment
 	// on_mapblocks_changed map event receiver
 	OnMapblocksChangedReceiver m_on_mapblocks_changed_receiver;
 	// Outgoing network message buffer for active objects
-	std::queue<ActiveObjectMessage> m_active_object_messages;
+	std::vector<ActiveObjectMessage> m_active_object_messages;
 	// Some timers
 	float m_send_recommended_timer = 0.0f;
 	IntervalLimiter m_object_management_interval;
@@ -380,6 +381,7 @@ class ServerEnvironment final : public Environment
 	u32 m_last_clear_objects_time = 0;
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
+	std::unique_ptr<ABMWorkerPool> m_abm_workers;
 	LBMManager m_lbm_mgr;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval = 0.1f;
@@ -4,6 +4,7 @@
 
 #include "map.h"
 #include "mapsector.h"
+#include "mapsnapshot.h"
 #include "filesys.h"
 #include "voxel.h"
 #include "voxelalgorithms.h"
@@ -26,6 +27,7 @@
 #include "database/database-sqlite3.h"
 #include "script/scripting_server.h"
 #include "irrlicht_changes/printing.h"
+#include "threading/thread.h"
 #if USE_LEVELDB
 #include "database/database-leveldb.h"
 #endif
@@ -35,14 +37,202 @@
 #if USE_POSTGRESQL
 #include "database/database-postgresql.h"
 #endif
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
 
 /*
 	Helpers
 */
 
+/*
+	Write-behind saver for ServerMap.
+
+	The server thread only serializes blocks (uncompressed), compression and
+	the database writes happen here. Blocks are removed from the queue only
+	after they have been written, so loads see the newest data at all times.
+*/
+class MapSaveThread : public Thread
+{
+public:
+	MapSaveThread(MapDatabaseAccessor *db, int compression_level) :
+		Thread("MapSave"),
+		m_db(db),
+		m_compression_level(compression_level)
+	{}
+
+	/// Queue uncompressed block data for saving.
+	/// Blocks the caller while the queue is full.
+	void enqueue(v3s16 pos, std::string &&raw);
+
+	/// Get data still waiting to be written, in database format.
+	/// @note may be called with the database lock held
+	bool getPending(v3s16 pos, std::string &ret);
+
+	/// Wait until everything queued so far is written
+	void flush();
+
+	/// Request exit, the queue is drained before the thread finishes
+	void stop();
+
+protected:
+	void *run() override;
+
+private:
+	struct Entry {
+		std::string raw;
+		u64 seq;
+		// false while the entry is being written
+		bool queued;
+	};
+
+	// Maximum number of blocks held in memory
+	static constexpr size_t QUEUE_LIMIT = 4096;
+	// Blocks written per database transaction
+	static constexpr size_t BATCH_SIZE = 256;
+
+	MapDatabaseAccessor *m_db;
+	const int m_compression_level;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::unordered_map<v3s16, Entry> m_pending;
+	std::deque<v3s16> m_order;
+	u64 m_next_seq = 0;
+};
+
+void MapSaveThread::enqueue(v3s16 pos, std::string &&raw)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_pending.size() >= QUEUE_LIMIT && isRunning()) {
+		ScopeProfiler sp(g_profiler, "ServerMap: save queue full (sum)");
+		m_cv.wait(lock, [&] {
+			return m_pending.size() < QUEUE_LIMIT || !isRunning();
+		});
+	}
+
+	auto it = m_pending.find(pos);
+	if (it == m_pending.end())
+		it = m_pending.emplace(pos, Entry{{}, 0, false}).first;
+	Entry &e = it->second;
+	e.raw = std::move(raw);
+	e.seq = m_next_seq++;
+	if (!e.queued) {
+		e.queued = true;
+		m_order.push_back(pos);
+	}
+	lock.unlock();
+	m_cv.notify_all();
+}
+
+bool MapSaveThread::getPending(v3s16 pos, std::string &ret)
+{
+	std::string raw;
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_pending.find(pos);
+		if (it == m_pending.end())
+			return false;
+		raw = it->second.raw;
+	}
+
+	const u8 version = SER_FMT_VER_HIGHEST_WRITE;
+	std::ostringstream os(std::ios_base::binary);
+	os.write((char*) &version, 1);
+	compress(raw, os, version, m_compression_level);
+	ret = os.str();
+	return true;
+}
+
+void MapSaveThread::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [&] {
+		return m_pending.empty() || !isRunning();
+	});
+}
+
+void MapSaveThread::stop()
+{
+	{
+		MutexAutoLock lock(m_mutex);
+		Thread::stop();
+	}
+	m_cv.notify_all();
+}
+
+void *MapSaveThread::run()
+{
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	const u8 version = SER_FMT_VER_HIGHEST_WRITE;
+	std::vector<std::pair<v3s16, u64>> batch;
+	std::vector<std::string> raws, blobs;
+
+	while (true) {
+		batch.clear();
+		raws.clear();
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [&] {
+				return !m_order.empty() || stopRequested();
+			});
+			// only exit once everything is written
+			if (m_order.empty())
+				break;
+
+			while (!m_order.empty() && batch.size() < BATCH_SIZE) {
+				v3s16 pos = m_order.front();
+				m_order.pop_front();
+				Entry &e = m_pending[pos];
+				e.queued = false;
+				batch.emplace_back(pos, e.seq);
+				raws.push_back(e.raw);
+			}
+		}
+
+		blobs.resize(raws.size());
+		for (size_t i = 0; i < raws.size(); i++) {
+			std::ostringstream os(std::ios_base::binary);
+			os.write((char*) &version, 1);
+			compress(raws[i], os, version, m_compression_level);
+			blobs[i] = os.str();
+		}
+
+		{
+			MutexAutoLock dblock(m_db->mutex);
+			m_db->dbase->beginSave();
+			for (size_t i = 0; i < batch.size(); i++) {
+				if (!m_db->dbase->saveBlock(batch[i].first, blobs[i])) {
+					errorstream << "MapSaveThread: failed to save block "
+						<< batch[i].first << std::endl;
+				}
+			}
+			m_db->dbase->endSave();
+		}
+
+		{
+			MutexAutoLock lock(m_mutex);
+			for (auto &it : batch) {
+				auto it2 = m_pending.find(it.first);
+				// keep it if it was queued again meanwhile
+				if (it2 != m_pending.end() && it2->second.seq == it.second)
+					m_pending.erase(it2);
+			}
+		}
+		m_cv.notify_all();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+
+	return nullptr;
+}
+
 void MapDatabaseAccessor::loadBlock(v3s16 blockpos, std::string &ret)
 {
 	ret.clear();
+	if (saver && saver->getPending(blockpos, ret))
+		return;
 	dbase->loadBlock(blockpos, &ret);
 	if (ret.empty() && dbase_ro)
 		dbase_ro->loadBlock(blockpos, &ret);
@@ -87,6 +277,12 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 	m_savedir = savedir;
 	m_map_saving_enabled = false;
 
+	m_map_compression_level = rangelim(g_settings->getS16("map_compression_level_disk"), -1, 9);
+
+	m_save_thread = std::make_unique<MapSaveThread>(&m_db, m_map_compression_level);
+	m_db.saver = m_save_thread.get();
+	m_save_thread->start();
+
 	// Inform EmergeManager of db handles
 	m_emerge->initMap(&m_db);
 
@@ -97,8 +293,6 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 	m_loaded_blocks_gauge = mb->addGauge(
 		"minetest_map_loaded_blocks", "Number of loaded blocks");
 
-	m_map_compression_level = rangelim(g_settings->getS16("map_compression_level_disk"), -1, 9);
-
 	try {
 		// If directory exists, check contents and load if possible
 		if (fs::PathExists(m_savedir)) {
@@ -159,10 +353,15 @@ ServerMap::~ServerMap()
 				 << ", exception: " << e.what() << std::endl;
 	}
 
+	// Everything must have reached the database before it is closed
+	m_save_thread->stop();
+	m_save_thread->wait();
+
 	m_emerge->resetMap();
 
 	{
 		MutexAutoLock dblock(m_db.mutex);
+		m_db.saver = nullptr;
 		delete m_db.dbase;
 		m_db.dbase = nullptr;
 		delete m_db.dbase_ro;
@@ -172,6 +371,66 @@ ServerMap::~ServerMap()
 	deleteDetachedBlocks();
 }
 
+// Snapshots are dropped if nobody asked for them for this long
+#define SNAPSHOT_IDLE_TIMEOUT_MS 60000
+
+std::shared_ptr<const MapSnapshot> ServerMap::getSnapshot()
+{
+	m_snapshot_request_time.store(porting::getTimeMs(), std::memory_order_relaxed);
+	MutexAutoLock lock(m_snapshot_mutex);
+	return m_snapshot;
+}
+
+void ServerMap::updateSnapshot()
+{
+	const u64 request_time = m_snapshot_request_time.load(std::memory_order_relaxed);
+	if (request_time == 0 ||
+			porting::getTimeMs() - request_time > SNAPSHOT_IDLE_TIMEOUT_MS) {
+		if (m_snapshots_enabled) {
+			m_snapshots_enabled = false;
+			m_snapshot_removed_blocks.clear();
+			MutexAutoLock lock(m_snapshot_mutex);
+			m_snapshot.reset();
+		}
+		return;
+	}
+
+	// Only this thread replaces the snapshot, so it can be read unlocked
+	const bool full = !m_snapshots_enabled;
+	MapSnapshotBuilder builder(full ? nullptr : m_snapshot.get());
+	m_snapshots_enabled = true;
+
+	for (v3s16 blockpos : m_snapshot_removed_blocks)
+		builder.removeBlock(blockpos);
+	m_snapshot_removed_blocks.clear();
+
+	MapBlockVect blocks;
+	for (auto &sector_it : m_sectors) {
+		blocks.clear();
+		sector_it.second->getBlocks(blocks);
+		for (MapBlock *block : blocks) {
+			if (!full && !block->isSnapshotOutdated())
+				continue;
+			builder.setBlock(block->getPos(), block->getData());
+			block->setSnapshotOutdated(false);
+		}
+	}
+
+	if (!full && !builder.changed())
+		return;
+
+	auto snapshot = builder.finish();
+	MutexAutoLock lock(m_snapshot_mutex);
+	m_snapshot = std::move(snapshot);
+}
+
+void ServerMap::onBlockRemoved(v3s16 blockpos)
+{
+	m_blocks_removed++;
+	if (m_snapshots_enabled)
+		m_snapshot_removed_blocks.push_back(blockpos);
+}
+
 MapgenParams *ServerMap::getMapgenParams()
 {
 	// getMapgenParams() should only ever be called after Server is initialized
@@ -197,7 +456,57 @@ bool ServerMap::blockpos_over_mapgen_limit(v3s16 p)
 		p.Z >  mapgen_limit_bp;
 }
 
-bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
+void ServerMap::prepareBlockMake(v3s16 blockpos, BlockMakePrep *prep)
+{
+	assert(prep);
+	s16 csize = getMapgenParams()->chunksize;
+	v3s16 bpmin = EmergeManager::getContainingChunk(blockpos, csize);
+	v3s16 bpmax = bpmin + v3s16(1, 1, 1) * (csize - 1);
+
+	v3s16 extra_borders(1, 1, 1);
+	prep->full_bpmin = bpmin - extra_borders;
+	prep->full_bpmax = bpmax + extra_borders;
+	prep->prepared = true;
+
+	// initBlockMake() will not do anything
+	if (blockpos_over_mapgen_limit(prep->full_bpmin) ||
+			blockpos_over_mapgen_limit(prep->full_bpmax))
+		return;
+
+	const v3s16 extent = prep->full_bpmax - prep->full_bpmin + v3s16(1, 1, 1);
+	const size_t count = (size_t)extent.X * extent.Y * extent.Z;
+
+	// Blocks that are unloaded after this are read again by initBlockMake()
+	prep->blocks_removed = m_blocks_removed;
+	prep->blobs.resize(count);
+	{
+		static const ProfilerId sp_id =
+			ScopeProfiler::makeId("ServerMap: load blocks - prepare (sum)");
+		ScopeProfiler sp(g_profiler, sp_id);
+		MutexAutoLock dblock(m_db.mutex);
+		size_t i = 0;
+		for (s16 x = prep->full_bpmin.X; x <= prep->full_bpmax.X; x++)
+		for (s16 z = prep->full_bpmin.Z; z <= prep->full_bpmax.Z; z++)
+		for (s16 y = prep->full_bpmin.Y; y <= prep->full_bpmax.Y; y++)
+			m_db.loadBlock(v3s16(x, y, z), prep->blobs[i++]);
+	}
+
+	prep->blank_blocks.resize(count);
+	size_t i = 0;
+	for (s16 x = prep->full_bpmin.X; x <= prep->full_bpmax.X; x++)
+	for (s16 z = prep->full_bpmin.Z; z <= prep->full_bpmax.Z; z++)
+	for (s16 y = prep->full_bpmin.Y; y <= prep->full_bpmax.Y; y++) {
+		if (prep->blobs[i].empty())
+			prep->blank_blocks[i] = std::make_unique<MapBlock>(v3s16(x, y, z), m_gamedef);
+		i++;
+	}
+
+	prep->vmanip = std::make_unique<MMVManip>(this);
+	prep->vmanip->preallocate(prep->full_bpmin, prep->full_bpmax);
+}
+
+bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data,
+	BlockMakePrep *prep)
 {
 	assert(data);
 	s16 csize = getMapgenParams()->chunksize;
@@ -224,9 +533,17 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 	data->blockpos_max = bpmax;
 	data->nodedef = m_nodedef;
 
+	if (prep && (!prep->vmanip || prep->full_bpmin != full_bpmin))
+		prep = nullptr;
+	// The database may have changed since it was read
+	const bool use_blobs = prep && prep->blocks_removed == m_blocks_removed;
+
 	/*
 		Create the whole area of this and the neighboring blocks
 	*/
+	// Blocks that are not new, these have to be copied to the VManip
+	std::vector<MapBlock *> old_blocks;
+	size_t i = 0;
 	for (s16 x = full_bpmin.X; x <= full_bpmax.X; x++)
 	for (s16 z = full_bpmin.Z; z <= full_bpmax.Z; z++) {
 		v2s16 sectorpos(x, z);
@@ -234,18 +551,33 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 		MapSector *sector = createSector(sectorpos);
 		FATAL_ERROR_IF(sector == NULL, "createSector() failed");
 
-		for (s16 y = full_bpmin.Y; y <= full_bpmax.Y; y++) {
+		for (s16 y = full_bpmin.Y; y <= full_bpmax.Y; y++, i++) {
 			v3s16 p(x, y, z);
 
-			MapBlock *block = emergeBlock(p, false);
-			if (block == NULL) {
-				block = createBlock(p);
+			MapBlock *block;
+			if (!use_blobs) {
+				block = emergeBlock(p, false);
+			} else {
+				block = sector->getBlockNoCreateNoEx(y);
+				if (!block && !prep->blobs[i].empty())
+					block = loadBlock(prep->blobs[i], p);
+			}
+			if (block) {
+				old_blocks.push_back(block);
+				continue;
+			}
 
-				// Block gets sunlight if this is true.
-				// Refer to the map generator heuristics.
-				bool ug = m_emerge->isBlockUnderground(p);
-				block->setIsUnderground(ug);
+			if (prep && prep->blank_blocks[i]) {
+				block = prep->blank_blocks[i].get();
+				sector->insertBlock(std::move(prep->blank_blocks[i]));
+			} else {
+				block = createBlock(p);
 			}
+
+			// Block gets sunlight if this is true.
+			// Refer to the map generator heuristics.
+			bool ug = m_emerge->isBlockUnderground(p);
+			block->setIsUnderground(ug);
 		}
 	}
 
@@ -256,8 +588,13 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 		neighboring blocks
 	*/
 
-	data->vmanip = new MMVManip(this);
-	data->vmanip->initialEmerge(full_bpmin, full_bpmax);
+	if (prep) {
+		data->vmanip = prep->vmanip.release();
+		data->vmanip->initialEmergeBlocks(old_blocks);
+	} else {
+		data->vmanip = new MMVManip(this);
+		data->vmanip->initialEmerge(full_bpmin, full_bpmax);
+	}
 
 	// Data is ready now.
 	return true;
@@ -499,9 +836,6 @@ void ServerMap::save(ModifiedState save_level)
 	u32 block_count = 0;
 	u32 block_count_all = 0; // Number of blocks in memory
 
-	// Don't do anything with sqlite unless something is really saved
-	bool save_started = false;
-
 	for (auto &sector_it : m_sectors) {
 		MapSector *sector = sector_it.second;
 
@@ -512,12 +846,6 @@ void ServerMap::save(ModifiedState save_level)
 			block_count_all++;
 
 			if(block->getModified() >= (u32)save_level) {
-				// Lazy beginSave()
-				if(!save_started) {
-					beginSave();
-					save_started = true;
-				}
-
 				modprofiler.add(block->getModifiedReasonString(), 1);
 
 				saveBlock(block);
@@ -526,9 +854,6 @@ void ServerMap::save(ModifiedState save_level)
 		}
 	}
 
-	if(save_started)
-		endSave();
-
 	/*
 		Only print if something happened or saved whole map
 	*/
@@ -549,6 +874,9 @@ void ServerMap::save(ModifiedState save_level)
 
 void ServerMap::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
+	// Newly created blocks might not be in the database yet
+	m_save_thread->flush();
+
 	MutexAutoLock dblock(m_db.mutex);
 	m_db.dbase->listAllLoadableBlocks(dst);
 	if (m_db.dbase_ro)
@@ -605,23 +933,21 @@ MapDatabase *ServerMap::createDatabase(
 	return db;
 }
 
-void ServerMap::beginSave()
+bool ServerMap::saveBlock(MapBlock *block)
 {
-	MutexAutoLock dblock(m_db.mutex);
-	m_db.dbase->beginSave();
-}
+	// Only take a snapshot here, the save thread takes care of the rest
+	std::ostringstream o(std::ios_base::binary);
+	block->serializeUncompressed(o, SER_FMT_VER_HIGHEST_WRITE, true);
+	m_save_thread->enqueue(block->getPos(), o.str());
 
-void ServerMap::endSave()
-{
-	MutexAutoLock dblock(m_db.mutex);
-	m_db.dbase->endSave();
+	// The current state is safe now so clear modified flag
+	block->resetModified();
+	return true;
 }
 
-bool ServerMap::saveBlock(MapBlock *block)
+void ServerMap::flushSaveQueue()
 {
-	// FIXME: serialization happens under mutex
-	MutexAutoLock dblock(m_db.mutex);
-	return saveBlock(block, m_db.dbase, m_map_compression_level);
+	m_save_thread->flush();
 }
 
 bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_level)
@@ -650,7 +976,8 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 
 void ServerMap::deSerializeBlock(MapBlock *block, std::istream &is)
 {
-	ScopeProfiler sp(g_profiler, "ServerMap: deSer block", SPT_AVG, PRECISION_MICRO);
+	static const ProfilerId sp_id = ScopeProfiler::makeId("ServerMap: deSer block", PRECISION_MICRO);
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG, PRECISION_MICRO);
 
 	u8 version = readU8(is);
 	if (is.fail())
@@ -661,7 +988,8 @@ void ServerMap::deSerializeBlock(MapBlock *block, std::istream &is)
 
 MapBlock *ServerMap::loadBlock(const std::string &blob, v3s16 p3d, bool save_after_load)
 {
-	ScopeProfiler sp(g_profiler, "ServerMap: load block", SPT_AVG, PRECISION_MICRO);
+	static const ProfilerId sp_id = ScopeProfiler::makeId("ServerMap: load block", PRECISION_MICRO);
+	ScopeProfiler sp(g_profiler, sp_id, SPT_AVG, PRECISION_MICRO);
 	MapBlock *block = nullptr;
 	bool created_new = false;
 
@@ -758,6 +1086,9 @@ bool ServerMap::deleteBlock(v3s16 blockpos)
 		// It may not be safe to delete the block from memory at the moment
 		// (pointers to it could still be in use)
 		m_detached_blocks.push_back(sector->detachBlock(block));
+		onBlockRemoved(blockpos);
+	} else {
+		m_blocks_removed++;
 	}
 
 	return true;
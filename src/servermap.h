@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 #include "map.h"
 #include "util/container.h" // UniqueQueue
@@ -19,6 +21,8 @@ class EmergeManager;
 class ServerEnvironment;
 struct BlockMakeData;
 class MetricsBackend;
+class MapSaveThread;
+class MapSnapshot;
 
 // TODO: this could wrap all calls to MapDatabase, including locking
 struct MapDatabaseAccessor {
@@ -28,12 +32,35 @@ struct MapDatabaseAccessor {
 	MapDatabase *dbase = nullptr;
 	/// Fallback database for read operations
 	MapDatabase *dbase_ro = nullptr;
+	/// Blocks waiting to be written, these take precedence over dbase
+	MapSaveThread *saver = nullptr;
 
 	/// Load a block, taking dbase_ro into account.
 	/// @note call locked
 	void loadBlock(v3s16 blockpos, std::string &ret);
 };
 
+/*
+	The part of ServerMap::initBlockMake() that doesn't need the environment
+	lock, done by ServerMap::prepareBlockMake(). This way emerge threads
+	prepare independent chunks at the same time and the locked part stays
+	short.
+*/
+struct BlockMakePrep {
+	bool prepared = false;
+	// Area of the chunk and its border, in blocks
+	v3s16 full_bpmin, full_bpmax;
+	// Value of ServerMap::m_blocks_removed before the database was read
+	u32 blocks_removed = 0;
+	// The following are indexed in the order of initBlockMake():
+	// serialized blocks from the database, empty if there was none
+	std::vector<std::string> blobs;
+	// blank blocks where there was none
+	std::vector<std::unique_ptr<MapBlock>> blank_blocks;
+	// Allocated for the area, see MMVManip::preallocate()
+	std::unique_ptr<MMVManip> vmanip;
+};
+
 /*
 	ServerMap
 
@@ -61,9 +88,14 @@ class ServerMap : public Map
 		Blocks are generated by using these and makeBlock().
 	*/
 	bool blockpos_over_mapgen_limit(v3s16 p);
+	/// @brief do what initBlockMake() can do without the environment lock
+	/// @note thread-safe
+	void prepareBlockMake(v3s16 blockpos, BlockMakePrep *prep);
 	/// @brief copy data from map to prepare for mapgen
+	/// @param prep from prepareBlockMake(), optional
 	/// @return true if mapgen should actually happen
-	bool initBlockMake(v3s16 blockpos, BlockMakeData *data);
+	bool initBlockMake(v3s16 blockpos, BlockMakeData *data,
+		BlockMakePrep *prep = nullptr);
 	/// @brief write data back to map after mapgen
 	/// @param now current game time
 	void finishBlockMake(BlockMakeData *data,
@@ -104,18 +136,17 @@ class ServerMap : public Map
 	*/
 	static MapDatabase *createDatabase(const std::string &name, const std::string &savedir, Settings &conf);
 
-	// Call these before and after saving of blocks
-	void beginSave() override;
-	void endSave() override;
-
 	void save(ModifiedState save_level) override;
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 	void listAllLoadedBlocks(std::vector<v3s16> &dst);
 
 	MapgenParams *getMapgenParams();
 
+	// Snapshots the block and hands it to the save thread
 	bool saveBlock(MapBlock *block) override;
 	static bool saveBlock(MapBlock *block, MapDatabase *db, int compression_level = -1);
+	/// Wait until the blocks passed to saveBlock() so far are in the database
+	void flushSaveQueue();
 
 	// Load block in a synchronous fashion
 	MapBlock *loadBlock(v3s16 p);
@@ -136,6 +167,18 @@ class ServerMap : public Map
 
 	void step();
 
+	/*
+		Map snapshots
+	*/
+
+	/// Latest snapshot of the loaded blocks, nullptr if there is none yet.
+	/// Snapshots are only updated while they are being requested.
+	/// @note thread-safe
+	std::shared_ptr<const MapSnapshot> getSnapshot();
+	/// Copies the blocks that changed into a new snapshot.
+	/// @note call locked
+	void updateSnapshot();
+
 	void updateVManip(v3s16 pos);
 
 	// For debug printing
@@ -165,6 +208,7 @@ class ServerMap : public Map
 protected:
 
 	void reportMetrics(u64 save_time_us, u32 saved_blocks, u32 all_blocks) override;
+	void onBlockRemoved(v3s16 blockpos) override;
 
 private:
 	friend class ModApiMapgen; // for m_transforming_liquid
@@ -178,6 +222,9 @@ class ServerMap : public Map
 	int m_map_compression_level;
 
 	std::set<v3s16> m_chunks_in_progress;
+	// Counts blocks removed from memory or the database, blocks read from the
+	// database by prepareBlockMake() may be outdated if this changed since
+	std::atomic<u32> m_blocks_removed{0};
 
 	// used by deleteBlock() and deleteDetachedBlocks()
 	std::vector<std::unique_ptr<MapBlock>> m_detached_blocks;
@@ -196,6 +243,16 @@ class ServerMap : public Map
 	bool m_map_metadata_changed = true;
 
 	MapDatabaseAccessor m_db;
+	std::unique_ptr<MapSaveThread> m_save_thread;
+
+	// Map snapshots
+	std::mutex m_snapshot_mutex;
+	std::shared_ptr<const MapSnapshot> m_snapshot; // protected by m_snapshot_mutex
+	// Time of the last getSnapshot() call in ms
+	std::atomic<u64> m_snapshot_request_time{0};
+	bool m_snapshots_enabled = false;
+	// Blocks that were unloaded since the last update
+	std::vector<v3s16> m_snapshot_removed_blocks;
 
 	// Map metrics
 	MetricGaugePtr m_loaded_blocks_gauge;
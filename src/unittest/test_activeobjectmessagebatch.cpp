@@ -0,0 +1,129 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "test.h"
+
+#include "server/activeobjectmessagebatch.h"
+#include "util/serialize.h"
+
+class TestActiveObjectMessageBatch : public TestBase
+{
+public:
+	TestActiveObjectMessageBatch() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveObjectMessageBatch"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBuild();
+	void testSkipPosition();
+	void testReuse();
+};
+
+static TestActiveObjectMessageBatch g_test_instance;
+
+void TestActiveObjectMessageBatch::runTests(IGameDef *gamedef)
+{
+	TEST(testBuild);
+	TEST(testSkipPosition);
+	TEST(testReuse);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static std::string serialize_message(u16 id, const std::string &data)
+{
+	char buf[2];
+	writeU16((u8 *)buf, id);
+	return std::string(buf, 2) + serializeString16(data);
+}
+
+static std::string position_cmd(char c)
+{
+	return std::string(1, AO_CMD_UPDATE_POSITION) + c;
+}
+
+static std::string other_cmd(char c)
+{
+	return std::string(1, AO_CMD_SET_ANIMATION) + c;
+}
+
+void TestActiveObjectMessageBatch::testBuild()
+{
+	std::vector<ActiveObjectMessage> messages;
+	messages.emplace_back(7, true, other_cmd('a'));
+	messages.emplace_back(3, false, position_cmd('b'));
+	messages.emplace_back(7, false, position_cmd('c'));
+	messages.emplace_back(7, true, other_cmd('d'));
+	messages.emplace_back(3, true, "");
+
+	ActiveObjectMessageBatch batch;
+	batch.build(messages);
+
+	UASSERTEQ(u32, batch.getMessageCounts()[0], 3);
+	UASSERTEQ(u32, batch.getMessageCounts()[1], 2);
+
+	auto &objects = batch.getObjects();
+	UASSERTEQ(size_t, objects.size(), 2);
+	UASSERTEQ(u16, objects[0].id, 3);
+	UASSERTEQ(u16, objects[1].id, 7);
+	UASSERT(objects[0].has_position);
+
+	std::string reliable, unreliable;
+	for (const auto &obj : objects)
+		batch.append(obj, false, reliable, unreliable);
+
+	UASSERT(reliable == serialize_message(3, "") +
+		serialize_message(7, other_cmd('a')) +
+		serialize_message(7, other_cmd('d')));
+	UASSERT(unreliable == serialize_message(3, position_cmd('b')) +
+		serialize_message(7, position_cmd('c')));
+}
+
+void TestActiveObjectMessageBatch::testSkipPosition()
+{
+	std::vector<ActiveObjectMessage> messages;
+	messages.emplace_back(1, true, other_cmd('a'));
+	messages.emplace_back(1, true, position_cmd('b'));
+	messages.emplace_back(1, true, other_cmd('c'));
+
+	ActiveObjectMessageBatch batch;
+	batch.build(messages);
+	const auto &obj = batch.getObjects().at(0);
+
+	std::string reliable, unreliable;
+	batch.append(obj, false, reliable, unreliable);
+	UASSERT(reliable == serialize_message(1, other_cmd('a')) +
+		serialize_message(1, position_cmd('b')) +
+		serialize_message(1, other_cmd('c')));
+
+	reliable.clear();
+	batch.append(obj, true, reliable, unreliable);
+	UASSERT(reliable == serialize_message(1, other_cmd('a')) +
+		serialize_message(1, other_cmd('c')));
+	UASSERT(unreliable.empty());
+}
+
+void TestActiveObjectMessageBatch::testReuse()
+{
+	ActiveObjectMessageBatch batch;
+	std::vector<ActiveObjectMessage> messages;
+	messages.emplace_back(1, false, position_cmd('a'));
+	batch.build(messages);
+
+	messages.clear();
+	messages.emplace_back(2, true, other_cmd('b'));
+	batch.build(messages);
+
+	auto &objects = batch.getObjects();
+	UASSERTEQ(size_t, objects.size(), 1);
+	UASSERT(!objects[0].has_position);
+	UASSERTEQ(u32, batch.getMessageCounts()[1], 0);
+
+	std::string reliable, unreliable;
+	batch.append(objects[0], false, reliable, unreliable);
+	UASSERT(reliable == serialize_message(2, other_cmd('b')));
+
+	batch.clear();
+	UASSERT(batch.getObjects().empty());
+}
@@ -27,7 +27,8 @@ class TestConnection : public TestBase {
 
 	void testNetworkPacketSerialize();
 	void testHelpers();
-	void testConnectSendReceive();
+	void testPacketBuffer();
+	void testConnectSendReceive(u32 server_workers);
 };
 
 static TestConnection g_test_instance;
@@ -36,7 +37,10 @@ void TestConnection::runTests(IGameDef *gamedef)
 {
 	TEST(testNetworkPacketSerialize);
 	TEST(testHelpers);
-	TEST(testConnectSendReceive);
+	TEST(testPacketBuffer);
+	TEST(testConnectSendReceive, 1);
+	// peers are spread over several threads
+	TEST(testConnectSendReceive, 3);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -105,7 +109,7 @@ void TestConnection::testHelpers()
 	u32 proto_id = 0x12345678;
 	session_t peer_id = 123;
 	u8 channel = 2;
-	SharedBuffer<u8> data1(1);
+	PacketBuffer data1(1);
 	data1[0] = 100;
 	Address a(127,0,0,1, 10);
 	const u16 seqnum = 34352;
@@ -128,7 +132,7 @@ void TestConnection::testHelpers()
 
 	//infostream<<"initial data1[0]="<<((u32)data1[0]&0xff)<<std::endl;
 
-	SharedBuffer<u8> p2 = con::makeReliablePacket(data1, seqnum);
+	PacketBuffer p2 = con::makeReliablePacket(data1, seqnum);
 
 	/*infostream<<"p2.getSize()="<<p2.getSize()<<", data1.getSize()="
 			<<data1.getSize()<<std::endl;
@@ -136,14 +140,51 @@ void TestConnection::testHelpers()
 			<<" p2[3]="<<((u32)p2[3]&0xff)<<std::endl;
 	infostream<<"data1[0]="<<((u32)data1[0]&0xff)<<std::endl;*/
 
-	UASSERT(p2.getSize() == 3 + data1.getSize());
+	UASSERT(p2.size() == 3 + data1.size());
 	UASSERT(readU8(&p2[0]) == con::PACKET_TYPE_RELIABLE);
 	UASSERT(readU16(&p2[1]) == seqnum);
 	UASSERT(readU8(&p2[3]) == data1[0]);
 }
 
+void TestConnection::testPacketBuffer()
+{
+	PacketBuffer a(4);
+	a[0] = 42;
+	PacketBuffer b(a);
+	UASSERT(!a.unique() && b.data() == a.data());
+	b.makeUnique();
+	UASSERT(a.unique() && b.unique() && b.data() != a.data());
+	UASSERT(b[0] == 42);
+
+	NetworkPacket pkt(0x1234, 0);
+	pkt << (u32)0xdeadbeef;
+	const u8 *payload = reinterpret_cast<const u8 *>(pkt.getString(0));
+
+	// The command is put in front of the data without copying it
+	PacketBuffer forged = pkt.forgePacket();
+	UASSERTEQ(u32, forged.size(), 6);
+	UASSERT(forged.data() + 2 == payload);
+	UASSERTEQ(u16, readU16(&forged[0]), 0x1234);
+	UASSERTEQ(u32, readU32(&forged[2]), 0xdeadbeef);
+
+	// Only one packet can use the room in front
+	PacketBuffer forged2 = pkt.forgePacket();
+	UASSERT(forged2.data() + 2 != payload);
+	UASSERT(memcmp(forged2.data(), forged.data(), forged.size()) == 0);
+
+	// The headers of the connection are added in place too
+	PacketBuffer reliable = con::makeReliablePacket(forged, 1);
+	UASSERT(reliable.data() + 3 == forged.data());
+
+	// Writing to the packet does not change what is being sent
+	pkt << (u8)1;
+	UASSERTEQ(u32, pkt.getSize(), 5);
+	UASSERT(reinterpret_cast<const u8 *>(pkt.getString(0)) != payload);
+	UASSERTEQ(u32, forged.size(), 6);
+	UASSERTEQ(u32, readU32(&forged[2]), 0xdeadbeef);
+}
 
-void TestConnection::testConnectSendReceive()
+void TestConnection::testConnectSendReceive(u32 server_workers)
 {
 
 	constexpr u32 timeout_ms = 100;
@@ -174,7 +215,7 @@ void TestConnection::testConnectSendReceive()
 	}
 
 	infostream << "** Creating server Connection" << std::endl;
-	con::Connection server(512, 5.0f, false, &hand_server);
+	con::Connection server(512, 5.0f, false, &hand_server, server_workers);
 	server.Serve(address);
 
 	infostream << "** Creating client Connection" << std::endl;
@@ -3,6 +3,7 @@
 
 #include "test.h"
 
+#include <algorithm>
 #include <sstream>
 #include "gamedef.h"
 #include "nodedef.h"
@@ -33,6 +34,8 @@ class TestMapBlock : public TestBase
 
 	// Tests loading a non-standard MapBlock
 	void testLoadNonStd(IGameDef *gamedef);
+
+	void testContentCache(IGameDef *gamedef);
 };
 
 static TestMapBlock g_test_instance;
@@ -45,6 +48,7 @@ void TestMapBlock::runTests(IGameDef *gamedef)
 	TEST(testLoad29, gamedef);
 	TEST(testLoad20, gamedef);
 	TEST(testLoadNonStd, gamedef);
+	TEST(testContentCache, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -356,3 +360,37 @@ void TestMapBlock::testLoadNonStd(IGameDef *gamedef)
 	for (s16 i = 0; i < 16; i++)
 		UASSERTEQ(int, block.getNodeNoEx({i, 1, 0}).param2, data_lo[i]);
 }
+
+void TestMapBlock::testContentCache(IGameDef *gamedef)
+{
+	MapBlock block({}, gamedef);
+	for (size_t i = 0; i < MapBlock::nodecount; i++)
+		block.getData()[i] = MapNode(CONTENT_AIR);
+	block.expireContentCache();
+
+	UASSERT(block.getContents() == std::vector<content_t>{CONTENT_AIR});
+
+	// incremental updates
+	block.setNode({1, 2, 3}, MapNode(t_CONTENT_STONE));
+	block.setNode({4, 5, 6}, MapNode(t_CONTENT_STONE));
+	block.setNode({7, 8, 9}, MapNode(CONTENT_IGNORE));
+	std::vector<content_t> expected{CONTENT_AIR, t_CONTENT_STONE, CONTENT_IGNORE};
+	std::sort(expected.begin(), expected.end());
+	UASSERT(block.getContents() == expected);
+
+	block.setNode({1, 2, 3}, MapNode(CONTENT_AIR));
+	UASSERT(block.containsContent(t_CONTENT_STONE));
+	block.setNode({4, 5, 6}, MapNode(CONTENT_AIR));
+	UASSERT(!block.containsContent(t_CONTENT_STONE));
+	UASSERT(block.containsContent(CONTENT_IGNORE));
+
+	// bulk changes
+	block.getData()[0] = MapNode(t_CONTENT_WATER);
+	block.raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_VMANIP);
+	UASSERT(block.containsContent(t_CONTENT_WATER));
+
+	// the result must not depend on how we got there
+	std::vector<content_t> contents = block.getContents();
+	block.expireContentCache();
+	UASSERT(block.getContents() == contents);
+}
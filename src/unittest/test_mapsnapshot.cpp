@@ -0,0 +1,153 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "test.h"
+
+#include "mapsnapshot.h"
+
+class TestMapSnapshot : public TestBase
+{
+public:
+	TestMapSnapshot() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapSnapshot"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testGetNode();
+	void testCopyOnWrite();
+	void testRemove();
+	void testForEachNodeInArea();
+};
+
+static TestMapSnapshot g_test_instance;
+
+void TestMapSnapshot::runTests(IGameDef *gamedef)
+{
+	TEST(testGetNode);
+	TEST(testCopyOnWrite);
+	TEST(testRemove);
+	TEST(testForEachNodeInArea);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static MapSnapshot::BlockData make_block(content_t c)
+{
+	MapSnapshot::BlockData data;
+	data.fill(MapNode(c));
+	return data;
+}
+
+void TestMapSnapshot::testGetNode()
+{
+	auto data = make_block(CONTENT_AIR);
+	// (1, 2, 3) in block (0, -1, 0)
+	data[3 * 256 + 2 * 16 + 1] = MapNode(t_CONTENT_STONE, 0, 7);
+
+	MapSnapshotBuilder builder(nullptr);
+	builder.setBlock({0, -1, 0}, data.data());
+	auto snapshot = builder.finish();
+
+	UASSERTEQ(u64, snapshot->getEpoch(), 1);
+	UASSERTEQ(size_t, snapshot->getBlockCount(), 1);
+
+	bool valid;
+	MapNode n = snapshot->getNode({1, -14, 3}, &valid);
+	UASSERT(valid);
+	UASSERTEQ(content_t, n.getContent(), t_CONTENT_STONE);
+	UASSERTEQ(u8, n.getParam2(), 7);
+	UASSERTEQ(content_t, snapshot->getNode({0, -1, 0}).getContent(), CONTENT_AIR);
+
+	n = snapshot->getNode({0, 0, 0}, &valid);
+	UASSERT(!valid);
+	UASSERTEQ(content_t, n.getContent(), CONTENT_IGNORE);
+	UASSERT(!snapshot->getBlock({-1, -1, 0}));
+}
+
+void TestMapSnapshot::testCopyOnWrite()
+{
+	auto air = make_block(CONTENT_AIR);
+	auto stone = make_block(t_CONTENT_STONE);
+
+	MapSnapshotBuilder builder(nullptr);
+	builder.setBlock({0, 0, 0}, air.data());
+	builder.setBlock({1, 0, 0}, air.data());
+	builder.setBlock({100, 0, 0}, air.data());
+	auto first = builder.finish();
+
+	MapSnapshotBuilder builder2(first.get());
+	UASSERT(!builder2.changed());
+	builder2.setBlock({1, 0, 0}, stone.data());
+	builder2.setBlock({2, 0, 0}, stone.data());
+	UASSERT(builder2.changed());
+	auto second = builder2.finish();
+
+	// the old snapshot is unchanged
+	UASSERTEQ(size_t, first->getBlockCount(), 3);
+	UASSERTEQ(content_t, first->getNode({16, 0, 0}).getContent(), CONTENT_AIR);
+	UASSERT(!first->getBlock({2, 0, 0}));
+
+	UASSERTEQ(u64, second->getEpoch(), first->getEpoch() + 1);
+	UASSERTEQ(size_t, second->getBlockCount(), 4);
+	UASSERTEQ(content_t, second->getNode({16, 0, 0}).getContent(), t_CONTENT_STONE);
+	UASSERTEQ(content_t, second->getNode({32, 0, 0}).getContent(), t_CONTENT_STONE);
+
+	// unchanged blocks are shared
+	UASSERT(first->getBlock({0, 0, 0}) == second->getBlock({0, 0, 0}));
+	UASSERT(first->getBlock({100, 0, 0}) == second->getBlock({100, 0, 0}));
+	UASSERT(first->getBlock({1, 0, 0}) != second->getBlock({1, 0, 0}));
+}
+
+void TestMapSnapshot::testRemove()
+{
+	auto air = make_block(CONTENT_AIR);
+
+	MapSnapshotBuilder builder(nullptr);
+	builder.setBlock({0, 0, 0}, air.data());
+	builder.setBlock({1, 0, 0}, air.data());
+	auto first = builder.finish();
+
+	MapSnapshotBuilder builder2(first.get());
+	// not contained
+	builder2.removeBlock({5, 5, 5});
+	UASSERT(!builder2.changed());
+	builder2.removeBlock({0, 0, 0});
+	builder2.removeBlock({1, 0, 0});
+	UASSERT(builder2.changed());
+	auto second = builder2.finish();
+
+	UASSERTEQ(size_t, first->getBlockCount(), 2);
+	UASSERTEQ(size_t, second->getBlockCount(), 0);
+	UASSERT(first->getBlock({0, 0, 0}));
+	UASSERT(!second->getBlock({0, 0, 0}));
+	UASSERTEQ(content_t, second->getNode({0, 0, 0}).getContent(), CONTENT_IGNORE);
+}
+
+void TestMapSnapshot::testForEachNodeInArea()
+{
+	auto data = make_block(CONTENT_AIR);
+	data[0] = MapNode(t_CONTENT_STONE);
+
+	MapSnapshotBuilder builder(nullptr);
+	builder.setBlock({0, 0, 0}, data.data());
+	builder.setBlock({1, 0, 0}, data.data());
+	auto snapshot = builder.finish();
+
+	// includes an unloaded block at x = -1
+	u32 count = 0, stone = 0, ignore = 0;
+	snapshot->forEachNodeInArea({-2, 0, 0}, {17, 1, 1}, [&] (v3s16 p, MapNode n) {
+		count++;
+		if (n.getContent() == t_CONTENT_STONE) {
+			UASSERT(p == v3s16(0, 0, 0) || p == v3s16(16, 0, 0));
+			stone++;
+		} else if (n.getContent() == CONTENT_IGNORE) {
+			UASSERT(p.X < 0);
+			ignore++;
+		}
+		return true;
+	});
+	UASSERTEQ(u32, count, 20 * 2 * 2);
+	UASSERTEQ(u32, stone, 2);
+	UASSERTEQ(u32, ignore, 2 * 2 * 2);
+}
@@ -5,6 +5,8 @@
 #include "test.h"
 
 #include <cmath>
+#include <cstring>
+#include <vector>
 #include "exceptions.h"
 #include "noise.h"
 
@@ -26,6 +28,8 @@ class TestNoise : public TestBase {
 	void testNoise3dPoint();
 	void testNoise3dBulk();
 	void testNoiseInvalidParams();
+	void testNoiseMapReference();
+	void testNoiseMapSimd();
 
 	static const float expected_2d_results[10 * 10];
 	static const float expected_3d_results[10 * 10 * 10];
@@ -46,6 +50,8 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
 	TEST(testNoiseInvalidParams);
+	TEST(testNoiseMapReference);
+	TEST(testNoiseMapSimd);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -160,6 +166,152 @@ void TestNoise::testNoiseInvalidParams()
 	UASSERT(exception_thrown);
 }
 
+/*
+	Straightforward per-point version of Noise::noiseMap2D/3D() as it
+	used to be implemented. The optimized versions must match it exactly.
+*/
+static float ref_lerp(float v0, float v1, float t)
+{
+	return v0 + (v1 - v0) * t;
+}
+
+static std::vector<float> reference_noise_map(const NoiseParams &np, s32 seed,
+	u32 sx, u32 sy, u32 sz, float x, float y, float z)
+{
+	const bool is3d = sz > 1;
+	const bool eased = np.flags & (is3d ? NOISE_FLAG_EASED :
+		(NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED));
+	auto ease = [&] (float t) { return eased ? easeCurve(t) : t; };
+
+	std::vector<float> result(sx * sy * sz, 0.0f);
+	float f = 1.0, g = 1.0;
+	x /= np.spread.X;
+	y /= np.spread.Y;
+	z /= np.spread.Z;
+
+	for (size_t oct = 0; oct < np.octaves; oct++) {
+		const s32 oseed = seed + np.seed + oct;
+		const float ox = x * f, oy = y * f, oz = z * f;
+		const float step_x = f / np.spread.X, step_y = f / np.spread.Y,
+			step_z = f / np.spread.Z;
+		const s32 x0 = std::floor(ox), y0 = std::floor(oy), z0 = std::floor(oz);
+
+		auto lattice = [&] (u32 i, u32 j, u32 k) {
+			return is3d ? noise3d(x0 + i, y0 + j, z0 + k, oseed) :
+				noise2d(x0 + i, y0 + j, oseed);
+		};
+
+		u32 index = 0, nz = 0;
+		float w = oz - (float)z0;
+		for (u32 k = 0; k != sz; k++) {
+			u32 ny = 0;
+			float v = oy - (float)y0;
+			for (u32 j = 0; j != sy; j++) {
+				u32 nx = 0;
+				float u = ox - (float)x0;
+				for (u32 i = 0; i != sx; i++) {
+					float a = ref_lerp(ref_lerp(lattice(nx, ny, nz), lattice(nx + 1, ny, nz), ease(u)),
+						ref_lerp(lattice(nx, ny + 1, nz), lattice(nx + 1, ny + 1, nz), ease(u)),
+						ease(v));
+					if (is3d) {
+						float b = ref_lerp(ref_lerp(lattice(nx, ny, nz + 1), lattice(nx + 1, ny, nz + 1), ease(u)),
+							ref_lerp(lattice(nx, ny + 1, nz + 1), lattice(nx + 1, ny + 1, nz + 1), ease(u)),
+							ease(v));
+						a = ref_lerp(a, b, ease(w));
+					}
+					if (np.flags & NOISE_FLAG_ABSVALUE)
+						a = std::fabs(a);
+					result[index++] += g * a;
+
+					u += step_x;
+					if (u >= 1.0) {
+						u -= 1.0;
+						nx++;
+					}
+				}
+				v += step_y;
+				if (v >= 1.0) {
+					v -= 1.0;
+					ny++;
+				}
+			}
+			w += step_z;
+			if (w >= 1.0) {
+				w -= 1.0;
+				nz++;
+			}
+		}
+
+		f *= np.lacunarity;
+		g *= np.persist;
+	}
+
+	if (std::fabs(np.offset - 0.f) > 0.00001 || std::fabs(np.scale - 1.f) > 0.00001) {
+		for (float &r : result)
+			r = r * np.scale + np.offset;
+	}
+	return result;
+}
+
+static const NoiseParams test_noise_params[] = {
+	NoiseParams(20, 40, v3f(50, 50, 50), 9, 5, 0.6, 2.0),
+	NoiseParams(0, 1, v3f(250, 100, 250), 5902, 4, 0.5, 2.0, NOISE_FLAG_EASED),
+	NoiseParams(-3, 2, v3f(30, 17, 45), 42, 3, 0.7, 2.3, NOISE_FLAG_ABSVALUE),
+	NoiseParams(0, 1, v3f(8, 8, 8), 77, 3, 0.5, 2.0, NOISE_FLAG_DEFAULTS),
+};
+
+void TestNoise::testNoiseMapReference()
+{
+	for (const NoiseParams &np : test_noise_params) {
+		Noise noise2d(&np, 1337, 37, 21);
+		float *actual = noise2d.noiseMap2D(-123.4f, 4567.8f);
+		std::vector<float> expected = reference_noise_map(np, 1337, 37, 21, 1,
+			-123.4f, 4567.8f, 0);
+		UASSERT(std::memcmp(actual, expected.data(), expected.size() * sizeof(float)) == 0);
+
+		Noise noise3d(&np, 1337, 19, 23, 17);
+		actual = noise3d.noiseMap3D(-80.f, 31.5f, -1000.25f);
+		expected = reference_noise_map(np, 1337, 19, 23, 17,
+			-80.f, 31.5f, -1000.25f);
+		UASSERT(std::memcmp(actual, expected.data(), expected.size() * sizeof(float)) == 0);
+	}
+}
+
+void TestNoise::testNoiseMapSimd()
+{
+	const NoiseSimdLevel supported = getSupportedNoiseSimdLevel();
+	const NoiseSimdLevel prev = getNoiseSimdLevel();
+
+	for (const NoiseParams &np : test_noise_params) {
+		std::vector<float> pmap(80 * 80 * 80);
+		for (size_t i = 0; i < pmap.size(); i++)
+			pmap[i] = 0.3f + (i % 7) * 0.1f;
+
+		std::vector<float> expected2d, expected3d;
+		for (int level = NOISE_SIMD_NONE; level <= supported; level++) {
+			UASSERT(setNoiseSimdLevel((NoiseSimdLevel)level));
+
+			Noise noise2d(&np, 42, 80, 80);
+			noise2d.noiseMap2D(1000.5f, -70.f, pmap.data());
+			std::vector<float> result2d(noise2d.result, noise2d.result + 80 * 80);
+
+			Noise noise3d(&np, 42, 80, 80, 80);
+			noise3d.noiseMap3D(-3.f, 100.f, 7.75f, pmap.data());
+			std::vector<float> result3d(noise3d.result, noise3d.result + 80 * 80 * 80);
+
+			if (level == NOISE_SIMD_NONE) {
+				expected2d = std::move(result2d);
+				expected3d = std::move(result3d);
+			} else {
+				UASSERT(result2d == expected2d);
+				UASSERT(result3d == expected3d);
+			}
+		}
+	}
+
+	setNoiseSimdLevel(prev);
+}
+
 const float TestNoise::expected_2d_results[10 * 10] = {
 	19.11726, 18.49626, 16.48476, 15.02135, 14.75713, 16.26008, 17.54822,
 	18.06860, 18.57016, 18.48407, 18.49649, 17.89160, 15.94162, 14.54901,
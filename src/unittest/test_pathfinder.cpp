@@ -0,0 +1,120 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "test.h"
+
+#include "dummymap.h"
+#include "gamedef.h"
+#include "mapblock.h"
+#include "mapsnapshot.h"
+#include "pathfinder.h"
+
+class TestPathfinder : public TestBase
+{
+public:
+	TestPathfinder() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestPathfinder"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testPath(IGameDef *gamedef);
+	void testSnapshot(IGameDef *gamedef);
+};
+
+static TestPathfinder g_test_instance;
+
+void TestPathfinder::runTests(IGameDef *gamedef)
+{
+	TEST(testPath, gamedef);
+	TEST(testSnapshot, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const v3s16 bpmin(0, 0, 0), bpmax(1, 0, 1);
+
+// Stone floor with a wall at x = 10 that has to be walked around
+static void make_map(DummyMap &map)
+{
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	for (s16 z = 0; z < 32; z++)
+	for (s16 x = 0; x < 32; x++)
+		map.setNode({x, 0, z}, MapNode(t_CONTENT_STONE));
+	for (s16 z = 0; z <= 20; z++)
+	for (s16 y = 1; y <= 3; y++)
+		map.setNode({10, y, z}, MapNode(t_CONTENT_STONE));
+}
+
+static std::shared_ptr<const MapSnapshot> make_snapshot(Map &map,
+		const MapSnapshot *base)
+{
+	MapSnapshotBuilder builder(base);
+	for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+	for (s16 x = bpmin.X; x <= bpmax.X; x++) {
+		MapBlock *block = map.getBlockNoCreateNoEx({x, 0, z});
+		if (base && !block->isSnapshotOutdated())
+			continue;
+		builder.setBlock(block->getPos(), block->getData());
+		block->setSnapshotOutdated(false);
+	}
+	return builder.finish();
+}
+
+static void check_path(const std::vector<v3s16> &path, v3s16 from, v3s16 to)
+{
+	UASSERT(!path.empty());
+	UASSERT(path.front() == from);
+	UASSERT(path.back() == to);
+	for (size_t i = 1; i < path.size(); i++) {
+		v3s16 d = path[i] - path[i - 1];
+		UASSERTEQ(int, std::abs(d.X) + std::abs(d.Z), 1);
+	}
+}
+
+void TestPathfinder::testPath(IGameDef *gamedef)
+{
+	DummyMap map(gamedef, bpmin, bpmax);
+	make_map(map);
+	const NodeDefManager *ndef = gamedef->ndef();
+
+	const v3s16 from(2, 1, 5), to(20, 1, 5);
+	for (PathAlgorithm algo : {PA_PLAIN_NP, PA_PLAIN, PA_DIJKSTRA}) {
+		auto path = get_path(&map, ndef, from, to, 20, 1, 1, algo);
+		check_path(path, from, to);
+		// around the wall
+		UASSERT(path.size() >= 19 + 2 * 16);
+	}
+
+	// the wall is too high to jump over and outside of the search area
+	UASSERT(get_path(&map, ndef, from, to, 5, 1, 1, PA_PLAIN).empty());
+	// the start is buried
+	UASSERT(get_path(&map, ndef, {2, 0, 5}, to, 20, 1, 1, PA_PLAIN).empty());
+}
+
+void TestPathfinder::testSnapshot(IGameDef *gamedef)
+{
+	DummyMap map(gamedef, bpmin, bpmax);
+	make_map(map);
+	const NodeDefManager *ndef = gamedef->ndef();
+
+	const v3s16 from(2, 1, 5), to(20, 1, 5);
+	auto first = make_snapshot(map, nullptr);
+	auto path = get_path(first.get(), ndef, from, to, 20, 1, 1, PA_PLAIN);
+	check_path(path, from, to);
+	UASSERT(path == get_path(&map, ndef, from, to, 20, 1, 1, PA_PLAIN));
+
+	// cut a door into the wall
+	for (s16 y = 1; y <= 3; y++)
+		map.setNode({10, y, 5}, MapNode(CONTENT_AIR));
+	auto second = make_snapshot(map, first.get());
+
+	// the cached node types of the old block must not be used
+	auto path2 = get_path(second.get(), ndef, from, to, 20, 1, 1, PA_PLAIN);
+	check_path(path2, from, to);
+	UASSERTEQ(size_t, path2.size(), 19);
+	UASSERT(path2 == get_path(&map, ndef, from, to, 20, 1, 1, PA_PLAIN));
+
+	// the old snapshot still has the wall
+	UASSERT(path == get_path(first.get(), ndef, from, to, 20, 1, 1, PA_PLAIN));
+}
@@ -5,6 +5,8 @@
 #include "test.h"
 
 #include "profiler.h"
+#include <sstream>
+#include <thread>
 
 class TestProfiler : public TestBase
 {
@@ -15,6 +17,9 @@ class TestProfiler : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testProfilerAverage();
+	void testProfilerTypes();
+	void testProfilerClearRemove();
+	void testProfilerThreads();
 };
 
 static TestProfiler g_test_instance;
@@ -22,6 +27,9 @@ static TestProfiler g_test_instance;
 void TestProfiler::runTests(IGameDef *gamedef)
 {
 	TEST(testProfilerAverage);
+	TEST(testProfilerTypes);
+	TEST(testProfilerClearRemove);
+	TEST(testProfilerThreads);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -56,3 +64,87 @@ void TestProfiler::testProfilerAverage()
 
 	UASSERT(p.getValue("Test2") == 123.57f);
 }
+
+void TestProfiler::testProfilerTypes()
+{
+	Profiler p;
+
+	const ProfilerId id = Profiler::getId("TestTypes add");
+	UASSERTEQ(ProfilerId, Profiler::getId("TestTypes add"), id);
+	UASSERTEQ(std::string, Profiler::getName(id), "TestTypes add");
+
+	p.add(id, 2.f);
+	p.add("TestTypes add", 3.f);
+	UASSERTEQ(float, p.getValue("TestTypes add"), 5.f);
+	UASSERTEQ(int, p.getAvgCount("TestTypes add"), 1);
+
+	p.max("TestTypes max", 2.f);
+	p.max("TestTypes max", 7.f);
+	p.max("TestTypes max", 3.f);
+	UASSERTEQ(float, p.getValue("TestTypes max"), 7.f);
+
+	// Other profilers are separate
+	Profiler p2;
+	UASSERTEQ(float, p2.getValue("TestTypes add"), 0.f);
+}
+
+void TestProfiler::testProfilerClearRemove()
+{
+	Profiler p;
+
+	p.avg("TestClear avg", 4.f);
+	p.add("TestClear add", 4.f);
+	p.clear();
+
+	// Still listed, but without a value
+	Profiler::GraphValues values;
+	p.getPage(values, 1, 1);
+	UASSERTEQ(size_t, values.size(), 2);
+	UASSERTEQ(float, values["TestClear avg"], 0.f);
+	UASSERTEQ(float, values["TestClear add"], 0.f);
+
+	p.avg("TestClear avg", 2.f);
+	p.add("TestClear add", 1.f);
+	UASSERTEQ(float, p.getValue("TestClear avg"), 2.f);
+	UASSERTEQ(int, p.getAvgCount("TestClear avg"), 1);
+	UASSERTEQ(float, p.getValue("TestClear add"), 1.f);
+
+	p.remove("TestClear add");
+	values.clear();
+	p.getPage(values, 1, 1);
+	UASSERTEQ(size_t, values.size(), 1);
+	UASSERT(values.count("TestClear avg") == 1);
+
+	// Appears again once written
+	p.add("TestClear add", 1.f);
+	values.clear();
+	p.getPage(values, 1, 1);
+	UASSERTEQ(size_t, values.size(), 2);
+
+	std::ostringstream os;
+	UASSERTEQ(int, p.print(os), 2);
+}
+
+void TestProfiler::testProfilerThreads()
+{
+	Profiler p;
+	const ProfilerId add_id = Profiler::getId("TestThreads add");
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&p, add_id, t] () {
+			for (int i = 0; i < 1000; i++) {
+				p.add(add_id, 1.f);
+				p.avg("TestThreads avg", t);
+				p.max("TestThreads max", t * 1000 + i);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+
+	UASSERTEQ(float, p.getValue("TestThreads add"), 4000.f);
+	UASSERTEQ(int, p.getAvgCount("TestThreads avg"), 4000);
+	UASSERTEQ(float, p.getValue("TestThreads avg"), 1.5f);
+	UASSERTEQ(float, p.getValue("TestThreads max"), 3999.f);
+}
@@ -0,0 +1,209 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "test.h"
+
+#include <cstring>
+#include <sstream>
+#include "gamedef.h"
+#include "mapblock.h"
+#include "mapblock_diff.h"
+#include "serialization.h"
+#include "server/sentblockhistory.h"
+
+class TestSentBlockHistory : public TestBase
+{
+public:
+	TestSentBlockHistory() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestSentBlockHistory"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testRemember(IGameDef *gamedef);
+	void testDiff(IGameDef *gamedef);
+	void testExtraNodes(IGameDef *gamedef);
+	void testEviction(IGameDef *gamedef);
+};
+
+static TestSentBlockHistory g_test_instance;
+
+void TestSentBlockHistory::runTests(IGameDef *gamedef)
+{
+	TEST(testRemember, gamedef);
+	TEST(testDiff, gamedef);
+	TEST(testExtraNodes, gamedef);
+	TEST(testEviction, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static void fill_block(MapBlock &block)
+{
+	for (size_t i = 0; i < MapBlock::nodecount; ++i)
+		block.getData()[i] = MapNode(i % 3 ? CONTENT_AIR : t_CONTENT_STONE);
+}
+
+static std::string serialize_metadata(MapBlock &block)
+{
+	std::ostringstream os(std::ios_base::binary);
+	block.m_node_metadata.serialize(os, SER_FMT_VER_HIGHEST_WRITE, false);
+	return os.str();
+}
+
+// Sends the diff over the "network" and applies it to the client's block
+static void apply_diff(const MapBlockDiff &diff, MapBlock &block, IGameDef *gamedef)
+{
+	std::ostringstream os(std::ios_base::binary);
+	diff.serialize(os, SER_FMT_VER_HIGHEST_WRITE, -1);
+	std::istringstream is(os.str(), std::ios_base::binary);
+	MapBlockDiff received;
+	received.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE);
+	received.apply(&block, gamedef->idef());
+}
+
+void TestSentBlockHistory::testRemember(IGameDef *gamedef)
+{
+	SentBlockHistory history(1 << 20, SER_FMT_VER_HIGHEST_WRITE);
+
+	MapBlock block({1, 2, 3}, gamedef);
+	fill_block(block);
+
+	u32 v1 = history.remember(&block);
+	UASSERT(v1 != 0);
+	UASSERTEQ(u32, history.remember(&block), v1);
+
+	// still the same content
+	history.invalidate({block.getPos()});
+	UASSERTEQ(u32, history.remember(&block), v1);
+
+	// the change is only seen after invalidation
+	block.getData()[0] = MapNode(t_CONTENT_GRASS);
+	UASSERTEQ(u32, history.remember(&block), v1);
+	history.invalidate({block.getPos()});
+	u32 v2 = history.remember(&block);
+	UASSERT(v2 != 0 && v2 != v1);
+
+	history.clear();
+	UASSERTEQ(size_t, history.getSize(), 0);
+
+	// disabled history has no versions
+	SentBlockHistory history2(0, SER_FMT_VER_HIGHEST_WRITE);
+	UASSERTEQ(u32, history2.remember(&block), 0);
+}
+
+void TestSentBlockHistory::testDiff(IGameDef *gamedef)
+{
+	SentBlockHistory history(1 << 20, SER_FMT_VER_HIGHEST_WRITE);
+
+	MapBlock block({1, 2, 3}, gamedef);
+	fill_block(block);
+	u32 v1 = history.remember(&block);
+
+	// What the client got
+	MapBlock client_block({1, 2, 3}, gamedef);
+	fill_block(client_block);
+
+	block.getData()[5] = MapNode(t_CONTENT_WATER, 0, 7);
+	block.getData()[4000] = MapNode(t_CONTENT_LAVA);
+	block.setLightingComplete(0x1234);
+	history.invalidate({block.getPos()});
+	history.remember(&block);
+
+	MapBlockDiff diff;
+	UASSERT(history.makeDiff(&block, v1, {}, false, diff));
+	UASSERT(diff.indices == std::vector<u16>({5, 4000}));
+	UASSERT(!diff.metadata);
+
+	apply_diff(diff, client_block, gamedef);
+	UASSERT(std::memcmp(client_block.getData(), block.getData(),
+		MapBlock::nodecount * sizeof(MapNode)) == 0);
+	UASSERTEQ(u16, client_block.getLightingComplete(), 0x1234);
+
+	// metadata is sent as a whole
+	u32 v2 = history.remember(&block);
+	NodeMetadata *meta = new NodeMetadata(gamedef->idef());
+	meta->setString("foo", "bar");
+	block.m_node_metadata.set({1, 1, 1}, meta);
+	history.invalidate({block.getPos()});
+	history.remember(&block);
+
+	UASSERT(history.makeDiff(&block, v2, {}, false, diff));
+	UASSERT(diff.indices.empty());
+	UASSERT(diff.metadata);
+
+	apply_diff(diff, client_block, gamedef);
+	UASSERT(serialize_metadata(client_block) == serialize_metadata(block));
+
+	// unknown version
+	UASSERT(!history.makeDiff(&block, 12345, {}, false, diff));
+}
+
+void TestSentBlockHistory::testExtraNodes(IGameDef *gamedef)
+{
+	SentBlockHistory history(1 << 20, SER_FMT_VER_HIGHEST_WRITE);
+
+	MapBlock block({1, 2, 3}, gamedef);
+	fill_block(block);
+	u32 v1 = history.remember(&block);
+
+	// Changed by TOCLIENT_ADDNODE on the client and back on the server,
+	// so it's the same in both versions
+	MapBlock client_block({1, 2, 3}, gamedef);
+	fill_block(client_block);
+	client_block.getData()[10] = MapNode(t_CONTENT_TORCH);
+
+	block.getData()[20] = MapNode(t_CONTENT_GRASS);
+	history.invalidate({block.getPos()});
+	history.remember(&block);
+
+	MapBlockDiff diff;
+	UASSERT(history.makeDiff(&block, v1, {30, 10, 20}, true, diff));
+	UASSERT(diff.indices == std::vector<u16>({10, 20, 30}));
+	UASSERT(diff.metadata);
+
+	apply_diff(diff, client_block, gamedef);
+	UASSERT(std::memcmp(client_block.getData(), block.getData(),
+		MapBlock::nodecount * sizeof(MapNode)) == 0);
+}
+
+void TestSentBlockHistory::testEviction(IGameDef *gamedef)
+{
+	// Room for a bit more than two versions
+	SentBlockHistory history(2 * MapBlock::nodecount * sizeof(MapNode) + 1000,
+		SER_FMT_VER_HIGHEST_WRITE);
+
+	MapBlock block1({0, 0, 0}, gamedef);
+	MapBlock block2({1, 0, 0}, gamedef);
+	MapBlock block3({2, 0, 0}, gamedef);
+	fill_block(block1);
+	fill_block(block2);
+	fill_block(block3);
+
+	u32 v1 = history.remember(&block1);
+	u32 v2 = history.remember(&block2);
+	// make block1 the most recently used one
+	history.remember(&block1);
+	u32 v3 = history.remember(&block3);
+
+	MapBlockDiff diff;
+	UASSERT(history.makeDiff(&block1, v1, {}, false, diff));
+	UASSERT(!history.makeDiff(&block2, v2, {}, false, diff));
+	UASSERT(history.makeDiff(&block3, v3, {}, false, diff));
+	UASSERT(history.getSize() <= 2 * MapBlock::nodecount * sizeof(MapNode) + 1000);
+
+	// only a few versions of a block are kept
+	SentBlockHistory history2(1 << 20, SER_FMT_VER_HIGHEST_WRITE);
+	u32 first = history2.remember(&block1);
+	u32 second = 0;
+	for (int i = 0; i < 10; i++) {
+		block1.getData()[0] = MapNode(i % 2 ? t_CONTENT_GRASS : t_CONTENT_BRICK);
+		history2.invalidate({block1.getPos()});
+		u32 v = history2.remember(&block1);
+		if (i == 0)
+			second = v;
+		UASSERT(history2.makeDiff(&block1, v, {}, false, diff));
+	}
+	UASSERT(!history2.makeDiff(&block1, first, {}, false, diff));
+	UASSERT(!history2.makeDiff(&block1, second, {}, false, diff));
+}
@@ -0,0 +1,175 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2026 Luanti core developers & community
+
+#include "test.h"
+
+#include <algorithm>
+#include <sstream>
+#include "gamedef.h"
+#include "mapblock.h"
+#include "porting.h"
+#include "serialization.h"
+#include "server/serializedblockcache.h"
+
+class TestSerializedBlockCache : public TestBase
+{
+public:
+	TestSerializedBlockCache() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestSerializedBlockCache"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testPutGet();
+	void testEviction();
+	void testInvalidate();
+	void testPrecompress(IGameDef *gamedef);
+	void testCompressAndSend(IGameDef *gamedef);
+};
+
+static TestSerializedBlockCache g_test_instance;
+
+void TestSerializedBlockCache::runTests(IGameDef *gamedef)
+{
+	TEST(testPutGet);
+	TEST(testEviction);
+	TEST(testInvalidate);
+	TEST(testPrecompress, gamedef);
+	TEST(testCompressAndSend, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static SerializedBlockCache::Data make_data(size_t size)
+{
+	return std::make_shared<std::string>(size, 'x');
+}
+
+static void fill_block(MapBlock &block)
+{
+	for (size_t i = 0; i < MapBlock::nodecount; ++i)
+		block.getData()[i] = MapNode(i % 3 ? CONTENT_AIR : t_CONTENT_STONE);
+}
+
+static std::string serialize_for_net(MapBlock &block)
+{
+	std::ostringstream os(std::ios_base::binary);
+	block.serialize(os, SER_FMT_VER_HIGHEST_WRITE, false, -1);
+	MapBlock::serializeNetworkSpecific(os);
+	return os.str();
+}
+
+void TestSerializedBlockCache::testPutGet()
+{
+	SerializedBlockCache cache(1000, -1);
+
+	UASSERT(!cache.get({1, 2, 3}, 29));
+	cache.put({1, 2, 3}, 29, make_data(10));
+	UASSERT(cache.get({1, 2, 3}, 29));
+	UASSERTEQ(size_t, cache.get({1, 2, 3}, 29)->size(), 10);
+	// other version is separate
+	UASSERT(!cache.get({1, 2, 3}, 28));
+	UASSERTEQ(size_t, cache.getSize(), 10);
+
+	// replacing updates the size
+	cache.put({1, 2, 3}, 29, make_data(20));
+	UASSERTEQ(size_t, cache.getSize(), 20);
+
+	cache.clear();
+	UASSERT(!cache.get({1, 2, 3}, 29));
+	UASSERTEQ(size_t, cache.getSize(), 0);
+
+	// disabled cache never stores anything
+	SerializedBlockCache cache2(0, -1);
+	cache2.put({1, 2, 3}, 29, make_data(10));
+	UASSERT(!cache2.get({1, 2, 3}, 29));
+}
+
+void TestSerializedBlockCache::testEviction()
+{
+	SerializedBlockCache cache(100, -1);
+
+	cache.put({0, 0, 0}, 29, make_data(40));
+	cache.put({1, 0, 0}, 29, make_data(40));
+	// make {0,0,0} the most recently used one
+	UASSERT(cache.get({0, 0, 0}, 29));
+	cache.put({2, 0, 0}, 29, make_data(40));
+
+	UASSERT(cache.get({0, 0, 0}, 29));
+	UASSERT(!cache.get({1, 0, 0}, 29));
+	UASSERT(cache.get({2, 0, 0}, 29));
+	UASSERTEQ(size_t, cache.getSize(), 80);
+}
+
+void TestSerializedBlockCache::testInvalidate()
+{
+	SerializedBlockCache cache(1000, -1);
+
+	cache.put({0, 0, 0}, 28, make_data(10));
+	cache.put({0, 0, 0}, 29, make_data(10));
+	cache.put({0, 1, 0}, 29, make_data(10));
+
+	cache.invalidate({0, 0, 0});
+	UASSERT(!cache.get({0, 0, 0}, 28));
+	UASSERT(!cache.get({0, 0, 0}, 29));
+	UASSERT(cache.get({0, 1, 0}, 29));
+
+	cache.invalidate(std::vector<v3s16>{{0, 1, 0}});
+	UASSERT(!cache.get({0, 1, 0}, 29));
+	UASSERTEQ(size_t, cache.getSize(), 0);
+}
+
+void TestSerializedBlockCache::testPrecompress(IGameDef *gamedef)
+{
+	SerializedBlockCache cache(1 << 20, -1);
+
+	MapBlock block({1, 2, 3}, gamedef);
+	fill_block(block);
+
+	cache.precompress(&block, SER_FMT_VER_HIGHEST_WRITE);
+
+	SerializedBlockCache::Data data;
+	for (int i = 0; i < 500 && !data; i++) {
+		sleep_ms(10);
+		data = cache.get(block.getPos(), SER_FMT_VER_HIGHEST_WRITE);
+	}
+	UASSERT(data);
+	UASSERT(*data == serialize_for_net(block));
+}
+
+void TestSerializedBlockCache::testCompressAndSend(IGameDef *gamedef)
+{
+	SerializedBlockCache cache(1 << 20, -1);
+
+	std::mutex mutex;
+	std::vector<session_t> sent_to;
+	std::string sent_data;
+	cache.setSendCallback([&] (v3s16 pos, const std::vector<session_t> &peers,
+			const SerializedBlockCache::Data &data, bool outdated) {
+		MutexAutoLock lock(mutex);
+		sent_to.insert(sent_to.end(), peers.begin(), peers.end());
+		sent_data = *data;
+	});
+
+	MapBlock block({1, 2, 3}, gamedef);
+	fill_block(block);
+
+	// old format can't be done in the background
+	UASSERT(!cache.compressAndSend(&block, 28, 5));
+
+	UASSERT(cache.compressAndSend(&block, SER_FMT_VER_HIGHEST_WRITE, 5));
+	UASSERT(cache.compressAndSend(&block, SER_FMT_VER_HIGHEST_WRITE, 6));
+
+	for (int i = 0; i < 500; i++) {
+		sleep_ms(10);
+		MutexAutoLock lock(mutex);
+		if (sent_to.size() >= 2)
+			break;
+	}
+
+	MutexAutoLock lock(mutex);
+	std::sort(sent_to.begin(), sent_to.end());
+	UASSERT(sent_to == std::vector<session_t>({5, 6}));
+	UASSERT(sent_data == serialize_for_net(block));
+	UASSERT(cache.get(block.getPos(), SER_FMT_VER_HIGHEST_WRITE));
+}
@@ -22,6 +22,7 @@ class TestSocket : public TestBase {
 
 	void testIPv4Socket();
 	void testIPv6Socket();
+	void testBatching();
 
 	static const int port = 30003;
 };
@@ -31,6 +32,7 @@ static TestSocket g_test_instance;
 void TestSocket::runTests(IGameDef *gamedef)
 {
 	TEST(testIPv4Socket);
+	TEST(testBatching);
 
 	if (g_settings->getBool("enable_ipv6"))
 		TEST(testIPv6Socket);
@@ -132,3 +134,44 @@ void TestSocket::testIPv6Socket()
 				Address(&bytes, 0).getAddress6().s6_addr, 16) == 0);
 	}
 }
+
+void TestSocket::testBatching()
+{
+	UDPSocket socket(false);
+	socket.Bind(Address(0, 0, 0, 0, port + 1));
+	const Address address(127, 0, 0, 1, port + 1);
+
+	// More than fits into one call of the OS function
+	const int count = UDPSocket::BATCH_SIZE + 10;
+	std::vector<std::string> sent(count);
+	std::vector<UDPSocket::OutgoingPacket> packets(count);
+	for (int i = 0; i < count; i++) {
+		sent[i] = "packet " + std::to_string(i);
+		packets[i] = {address, sent[i].data(), (int)sent[i].size()};
+	}
+	// This one is skipped
+	packets[3].destination = Address((IPv6AddressBytes *)nullptr, port + 1);
+	UASSERTEQ(int, socket.SendMany(packets.data(), count), count - 1);
+
+	sleep_ms(50);
+
+	char buffers[16][256];
+	UDPSocket::IncomingPacket received[16];
+	std::vector<std::string> got;
+	socket.setTimeoutMs(100);
+	for (;;) {
+		for (int i = 0; i < 16; i++)
+			received[i] = {Address(), buffers[i], sizeof(buffers[i])};
+		int n = socket.ReceiveMany(received, 16);
+		if (n == 0)
+			break;
+		UASSERT(n <= 16);
+		for (int i = 0; i < n; i++) {
+			UASSERT(received[i].sender == address);
+			got.emplace_back(buffers[i], received[i].size);
+		}
+	}
+
+	sent.erase(sent.begin() + 3);
+	UASSERT(got == sent);
+}
@@ -9,6 +9,7 @@
 #include "util/numeric.h"
 #include "dummymap.h"
 #include "nodedef.h"
+#include "noise.h"
 
 class TestVoxelAlgorithms : public TestBase {
 public:
@@ -19,6 +20,7 @@ class TestVoxelAlgorithms : public TestBase {
 
 	void testVoxelLineIterator();
 	void testLighting(IGameDef *gamedef);
+	void testBulkLightingThreads(IGameDef *gamedef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -27,6 +29,7 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 {
 	TEST(testVoxelLineIterator);
 	TEST(testLighting, gamedef);
+	TEST(testBulkLightingThreads, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -153,3 +156,56 @@ void TestVoxelAlgorithms::testLighting(IGameDef *gamedef)
 		UASSERTEQ(int, n.getParam1(), 153);
 	}
 }
+
+void TestVoxelAlgorithms::testBulkLightingThreads(IGameDef *gamedef)
+{
+	v3s16 bpmin(-4, -2, -4);
+	v3s16 bpmax(3, 0, 3);
+	DummyMap map_serial(gamedef, bpmin, bpmax);
+	DummyMap map_parallel(gamedef, bpmin, bpmax);
+
+	// Random terrain with caves and light sources, then a second
+	// write that digs a hole through part of it.
+	auto write = [&] (Map *map, v3s16 minp, v3s16 maxp, u64 seed) {
+		PcgRandom r(seed);
+		std::map<v3s16, MapBlock*> modified_blocks;
+		MMVManip vm(map);
+		vm.initialEmerge(minp, maxp, false);
+		const VoxelArea &area = vm.m_area;
+		for (s32 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s32 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+		for (s32 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			content_t c = CONTENT_AIR;
+			u32 v = r.range(0, 99);
+			if (y < x / 4 + z / 8 && v < 85)
+				c = t_CONTENT_STONE;
+			else if (v == 0)
+				c = t_CONTENT_TORCH;
+			else if (v == 1)
+				c = t_CONTENT_WATER;
+			vm.m_data[area.index(x, y, z)] = MapNode(c);
+		}
+		voxalgo::blit_back_with_light(map, &vm, &modified_blocks);
+	};
+
+	voxalgo::set_bulk_light_threads(1);
+	write(&map_serial, bpmin, bpmax, 42);
+	write(&map_serial, v3s16(-2, -2, -3), v3s16(1, 0, 2), 43);
+	voxalgo::set_bulk_light_threads(4);
+	write(&map_parallel, bpmin, bpmax, 42);
+	write(&map_parallel, v3s16(-2, -2, -3), v3s16(1, 0, 2), 43);
+	voxalgo::set_bulk_light_threads(0);
+
+	v3s16 bp;
+	for (bp.Z = bpmin.Z; bp.Z <= bpmax.Z; bp.Z++)
+	for (bp.Y = bpmin.Y; bp.Y <= bpmax.Y; bp.Y++)
+	for (bp.X = bpmin.X; bp.X <= bpmax.X; bp.X++) {
+		MapBlock *block_s = map_serial.getBlockNoCreateNoEx(bp);
+		MapBlock *block_p = map_parallel.getBlockNoCreateNoEx(bp);
+		UASSERT(block_s && block_p);
+		UASSERTEQ(u16, block_s->getLightingComplete(),
+			block_p->getLightingComplete());
+		for (size_t i = 0; i < MapBlock::nodecount; i++)
+			UASSERT(block_s->getData()[i] == block_p->getData()[i]);
+	}
+}
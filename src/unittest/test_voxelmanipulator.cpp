@@ -23,6 +23,7 @@ class TestVoxelManipulator : public TestBase {
 	void testEmerge(IGameDef *gamedef);
 	void testBlitBack(IGameDef *gamedef);
 	void testBlitBack2(IGameDef *gamedef);
+	void testPrepared(IGameDef *gamedef);
 };
 
 static TestVoxelManipulator g_test_instance;
@@ -33,6 +34,7 @@ void TestVoxelManipulator::runTests(IGameDef *gamedef)
 	TEST(testEmerge, gamedef);
 	TEST(testBlitBack, gamedef);
 	TEST(testBlitBack2, gamedef);
+	TEST(testPrepared, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -179,3 +181,36 @@ void TestVoxelManipulator::testBlitBack2(IGameDef *gamedef)
 	// The upper one should not!
 	UASSERTEQ(auto, map.getNode({0,bs,0}).getContent(), CONTENT_AIR);
 }
+
+void TestVoxelManipulator::testPrepared(IGameDef *gamedef)
+{
+	constexpr int bs = MAP_BLOCKSIZE;
+
+	// The second block is new, it only contains ignore
+	DummyMap map(gamedef, {0,0,0}, {1,0,0});
+	map.fill({0,0,0}, {0,0,0}, CONTENT_AIR);
+
+	MMVManip vm(&map);
+	vm.preallocate({0,0,0}, {1,0,0});
+	UASSERTEQ(auto, vm.m_area.getExtent(), v3s32(2*bs,bs,bs));
+	vm.initialEmergeBlocks({map.getBlockNoCreateNoEx({0,0,0})});
+	UASSERTEQ(auto, vm.getNodeNoExNoEmerge({0,0,0}).getContent(), CONTENT_AIR);
+	UASSERT(vm.exists({bs,0,0}));
+	UASSERTEQ(auto, vm.getNodeNoExNoEmerge({bs,0,0}).getContent(), CONTENT_IGNORE);
+
+	vm.setNodeNoEmerge({1,1,1}, t_CONTENT_STONE);
+	vm.setNodeNoEmerge({2,2,2}, CONTENT_IGNORE);
+	vm.setNodeNoEmerge({bs,0,0}, t_CONTENT_GRASS);
+
+	vm.prepareBlitBack();
+	std::map<v3s16, MapBlock*> modified;
+	vm.blitBackAll(&modified);
+	UASSERTEQ(size_t, modified.size(), 2);
+
+	UASSERTEQ(auto, map.getNode({1,1,1}).getContent(), t_CONTENT_STONE);
+	UASSERTEQ(auto, map.getNode({0,0,0}).getContent(), CONTENT_AIR);
+	// same as without preparing
+	UASSERTEQ(auto, map.getNode({2,2,2}).getContent(), CONTENT_AIR);
+	UASSERTEQ(auto, map.getNode({bs,0,0}).getContent(), t_CONTENT_GRASS);
+	UASSERTEQ(auto, map.getNode({bs+1,0,0}).getContent(), CONTENT_IGNORE);
+}
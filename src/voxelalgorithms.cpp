@@ -3,11 +3,14 @@
 // Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
 
 #include <array>
+#include <atomic>
+#include <thread>
 
 #include "voxelalgorithms.h"
 #include "nodedef.h"
 #include "mapblock.h"
 #include "map.h"
+#include "threading/thread.h"
 
 namespace voxalgo
 {
@@ -125,6 +128,16 @@ struct LightQueue {
 		assert(light <= LIGHT_SUN);
 		lights[light].emplace_back(rel_pos, block_pos, block, source_dir);
 	}
+
+	//! Moves all elements of the other queue to the end of this one.
+	void append(LightQueue &other)
+	{
+		for (size_t i = 0; i < lights.size(); i++) {
+			lights[i].insert(lights[i].end(), other.lights[i].begin(),
+				other.lights[i].end());
+			other.lights[i].clear();
+		}
+	}
 };
 
 /*!
@@ -327,6 +340,55 @@ void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 	}
 }
 
+/*
+ * Spreads light from a node to one of its neighbors.
+ *
+ * \param bank the light bank in which the procedure operates
+ * \param light_sources the neighbor is added here if it got brighter
+ * \param current the node that spreads light
+ * \param spreading_light the light the node gives to its neighbors
+ * \param dir direction of the neighbor
+ * \param modified_blocks output, all modified map blocks are added to this
+ */
+static inline void spread_light_to_neighbor(Map *map,
+	const NodeDefManager *nodemgr, LightBank bank,
+	LightQueue &light_sources, const ChangingLight &current,
+	u8 spreading_light, direction dir,
+	std::map<v3s16, MapBlock*> &modified_blocks)
+{
+	// Get the neighbor's position and block
+	relative_v3 neighbor_rel_pos = current.rel_position;
+	mapblock_v3 neighbor_block_pos = current.block_position;
+	MapBlock *neighbor_block;
+	if (step_rel_block_pos(dir, neighbor_rel_pos, neighbor_block_pos)) {
+		neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
+		if (neighbor_block == NULL) {
+			current.block->setLightingComplete(bank, dir, false);
+			return;
+		}
+	} else {
+		neighbor_block = current.block;
+	}
+	// Get the neighbor itself
+	MapNode neighbor = neighbor_block->getNodeNoCheck(neighbor_rel_pos);
+	ContentLightingFlags f = nodemgr->getLightingFlags(neighbor);
+	if (f.light_propagates) {
+		// Light up the neighbor, if it has less light than it should.
+		u8 neighbor_light = neighbor.getLightRaw(bank, f);
+		if (neighbor_light < spreading_light) {
+			neighbor.setLight(bank, spreading_light, f);
+			neighbor_block->setNodeNoCheck(neighbor_rel_pos, neighbor);
+			light_sources.push(spreading_light, neighbor_rel_pos,
+				neighbor_block_pos, neighbor_block, dir);
+			// The current node was modified earlier, so its block
+			// is in modified_blocks.
+			if (current.block != neighbor_block) {
+				modified_blocks[neighbor_block_pos] = neighbor_block;
+			}
+		}
+	}
+}
+
 /*
  * Spreads light from the specified starting nodes.
  *
@@ -347,9 +409,6 @@ void spread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 	u8 spreading_light;
 	// The ChangingLight for the current node.
 	ChangingLight current;
-	// Position of the current neighbor.
-	mapblock_v3 neighbor_block_pos;
-	relative_v3 neighbor_rel_pos;
 	while (light_sources.next(spreading_light, current)) {
 		spreading_light--;
 		for (direction i = 0; i < 6; i++) {
@@ -357,37 +416,8 @@ void spread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 			if (current.source_direction + i == 5) {
 				continue;
 			}
-			// Get the neighbor's position and block
-			neighbor_rel_pos = current.rel_position;
-			neighbor_block_pos = current.block_position;
-			MapBlock *neighbor_block;
-			if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
-				neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
-				if (neighbor_block == NULL) {
-					current.block->setLightingComplete(bank, i, false);
-					continue;
-				}
-			} else {
-				neighbor_block = current.block;
-			}
-			// Get the neighbor itself
-			MapNode neighbor = neighbor_block->getNodeNoCheck(neighbor_rel_pos);
-			ContentLightingFlags f = nodemgr->getLightingFlags(neighbor);
-			if (f.light_propagates) {
-				// Light up the neighbor, if it has less light than it should.
-				u8 neighbor_light = neighbor.getLightRaw(bank, f);
-				if (neighbor_light < spreading_light) {
-					neighbor.setLight(bank, spreading_light, f);
-					neighbor_block->setNodeNoCheck(neighbor_rel_pos, neighbor);
-					light_sources.push(spreading_light, neighbor_rel_pos,
-						neighbor_block_pos, neighbor_block, i);
-					// The current node was modified earlier, so its block
-					// is in modified_blocks.
-					if (current.block != neighbor_block) {
-						modified_blocks[neighbor_block_pos] = neighbor_block;
-					}
-				}
-			}
+			spread_light_to_neighbor(map, nodemgr, bank, light_sources,
+				current, spreading_light, i, modified_blocks);
 		}
 	}
 }
@@ -941,6 +971,188 @@ const static VoxelArea block_pad[] = {
 #undef B_1
 #undef B_2
 
+//! Upper limit for the threads of bulk light updates, 0 = automatic.
+static std::atomic<unsigned int> s_bulk_light_threads{0};
+
+/*!
+ * Bulk light updates are only split up if every thread gets at least
+ * this many map blocks. Starting threads isn't worth it for less.
+ */
+constexpr size_t BULK_LIGHT_MIN_BLOCKS_PER_THREAD = 8;
+
+void set_bulk_light_threads(unsigned int count)
+{
+	s_bulk_light_threads = count;
+}
+
+/*!
+ * Returns how many threads (including the calling one)
+ * should work on a bulk light update of the given size.
+ */
+static unsigned int get_bulk_light_threads(size_t block_count)
+{
+	unsigned int threads = s_bulk_light_threads;
+	if (threads == 0)
+		threads = std::min(Thread::getNumberOfProcessors(), 8U);
+	size_t useful = block_count / BULK_LIGHT_MIN_BLOCKS_PER_THREAD;
+	return std::max<size_t>(1, std::min<size_t>(threads, useful));
+}
+
+/*!
+ * Calls fn(i) for each i in [0, count). The calls are distributed over
+ * the given number of threads, the calling thread is one of them.
+ */
+template <typename F>
+static void run_parallel(size_t count, unsigned int threads, const F &fn)
+{
+	if (threads > count)
+		threads = count;
+	if (threads <= 1) {
+		for (size_t i = 0; i < count; i++)
+			fn(i);
+		return;
+	}
+	std::atomic<size_t> next_index{0};
+	auto work = [&] () {
+		size_t i;
+		while ((i = next_index++) < count)
+			fn(i);
+	};
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (unsigned int i = 1; i < threads; i++)
+		workers.emplace_back(work);
+	work();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+//! Light spreading from one node towards a node of another column.
+struct DeferredLight {
+	ChangingLight source;
+	u8 spreading_light;
+	direction dir;
+};
+
+/*!
+ * A vertical column of map blocks of a bulk light update.
+ * Each column is processed by only one thread, nodes outside of it
+ * are neither read nor written meanwhile.
+ */
+struct BlockColumn {
+	//! X and Z block coordinates of the column.
+	v2s16 pos;
+	//! The loaded blocks of the column, bottom first (may be nullptr).
+	std::vector<MapBlock *> blocks;
+	//! Incoming sunlight at the top, see fill_with_sunlight().
+	bool sunlight[MAP_BLOCKSIZE][MAP_BLOCKSIZE];
+	//! First queue is for day light, second is for night light.
+	UnlightQueue unlight[2] = { UnlightQueue(0), UnlightQueue(0) };
+	ReLightQueue relight[2] = { ReLightQueue(0), ReLightQueue(0) };
+	//! Light that must be spread out of the column, per bank.
+	std::vector<DeferredLight> deferred[2];
+	//! Blocks modified by light spreading inside the column.
+	std::vector<MapBlock *> modified;
+};
+
+/*!
+ * Collects the given area's blocks in columns, ordered by X, then Z.
+ */
+static std::vector<BlockColumn> get_block_columns(Map *map,
+	mapblock_v3 minblock, mapblock_v3 maxblock)
+{
+	std::vector<BlockColumn> columns(
+		(maxblock.X - minblock.X + 1) * (maxblock.Z - minblock.Z + 1));
+	size_t i = 0;
+	for (s16 x = minblock.X; x <= maxblock.X; x++)
+	for (s16 z = minblock.Z; z <= maxblock.Z; z++) {
+		BlockColumn &column = columns[i++];
+		column.pos = v2s16(x, z);
+		column.blocks.reserve(maxblock.Y - minblock.Y + 1);
+		for (s16 y = minblock.Y; y <= maxblock.Y; y++)
+			column.blocks.push_back(map->getBlockNoCreateNoEx(v3s16(x, y, z)));
+	}
+	return columns;
+}
+
+/*!
+ * Like spread_light(), but the light doesn't leave the column.
+ * Spreading out of it is recorded in column.deferred instead,
+ * to be done after all columns are finished.
+ *
+ * \param min_y block Y coordinate of the lowest block in the column
+ */
+static void spread_light_in_column(const NodeDefManager *nodemgr,
+	size_t bank_index, BlockColumn &column, s16 min_y)
+{
+	LightBank bank = banks[bank_index];
+	ReLightQueue &light_sources = column.relight[bank_index];
+	u8 spreading_light;
+	ChangingLight current;
+	mapblock_v3 neighbor_block_pos;
+	relative_v3 neighbor_rel_pos;
+	while (light_sources.next(spreading_light, current)) {
+		spreading_light--;
+		for (direction i = 0; i < 6; i++) {
+			// This node can't light up its light source
+			if (current.source_direction + i == 5)
+				continue;
+			neighbor_rel_pos = current.rel_position;
+			neighbor_block_pos = current.block_position;
+			MapBlock *neighbor_block = current.block;
+			if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
+				s32 y = neighbor_block_pos.Y - min_y;
+				// Only steps along Y can stay in the column
+				if (i == 1 || i == 4) {
+					if (y >= 0 && y < (s32)column.blocks.size())
+						neighbor_block = column.blocks[y];
+					else
+						neighbor_block = nullptr;
+				} else {
+					neighbor_block = nullptr;
+				}
+				if (!neighbor_block) {
+					column.deferred[bank_index].push_back(
+						{current, spreading_light, i});
+					continue;
+				}
+			}
+			MapNode neighbor = neighbor_block->getNodeNoCheck(neighbor_rel_pos);
+			ContentLightingFlags f = nodemgr->getLightingFlags(neighbor);
+			if (f.light_propagates) {
+				u8 neighbor_light = neighbor.getLightRaw(bank, f);
+				if (neighbor_light < spreading_light) {
+					neighbor.setLight(bank, spreading_light, f);
+					neighbor_block->setNodeNoCheck(neighbor_rel_pos, neighbor);
+					light_sources.push(spreading_light, neighbor_rel_pos,
+						neighbor_block_pos, neighbor_block, i);
+					if (current.block != neighbor_block)
+						column.modified.push_back(neighbor_block);
+				}
+			}
+		}
+	}
+}
+
+/*!
+ * Sets the light of the nodes in the relight queue to the light
+ * they have in the queue, as spread_light() expects it.
+ *
+ * \param maxlight the brightest level to initialize
+ */
+static void init_relight_queue(const NodeDefManager *ndef, LightBank bank,
+	const ReLightQueue &relight, u8 maxlight)
+{
+	for (u8 i = 0; i <= maxlight; i++) {
+		const auto &lights = relight.lights[i];
+		for (auto it = lights.begin(); it < lights.end(); ++it) {
+			MapNode n = it->block->getNodeNoCheck(it->rel_position);
+			n.setLight(bank, i, ndef->getLightingFlags(n));
+			it->block->setNodeNoCheck(it->rel_position, n);
+		}
+	}
+}
+
 /*!
  * The common part of bulk light updates - it is always executed.
  * The procedure takes the nodes that should be unlit, and the
@@ -949,6 +1161,13 @@ const static VoxelArea block_pad[] = {
  * The procedure handles the correction of all lighting except
  * direct sunlight spreading.
  *
+ * Large areas are processed by multiple threads: each column of
+ * blocks gets its light sources and spreads them on its own, then
+ * the light crossing the columns' borders is spread by the calling
+ * thread. Light spreading only ever raises light levels to the
+ * brightest reachable value, so the result doesn't depend on the
+ * number of threads.
+ *
  * \param minblock least coordinates of the changed area in block
  * coordinates
  * \param maxblock greatest coordinates of the changed area in block
@@ -975,51 +1194,86 @@ void finish_bulk_light_update(Map *map, mapblock_v3 minblock,
 			*modified_blocks);
 	}
 
-	// --- STEP 2: Get all newly inserted light sources
-
-	// For each block:
-	v3s16 blockpos;
-	v3s16 relpos;
-	for (blockpos.X = minblock.X; blockpos.X <= maxblock.X; blockpos.X++)
-	for (blockpos.Y = minblock.Y; blockpos.Y <= maxblock.Y; blockpos.Y++)
-	for (blockpos.Z = minblock.Z; blockpos.Z <= maxblock.Z; blockpos.Z++) {
-		MapBlock *block = map->getBlockNoCreateNoEx(blockpos);
-		if (!block)
-			// Skip not existing blocks
-			continue;
-		// For each node in the block:
-		for (relpos.Z = 0; relpos.Z < MAP_BLOCKSIZE; relpos.Z++)
-		for (relpos.X = 0; relpos.X < MAP_BLOCKSIZE; relpos.X++)
-		for (relpos.Y = 0; relpos.Y < MAP_BLOCKSIZE; relpos.Y++) {
-			MapNode node = block->getNodeNoCheck(relpos.X, relpos.Y, relpos.Z);
-			ContentLightingFlags f = ndef->getLightingFlags(node);
+	// --- STEP 2: Distribute the light sources found so far
 
-			// For each light bank
-			for (size_t b = 0; b < 2; b++) {
-				LightBank bank = banks[b];
-				u8 light = f.has_light ?
-					node.getLight(bank, f):
-					f.light_source;
-				if (light > 1)
-					relight[b].push(light, relpos, blockpos, block, 6);
-			} // end of banks
-		} // end of nodes
-	} // end of blocks
+	std::vector<BlockColumn> columns = get_block_columns(map, minblock, maxblock);
+	const s16 zcount = maxblock.Z - minblock.Z + 1;
+	const VoxelArea area(minblock, maxblock);
+	for (size_t b = 0; b < 2; b++) {
+		for (u8 i = 0; i <= LIGHT_SUN; i++) {
+			// Lights outside of the area stay in relight
+			std::vector<ChangingLight> &lights = relight[b].lights[i];
+			size_t kept = 0;
+			for (const ChangingLight &light : lights) {
+				const v3s16 &p = light.block_position;
+				if (area.contains(p)) {
+					BlockColumn &column = columns[(p.X - minblock.X) * zcount +
+						(p.Z - minblock.Z)];
+					column.relight[b].lights[i].push_back(light);
+				} else {
+					lights[kept++] = light;
+				}
+			}
+			lights.resize(kept);
+		}
+	}
+
+	// --- STEP 3: Get all newly inserted light sources and spread them
+	// inside of each column
+
+	run_parallel(columns.size(),
+		get_bulk_light_threads(columns.size() * (maxblock.Y - minblock.Y + 1)),
+		[&] (size_t column_index) {
+		BlockColumn &column = columns[column_index];
+		v3s16 relpos;
+		for (size_t y = 0; y < column.blocks.size(); y++) {
+			MapBlock *block = column.blocks[y];
+			if (!block)
+				// Skip not existing blocks
+				continue;
+			v3s16 blockpos(column.pos.X, minblock.Y + y, column.pos.Y);
+			// For each node in the block:
+			for (relpos.Z = 0; relpos.Z < MAP_BLOCKSIZE; relpos.Z++)
+			for (relpos.X = 0; relpos.X < MAP_BLOCKSIZE; relpos.X++)
+			for (relpos.Y = 0; relpos.Y < MAP_BLOCKSIZE; relpos.Y++) {
+				MapNode node = block->getNodeNoCheck(relpos.X, relpos.Y, relpos.Z);
+				ContentLightingFlags f = ndef->getLightingFlags(node);
+
+				// For each light bank
+				for (size_t b = 0; b < 2; b++) {
+					LightBank bank = banks[b];
+					u8 light = f.has_light ?
+						node.getLight(bank, f):
+						f.light_source;
+					if (light > 1)
+						column.relight[b].push(light, relpos, blockpos, block, 6);
+				} // end of banks
+			} // end of nodes
+		} // end of blocks
 
-	// --- STEP 3: do light spreading
+		for (size_t b = 0; b < 2; b++) {
+			// Sunlight is already initialized.
+			u8 maxlight = (b == 0) ? LIGHT_MAX : LIGHT_SUN;
+			init_relight_queue(ndef, banks[b], column.relight[b], maxlight);
+			spread_light_in_column(ndef, b, column, minblock.Y);
+		}
+	});
+
+	// --- STEP 4: Spread light across the columns' borders
 
+	for (const BlockColumn &column : columns) {
+		for (MapBlock *block : column.modified)
+			(*modified_blocks)[block->getPos()] = block;
+	}
 	// For each light bank:
 	for (size_t b = 0; b < 2; b++) {
 		LightBank bank = banks[b];
-		// Sunlight is already initialized.
 		u8 maxlight = (b == 0) ? LIGHT_MAX : LIGHT_SUN;
-		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= maxlight; i++) {
-			const auto &lights = relight[b].lights[i];
-			for (auto it = lights.begin(); it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position);
-				n.setLight(bank, i, ndef->getLightingFlags(n));
-				it->block->setNodeNoCheck(it->rel_position, n);
+		init_relight_queue(ndef, bank, relight[b], maxlight);
+		for (const BlockColumn &column : columns) {
+			for (const DeferredLight &d : column.deferred[b]) {
+				spread_light_to_neighbor(map, ndef, bank, relight[b],
+					d.source, d.spreading_light, d.dir, *modified_blocks);
 			}
 		}
 		// Spread lights.
@@ -1039,27 +1293,80 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 	// First queue is for day light, second is for night light.
 	UnlightQueue unlight[] = { UnlightQueue(256), UnlightQueue(256) };
 	ReLightQueue relight[] = { ReLightQueue(256), ReLightQueue(256) };
-	// Will hold sunlight data.
-	bool lights[MAP_BLOCKSIZE][MAP_BLOCKSIZE];
 	SunlightPropagationData data;
 
-	// --- STEP 1: reset everything to sunlight
+	std::vector<BlockColumn> columns = get_block_columns(map, minblock, maxblock);
+
+	// Extract sunlight above. This may load blocks, so it can't be
+	// done in parallel.
+	for (BlockColumn &column : columns) {
+		is_sunlight_above_block(map,
+			v3s16(column.pos.X, maxblock.Y, column.pos.Y), ndef,
+			column.sunlight);
+	}
+
+	run_parallel(columns.size(),
+		get_bulk_light_threads(columns.size() * (maxblock.Y - minblock.Y + 1)),
+		[&] (size_t column_index) {
+		BlockColumn &column = columns[column_index];
+
+		// --- STEP 1: reset everything to sunlight
 
-	// For each map block:
-	for (s16 x = minblock.X; x <= maxblock.X; x++)
-	for (s16 z = minblock.Z; z <= maxblock.Z; z++) {
-		// Extract sunlight above.
-		is_sunlight_above_block(map, v3s16(x, maxblock.Y, z), ndef, lights);
-		v2s16 offset(x, z);
-		offset *= MAP_BLOCKSIZE;
 		// Reset the voxel manipulator.
-		fill_with_sunlight(vm, ndef, offset, lights);
-		// Copy sunlight data
-		data.target_block = v3s16(x, minblock.Y - 1, z);
+		fill_with_sunlight(vm, ndef, column.pos * MAP_BLOCKSIZE,
+			column.sunlight);
+
+		// --- STEP 2: Get nodes from borders to unlight
+
+		// In case there are unloaded holes in the voxel manipulator
+		// unlight each block.
+		v3s16 relpos;
+		for (size_t y = 0; y < column.blocks.size(); y++) {
+			MapBlock *block = column.blocks[y];
+			if (!block)
+				// Skip not existing blocks.
+				continue;
+			v3s16 blockpos(column.pos.X, minblock.Y + y, column.pos.Y);
+			v3s16 offset = block->getPosRelative();
+			// For each border of the block:
+			for (const VoxelArea &a : block_pad) {
+				// For each node of the border:
+				for (relpos.Z = a.MinEdge.Z; relpos.Z <= a.MaxEdge.Z; relpos.Z++)
+				for (relpos.X = a.MinEdge.X; relpos.X <= a.MaxEdge.X; relpos.X++)
+				for (relpos.Y = a.MinEdge.Y; relpos.Y <= a.MaxEdge.Y; relpos.Y++) {
+
+					// Get old and new node
+					MapNode oldnode = block->getNodeNoCheck(relpos);
+					ContentLightingFlags oldf = ndef->getLightingFlags(oldnode);
+					MapNode newnode = vm->getNodeNoExNoEmerge(relpos + offset);
+					ContentLightingFlags newf = ndef->getLightingFlags(newnode);
+
+					// For each light bank
+					for (size_t b = 0; b < 2; b++) {
+						LightBank bank = banks[b];
+						u8 oldlight = oldf.has_light ?
+							oldnode.getLight(bank, oldf):
+							LIGHT_SUN; // no light information, force unlighting
+						u8 newlight = newf.has_light ?
+							newnode.getLight(bank, newf):
+							newf.light_source;
+						// If the new node is dimmer, unlight.
+						if (oldlight > newlight) {
+							column.unlight[b].push(
+								oldlight, relpos, blockpos, block, 6);
+						}
+					} // end of banks
+				} // end of nodes
+			} // end of borders
+		} // end of blocks
+	});
+
+	// Propagate sunlight and shadow below the voxel manipulator.
+	for (BlockColumn &column : columns) {
+		data.target_block = v3s16(column.pos.X, minblock.Y - 1, column.pos.Y);
 		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
 		for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
-			data.data.emplace_back(v2s16(x, z), lights[z][x]);
-		// Propagate sunlight and shadow below the voxel manipulator.
+			data.data.emplace_back(v2s16(x, z), column.sunlight[z][x]);
 		while (!data.data.empty()) {
 			if (propagate_block_sunlight(map, ndef, &data, &unlight[0],
 					&relight[0]))
@@ -1069,53 +1376,11 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 			data.target_block.Y--;
 		}
 	}
-
-	// --- STEP 2: Get nodes from borders to unlight
-	v3s16 blockpos;
-	v3s16 relpos;
-
-	// In case there are unloaded holes in the voxel manipulator
-	// unlight each block.
-	// For each block:
-	for (blockpos.X = minblock.X; blockpos.X <= maxblock.X; blockpos.X++)
-	for (blockpos.Y = minblock.Y; blockpos.Y <= maxblock.Y; blockpos.Y++)
-	for (blockpos.Z = minblock.Z; blockpos.Z <= maxblock.Z; blockpos.Z++) {
-		MapBlock *block = map->getBlockNoCreateNoEx(blockpos);
-		if (!block)
-			// Skip not existing blocks.
-			continue;
-		v3s16 offset = block->getPosRelative();
-		// For each border of the block:
-		for (const VoxelArea &a : block_pad) {
-			// For each node of the border:
-			for (relpos.Z = a.MinEdge.Z; relpos.Z <= a.MaxEdge.Z; relpos.Z++)
-			for (relpos.X = a.MinEdge.X; relpos.X <= a.MaxEdge.X; relpos.X++)
-			for (relpos.Y = a.MinEdge.Y; relpos.Y <= a.MaxEdge.Y; relpos.Y++) {
-
-				// Get old and new node
-				MapNode oldnode = block->getNodeNoCheck(relpos);
-				ContentLightingFlags oldf = ndef->getLightingFlags(oldnode);
-				MapNode newnode = vm->getNodeNoExNoEmerge(relpos + offset);
-				ContentLightingFlags newf = ndef->getLightingFlags(newnode);
-
-				// For each light bank
-				for (size_t b = 0; b < 2; b++) {
-					LightBank bank = banks[b];
-					u8 oldlight = oldf.has_light ?
-						oldnode.getLight(bank, oldf):
-						LIGHT_SUN; // no light information, force unlighting
-					u8 newlight = newf.has_light ?
-						newnode.getLight(bank, newf):
-						newf.light_source;
-					// If the new node is dimmer, unlight.
-					if (oldlight > newlight) {
-						unlight[b].push(
-							oldlight, relpos, blockpos, block, 6);
-					}
-				} // end of banks
-			} // end of nodes
-		} // end of borders
-	} // end of blocks
+	// Merge in a fixed order
+	for (BlockColumn &column : columns) {
+		unlight[0].append(column.unlight[0]);
+		unlight[1].append(column.unlight[1]);
+	}
 
 	// --- STEP 3: All information extracted, overwrite
 
@@ -55,6 +55,13 @@ void update_block_border_lighting(Map *map, MapBlock *block,
 void blit_back_with_light(Map *map, MMVManip *vm,
 	std::map<v3s16, MapBlock*> *modified_blocks);
 
+/*!
+ * Sets how many threads large bulk light updates (blit_back_with_light)
+ * may use, including the calling thread.
+ * 0 picks a number based on the CPU. 1 disables multithreading.
+ */
+void set_bulk_light_threads(unsigned int count);
+
 /*!
  * Corrects the light in a map block.
  * For server use only.